@@ -15,6 +15,7 @@ import com.tschuster.esp32nav.network.NavRoute
 import com.tschuster.esp32nav.network.NavRouter
 import com.tschuster.esp32nav.network.NetworkManager
 import com.tschuster.esp32nav.network.VectorFetcher
+import com.tschuster.esp32nav.util.DeltaFrameEncoder
 import com.tschuster.esp32nav.util.VectorRenderer
 import com.tschuster.esp32nav.util.formatEtaMinutes
 import kotlinx.coroutines.Dispatchers
@@ -84,9 +85,12 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
     private var arrivedClearJob: Job? = null
     private var recalcJob: Job? = null
     private var lastRecalcTimeMs: Long = 0L
+    private var vecSeq = 0 // seq de los frames binarios (uint16 en el ESP32)
+    private val deltaEncoder = DeltaFrameEncoder()
 
     private val OFF_ROUTE_TOLERANCE_M = 100f
     private val RECALC_COOLDOWN_MS = 60_000L
+    private val MAP_DELTA_MS = 100L // modo delta: cada tick viaja solo posición + cambios
 
     // Callbacks registrados por la UI para controlar el MapView (Android)
     private var enableFollowCallback: (() -> Unit)? = null
@@ -358,10 +362,12 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
     // ── Map loop ──────────────────────────────────────────────────────
     // Envía un frame vectorial (calles + ruta + posición) al ESP32 cada 500 ms (2 Hz).
     // El ESP32 solo renderiza el último frame recibido; más frecuencia = más fluido sin cola.
+    // Si el firmware manda acks, LinkPacer estira el período, saltea frames mientras haya
+    // otros sin dibujar y baja el detalle de los frames completos cuando no da abasto.
     private fun startMapLoop() {
         mapJob?.cancel()
         roadsJob?.cancel()
-        Log.i(TAG, "startMapLoop: enviando frames vectoriales cada 500 ms → ESP32")
+        Log.i(TAG, "startMapLoop: enviando frames vectoriales cada 500 ms (100 ms en modo delta) → ESP32")
         mapJob =
                 viewModelScope.launch {
                     while (true) {
@@ -371,8 +377,10 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
                                 val zoom = _ui.value.zoom.toDouble()
 
                                 // Disparar consulta Overpass en background si es necesario y no hay
-                                // una en curso
-                                if (vectorFetcher.needsRefresh(loc.latitude, loc.longitude) &&
+                                // una en curso (con paquete offline el ESP32 ya tiene las calles)
+                                val offline = esp32Client.supportsDeltaVec && esp32Client.supportsPack
+                                if (!offline &&
+                                                vectorFetcher.needsRefresh(loc.latitude, loc.longitude) &&
                                                 roadsJob?.isActive != true
                                 ) {
                                     roadsJob =
@@ -386,7 +394,22 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
 
                                 // Toda la geometría en Default para no bloquear el hilo principal
                                 val routeGeometry = _ui.value.route?.geometry
-                                val json =
+                                val pacer = esp32Client.pacer
+                                if (esp32Client.supportsDeltaVec) {
+                                    // Un delta salteado no se pierde: el próximo lleva los cambios
+                                    if (pacer.shouldSend())
+                                            sendDeltaFrame(loc, _ui.value.zoom, _ui.value.route)
+                                    delay(pacer.intervalMs(MAP_DELTA_MS))
+                                    continue
+                                }
+                                if (!pacer.shouldSend()) {
+                                    delay(pacer.intervalMs(500L))
+                                    continue
+                                }
+                                val binary = esp32Client.supportsBinaryVec
+                                val detail = pacer.detail
+                                val fixMs = fixTimeMs(loc)
+                                val frame =
                                         withContext(Dispatchers.Default) {
                                             val roads =
                                                     vectorFetcher.getCachedRoads(
@@ -407,7 +430,7 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
                                                                 )
                                                             }
                                                             ?.let {
-                                                                VectorRenderer.simplify(it, 1.5)
+                                                                VectorRenderer.simplify(it, 1.5 / detail)
                                                             }
                                                             ?: emptyList()
 
@@ -449,7 +472,7 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
                                                                 .sortedByDescending { it.width }
                                                                 .forEach { seg ->
                                                                     if (seg.name !in seen &&
-                                                                                    size < 20
+                                                                                    size < 20 * detail
                                                                     ) {
                                                                         val mid =
                                                                                 seg.pixels
@@ -477,24 +500,83 @@ class MainViewModel(app: Application) : AndroidViewModel(app) {
                                                                 }
                                                     }
 
-                                            VectorRenderer.buildFrame(
-                                                    rotatedRoads,
-                                                    rotatedRoute,
-                                                    labels,
-                                                    cx,
-                                                    cy,
-                                                    heading
-                                            )
+                                            if (binary)
+                                                    VectorRenderer.buildBinaryFrame(
+                                                            vecSeq++ and 0xFFFF,
+                                                            rotatedRoads,
+                                                            rotatedRoute,
+                                                            labels,
+                                                            cx,
+                                                            cy,
+                                                            heading,
+                                                            fixMs
+                                                    )
+                                            else
+                                                    VectorRenderer.buildFrame(
+                                                            rotatedRoads,
+                                                            rotatedRoute,
+                                                            labels,
+                                                            cx,
+                                                            cy,
+                                                            heading
+                                                    )
                                         }
-                                esp32Client.sendVectorFrame(json)
-                                Log.d(TAG, "vec frame: ${json.length} chars")
+                                when (frame) {
+                                    is ByteArray -> {
+                                        esp32Client.sendVectorFrame(frame)
+                                        Log.d(TAG, "vec frame: ${frame.size} bytes (binario)")
+                                    }
+                                    is String -> {
+                                        esp32Client.sendVectorFrame(frame)
+                                        Log.d(TAG, "vec frame: ${frame.length} chars")
+                                    }
+                                }
                             }
                         }
-                        delay(500L)
+                        delay(esp32Client.pacer.intervalMs(500L))
                     }
                 }
     }
 
+    /**
+     * Modo delta: el ESP32 guarda calles/ruta/labels en coordenadas de mundo y proyecta
+     * él mismo; solo se envían posición, heading, zoom y las altas/bajas
+     * (ver [DeltaFrameEncoder]). Si el ESP32 anuncia "nav" la ruta va con sus maniobras y
+     * él mismo calcula la guía; con "route", su geometría va una sola vez codificada.
+     * Con "pack" las calles y labels salen de su SD: no se manda ninguna.
+     */
+    private suspend fun sendDeltaFrame(
+            loc: Location,
+            zoom: Int,
+            route: NavRoute?
+    ) {
+        val roads = if (esp32Client.supportsPack) emptyList() else vectorFetcher.getRawRoads()
+        val heading = if (loc.hasBearing()) loc.bearing.toInt() else -1
+        val msgs =
+                withContext(Dispatchers.Default) {
+                    deltaEncoder.encode(
+                            { vecSeq++ },
+                            esp32Client.syncGeneration,
+                            roads,
+                            route,
+                            esp32Client.supportsNav,
+                            esp32Client.supportsRoute,
+                            loc.latitude,
+                            loc.longitude,
+                            zoom,
+                            heading,
+                            fixTimeMs(loc),
+                            esp32Client.routeMaxPts
+                    )
+                }
+        msgs.forEach { esp32Client.sendVectorFrame(it) }
+        if (msgs.size > 1) Log.d(TAG, "vec delta: ${msgs.size} mensajes, ${msgs.sumOf { it.size }} bytes")
+    }
+
+    /** Hora del fix para la medición de latencia del ESP32, o -1 si no la soporta. */
+    private fun fixTimeMs(loc: Location): Long =
+            if (esp32Client.supportsLatency) loc.elapsedRealtimeNanos / 1_000_000 else -1L
+
     // ── Zoom / centrar ────────────────────────────────────────────────
     fun setZoom(zoom: Int) {
         val z = zoom.coerceIn(10, 19)
@@ -1,12 +1,15 @@
 package com.tschuster.esp32nav.network
 
 import android.net.Network
+import android.os.SystemClock
 import android.util.Log
+import com.tschuster.esp32nav.util.HsEncoder
 import java.util.concurrent.TimeUnit
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.asStateFlow
 import okhttp3.*
 import okio.ByteString.Companion.toByteString
+import org.json.JSONObject
 
 private const val TAG = "ESP32Nav/WS"
 
@@ -18,6 +21,31 @@ private const val TAG = "ESP32Nav/WS"
  *                   {"t":"nav","step":"...","dist":"200m","eta":"12 min"}
  * ```
  * Binario → JPEG bytes directos (sin header)
+ * ```
+ *           frames del protocolo binario (ver [MapsProtocol])
+ * ```
+ * Al conectar el ESP32 envía {"t":"hello","v":1,"caps":[...]}; si incluye "vecb"
+ * los frames vectoriales se envían en binario ([supportsBinaryVec]) y si incluye
+ * "vecd", como deltas sobre su conjunto persistente ([supportsDeltaVec]).
+ * Si el ESP32 pierde un delta envía {"t":"resync"}: ambos mensajes incrementan
+ * [syncGeneration] para que el próximo frame delta sea un RESET completo.
+ * Si una ruta codificada no entra entera envía {"t":"route_cap","id":..,"max":..}: queda
+ * en [routeMaxPts] y también fuerza un RESET, que la reenvía diezmada.
+ * Con "ack", después de dibujar cada frame binario el ESP32 responde
+ * {"t":"ack","seq":..,"parse_us":..,"rast_us":..,"heap":..,"psram":..}; [pacer] lo usa
+ * para regular el envío.
+ * Con "lat" los frames llevan la hora del fix GPS ([supportsLatency]) y el ESP32 manda
+ * {"t":"ping","d":ms} para estimar el offset entre relojes: se contesta enseguida con un
+ * [MapsProtocol.TYPE_CLOCK]. [requestLatency] pide los histogramas por etapa, que llegan
+ * como {"t":"lat",...} a [latencyReport].
+ * Con "hs" los frames binarios de más de [HS_MIN_BYTES] viajan con el payload comprimido
+ * ([HsEncoder]) si eso los achica.
+ * Con "nav" los deltas de la ruta llevan también maniobras y totales ([supportsNav]) y el
+ * ESP32 calcula él mismo distancia al giro, ETA y fuera de ruta.
+ * Con "route" la geometría de la ruta viaja una sola vez, codificada
+ * ([MapsProtocol.TYPE_ROUTE], [supportsRoute]), en vez de tramos dentro de los deltas.
+ * Con "pack" el ESP32 lee calles y labels de un paquete offline en su SD ([supportsPack]):
+ * los deltas llevan solo la posición y la ruta.
  */
 class Esp32Client {
 
@@ -34,9 +62,62 @@ class Esp32Client {
     private var ws: WebSocket? = null
     private var httpClient: OkHttpClient? = null
 
+    /** Capacidades anunciadas por el ESP32 en el hello (vacío hasta recibirlo). */
+    @Volatile private var caps: Set<String> = emptySet()
+
+    /** true si el firmware acepta frames vectoriales en el protocolo binario. */
+    val supportsBinaryVec: Boolean
+        get() = MapsProtocol.CAP_VEC_BINARY in caps
+
+    /** true si el firmware acepta frames delta ([MapsProtocol.TYPE_DELTA]). */
+    val supportsDeltaVec: Boolean
+        get() = MapsProtocol.CAP_VEC_DELTA in caps
+
+    /** true si el firmware confirma los frames dibujados ([pacer]). */
+    val supportsAck: Boolean
+        get() = MapsProtocol.CAP_ACK in caps
+
+    val pacer = LinkPacer()
+
+    /** true si el firmware mide la latencia fix → panel (frames con hora del fix). */
+    val supportsLatency: Boolean
+        get() = MapsProtocol.CAP_LAT in caps
+
+    /** true si el firmware descomprime payloads con [MapsProtocol.FLAG_HS]. */
+    val supportsCompression: Boolean
+        get() = MapsProtocol.CAP_HS in caps
+
+    private val hsEncoder = HsEncoder()
+
+    /** true si el firmware calcula el progreso sobre la ruta ([MapsProtocol.OP_MANEUVER]). */
+    val supportsNav: Boolean
+        get() = MapsProtocol.CAP_NAV in caps
+
+    /** true si el firmware guarda la ruta entera codificada ([MapsProtocol.TYPE_ROUTE]). */
+    val supportsRoute: Boolean
+        get() = MapsProtocol.CAP_ROUTE in caps
+
+    /** true si el firmware tiene las calles en un paquete offline (no hace falta Overpass). */
+    val supportsPack: Boolean
+        get() = MapsProtocol.CAP_PACK in caps
+
+    private val _latencyReport = MutableStateFlow<String?>(null)
+
+    /** Último {"t":"lat",...} recibido (JSON crudo, ver src/maps/map_latency.h). */
+    val latencyReport = _latencyReport.asStateFlow()
+
+    /** Cambia con cada hello o resync: el estado delta del ESP32 ya no es confiable. */
+    @Volatile var syncGeneration = 0
+        private set
+
+    /** Puntos que entran en la ruta codificada del ESP32 (0: sin límite conocido). */
+    @Volatile var routeMaxPts = 0
+        private set
+
     companion object {
         const val ESP32_IP = "192.168.4.1"
         const val ESP32_PORT = 8080
+        const val HS_MIN_BYTES = 96
     }
 
     // ── Conectar ─────────────────────────────────────────────────
@@ -65,8 +146,12 @@ class Esp32Client {
                     override fun onOpen(webSocket: WebSocket, response: Response) {
                         Log.i(TAG, "WebSocket conectado al ESP32 response.code=${response.code}")
                         ws = webSocket
+                        caps = emptySet()
                         _state.value = State.CONNECTED
                     }
+                    override fun onMessage(webSocket: WebSocket, text: String) {
+                        handleText(text)
+                    }
                     override fun onFailure(
                             webSocket: WebSocket,
                             t: Throwable,
@@ -93,6 +178,52 @@ class Esp32Client {
         )
     }
 
+    // ── Mensajes del ESP32 ───────────────────────────────────────
+    private fun handleText(text: String) {
+        try {
+            val obj = JSONObject(text)
+            when (obj.optString("t")) {
+                "hello" -> {
+                    val arr = obj.optJSONArray("caps")
+                    caps = buildSet { if (arr != null) for (i in 0 until arr.length()) add(arr.getString(i)) }
+                    Log.i(TAG, "hello: protocolo v${obj.optInt("v")} caps=$caps")
+                    pacer.reset()
+                    routeMaxPts = 0
+                    syncGeneration++
+                }
+                "ping" -> {
+                    val d = obj.optLong("d").toInt()
+                    val now = SystemClock.elapsedRealtime().toInt()
+                    ws?.send(ProtoWriter(MapsProtocol.TYPE_CLOCK, 0, 16).varint(d).varint(now)
+                                    .toByteArray().toByteString())
+                }
+                "lat" -> {
+                    Log.i(TAG, "latencias: $text")
+                    _latencyReport.value = text
+                }
+                "ack" ->
+                        pacer.onAck(
+                                obj.optInt("seq"),
+                                obj.optLong("parse_us"),
+                                obj.optLong("rast_us"),
+                                obj.optInt("heap"),
+                                obj.optInt("psram")
+                        )
+                "resync" -> {
+                    Log.w(TAG, "resync pedido por el ESP32")
+                    syncGeneration++
+                }
+                "route_cap" -> {
+                    Log.w(TAG, "ruta ${obj.optLong("id")} truncada en el ESP32: máximo ${obj.optInt("max")} puntos")
+                    routeMaxPts = obj.optInt("max")
+                    syncGeneration++
+                }
+            }
+        } catch (e: Exception) {
+            Log.w(TAG, "mensaje de texto inválido: ${e.message}")
+        }
+    }
+
     // ── Enviar GPS ───────────────────────────────────────────────
     fun sendGps(lat: Double, lon: Double, speedKmh: Int = 0) {
         ws?.send(
@@ -126,6 +257,42 @@ class Esp32Client {
         ws?.send(json)
     }
 
+    fun sendVectorFrame(frame: ByteArray) {
+        val socket = ws ?: return
+        val out = if (supportsCompression) compress(frame) else frame
+        if (socket.send(out.toByteString()) && frame.size >= 6 &&
+                        (frame[0].toInt() and 0xFF) == MapsProtocol.MAGIC
+        ) {
+            pacer.onSent((frame[4].toInt() and 0xFF) or ((frame[5].toInt() and 0xFF) shl 8))
+        }
+    }
+
+    /**
+     * [frame] con el payload comprimido y [MapsProtocol.FLAG_HS], o el mismo si es chico
+     * o no se achica. La cabecera (con la hora del fix, si la lleva) queda igual.
+     */
+    private fun compress(frame: ByteArray): ByteArray {
+        if (frame.size < HS_MIN_BYTES || (frame[0].toInt() and 0xFF) != MapsProtocol.MAGIC) return frame
+        val flags = frame[3].toInt()
+        val hdrLen = if (flags and MapsProtocol.FLAG_TS != 0) 10 else 6
+        val packed = synchronized(hsEncoder) { hsEncoder.encode(frame, hdrLen) }
+        if (packed.size + hdrLen >= frame.size) return frame
+        val out = frame.copyOf(hdrLen + packed.size)
+        out[3] = (flags or MapsProtocol.FLAG_HS).toByte()
+        packed.copyInto(out, hdrLen)
+        return out
+    }
+
+    /** Pide los histogramas de latencia del ESP32; con [reset] los vacía después. */
+    fun requestLatency(reset: Boolean = false) {
+        ws?.send(
+                ProtoWriter(MapsProtocol.TYPE_LAT, 0, 8)
+                        .u8(if (reset) MapsProtocol.LAT_RESET else 0)
+                        .toByteArray()
+                        .toByteString()
+        )
+    }
+
     // ── Enviar paso de navegación ────────────────────────────────
     /** [etaFormatted] ya debe ser el texto final, p. ej. "1 h 25 min" o "45 min". */
     fun sendNavStep(step: String, distanceM: Int, etaFormatted: String) {
@@ -147,6 +314,7 @@ class Esp32Client {
     fun disconnect() {
         ws?.close(1000, "disconnect")
         ws = null
+        caps = emptySet()
         // No llamar shutdown() en el executor: reconstruirlo en cada reconexión es costoso.
         // El cliente es GC'd naturalmente al nullear la referencia.
         httpClient = null
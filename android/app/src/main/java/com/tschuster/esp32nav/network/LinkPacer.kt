@@ -0,0 +1,94 @@
+package com.tschuster.esp32nav.network
+
+import android.os.SystemClock
+
+/**
+ * Regula el envío de frames según los acks del ESP32 ({"t":"ack",...}).
+ *
+ * Cada ack trae el último seq dibujado, el tiempo de parseo y de render y la memoria
+ * libre. Con eso:
+ * - [shouldSend] descarta el frame antes de armarlo si el ESP32 todavía tiene
+ * [MAX_IN_FLIGHT] sin dibujar (el próximo va a llevar datos más nuevos);
+ * - [intervalMs] estira el período cuando el render no entra en él;
+ * - [detail] baja el detalle de los frames completos si el render es caro o queda poca
+ * memoria.
+ *
+ * Sin acks (firmware viejo, o se cortaron por más de [ACK_TIMEOUT_MS]) todo vuelve al
+ * comportamiento anterior: mandar a ritmo fijo.
+ */
+class LinkPacer {
+
+    companion object {
+        const val MAX_IN_FLIGHT = 2
+        const val ACK_TIMEOUT_MS = 1500L
+
+        /** Fracción del período que puede ocupar el ESP32 antes de estirarlo. */
+        private const val BUSY_FRACTION = 0.6
+
+        /** Por debajo de esta memoria interna libre se baja el detalle. */
+        private const val LOW_HEAP_BYTES = 24 * 1024
+
+        private const val MIN_DETAIL = 0.4f
+    }
+
+    @Volatile private var lastSentSeq = -1
+    @Volatile private var lastAckSeq = -1
+    @Volatile private var lastAckMs = 0L
+
+    /** Parseo + render del último frame dibujado, en µs. */
+    @Volatile var costUs = 0L
+        private set
+
+    @Volatile var heapFree = 0
+        private set
+
+    @Volatile var psramFree = 0
+        private set
+
+    /** 1 = detalle completo; baja hasta [MIN_DETAIL] mientras el ESP32 no da abasto. */
+    @Volatile var detail = 1f
+        private set
+
+    private val active: Boolean
+        get() = lastAckSeq >= 0 && SystemClock.elapsedRealtime() - lastAckMs < ACK_TIMEOUT_MS
+
+    fun reset() {
+        lastSentSeq = -1
+        lastAckSeq = -1
+        lastAckMs = 0L
+        costUs = 0L
+        detail = 1f
+    }
+
+    fun onSent(seq: Int) {
+        lastSentSeq = seq and 0xFFFF
+    }
+
+    fun onAck(seq: Int, parseUs: Long, rastUs: Long, heap: Int, psram: Int) {
+        lastAckSeq = seq and 0xFFFF
+        lastAckMs = SystemClock.elapsedRealtime()
+        costUs = parseUs + rastUs
+        heapFree = heap
+        psramFree = psram
+    }
+
+    /** Mensajes enviados que el ESP32 todavía no dibujó. */
+    fun inFlight(): Int =
+            if (lastSentSeq < 0 || lastAckSeq < 0) 0 else (lastSentSeq - lastAckSeq) and 0xFFFF
+
+    fun shouldSend(): Boolean = !active || inFlight() < MAX_IN_FLIGHT
+
+    /** Período de envío para un período nominal [baseMs], con [detail] ajustado. */
+    fun intervalMs(baseMs: Long): Long {
+        if (!active) {
+            detail = 1f
+            return baseMs
+        }
+        val costMs = costUs / 1000.0
+        val busy = costMs > baseMs * BUSY_FRACTION
+        detail =
+                if (busy || heapFree in 1 until LOW_HEAP_BYTES) (detail * 0.8f).coerceAtLeast(MIN_DETAIL)
+                else (detail + 0.05f).coerceAtMost(1f)
+        return if (busy) (costMs / BUSY_FRACTION).toLong().coerceAtMost(baseMs * 4) else baseMs
+    }
+}
@@ -0,0 +1,123 @@
+package com.tschuster.esp32nav.network
+
+import java.io.ByteArrayOutputStream
+
+/**
+ * Protocolo binario de mapas hacia el ESP32 (espejo de src/maps/vec_proto.h).
+ *
+ * Cabecera de 6 bytes: magia 0xA5, versión, tipo, flags, seq (uint16 LE); con
+ * [FLAG_TS], 4 bytes más con la hora del fix GPS (reloj de SystemClock.elapsedRealtime).
+ * Los enteros del payload van como varints; los con signo, en zig-zag.
+ */
+object MapsProtocol {
+    const val MAGIC = 0xA5
+    const val VERSION = 1
+
+    const val TYPE_VEC = 1
+    const val TYPE_DELTA = 2
+    const val TYPE_CLOCK = 4
+    const val TYPE_LAT = 5
+    const val TYPE_ROUTE = 6
+
+    /** Flag de cabecera: siguen 4 bytes con la hora del fix (ms, uint32 LE). */
+    const val FLAG_TS = 0x01
+
+    /** Flag de cabecera: el payload va comprimido (ver [com.tschuster.esp32nav.util.HsEncoder]). */
+    const val FLAG_HS = 0x02
+
+    /** Flag del payload de [TYPE_LAT]: vaciar los histogramas después de mandarlos. */
+    const val LAT_RESET = 0x01
+
+    /** Flag del payload de [TYPE_DELTA]: vaciar el conjunto antes de aplicar. */
+    const val DELTA_RESET = 0x01
+
+    // Operaciones de [TYPE_DELTA]
+    const val OP_ROAD = 1
+    const val OP_ROUTE = 2
+    const val OP_LABEL = 3
+    const val OP_REMOVE = 4
+    const val OP_CLEAR = 5
+    const val OP_MANEUVER = 6
+    const val OP_ROUTE_INFO = 7
+
+    // Tipos de elemento para OP_REMOVE / OP_CLEAR
+    const val KIND_ROAD = 0
+    const val KIND_ROUTE = 1
+    const val KIND_LABEL = 2
+    const val KIND_MANEUVER = 3
+
+    /** Capacidad anunciada por el ESP32 en el hello para aceptar [TYPE_VEC]. */
+    const val CAP_VEC_BINARY = "vecb"
+
+    /** Capacidad anunciada por el ESP32 en el hello para aceptar [TYPE_DELTA]. */
+    const val CAP_VEC_DELTA = "vecd"
+
+    /** Capacidad anunciada por el ESP32 en el hello si manda acks de render (ver [LinkPacer]). */
+    const val CAP_ACK = "ack"
+
+    /** Capacidad anunciada por el ESP32 en el hello si mide latencias ([FLAG_TS], pings). */
+    const val CAP_LAT = "lat"
+
+    /** Capacidad anunciada por el ESP32 en el hello si acepta payloads con [FLAG_HS]. */
+    const val CAP_HS = "hs"
+
+    /** Capacidad anunciada por el ESP32 en el hello si acepta [OP_MANEUVER] / [OP_ROUTE_INFO]. */
+    const val CAP_NAV = "nav"
+
+    /** Capacidad anunciada por el ESP32 en el hello si acepta la ruta entera en [TYPE_ROUTE]. */
+    const val CAP_ROUTE = "route"
+
+    /** Capacidad anunciada por el ESP32 en el hello si tiene calles y labels propios (paquete offline). */
+    const val CAP_PACK = "pack"
+}
+
+/** Escritor de varints / zig-zag sin cabecera (operaciones sueltas). */
+open class ByteWriter(capacity: Int = 256) {
+
+    protected val out = ByteArrayOutputStream(capacity)
+
+    val size: Int
+        get() = out.size()
+
+    fun u8(v: Int): ByteWriter {
+        out.write(v and 0xFF)
+        return this
+    }
+
+    fun varint(v: Int): ByteWriter {
+        var x = v
+        while (x and 0x7F.inv() != 0) {
+            out.write((x and 0x7F) or 0x80)
+            x = x ushr 7
+        }
+        out.write(x)
+        return this
+    }
+
+    fun zigzag(v: Int): ByteWriter = varint((v shl 1) xor (v shr 31))
+
+    fun bytes(b: ByteArray): ByteWriter {
+        out.write(b)
+        return this
+    }
+
+    fun toByteArray(): ByteArray = out.toByteArray()
+}
+
+/**
+ * Escritor de mensajes binarios con cabecera del protocolo. Con [fixMs] >= 0 la cabecera
+ * lleva la hora del fix GPS ([MapsProtocol.FLAG_TS]).
+ */
+class ProtoWriter(type: Int, seq: Int, capacity: Int = 2048, fixMs: Long = -1L) :
+        ByteWriter(capacity) {
+
+    init {
+        out.write(MapsProtocol.MAGIC)
+        out.write(MapsProtocol.VERSION)
+        out.write(type)
+        out.write(if (fixMs >= 0) MapsProtocol.FLAG_TS else 0)
+        out.write(seq and 0xFF)
+        out.write((seq shr 8) and 0xFF)
+        if (fixMs >= 0) for (i in 0 until 4) out.write((fixMs shr (8 * i)).toInt() and 0xFF)
+    }
+}
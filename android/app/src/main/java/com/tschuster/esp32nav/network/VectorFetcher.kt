@@ -22,10 +22,17 @@ private const val TAG = "ESP32Nav/VectorFetcher"
  * - Solo re-consulta cuando el GPS se mueve >80 m desde la última consulta.
  * - [fetchAndCache] debe llamarse desde un corutina IO (no bloquea el hilo principal).
  * - [getCachedRoads] es sincrónico y devuelve los datos del caché reproyectados.
+ * - [getRawRoads] devuelve el caché sin proyectar (frames delta, ver DeltaFrameEncoder).
  */
 class VectorFetcher {
 
-    private data class RawRoadSegment(val latLons: List<Pair<Double, Double>>, val width: Int, val name: String = "")
+    /** Calle de Overpass en lat/lon; [id] es el id del way de OSM (estable entre consultas). */
+    data class RawRoadSegment(
+        val id: Long,
+        val latLons: List<Pair<Double, Double>>,
+        val width: Int,
+        val name: String = ""
+    )
 
     private val defaultClient = OkHttpClient.Builder()
         .connectTimeout(10, TimeUnit.SECONDS)
@@ -96,6 +103,12 @@ class VectorFetcher {
         }
     }
 
+    /**
+     * Caché crudo de la última consulta. La lista se reemplaza entera en cada consulta,
+     * así que comparar por referencia alcanza para saber si cambió.
+     */
+    fun getRawRoads(): List<RawRoadSegment> = cachedRawRoads
+
     /**
      * Reproyecta el caché a píxeles de pantalla para el [centerLat]/[centerLon] y [zoom] actuales.
      * Sincrónico, sin red. Reutiliza el resultado anterior si la fuente no cambió,
@@ -152,7 +165,7 @@ class VectorFetcher {
                     val node = geom.getJSONObject(j)
                     latLons.add(node.getDouble("lat") to node.getDouble("lon"))
                 }
-                if (latLons.size >= 2) result.add(RawRoadSegment(latLons, width, name))
+                if (latLons.size >= 2) result.add(RawRoadSegment(el.optLong("id"), latLons, width, name))
             }
         } catch (e: Exception) {
             Log.e(TAG, "parseOverpass error: ${e.message}")
@@ -0,0 +1,315 @@
+package com.tschuster.esp32nav.util
+
+import android.util.Log
+import com.tschuster.esp32nav.network.ByteWriter
+import com.tschuster.esp32nav.network.MapsProtocol
+import com.tschuster.esp32nav.network.NavRoute
+import com.tschuster.esp32nav.network.ProtoWriter
+import com.tschuster.esp32nav.network.VectorFetcher
+
+private const val TAG = "ESP32Nav/Delta"
+
+/**
+ * Codificador de frames delta ([MapsProtocol.TYPE_DELTA]) para el conjunto
+ * persistente de calles/ruta/labels del ESP32 (src/maps/vec_store.h).
+ *
+ * Coordenadas de mundo ([VectorRenderer.latLonToWorld]): la geometría ya enviada no
+ * depende de la vista, así que cada tick viaja solo posición + heading + zoom, más
+ * altas/bajas cuando cambia el caché de Overpass o la ruta. La proyección a pantalla
+ * y la rotación heading-up las hace el ESP32.
+ *
+ * Con [withManeuvers] (capacidad "nav") la ruta viaja con sus maniobras y totales: el
+ * ESP32 calcula distancia al giro, ETA y fuera de ruta (src/maps/nav_route.h).
+ *
+ * Con [withEncodedRoute] (capacidad "route") la geometría de la ruta no va en tramos
+ * [MapsProtocol.OP_ROUTE] sino una sola vez entera, como polilínea codificada en mensajes
+ * [MapsProtocol.TYPE_ROUTE] ([PolylineEncoder]); maniobras y totales siguen en los deltas.
+ * Si el ESP32 avisó que no entra (Esp32Client.routeMaxPts) se manda diezmada.
+ *
+ * Se manda un RESET completo al agotar los ids o cuando el ESP32 reconecta / pide
+ * resync (syncGeneration).
+ */
+class DeltaFrameEncoder {
+
+    companion object {
+        /** Puntos por elemento en el ESP32 (VEC_STORE_ITEM_PTS). */
+        private const val CHUNK_PTS = 64
+        /** Slots de VEC_STORE_MAX_ITEMS reservados para la ruta; el resto, calles. */
+        private const val ROUTE_BUDGET = 64
+        private const val ROAD_BUDGET = 512 - ROUTE_BUDGET
+        /** VEC_STORE_MAX_LABELS */
+        private const val LABEL_BUDGET = 128
+        /** VEC_STORE_MAX_MANEUVERS / VEC_MANEUVER_LEN */
+        private const val MANEUVER_BUDGET = 128
+        private const val MANEUVER_MAX_BYTES = 63
+        /** Tamaño máximo de cada mensaje WS; solo el primero lleva RESET. */
+        private const val MAX_MSG_BYTES = 8 * 1024
+        /** Tolerancia de simplificación: 1,5 px al zoom máximo de la app (19 → 2 unidades/px). */
+        private const val SIMPLIFY_EPS = 3.0
+        private const val MAX_ID = 0xFFFF
+        /** Decimales de la ruta codificada (~1 m, lo mismo que GraphHopper por defecto). */
+        private const val ROUTE_PRECISION = 5
+        /** Polilínea por mensaje [MapsProtocol.TYPE_ROUTE] (MAPS_ROUTE_PART_MAX = 16 KB). */
+        private const val ROUTE_PART_BYTES = 12 * 1024
+    }
+
+    private var generation = -1
+    private var nextId = 1
+
+    private var roadsRef: List<VectorFetcher.RawRoadSegment>? = null
+    private val roadChunks = HashMap<Long, List<Int>>() // id OSM → ids de los tramos enviados
+    private var roadItems = 0
+    private var routeRef: NavRoute? = null
+    private var maneuversSent = false
+    private var routeId = 0
+    private var encodedRouteSent = false
+    private val labelIds = HashMap<String, Int>()
+
+    /**
+     * Mensajes a enviar en este tick (al menos uno, con la posición). [nextSeq] da el
+     * número de secuencia de cada mensaje; [syncGeneration] viene de Esp32Client.
+     * [route] se compara por identidad: una ruta nueva (o recalculada) se reenvía entera.
+     * [withManeuvers] agrega sus maniobras y totales (Esp32Client.supportsNav).
+     * [withEncodedRoute] manda la geometría codificada (Esp32Client.supportsRoute): sus
+     * mensajes van primero en la lista, diezmada a [routeMaxPts] puntos si es > 0.
+     * [fixMs] es la hora del fix (ver [ProtoWriter]); -1 para no mandarla.
+     */
+    fun encode(
+        nextSeq: () -> Int,
+        syncGeneration: Int,
+        roads: List<VectorFetcher.RawRoadSegment>,
+        route: NavRoute?,
+        withManeuvers: Boolean,
+        withEncodedRoute: Boolean,
+        lat: Double,
+        lon: Double,
+        zoom: Int,
+        heading: Int,
+        fixMs: Long = -1L,
+        routeMaxPts: Int = 0
+    ): List<ByteArray> {
+        val reset = syncGeneration != generation || nextId > MAX_ID - 1024
+        if (reset) {
+            generation = syncGeneration
+            nextId = 1
+            roadsRef = null
+            roadChunks.clear()
+            roadItems = 0
+            routeRef = null
+            maneuversSent = false
+            encodedRouteSent = true // el ESP32 puede seguir con una ruta de antes del resync
+            labelIds.clear()
+        }
+
+        val (posX, posY) = project(lat, lon)
+        val ops = mutableListOf<ByteArray>()
+        if (roads !== roadsRef) {
+            syncRoads(roads, posX, posY, ops)
+            roadsRef = roads
+        }
+        val routeMsgs = mutableListOf<ByteArray>()
+        if (route !== routeRef || reset) {
+            syncRoute(route, withManeuvers, !withEncodedRoute, posX, posY, ops)
+            if (withEncodedRoute) encodeRoute(nextSeq, route, routeMaxPts, routeMsgs)
+            routeRef = route
+        }
+        if (reset) Log.i(TAG, "RESET: ${roadChunks.size} calles ($roadItems tramos), ${labelIds.size} labels")
+
+        return routeMsgs + pack(nextSeq, reset, posX, posY, heading, zoom, ops, fixMs)
+    }
+
+    // ── Proyección ────────────────────────────────────────────────────────────
+    private fun project(lat: Double, lon: Double): Pair<Int, Int> = VectorRenderer.latLonToWorld(lat, lon)
+
+    private fun projectLine(latLons: List<Pair<Double, Double>>): List<Pair<Int, Int>> =
+        VectorRenderer.simplify(latLons.map { (lat, lon) -> project(lat, lon) }, SIMPLIFY_EPS)
+
+    // ── Calles y labels ───────────────────────────────────────────────────────
+    private fun syncRoads(
+        roads: List<VectorFetcher.RawRoadSegment>,
+        posX: Int,
+        posY: Int,
+        ops: MutableList<ByteArray>
+    ) {
+        val byId = roads.associateBy { it.id }
+
+        // Bajas: ways que ya no están en el caché
+        val gone = roadChunks.keys.filter { it !in byId }
+        gone.forEach { osmId ->
+            roadChunks.remove(osmId)?.forEach { id ->
+                ops += ByteWriter(8).u8(MapsProtocol.OP_REMOVE).u8(MapsProtocol.KIND_ROAD).varint(id).toByteArray()
+                roadItems--
+            }
+        }
+
+        // Altas: las más anchas primero, por si no entran todas
+        val projected = HashMap<Long, List<Pair<Int, Int>>>()
+        byId.values
+            .filter { it.id !in roadChunks }
+            .sortedByDescending { it.width }
+            .forEach { road ->
+                val pts = projectLine(road.latLons)
+                if (pts.size < 2) return@forEach
+                val chunks = pts.chunkedShared()
+                if (roadItems + chunks.size > ROAD_BUDGET) return@forEach
+                projected[road.id] = pts
+                roadChunks[road.id] = chunks.map { chunk ->
+                    val id = nextId++
+                    val w = ByteWriter(16 + chunk.size * 4)
+                    w.u8(MapsProtocol.OP_ROAD).varint(id).u8(road.width).varint(chunk.size)
+                    w.points(chunk, posX, posY)
+                    ops += w.toByteArray()
+                    id
+                }
+                roadItems += chunks.size
+            }
+
+        // Labels: uno por nombre, en el medio del tramo más ancho/largo de ese nombre
+        val named = roads.filter { it.name.isNotBlank() && it.id in roadChunks }
+            .groupBy { it.name }
+        labelIds.keys.filter { it !in named }.forEach { name ->
+            val id = labelIds.remove(name) ?: return@forEach
+            ops += ByteWriter(8).u8(MapsProtocol.OP_REMOVE).u8(MapsProtocol.KIND_LABEL).varint(id).toByteArray()
+        }
+        named.entries
+            .filter { it.key !in labelIds }
+            .sortedByDescending { (_, segs) -> segs.maxOf { it.width } }
+            .take(LABEL_BUDGET - labelIds.size)
+            .forEach { (name, segs) ->
+                val best = segs.maxWith(compareBy({ it.width }, { it.latLons.size }))
+                val pts = projected[best.id] ?: projectLine(best.latLons)
+                val (x, y) = pts[pts.size / 2]
+                val id = nextId++
+                val bytes = VectorRenderer.utf8Prefix(name, VectorRenderer.LABEL_MAX_BYTES)
+                ops += ByteWriter(16 + bytes.size)
+                    .u8(MapsProtocol.OP_LABEL).varint(id)
+                    .zigzag(x - posX).zigzag(y - posY)
+                    .u8(bytes.size).bytes(bytes)
+                    .toByteArray()
+                labelIds[name] = id
+            }
+    }
+
+    // ── Ruta ──────────────────────────────────────────────────────────────────
+    private fun syncRoute(
+        route: NavRoute?,
+        withManeuvers: Boolean,
+        withGeometry: Boolean,
+        posX: Int,
+        posY: Int,
+        ops: MutableList<ByteArray>
+    ) {
+        if (routeRef != null) ops += ByteWriter(4).u8(MapsProtocol.OP_CLEAR).u8(MapsProtocol.KIND_ROUTE).toByteArray()
+        if (maneuversSent) {
+            ops += ByteWriter(4).u8(MapsProtocol.OP_CLEAR).u8(MapsProtocol.KIND_MANEUVER).toByteArray()
+            maneuversSent = false
+        }
+        if (route == null || route.geometry.size < 2) return
+        if (withGeometry) {
+            val chunks = projectLine(route.geometry).chunkedShared()
+            if (chunks.size > ROUTE_BUDGET) Log.w(TAG, "ruta de ${chunks.size} tramos, se envían $ROUTE_BUDGET")
+            chunks.take(ROUTE_BUDGET).forEach { chunk ->
+                val w = ByteWriter(16 + chunk.size * 4)
+                w.u8(MapsProtocol.OP_ROUTE).varint(nextId++).varint(chunk.size)
+                w.points(chunk, posX, posY)
+                ops += w.toByteArray()
+            }
+        }
+        if (!withManeuvers) return
+
+        // Maniobras en orden de instrucción (el ESP32 las ubica sobre la ruta en ese orden)
+        ops += ByteWriter(12)
+            .u8(MapsProtocol.OP_ROUTE_INFO)
+            .varint(route.totalDistanceM.coerceAtLeast(0))
+            .varint(route.totalDurationSec.coerceAtLeast(0))
+            .toByteArray()
+        route.steps.take(MANEUVER_BUDGET).forEach { step ->
+            val (x, y) = project(step.lat, step.lon)
+            val bytes = VectorRenderer.utf8Prefix(step.instruction, MANEUVER_MAX_BYTES)
+            ops += ByteWriter(16 + bytes.size)
+                .u8(MapsProtocol.OP_MANEUVER).varint(nextId++)
+                .zigzag(x - posX).zigzag(y - posY)
+                .u8(bytes.size).bytes(bytes)
+                .toByteArray()
+        }
+        maneuversSent = true
+    }
+
+    /**
+     * Ruta entera como polilínea codificada, en partes que el ESP32 decodifica a medida que
+     * llegan; sin ruta, un mensaje con id 0 (si el ESP32 podía tener una).
+     */
+    private fun encodeRoute(nextSeq: () -> Int, route: NavRoute?, maxPts: Int, msgs: MutableList<ByteArray>) {
+        val geometry = decimate(route?.geometry.orEmpty(), maxPts)
+        if (geometry.size < 2) {
+            if (encodedRouteSent) msgs += routeMsg(nextSeq, 0, 0, 0, ByteArray(0))
+            encodedRouteSent = false
+            return
+        }
+        routeId = if (routeId >= MAX_ID) 1 else routeId + 1
+        val parts = PolylineEncoder.encodeParts(geometry, ROUTE_PRECISION, ROUTE_PART_BYTES)
+        parts.forEach { part -> msgs += routeMsg(nextSeq, routeId, geometry.size, part.first, part.bytes) }
+        encodedRouteSent = true
+        Log.i(TAG, "ruta codificada: ${geometry.size} puntos, ${parts.sumOf { it.bytes.size }} bytes en ${parts.size} partes")
+    }
+
+    /** A lo sumo [maxPts] puntos (0: todos) con paso uniforme, conservando el último. */
+    private fun <T> decimate(pts: List<T>, maxPts: Int): List<T> {
+        if (maxPts < 2 || pts.size <= maxPts) return pts
+        val step = (pts.size - 1 + maxPts - 2) / (maxPts - 1)
+        val out = (pts.indices step step).map { pts[it] }
+        return if ((pts.size - 1) % step == 0) out else out + pts.last()
+    }
+
+    private fun routeMsg(nextSeq: () -> Int, id: Int, total: Int, first: Int, poly: ByteArray): ByteArray =
+        ProtoWriter(MapsProtocol.TYPE_ROUTE, nextSeq() and 0xFFFF, poly.size + 24)
+            .varint(id).varint(total).varint(first).u8(ROUTE_PRECISION)
+            .bytes(poly)
+            .toByteArray()
+
+    // ── Empaquetado ───────────────────────────────────────────────────────────
+    private fun pack(
+        nextSeq: () -> Int,
+        reset: Boolean,
+        posX: Int,
+        posY: Int,
+        heading: Int,
+        zoom: Int,
+        ops: List<ByteArray>,
+        fixMs: Long
+    ): List<ByteArray> {
+        val msgs = mutableListOf<ByteArray>()
+        var i = 0
+        do {
+            var end = i
+            var bytes = 0
+            while (end < ops.size && (end == i || bytes + ops[end].size <= MAX_MSG_BYTES)) {
+                bytes += ops[end].size
+                end++
+            }
+            val w = ProtoWriter(MapsProtocol.TYPE_DELTA, nextSeq() and 0xFFFF, bytes + 32, fixMs)
+            w.u8(if (reset && i == 0) MapsProtocol.DELTA_RESET else 0)
+            w.zigzag(posX).zigzag(posY).zigzag(heading).u8(zoom)
+            w.varint(end - i)
+            for (k in i until end) w.bytes(ops[k])
+            msgs += w.toByteArray()
+            i = end
+        } while (i < ops.size)
+        return msgs
+    }
+
+    /** Puntos delta-codificados; el cursor arranca en la posición del mensaje. */
+    private fun ByteWriter.points(pts: List<Pair<Int, Int>>, posX: Int, posY: Int) {
+        var cx = posX
+        var cy = posY
+        pts.forEach { (x, y) ->
+            zigzag(x - cx).zigzag(y - cy)
+            cx = x
+            cy = y
+        }
+    }
+
+    /** Tramos de hasta CHUNK_PTS puntos que comparten el extremo (sin huecos al dibujar). */
+    private fun List<Pair<Int, Int>>.chunkedShared(): List<List<Pair<Int, Int>>> =
+        windowed(CHUNK_PTS, CHUNK_PTS - 1, partialWindows = true).filter { it.size >= 2 }
+}
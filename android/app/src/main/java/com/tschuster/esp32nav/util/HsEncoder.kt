@@ -0,0 +1,98 @@
+package com.tschuster.esp32nav.util
+
+import java.io.ByteArrayOutputStream
+
+/**
+ * Compresor LZSS en formato heatshrink (espejo de src/maps/hs_decode.h): ventana de
+ * 2^[WINDOW_BITS] bytes y referencias de hasta 2^[COUNT_BITS] bytes, para que el ESP32
+ * descomprima con 1 KB de estado a medida que llegan los fragmentos.
+ *
+ * Greedy con cadenas de hash sobre 2 bytes (mismo algoritmo que tools/bench/bench_hs.cpp).
+ * No es thread-safe: reutiliza la tabla entre llamadas.
+ */
+class HsEncoder {
+
+    companion object {
+        const val WINDOW_BITS = 10
+        const val COUNT_BITS = 4
+        private const val WINDOW = 1 shl WINDOW_BITS
+        private const val MIN_MATCH = 2
+        private const val MAX_MATCH = 1 shl COUNT_BITS
+        private const val MAX_CHAIN = 64
+    }
+
+    private val head = IntArray(1 shl 16)
+    private var prev = IntArray(0)
+
+    fun encode(input: ByteArray, from: Int = 0, to: Int = input.size): ByteArray {
+        val len = to - from
+        if (prev.size < len) prev = IntArray(len)
+        head.fill(-1)
+        val w = BitWriter(len / 2 + 16)
+
+        fun b(p: Int) = input[from + p].toInt() and 0xFF
+        fun insert(p: Int) {
+            if (p + 1 >= len) return
+            val h = b(p) or (b(p + 1) shl 8)
+            prev[p] = head[h]
+            head[h] = p
+        }
+
+        var i = 0
+        while (i < len) {
+            var best = 0
+            var bestDist = 0
+            if (i + 1 < len) {
+                var c = head[b(i) or (b(i + 1) shl 8)]
+                var chain = 0
+                while (c >= 0 && i - c <= WINDOW && chain < MAX_CHAIN) {
+                    var n = 0
+                    while (n < MAX_MATCH && i + n < len && b(c + n) == b(i + n)) n++
+                    if (n > best) {
+                        best = n
+                        bestDist = i - c
+                        if (n == MAX_MATCH) break
+                    }
+                    c = prev[c]
+                    chain++
+                }
+            }
+            if (best >= MIN_MATCH) {
+                w.put(0, 1)
+                w.put(bestDist - 1, WINDOW_BITS)
+                w.put(best - 1, COUNT_BITS)
+                for (k in 0 until best) insert(i + k)
+                i += best
+            } else {
+                w.put(1, 1)
+                w.put(b(i), 8)
+                insert(i)
+                i++
+            }
+        }
+        return w.finish()
+    }
+
+    /** Bits MSB primero; el último byte se rellena con ceros. */
+    private class BitWriter(capacity: Int) {
+        private val out = ByteArrayOutputStream(capacity)
+        private var acc = 0
+        private var n = 0
+
+        fun put(v: Int, bits: Int) {
+            for (i in bits - 1 downTo 0) {
+                acc = (acc shl 1) or ((v shr i) and 1)
+                if (++n == 8) {
+                    out.write(acc)
+                    acc = 0
+                    n = 0
+                }
+            }
+        }
+
+        fun finish(): ByteArray {
+            if (n > 0) out.write(acc shl (8 - n))
+            return out.toByteArray()
+        }
+    }
+}
@@ -0,0 +1,57 @@
+package com.tschuster.esp32nav.util
+
+import java.io.ByteArrayOutputStream
+import kotlin.math.roundToLong
+
+/**
+ * Polilínea codificada (algoritmo de Google, el mismo de points_encoded en GraphHopper),
+ * espejo de src/maps/route_poly.h: cada punto es (lat, lon) en punto fijo con [precision]
+ * decimales, como diferencia con el anterior, en zig-zag y partido en grupos de 5 bits + 63.
+ */
+object PolylineEncoder {
+
+    /** Lo más que ocupa un punto: dos valores de hasta 6 grupos. */
+    private const val MAX_POINT_BYTES = 12
+
+    /** Una parte de la polilínea: índice de su primer punto y los bytes codificados. */
+    class Part(val first: Int, val bytes: ByteArray, val count: Int)
+
+    /**
+     * Codifica [points] (lat, lon) en partes de a lo sumo [maxBytes]. Cada parte arranca
+     * las diferencias de (0, 0), así se decodifica sin las anteriores.
+     */
+    fun encodeParts(points: List<Pair<Double, Double>>, precision: Int, maxBytes: Int): List<Part> {
+        val scale = Math.pow(10.0, precision.toDouble())
+        val parts = mutableListOf<Part>()
+        val out = ByteArrayOutputStream(minOf(maxBytes, points.size * 4 + 16))
+        var first = 0
+        var prevLat = 0L
+        var prevLon = 0L
+        points.forEachIndexed { i, (lat, lon) ->
+            if (out.size() + MAX_POINT_BYTES > maxBytes) {
+                parts += Part(first, out.toByteArray(), i - first)
+                out.reset()
+                first = i
+                prevLat = 0L
+                prevLon = 0L
+            }
+            val fLat = (lat * scale).roundToLong()
+            val fLon = (lon * scale).roundToLong()
+            out.value(fLat - prevLat)
+            out.value(fLon - prevLon)
+            prevLat = fLat
+            prevLon = fLon
+        }
+        if (points.size > first) parts += Part(first, out.toByteArray(), points.size - first)
+        return parts
+    }
+
+    private fun ByteArrayOutputStream.value(v: Long) {
+        var x = if (v < 0) (v shl 1).inv() else v shl 1
+        while (x >= 0x20) {
+            write(((x and 0x1F) or 0x20).toInt() + 63)
+            x = x shr 5
+        }
+        write(x.toInt() + 63)
+    }
+}
@@ -1,5 +1,7 @@
 package com.tschuster.esp32nav.util
 
+import com.tschuster.esp32nav.network.MapsProtocol
+import com.tschuster.esp32nav.network.ProtoWriter
 import kotlin.math.*
 
 /**
@@ -15,6 +17,9 @@ import kotlin.math.*
  *   "hdg": 90
  * }
  * Coordenadas en píxeles de pantalla (0-319, 0-479), ya proyectadas aquí.
+ *
+ * Si el ESP32 anuncia "vecb" en el hello, el mismo frame se envía con
+ * [buildBinaryFrame] (ver [MapsProtocol]): varints zig-zag delta-codificados.
  */
 object VectorRenderer {
 
@@ -53,6 +58,22 @@ object VectorRenderer {
         )
     }
 
+    /** Zoom de las coordenadas de mundo del modo delta (VEC_WORLD_ZOOM en el ESP32). */
+    const val WORLD_ZOOM = 20
+
+    /**
+     * Convierte lat/lon a coordenadas de mundo: píxeles Mercator absolutos al zoom
+     * [WORLD_ZOOM] (2^28 unidades de lado, ~0,15 m en el ecuador). No dependen de la
+     * vista; el ESP32 las escala y traslada él mismo.
+     */
+    fun latLonToWorld(lat: Double, lon: Double): Pair<Int, Int> {
+        val size = 256.0 * 2.0.pow(WORLD_ZOOM)
+        val sinLat = sin(lat * PI / 180.0)
+        val x = (lon + 180.0) / 360.0 * size
+        val y = (0.5 - ln((1.0 + sinLat) / (1.0 - sinLat)) / (4.0 * PI)) * size
+        return Pair(x.roundToInt(), y.roundToInt())
+    }
+
     // ── Simplificación Ramer–Douglas–Peucker ─────────────────────────────────
     fun simplify(points: List<Pair<Int, Int>>, epsilon: Double): List<Pair<Int, Int>> {
         if (points.size <= 2) return points
@@ -154,5 +175,65 @@ object VectorRenderer {
         return sb.toString()
     }
 
+    // ── Constructor de frame binario ──────────────────────────────────────────
+    /** Mismo contenido que [buildFrame] en el formato MAPS_BIN_VEC ([fixMs]: ver [ProtoWriter]). */
+    fun buildBinaryFrame(
+        seq: Int,
+        roads: List<RoadSegment>,
+        route: List<Pair<Int, Int>>,
+        labels: List<StreetLabel>,
+        posX: Int,
+        posY: Int,
+        heading: Int,
+        fixMs: Long = -1L
+    ): ByteArray {
+        val w = ProtoWriter(MapsProtocol.TYPE_VEC, seq, fixMs = fixMs)
+        var cx = 0
+        var cy = 0
+        fun point(x: Int, y: Int) {
+            w.zigzag(x - cx).zigzag(y - cy)
+            cx = x
+            cy = y
+        }
+
+        w.varint(roads.size)
+        roads.forEach { road ->
+            w.u8(road.width).varint(road.pixels.size)
+            road.pixels.forEach { (x, y) -> point(x, y) }
+        }
+        w.varint(route.size)
+        route.forEach { (x, y) -> point(x, y) }
+        w.varint(labels.size)
+        labels.forEach { lbl ->
+            point(lbl.x, lbl.y)
+            val name = utf8Prefix(lbl.name, LABEL_MAX_BYTES)
+            w.u8(name.size).bytes(name)
+        }
+        w.zigzag(posX).zigzag(posY).zigzag(heading)
+        return w.toByteArray()
+    }
+
+    /** Bytes máximos del nombre de una calle en el ESP32 (VEC_LABEL_LEN). */
+    const val LABEL_MAX_BYTES = 20
+
+    /** Prefijo UTF-8 de [s] de hasta [maxBytes] bytes sin cortar caracteres. */
+    fun utf8Prefix(s: String, maxBytes: Int): ByteArray {
+        var end = 0
+        var bytes = 0
+        while (end < s.length) {
+            val cp = s.codePointAt(end)
+            val n = when {
+                cp < 0x80 -> 1
+                cp < 0x800 -> 2
+                cp < 0x10000 -> 3
+                else -> 4
+            }
+            if (bytes + n > maxBytes) break
+            bytes += n
+            end += Character.charCount(cp)
+        }
+        return s.substring(0, end).toByteArray(Charsets.UTF_8)
+    }
+
     private fun Double.roundToInt(): Int = kotlin.math.round(this).toInt()
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 /**
@@ -8,7 +9,22 @@
  * Protocolo v2 (vectorial):
  *   Texto {"t":"vec",...} → frame vectorial con calles + ruta + posición
  *   Texto {"t":"nav",...} → paso de navegación
+ *   Binario 0xA5 ...     → protocolo binario compacto (src/maps/vec_proto.h),
+ *                          incluidos tiles raster z/x/y (MAPS_BIN_TILE)
  *   Binario              → tile JPEG legacy (sigue funcionando)
+ *
+ * Al conectar, el ESP32 envía {"t":"hello","v":N,"caps":[...]} para que el
+ * cliente elija entre JSON y el protocolo binario.
+ *
+ * Después de dibujar, la pantalla responde {"t":"ack",...} (maps_ws_send_ack)
+ * con el último seq dibujado, los tiempos de parseo y de render y la memoria
+ * libre: la app regula con eso el ritmo y el detalle de lo que manda.
+ *
+ * Con "lat" la app marca los mensajes con la hora del fix y contesta los
+ * {"t":"ping"} del ESP32, que mide cada etapa hasta el panel
+ * (src/maps/map_latency.h) y manda los histogramas cuando se los piden.
+ * Con "hs" puede comprimir el payload de los mensajes binarios
+ * (src/maps/hs_decode.h).
  */
 
 /* Dimensiones de pantalla portrait */
@@ -18,37 +34,75 @@
 
 /* ── Tipos de datos del frame vectorial ─────────────────────────── */
 
-#define VEC_MAX_ROAD_SEGS   80
-#define VEC_MAX_PTS_PER_SEG 30
-#define VEC_MAX_ROUTE_PTS  100
+/* Bloque de memoria de cada frame (uno por slot del buzón, en PSRAM): entran
+ * ~7000 puntos entre calles y ruta, más tablas y labels */
+#define VEC_FRAME_BYTES    (32 * 1024)
+/* Puntos por polilínea: las más largas se parten compartiendo el extremo */
+#define VEC_FRAME_POLY_PTS 256
 
 struct vec_point_t { int16_t x, y; };
 
-struct vec_road_t {
-    vec_point_t pts[VEC_MAX_PTS_PER_SEG];
-    uint8_t n;   /* número de puntos */
-    uint8_t w;   /* grosor: 1=menor, 2=secundaria, 3=autopista */
+/* Una polilínea del frame: sus puntos son pts[off .. off + n) */
+struct vec_poly_t {
+    uint8_t  kind;  /* VEC_FRAME_ROAD / VEC_FRAME_ROUTE (src/maps/vec_frame.h) */
+    uint8_t  w;     /* grosor: 1=menor, 2=secundaria, 3=autopista */
+    uint16_t n;     /* número de puntos */
+    uint32_t off;
 };
 
-#define VEC_MAX_LABELS   20
 #define VEC_LABEL_LEN    20   /* máx. chars del nombre (sin null) */
 
 struct vec_label_t {
-    int16_t x, y;
+    uint8_t kind;   /* VEC_FRAME_LABEL */
     char    name[VEC_LABEL_LEN + 1];
+    int16_t x, y;
 };
 
+/**
+ * Frame vectorial en estructura de arreglos de largo variable sobre un
+ * bloque propio ([mem], VEC_FRAME_BYTES) que se vacía con cada frame: un
+ * pool contiguo con los puntos de todas las polilíneas y tablas de calles,
+ * tramos de ruta y labels. Se arma con src/maps/vec_frame.h y se recorre
+ * con vec_frame_poly_pts / vec_frame_label sin mirar la disposición.
+ */
 struct vec_frame_t {
-    vec_road_t  roads[VEC_MAX_ROAD_SEGS];
-    uint8_t     n_roads;
-    vec_point_t route[VEC_MAX_ROUTE_PTS];
-    uint16_t    n_route;
-    vec_label_t labels[VEC_MAX_LABELS];
-    uint8_t     n_labels;
+    uint8_t           *mem;
+    uint32_t           cap;
+    vec_point_t       *pts;       /* pool (comienzo de mem) */
+    uint32_t           n_pts;
+    const vec_poly_t  *roads;
+    const vec_poly_t  *routes;    /* la ruta, en tramos de hasta VEC_FRAME_POLY_PTS */
+    const uint32_t    *label_off; /* posición de cada label en mem */
+    uint16_t    n_roads;
+    uint16_t    n_routes;
+    uint16_t    n_labels;
+    uint32_t    used;      /* bytes ocupados de mem */
+    bool        full;      /* algo no entró en mem y se descartó */
     int16_t     pos_x, pos_y;
     int16_t     heading;   /* -1 si no disponible */
+    uint16_t    seq;       /* del mensaje binario; 0 si vino en JSON */
+    uint32_t    origin_us; /* fix GPS en micros() del ESP32; 0 si no se sabe */
+    uint32_t    pub_us;    /* micros() al publicarlo en el buzón */
+
+    /* Armado (vec_frame.cpp) */
+    uint32_t    log;       /* comienzo del registro de entradas (crece hacia abajo) */
+    uint32_t    reserve;   /* bytes comprometidos para las tablas */
+    vec_poly_t *open;      /* polilínea en curso */
+    uint32_t    start_log, start_reserve, start_pts; /* antes de su primer tramo */
+    uint16_t    pieces;    /* tramos ya cerrados de la polilínea partida */
 };
 
+static inline const vec_point_t *vec_frame_poly_pts(const vec_frame_t *f, const vec_poly_t &p) {
+    return f->pts + p.off;
+}
+
+static inline const vec_label_t &vec_frame_label(const vec_frame_t *f, uint16_t i) {
+    return *(const vec_label_t *)(f->mem + f->label_off[i]);
+}
+
+/* Tile raster pedido a la app (al zoom de la vista) */
+struct maps_tile_xy_t { uint32_t x, y; };
+
 struct nav_step_t {
     char step[128];
     char dist[20];
@@ -57,16 +111,40 @@ struct nav_step_t {
 
 /* ── Callbacks ───────────────────────────────────────────────────── */
 typedef void (*maps_ws_on_frame_t)(void);                   /* JPEG legacy */
-typedef void (*maps_ws_on_vec_t)(const vec_frame_t &frame); /* frame vectorial */
-typedef void (*maps_ws_on_nav_t)(const nav_step_t &step);   /* paso de nav */
-typedef void (*maps_ws_on_gps_t)(int speed_kmh);            /* velocidad GPS */
+/* Payload de un MAPS_BIN_DELTA o MAPS_BIN_ROUTE ([type], ver
+ * src/maps/vec_proto.h), su seq y el origen del fix en micros() (0 si no se
+ * sabe). Se llama desde el task de red: copiar los bytes antes de volver. */
+typedef void (*maps_ws_on_delta_t)(uint8_t type, uint16_t seq, uint32_t origin_us,
+                                   const uint8_t *payload, size_t len);
 
 /* ── API ─────────────────────────────────────────────────────────── */
-bool maps_ws_start(uint16_t          *map_buf,
-                   maps_ws_on_frame_t on_frame,
-                   maps_ws_on_vec_t   on_vec  = nullptr,
-                   maps_ws_on_nav_t   on_nav  = nullptr);
-void maps_ws_set_gps_cb(maps_ws_on_gps_t cb);
+bool maps_ws_start(uint16_t *map_buf, maps_ws_on_frame_t on_frame);
+void maps_ws_set_delta_cb(maps_ws_on_delta_t cb);
+/* Hay un paquete offline (src/maps/map_pack_sd.h): el hello anuncia "pack" y
+ * la app deja de mandar calles y labels. Llamar antes de maps_ws_start. */
+void maps_ws_set_pack(bool on);
+
+/* ── Buzones (task de red → un único lector, p. ej. el hilo LVGL) ──
+ * Triple buffer lock-free (maps/triple_buf.h): el parser escribe directo en
+ * un slot libre y lo publica; el lector obtiene el valor más nuevo sin
+ * copias ni frames a medio escribir. Devuelven nullptr / false si no llegó
+ * nada desde la llamada anterior; el puntero vale hasta la próxima. */
+const vec_frame_t *maps_ws_take_vec(void);
+const nav_step_t  *maps_ws_take_nav(void);
+bool               maps_ws_take_gps(int *speed_kmh);
+
+/**
+ * Ack a la app: se dibujó hasta el mensaje [seq] y el render tardó [rast_us].
+ * Agrega el tiempo de parseo del último mensaje y la memoria libre.
+ */
+void maps_ws_send_ack(uint16_t seq, uint32_t rast_us);
+
+/** Pide a la app que reenvíe el conjunto completo (se perdió un delta). */
+void maps_ws_request_resync(void);
+/** Avisa que la ruta [id] se cortó en [max] puntos: la app la reenvía diezmada. */
+void maps_ws_send_route_cap(uint32_t id, uint32_t max);
+/** Pide a la app los tiles [xy] del zoom [z] que no están en la caché. */
+void maps_ws_request_tiles(uint8_t z, const maps_tile_xy_t *xy, uint8_t n);
 void maps_ws_stop(void);
 bool maps_ws_is_running(void);
 bool maps_ws_has_client(void);
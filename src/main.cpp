@@ -11,6 +11,7 @@
 #include "audio_mgr.h"
 #include "dispcfg.h"
 #include "display_access.h"
+#include "maps/map_latency.h"
 #include "pincfg.h"
 #include "ui/ui.h"
 #include "wifi_manager.h"
@@ -39,6 +40,8 @@ static void disp_flush_cb(lv_display_t *disp, const lv_area_t *area,
   gfx->draw16bitRGBBitmap(area->x1, area->y1, (uint16_t *)px_map,
                           lv_area_get_width(area), lv_area_get_height(area));
   s_display_dirty = true;
+  if (lv_display_flush_is_last(disp))
+    lat_lvgl_flushed(); /* etapa LVGL del mapa, si hay un frame en camino */
   lv_disp_flush_ready(disp);
 }
 
@@ -146,7 +149,9 @@ void loop() {
       (now - last_flush_ms) >= (uint32_t)DISP_FLUSH_INTERVAL_MS) {
     s_display_dirty = false;
     last_flush_ms = now;
+    uint32_t t0 = micros();
     gfx->flush();
+    lat_panel_flushed(micros() - t0);
   }
 }
 
@@ -0,0 +1,90 @@
+/*
+ * Recepción de mensajes binarios del WebSocket (ver bin_rx.h).
+ */
+#include "bin_rx.h"
+#include "map_tiles.h"
+#include "vec_proto.h"
+
+#include <string.h>
+
+void bin_rx_init(bin_rx_t *rx, uint8_t *buf, size_t cap) {
+  memset(rx, 0, sizeof(*rx));
+  rx->buf = buf;
+  rx->cap = cap;
+}
+
+bin_rx_res_t bin_rx_feed(bin_rx_t *rx, size_t index, size_t total, bool final,
+                         const uint8_t *data, size_t len, bin_rx_out_t *out) {
+  if (index == 0) {
+    rx->is_proto = maps_bin_is_proto(data, len);
+    rx->tile = 0;
+    rx->skip = false;
+    rx->hs = false;
+    maps_bin_hdr_t hdr;
+    uint8_t z;
+    uint32_t x, y;
+    bool ok = rx->is_proto && maps_bin_parse_hdr(data, len, &hdr);
+    if (ok && (hdr.flags & MAPS_BIN_FLAG_HS)) {
+      /* Un JPEG no se achica: los tiles no se mandan comprimidos */
+      if (hdr.type == MAPS_BIN_TILE) {
+        rx->skip = true;
+        return BIN_RX_ERR_TILE_HS;
+      }
+      rx->hs = true;
+      rx->hdr_len = hdr.len;
+    } else if (ok && hdr.type == MAPS_BIN_TILE) {
+      size_t n = maps_bin_parse_tile(data + hdr.len, len - hdr.len, &z, &x, &y);
+      if (!n) {
+        rx->skip = true;
+        return BIN_RX_ERR_TILE_HDR;
+      }
+      rx->tile = map_tile_key(z, x, y);
+      rx->tile_off = hdr.len + n;
+    }
+  }
+  if (rx->skip)
+    return BIN_RX_MORE;
+
+  if (rx->tile || !rx->is_proto) {
+    /* JPEG: cada fragmento va al decoder sin ensamblar; el del tile, sin
+     * la cabecera */
+    size_t off = rx->tile ? rx->tile_off : 0;
+    if (index + len <= off)
+      return BIN_RX_MORE;
+    size_t skip = index < off ? off - index : 0;
+    *out = {data + skip, len - skip, rx->tile, index + skip - off, total - off};
+    return BIN_RX_JPEG;
+  }
+
+  if (rx->hs) {
+    /* La cabecera viaja sin comprimir; se copia sin el flag */
+    size_t off = 0;
+    if (index == 0) {
+      memcpy(rx->buf, data, rx->hdr_len);
+      rx->buf[3] &= ~MAPS_BIN_FLAG_HS;
+      hs_dec_init(&rx->dec);
+      rx->out = off = rx->hdr_len;
+    }
+    int32_t n = hs_dec_feed(&rx->dec, data + off, len - off, rx->buf + rx->out,
+                            rx->cap - rx->out);
+    if (n < 0) {
+      rx->skip = true;
+      return BIN_RX_ERR_HS_BIG;
+    }
+    rx->out += (size_t)n;
+    if (index + len < total || !final)
+      return BIN_RX_MORE;
+    *out = {rx->buf, rx->out, 0, 0, 0};
+    return BIN_RX_MSG;
+  }
+
+  if (index + len > rx->cap) {
+    rx->skip = true;
+    return BIN_RX_ERR_BIG;
+  }
+  memcpy(rx->buf + index, data, len);
+  if (index + len < total || !final)
+    return BIN_RX_MORE;
+  *out = {rx->buf, total, 0, 0, 0};
+  return BIN_RX_MSG;
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "hs_decode.h"
+
+/**
+ * Recepción de los mensajes binarios del WebSocket, fragmento a fragmento
+ * (el camino de on_ws_event en maps_ws_server.cpp).
+ *
+ *   - Protocolo binario (vec_proto.h): se ensambla en [buf]; con
+ *     MAPS_BIN_FLAG_HS se descomprime a medida que llega (hs_decode.h) y
+ *     queda igual que uno sin comprimir. Completo, sale como BIN_RX_MSG.
+ *   - MAPS_BIN_TILE y JPEG legacy: cada fragmento sale como BIN_RX_JPEG,
+ *     con el offset dentro de la imagen, sin ensamblar (jpeg_stream.h).
+ *
+ * Los errores se devuelven una vez por mensaje; el resto se ignora. El
+ * reproductor de sesiones grabadas (tools/replay) usa este mismo código.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+typedef enum {
+  BIN_RX_MORE = 0,  /* falta el resto del mensaje (o se ignora) */
+  BIN_RX_MSG,       /* mensaje del protocolo completo */
+  BIN_RX_JPEG,      /* fragmento de JPEG */
+  BIN_RX_ERR_TILE_HS,  /* tile comprimido: no soportado */
+  BIN_RX_ERR_TILE_HDR, /* cabecera de tile inválida */
+  BIN_RX_ERR_HS_BIG,   /* descomprimido no entra en buf */
+  BIN_RX_ERR_BIG,      /* mensaje no entra en buf */
+} bin_rx_res_t;
+
+struct bin_rx_out_t {
+  const uint8_t *data;
+  size_t len;
+  uint64_t tag;        /* JPEG: 0 = pantalla completa, si no map_tile_key */
+  size_t index, total; /* JPEG: offset del fragmento y largo de la imagen */
+};
+
+struct bin_rx_t {
+  uint8_t *buf;
+  size_t   cap;
+  bool     is_proto;
+  bool     skip;     /* mensaje inválido: ignorar el resto */
+  bool     hs;       /* payload comprimido */
+  uint8_t  hdr_len;
+  uint64_t tile;     /* clave del MAPS_BIN_TILE en curso */
+  size_t   tile_off; /* offset del JPEG en el mensaje */
+  size_t   out;      /* bytes descomprimidos en buf */
+  hs_dec_t dec;      /* ventana del decoder (1 KB) */
+};
+
+/** [buf] de [cap] bytes: el mensaje más grande que se acepta. */
+void bin_rx_init(bin_rx_t *rx, uint8_t *buf, size_t cap);
+
+/**
+ * Fragmento [data, len) en el offset [index] de un mensaje de [total]
+ * bytes ([final]: último frame WebSocket del mensaje). Con BIN_RX_MSG o
+ * BIN_RX_JPEG deja el resultado en [out].
+ */
+bin_rx_res_t bin_rx_feed(bin_rx_t *rx, size_t index, size_t total, bool final,
+                         const uint8_t *data, size_t len, bin_rx_out_t *out);
@@ -0,0 +1,67 @@
+/*
+ * Decoder LZSS / heatshrink (ver hs_decode.h).
+ *
+ * Los bytes de entrada se cargan en un acumulador de 32 bits y un token se
+ * decodifica solo cuando están todos sus bits (a lo sumo 1 + W + L = 15),
+ * así un token partido entre dos fragmentos no necesita más estado.
+ */
+#include "hs_decode.h"
+
+#include <string.h>
+
+#define HS_REF_BITS (1 + HS_WINDOW_BITS + HS_COUNT_BITS)
+#define HS_MASK     (HS_WINDOW_SIZE - 1)
+
+void hs_dec_init(hs_dec_t *d) {
+  /* Como heatshrink: la ventana arranca en cero */
+  memset(d, 0, sizeof(*d));
+}
+
+static inline uint32_t peek(const hs_dec_t *d, uint8_t skip, uint8_t n) {
+  return (d->bits >> (d->n_bits - skip - n)) & ((1u << n) - 1);
+}
+
+int32_t hs_dec_feed(hs_dec_t *d, const uint8_t *in, size_t in_len, uint8_t *out,
+                    size_t out_cap) {
+  size_t o = 0;
+  size_t i = 0;
+  for (;;) {
+    while (d->n_bits <= 24 && i < in_len) {
+      d->bits = (d->bits << 8) | in[i++];
+      d->n_bits += 8;
+    }
+    if (d->n_bits < 1)
+      break;
+
+    if (peek(d, 0, 1)) {
+      /* Literal */
+      if (d->n_bits < 9)
+        break;
+      if (o >= out_cap)
+        return -1;
+      uint8_t c = (uint8_t)peek(d, 1, 8);
+      d->n_bits -= 9;
+      out[o++] = c;
+      d->window[d->head] = c;
+      d->head = (d->head + 1) & HS_MASK;
+      continue;
+    }
+
+    /* Referencia hacia atrás en la ventana */
+    if (d->n_bits < HS_REF_BITS)
+      break;
+    uint32_t dist = peek(d, 1, HS_WINDOW_BITS) + 1;
+    uint32_t count = peek(d, 1 + HS_WINDOW_BITS, HS_COUNT_BITS) + 1;
+    d->n_bits -= HS_REF_BITS;
+    if (o + count > out_cap)
+      return -1;
+    for (uint32_t k = 0; k < count; k++) {
+      uint8_t c = d->window[(d->head - dist) & HS_MASK];
+      out[o++] = c;
+      d->window[d->head] = c;
+      d->head = (d->head + 1) & HS_MASK;
+    }
+  }
+  d->bits &= d->n_bits ? (1u << d->n_bits) - 1 : 0; /* solo los pendientes */
+  return (int32_t)o;
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decoder LZSS en streaming, formato heatshrink (ventana 2^HS_WINDOW_BITS,
+ * largo máximo 2^HS_COUNT_BITS).
+ *
+ * Flujo de bits MSB primero; cada token empieza con un bit de marca:
+ *   1 + 8 bits             literal
+ *   0 + W bits + L bits    referencia: distancia - 1, largo - 1
+ * El relleno con ceros del último byte queda como token incompleto y se
+ * ignora.
+ *
+ * Solo guarda la ventana y un acumulador de bits, así que se puede
+ * alimentar fragmento a fragmento tal como llegan del WebSocket; la salida
+ * va al buffer que se le pase en cada llamada. No reserva memoria.
+ */
+
+#define HS_WINDOW_BITS 10
+#define HS_COUNT_BITS  4
+#define HS_WINDOW_SIZE (1u << HS_WINDOW_BITS)
+
+struct hs_dec_t {
+  uint8_t  window[HS_WINDOW_SIZE];
+  uint16_t head;   /* próxima posición a escribir en la ventana */
+  uint32_t bits;   /* acumulador, los válidos alineados abajo */
+  uint8_t  n_bits;
+};
+
+void hs_dec_init(hs_dec_t *d);
+
+/**
+ * Consume [in, in_len) y escribe lo decodificado en [out] (hasta [out_cap]
+ * bytes). Devuelve los bytes escritos, o -1 si la salida no alcanza.
+ */
+int32_t hs_dec_feed(hs_dec_t *d, const uint8_t *in, size_t in_len, uint8_t *out,
+                    size_t out_cap);
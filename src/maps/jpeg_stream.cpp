@@ -0,0 +1,249 @@
+/*
+ * Decodificación JPEG en streaming (ver jpeg_stream.h).
+ *
+ * Cada item de la cola es una cabecera (número de imagen, primero/último,
+ * hora de llegada) seguida de los bytes del fragmento. El decoder lleva un
+ * item "en mano": la función de entrada de tjpgd lo consume y pide el
+ * siguiente; si el siguiente es de otra imagen lo deja en mano para la
+ * vuelta del loop y corta la actual (tjpgd devuelve JDR_INP).
+ */
+#include "jpeg_stream.h"
+
+#include <Arduino.h>
+#include <TJpg_Decoder.h> /* trae tjpgd.h (jd_prepare / jd_decomp) */
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+#include <string.h>
+
+/* Memoria de trabajo de tjpgd (JD_FASTDECODE 1 pide ~3,5 KB) */
+#define JPEG_WORK_BYTES 4096
+#define JPEG_TASK_STACK 6144
+#define JPEG_TASK_PRIO  1
+#define JPEG_TASK_CORE  0 /* LVGL corre en el 1 */
+
+enum { FRAG_FIRST = 1, FRAG_LAST = 2 };
+
+struct frag_hdr_t {
+  uint64_t tag; /* 0 = pantalla, si no tile (ver jpeg_stream_set_tiles) */
+  uint32_t ms;  /* llegada del fragmento */
+  uint16_t seq; /* número de imagen */
+  uint8_t  flags;
+};
+
+static RingbufHandle_t s_ring = nullptr;
+static StaticRingbuffer_t s_ring_ctl;
+static TaskHandle_t s_task = nullptr;
+static uint16_t *volatile s_dst = nullptr;
+static uint16_t s_w = 0, s_h = 0;
+static jpeg_stream_done_t s_on_done = nullptr;
+static jpeg_stream_open_t s_tile_open = nullptr;
+static jpeg_stream_close_t s_tile_close = nullptr;
+static uint16_t s_tile_px = 0;
+
+/* Task de red */
+static uint16_t s_tx_seq = 0;
+static bool s_tx_drop = false;
+
+/* Task del decoder: item en mano e imagen en curso */
+static uint8_t *s_item = nullptr;
+static size_t s_item_len = 0, s_item_off = 0;
+static frag_hdr_t s_item_hdr;
+static uint16_t s_cur_seq = 0;
+static uint16_t *s_cur_dst = nullptr; /* destino de la imagen en curso */
+static uint16_t s_cur_w = 0, s_cur_h = 0;
+static bool s_cur_last = false;    /* ya se consumió el último fragmento */
+static uint32_t s_cur_last_ms = 0; /* llegada del último fragmento */
+alignas(4) static uint8_t s_work[JPEG_WORK_BYTES];
+
+/* ── Cola ────────────────────────────────────────────────────────── */
+static bool take_item(TickType_t wait) {
+  size_t len;
+  uint8_t *p = (uint8_t *)xRingbufferReceive(s_ring, &len, wait);
+  if (!p)
+    return false;
+  memcpy(&s_item_hdr, p, sizeof(frag_hdr_t));
+  s_item = p;
+  s_item_len = len;
+  s_item_off = sizeof(frag_hdr_t);
+  return true;
+}
+
+static void release_item(void) {
+  vRingbufferReturnItem(s_ring, s_item);
+  s_item = nullptr;
+}
+
+/* Item en mano que ya no es de la imagen en curso (cada imagen tiene su seq) */
+static bool item_foreign(void) {
+  return s_item && s_item_hdr.seq != s_cur_seq;
+}
+
+/* ── Callbacks de tjpgd ──────────────────────────────────────────── */
+
+/* Entrada: copia (o saltea, con buf nulo) hasta n bytes de la imagen en
+ * curso, esperando fragmentos nuevos. Devuelve menos si la imagen terminó,
+ * se cortó o empezó otra. */
+static size_t in_func(JDEC *jd, uint8_t *buf, size_t n) {
+  (void)jd;
+  size_t got = 0;
+  while (got < n) {
+    if (!s_item) {
+      if (s_cur_last || !take_item(pdMS_TO_TICKS(JPEG_STREAM_WAIT_MS)))
+        break;
+    }
+    if (item_foreign())
+      break;
+    size_t take = s_item_len - s_item_off;
+    if (take > n - got)
+      take = n - got;
+    if (buf)
+      memcpy(buf + got, s_item + s_item_off, take);
+    s_item_off += take;
+    got += take;
+    if (s_item_off == s_item_len) {
+      if (s_item_hdr.flags & FRAG_LAST) {
+        s_cur_last = true;
+        s_cur_last_ms = s_item_hdr.ms;
+      }
+      release_item();
+    }
+  }
+  return got;
+}
+
+/* Salida: un bloque de MCU RGB565 directo al destino, recortado */
+static int out_func(JDEC *jd, void *bitmap, JRECT *rect) {
+  (void)jd;
+  if (!s_dst)
+    return 0; /* jpeg_stream_stop: abortar */
+  const uint16_t *src = (const uint16_t *)bitmap;
+  uint32_t bw = rect->right - rect->left + 1;
+  if (rect->left >= s_cur_w || rect->top >= s_cur_h)
+    return 1;
+  uint32_t w = rect->right < s_cur_w ? bw : s_cur_w - rect->left;
+  for (uint32_t y = rect->top; y <= rect->bottom && y < s_cur_h; y++)
+    memcpy(s_cur_dst + y * s_cur_w + rect->left, src + (y - rect->top) * bw, w * 2);
+  return 1;
+}
+
+/* ── Task del decoder ────────────────────────────────────────────── */
+static void decode_task(void *arg) {
+  (void)arg;
+  for (;;) {
+    if (!s_item && !take_item(portMAX_DELAY))
+      continue;
+    if (!(s_item_hdr.flags & FRAG_FIRST)) {
+      release_item(); /* resto de una imagen abortada o descartada */
+      continue;
+    }
+    s_cur_seq = s_item_hdr.seq;
+    s_cur_last = false;
+    uint64_t tag = s_item_hdr.tag;
+    if (tag) {
+      s_cur_dst = s_tile_open ? s_tile_open(tag) : nullptr;
+      s_cur_w = s_cur_h = s_tile_px;
+    } else {
+      s_cur_dst = s_dst;
+      s_cur_w = s_w;
+      s_cur_h = s_h;
+    }
+    uint32_t t0 = millis();
+
+    JDEC jd;
+    JRESULT r = JDR_PAR; /* sin destino: solo se descarta */
+    if (s_cur_dst) {
+      r = jd_prepare(&jd, in_func, s_work, sizeof(s_work), nullptr);
+      if (r == JDR_OK)
+        r = jd_decomp(&jd, out_func, 0);
+    }
+    /* Lo que quede de esta imagen (relleno después de EOI o un corte) */
+    while (!s_cur_last && !item_foreign() && in_func(&jd, nullptr, 4096) > 0) {
+    }
+
+    if (tag) {
+      if (s_cur_dst)
+        s_tile_close(tag, r == JDR_OK && s_dst);
+      continue;
+    }
+    if (r == JDR_OK && s_dst) {
+      uint32_t now = millis();
+      Serial.printf("[Maps] JPEG %ux%u en %lu ms, %lu ms después del último byte\n",
+                    jd.width, jd.height, (unsigned long)(now - t0),
+                    (unsigned long)(s_cur_last ? now - s_cur_last_ms : 0));
+      if (s_on_done)
+        s_on_done();
+    } else if (r != JDR_OK && s_cur_dst) {
+      Serial.printf("[Maps] JPEG decode error %d\n", (int)r);
+    }
+  }
+}
+
+/* ── API ─────────────────────────────────────────────────────────── */
+bool jpeg_stream_start(uint16_t *dst, uint16_t w, uint16_t h, jpeg_stream_done_t on_done) {
+  if (!s_ring) {
+    uint8_t *storage = (uint8_t *)heap_caps_malloc(
+        JPEG_STREAM_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!storage)
+      return false;
+    s_ring = xRingbufferCreateStatic(JPEG_STREAM_RING_BYTES, RINGBUF_TYPE_NOSPLIT,
+                                     storage, &s_ring_ctl);
+    if (!s_ring)
+      return false;
+  }
+  s_w = w;
+  s_h = h;
+  s_on_done = on_done;
+  s_tx_drop = true; /* hasta el primer fragmento de una imagen */
+  s_dst = dst;
+  if (!s_task &&
+      xTaskCreatePinnedToCore(decode_task, "jpeg", JPEG_TASK_STACK, nullptr,
+                              JPEG_TASK_PRIO, &s_task, JPEG_TASK_CORE) != pdPASS) {
+    s_task = nullptr;
+    s_dst = nullptr;
+    return false;
+  }
+  return true;
+}
+
+void jpeg_stream_set_tiles(jpeg_stream_open_t open, jpeg_stream_close_t close,
+                           uint16_t tile_px) {
+  s_tile_px = tile_px;
+  s_tile_close = close;
+  s_tile_open = open;
+}
+
+void jpeg_stream_stop(void) {
+  /* El task y la cola quedan para la próxima vez; lo encolado se descarta
+   * solo porque ya no hay destino */
+  s_dst = nullptr;
+  s_on_done = nullptr;
+}
+
+void jpeg_stream_feed(uint64_t tag, size_t index, size_t total, const uint8_t *data,
+                      size_t len) {
+  if (!s_ring || !s_dst)
+    return;
+  if (index == 0) {
+    s_tx_seq++;
+    s_tx_drop = false;
+  }
+  if (s_tx_drop)
+    return;
+
+  void *p;
+  if (xRingbufferSendAcquire(s_ring, &p, sizeof(frag_hdr_t) + len, 0) != pdTRUE) {
+    s_tx_drop = true;
+    Serial.println("[Maps] JPEG: cola llena, imagen descartada");
+    return;
+  }
+  frag_hdr_t hdr = {tag, millis(), s_tx_seq, 0};
+  if (index == 0)
+    hdr.flags |= FRAG_FIRST;
+  if (index + len >= total)
+    hdr.flags |= FRAG_LAST;
+  memcpy(p, &hdr, sizeof(hdr));
+  memcpy((uint8_t *)p + sizeof(hdr), data, len);
+  xRingbufferSendComplete(s_ring, p);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Decodificación en streaming de tiles JPEG (camino binario legacy).
+ *
+ * El task de red copia cada fragmento del mensaje WebSocket a una cola de
+ * items en PSRAM y vuelve enseguida; un task propio decodifica con tjpgd a
+ * medida que llegan los bytes (la función de entrada de tjpgd espera el
+ * próximo fragmento), así la decodificación se solapa con la recepción y no
+ * corre en el task de AsyncTCP. Cada bloque de MCU se escribe directo en el
+ * buffer RGB565 de destino: la imagen aparece por franjas, sin staging.
+ *
+ * La cola hace de segundo slot: la imagen N+1 se sigue recibiendo mientras
+ * la N se decodifica. Si no entra un fragmento, la imagen en curso se
+ * descarta entera; el decoder la aborta al ver empezar la siguiente o al
+ * pasar JPEG_STREAM_WAIT_MS sin bytes.
+ *
+ * Cada imagen lleva un tag: 0 es la pantalla completa (tile legacy); otro
+ * valor es un tile de mapa cuyo destino pide el decoder al empezarlo
+ * (jpeg_stream_set_tiles, ver map_tiles.h).
+ */
+
+#define JPEG_STREAM_RING_BYTES (48 * 1024)
+#define JPEG_STREAM_WAIT_MS    500
+
+typedef void (*jpeg_stream_done_t)(void);
+/* Destino del tile [tag] (tile_px × tile_px), o nullptr para descartarlo */
+typedef uint16_t *(*jpeg_stream_open_t)(uint64_t tag);
+/* Fin del tile [tag]: ok si se decodificó entero */
+typedef void (*jpeg_stream_close_t)(uint64_t tag, bool ok);
+
+/**
+ * Empieza a decodificar hacia [dst] ([w]×[h], stride w). [on_done] se llama
+ * desde el task del decoder con cada imagen completa. false sin memoria.
+ */
+bool jpeg_stream_start(uint16_t *dst, uint16_t w, uint16_t h, jpeg_stream_done_t on_done);
+
+/** Destino de las imágenes con tag != 0 (desde el task del decoder). */
+void jpeg_stream_set_tiles(jpeg_stream_open_t open, jpeg_stream_close_t close,
+                           uint16_t tile_px);
+
+/** Deja de escribir en el destino (la imagen en curso se aborta). */
+void jpeg_stream_stop(void);
+
+/**
+ * Fragmento [data, len) en el offset [index] de una imagen [tag] de [total]
+ * bytes. Desde el task de red; no bloquea.
+ */
+void jpeg_stream_feed(uint64_t tag, size_t index, size_t total, const uint8_t *data,
+                      size_t len);
@@ -0,0 +1,287 @@
+/*
+ * Tokenizer JSON incremental (ver json_sax.h).
+ *
+ * Máquina de estados carácter a carácter. Los únicos datos que sobreviven
+ * entre llamadas son los de json_sax_t: el string/número en curso, la pila
+ * de contenedores (un bit por nivel) y el estado.
+ */
+#include "json_sax.h"
+
+#include <string.h>
+
+enum {
+  ST_VALUE,        /* se espera un valor */
+  ST_VALUE_OR_END, /* primer elemento de un array: valor o ']' */
+  ST_KEY,          /* se espera una clave (después de ',') */
+  ST_KEY_OR_END,   /* primera clave de un objeto: clave o '}' */
+  ST_COLON,
+  ST_AFTER,        /* después de un valor: ',' o cierre */
+  ST_STRING,
+  ST_ESCAPE,
+  ST_UNICODE,
+  ST_NUMBER,
+  ST_LITERAL,
+  ST_DONE,
+};
+
+/* Sub-estado de número */
+#define NUM_FRAC 0x01 /* ya pasó '.' o 'e': no acumular más parte entera */
+
+static const char *const k_literals[] = { "true", "false", "null" };
+
+static bool is_ws(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+static void emit(json_sax_t *p, json_sax_ev_t ev) {
+  if (p->cb) p->cb(p->ctx, ev, p);
+}
+
+static void fail(json_sax_t *p) { p->error = true; }
+
+static bool top_is_obj(const json_sax_t *p) {
+  return p->depth > 0 && (p->stack >> (p->depth - 1)) & 1;
+}
+
+static void str_reset(json_sax_t *p) {
+  p->str_len = 0;
+  p->str_truncated = false;
+  p->str[0] = '\0';
+}
+
+static void str_put(json_sax_t *p, char c) {
+  if (p->str_len < JSON_SAX_STR_MAX) {
+    p->str[p->str_len++] = c;
+    p->str[p->str_len] = '\0';
+  } else {
+    p->str_truncated = true;
+  }
+}
+
+static void str_put_utf8(json_sax_t *p, uint32_t cp) {
+  if (cp < 0x80) {
+    str_put(p, (char)cp);
+  } else if (cp < 0x800) {
+    str_put(p, (char)(0xC0 | (cp >> 6)));
+    str_put(p, (char)(0x80 | (cp & 0x3F)));
+  } else if (cp < 0x10000) {
+    str_put(p, (char)(0xE0 | (cp >> 12)));
+    str_put(p, (char)(0x80 | ((cp >> 6) & 0x3F)));
+    str_put(p, (char)(0x80 | (cp & 0x3F)));
+  } else {
+    str_put(p, (char)(0xF0 | (cp >> 18)));
+    str_put(p, (char)(0x80 | ((cp >> 12) & 0x3F)));
+    str_put(p, (char)(0x80 | ((cp >> 6) & 0x3F)));
+    str_put(p, (char)(0x80 | (cp & 0x3F)));
+  }
+}
+
+static void push(json_sax_t *p, bool is_obj) {
+  if (p->depth >= JSON_SAX_MAX_DEPTH) { fail(p); return; }
+  if (is_obj) p->stack |= 1u << p->depth;
+  else        p->stack &= ~(1u << p->depth);
+  p->depth++;
+  emit(p, is_obj ? JSON_SAX_OBJ_BEGIN : JSON_SAX_ARR_BEGIN);
+  p->state = is_obj ? ST_KEY_OR_END : ST_VALUE_OR_END;
+}
+
+static void pop(json_sax_t *p, bool is_obj) {
+  if (p->depth == 0 || top_is_obj(p) != is_obj) { fail(p); return; }
+  emit(p, is_obj ? JSON_SAX_OBJ_END : JSON_SAX_ARR_END);
+  p->depth--;
+  p->state = p->depth == 0 ? ST_DONE : ST_AFTER;
+}
+
+/* Fin de un valor escalar */
+static void value_done(json_sax_t *p) {
+  p->state = p->depth == 0 ? ST_DONE : ST_AFTER;
+}
+
+static void number_done(json_sax_t *p) {
+  if (p->neg) p->num = -p->num;
+  emit(p, JSON_SAX_NUMBER);
+  value_done(p);
+}
+
+/* Comienzo de un valor a partir de su primer carácter */
+static void value_start(json_sax_t *p, char c) {
+  switch (c) {
+  case '{': push(p, true); return;
+  case '[': push(p, false); return;
+  case '"':
+    str_reset(p);
+    p->in_key = false;
+    p->state = ST_STRING;
+    return;
+  case 't': case 'f': case 'n':
+    p->sub = c == 't' ? 0 : c == 'f' ? 1 : 2;
+    p->ucode = 1; /* índice del próximo carácter del literal */
+    p->state = ST_LITERAL;
+    return;
+  default:
+    if (c == '-' || (c >= '0' && c <= '9')) {
+      str_reset(p);
+      str_put(p, c);
+      p->neg = c == '-';
+      p->num = c == '-' ? 0 : c - '0';
+      p->sub = 0;
+      p->state = ST_NUMBER;
+      return;
+    }
+    fail(p);
+  }
+}
+
+/* ── API ─────────────────────────────────────────────────────────── */
+void json_sax_begin(json_sax_t *p, json_sax_cb_t cb, void *ctx) {
+  p->cb = cb;
+  p->ctx = ctx;
+  p->state = ST_VALUE;
+  p->sub = 0;
+  p->ucode = 0;
+  p->stack = 0;
+  p->depth = 0;
+  p->in_key = false;
+  p->neg = false;
+  p->error = false;
+  p->num = 0;
+  str_reset(p);
+}
+
+bool json_sax_feed(json_sax_t *p, const char *data, size_t len) {
+  for (size_t i = 0; i < len && !p->error; i++) {
+    char c = data[i];
+    switch (p->state) {
+    case ST_VALUE:
+      if (!is_ws(c)) value_start(p, c);
+      break;
+
+    case ST_VALUE_OR_END:
+      if (is_ws(c)) break;
+      if (c == ']') pop(p, false);
+      else value_start(p, c);
+      break;
+
+    case ST_KEY_OR_END:
+    case ST_KEY:
+      if (is_ws(c)) break;
+      if (c == '}' && p->state == ST_KEY_OR_END) { pop(p, true); break; }
+      if (c != '"') { fail(p); break; }
+      str_reset(p);
+      p->in_key = true;
+      p->state = ST_STRING;
+      break;
+
+    case ST_COLON:
+      if (is_ws(c)) break;
+      if (c == ':') p->state = ST_VALUE;
+      else fail(p);
+      break;
+
+    case ST_AFTER:
+      if (is_ws(c)) break;
+      if (c == ',') p->state = top_is_obj(p) ? ST_KEY : ST_VALUE;
+      else if (c == '}') pop(p, true);
+      else if (c == ']') pop(p, false);
+      else fail(p);
+      break;
+
+    case ST_STRING:
+      if (c == '\\') {
+        p->state = ST_ESCAPE;
+      } else if (c == '"') {
+        if (p->in_key) {
+          emit(p, JSON_SAX_KEY);
+          p->state = ST_COLON;
+        } else {
+          emit(p, JSON_SAX_STRING);
+          value_done(p);
+        }
+      } else if ((uint8_t)c < 0x20) {
+        fail(p);
+      } else {
+        str_put(p, c);
+      }
+      break;
+
+    case ST_ESCAPE:
+      p->state = ST_STRING;
+      switch (c) {
+      case '"': case '\\': case '/': str_put(p, c); break;
+      case 'b': str_put(p, '\b'); break;
+      case 'f': str_put(p, '\f'); break;
+      case 'n': str_put(p, '\n'); break;
+      case 'r': str_put(p, '\r'); break;
+      case 't': str_put(p, '\t'); break;
+      case 'u':
+        /* ucode conserva un surrogate alto pendiente en los bits 16..31 */
+        p->ucode &= 0xFFFF0000u;
+        p->sub = 0;
+        p->state = ST_UNICODE;
+        break;
+      default: fail(p); break;
+      }
+      break;
+
+    case ST_UNICODE: {
+      uint32_t h;
+      if (c >= '0' && c <= '9')      h = c - '0';
+      else if (c >= 'a' && c <= 'f') h = c - 'a' + 10;
+      else if (c >= 'A' && c <= 'F') h = c - 'A' + 10;
+      else { fail(p); break; }
+      p->ucode = (p->ucode & 0xFFFF0000u) | (((p->ucode & 0xFFFF) << 4) | h);
+      if (++p->sub < 4) break;
+
+      uint32_t hi = p->ucode >> 16;
+      uint32_t cu = p->ucode & 0xFFFF;
+      p->ucode = 0;
+      if (cu >= 0xD800 && cu <= 0xDBFF) {
+        if (hi) str_put_utf8(p, 0xFFFD);
+        p->ucode = cu << 16; /* esperar el surrogate bajo */
+      } else if (cu >= 0xDC00 && cu <= 0xDFFF) {
+        str_put_utf8(p, hi ? 0x10000 + ((hi - 0xD800) << 10) + (cu - 0xDC00) : 0xFFFD);
+      } else {
+        if (hi) str_put_utf8(p, 0xFFFD);
+        str_put_utf8(p, cu);
+      }
+      p->state = ST_STRING;
+      break;
+    }
+
+    case ST_NUMBER:
+      if (c >= '0' && c <= '9') {
+        str_put(p, c);
+        if (!(p->sub & NUM_FRAC)) {
+          if (p->num <= (INT32_MAX - 9) / 10) p->num = p->num * 10 + (c - '0');
+          else p->num = INT32_MAX;
+        }
+      } else if (c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-') {
+        str_put(p, c);
+        p->sub |= NUM_FRAC;
+      } else {
+        number_done(p);
+        i--; /* reprocesar el carácter en ST_AFTER */
+      }
+      break;
+
+    case ST_LITERAL: {
+      const char *lit = k_literals[p->sub];
+      if (c != lit[p->ucode]) { fail(p); break; }
+      if (lit[++p->ucode] != '\0') break;
+      p->ucode = 0;
+      emit(p, p->sub == 0 ? JSON_SAX_TRUE : p->sub == 1 ? JSON_SAX_FALSE : JSON_SAX_NULL);
+      value_done(p);
+      break;
+    }
+
+    case ST_DONE:
+      if (!is_ws(c)) fail(p);
+      break;
+    }
+  }
+  return !p->error;
+}
+
+bool json_sax_end(json_sax_t *p) {
+  if (p->error) return false;
+  if (p->state == ST_NUMBER && p->depth == 0) number_done(p);
+  return p->state == ST_DONE;
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Tokenizer JSON incremental (estilo SAX) sin memoria dinámica.
+ *
+ * Se alimenta con trozos arbitrarios del mensaje (p. ej. cada fragmento del
+ * WebSocket tal como llega) y emite un evento por token. El estado completo
+ * vive en json_sax_t, así que un token puede quedar partido entre dos
+ * llamadas a json_sax_feed() sin copiar el mensaje.
+ *
+ * Límites: anidamiento ≤ JSON_SAX_MAX_DEPTH y strings de hasta
+ * JSON_SAX_STR_MAX bytes (el resto se descarta y se marca str_truncated).
+ * El tamaño total del mensaje no tiene límite.
+ */
+
+#define JSON_SAX_MAX_DEPTH 16
+#define JSON_SAX_STR_MAX   128
+
+typedef enum {
+  JSON_SAX_OBJ_BEGIN,
+  JSON_SAX_OBJ_END,
+  JSON_SAX_ARR_BEGIN,
+  JSON_SAX_ARR_END,
+  JSON_SAX_KEY,    /* str/str_len */
+  JSON_SAX_STRING, /* str/str_len */
+  JSON_SAX_NUMBER, /* num (parte entera, saturada) + str con el texto */
+  JSON_SAX_TRUE,
+  JSON_SAX_FALSE,
+  JSON_SAX_NULL,
+} json_sax_ev_t;
+
+struct json_sax_t;
+typedef void (*json_sax_cb_t)(void *ctx, json_sax_ev_t ev, const json_sax_t *p);
+
+struct json_sax_t {
+  /* Resultado del último token (válido dentro del callback) */
+  char     str[JSON_SAX_STR_MAX + 1];
+  uint16_t str_len;
+  bool     str_truncated;
+  int32_t  num;
+
+  /* Profundidad actual; depth == 1 dentro del objeto raíz */
+  uint8_t  depth;
+
+  /* ── Estado interno ── */
+  json_sax_cb_t cb;
+  void    *ctx;
+  uint8_t  state;
+  uint8_t  sub;        /* sub-estado: escape, \uXXXX, literal */
+  uint32_t ucode;      /* acumulador de \uXXXX */
+  uint32_t stack;      /* bit i = 1 si el nivel i es un objeto */
+  bool     in_key;
+  bool     neg;
+  bool     error;
+};
+
+/** Prepara el parser para un mensaje nuevo. */
+void json_sax_begin(json_sax_t *p, json_sax_cb_t cb, void *ctx);
+
+/**
+ * Consume [len] bytes del mensaje. Devuelve false si ya hubo un error de
+ * sintaxis (el resto del mensaje se ignora).
+ */
+bool json_sax_feed(json_sax_t *p, const char *data, size_t len);
+
+/** true si el valor raíz se cerró sin errores. */
+bool json_sax_end(json_sax_t *p);
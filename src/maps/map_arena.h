@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Arena de bump sobre un bloque reservado por quien la usa (PSRAM en el
+ * ESP32). Se pide memoria en orden y se libera toda junta con reset: sirve
+ * para estructuras que se rearman enteras (índices, tablas por frame).
+ */
+struct map_arena_t {
+  uint8_t *base;
+  size_t   cap;
+  size_t   used;
+};
+
+static inline void map_arena_init(map_arena_t *a, void *buf, size_t cap) {
+  a->base = (uint8_t *)buf;
+  a->cap = buf ? cap : 0;
+  a->used = 0;
+}
+
+static inline void map_arena_reset(map_arena_t *a) { a->used = 0; }
+
+/** [bytes] alineados a [align] (potencia de 2), o nullptr si no entran. */
+static inline void *map_arena_alloc(map_arena_t *a, size_t bytes, size_t align = 4) {
+  size_t off = (a->used + align - 1) & ~(align - 1);
+  if (off > a->cap || bytes > a->cap - off) return nullptr;
+  a->used = off + bytes;
+  return a->base + off;
+}
@@ -0,0 +1,102 @@
+/*
+ * Rectángulos sucios (ver map_damage.h).
+ *
+ * La lista es chica a propósito: cada rectángulo cuesta un relleno de fondo
+ * y una pasada por todas las primitivas, así que conviene fusionar de más
+ * antes que fragmentar.
+ */
+#include "map_damage.h"
+
+/* Margen con el que dos rectángulos cercanos se consideran contiguos */
+#define DMG_MERGE_SLACK 8
+
+static int32_t area(const dmg_rect_t &r) {
+  return (int32_t)(r.x2 - r.x1 + 1) * (r.y2 - r.y1 + 1);
+}
+
+static dmg_rect_t join(const dmg_rect_t &a, const dmg_rect_t &b) {
+  return { a.x1 < b.x1 ? a.x1 : b.x1, a.y1 < b.y1 ? a.y1 : b.y1,
+           a.x2 > b.x2 ? a.x2 : b.x2, a.y2 > b.y2 ? a.y2 : b.y2 };
+}
+
+static bool near(const dmg_rect_t &a, const dmg_rect_t &b) {
+  return a.x1 <= b.x2 + DMG_MERGE_SLACK && b.x1 <= a.x2 + DMG_MERGE_SLACK &&
+         a.y1 <= b.y2 + DMG_MERGE_SLACK && b.y1 <= a.y2 + DMG_MERGE_SLACK;
+}
+
+uint32_t dmg_hash(uint32_t h, const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *)data;
+  for (size_t i = 0; i < len; i++) {
+    h ^= p[i];
+    h *= 16777619u;
+  }
+  return h;
+}
+
+void dmg_clear(dmg_list_t *l) {
+  l->n = 0;
+  l->full = false;
+}
+
+void dmg_full(dmg_list_t *l, const dmg_rect_t &screen) {
+  l->r[0] = screen;
+  l->n = 1;
+  l->full = true;
+}
+
+void dmg_add(dmg_list_t *l, dmg_rect_t r, const dmg_rect_t &screen) {
+  if (l->full || !dmg_intersects(r, screen)) return;
+  if (r.x1 < screen.x1) r.x1 = screen.x1;
+  if (r.y1 < screen.y1) r.y1 = screen.y1;
+  if (r.x2 > screen.x2) r.x2 = screen.x2;
+  if (r.y2 > screen.y2) r.y2 = screen.y2;
+
+  /* Absorber los que toca (la unión puede tocar otros: repetir) */
+  for (uint8_t i = 0; i < l->n;) {
+    if (near(l->r[i], r)) {
+      r = join(r, l->r[i]);
+      l->r[i] = l->r[--l->n];
+      i = 0;
+    } else {
+      i++;
+    }
+  }
+
+  if (l->n == DMG_MAX_RECTS) {
+    uint8_t best = 0;
+    int32_t best_growth = INT32_MAX;
+    for (uint8_t i = 0; i < l->n; i++) {
+      int32_t g = area(join(l->r[i], r)) - area(l->r[i]);
+      if (g < best_growth) {
+        best_growth = g;
+        best = i;
+      }
+    }
+    r = join(r, l->r[best]);
+    l->r[best] = l->r[--l->n];
+  }
+  l->r[l->n++] = r;
+
+  int32_t total = 0;
+  for (uint8_t i = 0; i < l->n; i++) total += area(l->r[i]);
+  if (total * 256 > area(screen) * DMG_FULL_RATIO) dmg_full(l, screen);
+}
+
+void dmg_diff(const dmg_prim_t *prev, uint16_t n_prev, const dmg_prim_t *cur,
+              uint16_t n_cur, dmg_list_t *out, const dmg_rect_t &screen) {
+  uint16_t i = 0, j = 0;
+  while ((i < n_prev || j < n_cur) && !out->full) {
+    if (j >= n_cur || (i < n_prev && prev[i].key < cur[j].key)) {
+      dmg_add(out, prev[i++].box, screen); /* desapareció */
+    } else if (i >= n_prev || cur[j].key < prev[i].key) {
+      dmg_add(out, cur[j++].box, screen);  /* apareció */
+    } else {
+      if (prev[i].hash != cur[j].hash) {
+        dmg_add(out, prev[i].box, screen);
+        dmg_add(out, cur[j].box, screen);
+      }
+      i++;
+      j++;
+    }
+  }
+}
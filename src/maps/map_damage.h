@@ -0,0 +1,69 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Rectángulos sucios para el render incremental del mapa.
+ *
+ * Cada frame se describe como una lista de primitivas (calle, tramo de ruta,
+ * label, marcador) con una clave estable, un hash de lo que se dibuja y su
+ * bbox en pantalla. Comparando la lista anterior con la nueva salen las zonas
+ * a re-rasterizar: bbox viejo y nuevo de lo que cambió, apareció o se fue.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+/* Rectángulo inclusivo en píxeles de pantalla (mismo criterio que lv_area_t) */
+struct dmg_rect_t {
+  int16_t x1, y1, x2, y2;
+};
+
+struct dmg_prim_t {
+  uint32_t   key;  /* identidad estable entre frames; listas ordenadas por key */
+  uint32_t   hash; /* contenido dibujado: puntos proyectados, estilo, texto */
+  dmg_rect_t box;  /* bbox en pantalla, incluye grosor de línea */
+  uint16_t   src;  /* índice del elemento en la fuente, para redibujarlo */
+  uint8_t    type;
+};
+
+#define DMG_MAX_RECTS   8
+/* Por encima de esta fracción de la pantalla (en 1/256) conviene redibujar todo */
+#define DMG_FULL_RATIO 160
+
+struct dmg_list_t {
+  dmg_rect_t r[DMG_MAX_RECTS];
+  uint8_t    n;
+  bool       full; /* redibujar la pantalla completa (r[0] = pantalla) */
+};
+
+static inline uint32_t dmg_key(uint8_t type, uint16_t idx) {
+  return ((uint32_t)type << 24) | idx;
+}
+
+static inline bool dmg_intersects(const dmg_rect_t &a, const dmg_rect_t &b) {
+  return a.x1 <= b.x2 && b.x1 <= a.x2 && a.y1 <= b.y2 && b.y1 <= a.y2;
+}
+
+/** FNV-1a incremental; arrancar con DMG_HASH_SEED. */
+#define DMG_HASH_SEED 2166136261u
+uint32_t dmg_hash(uint32_t h, const void *data, size_t len);
+
+void dmg_clear(dmg_list_t *l);
+
+/** Marca toda la pantalla como sucia. */
+void dmg_full(dmg_list_t *l, const dmg_rect_t &screen);
+
+/**
+ * Agrega un rectángulo recortado a [screen]. Se fusiona con los que toca; si
+ * no queda lugar se une al que menos área agrega. Si el total supera
+ * DMG_FULL_RATIO pasa a pantalla completa.
+ */
+void dmg_add(dmg_list_t *l, dmg_rect_t r, const dmg_rect_t &screen);
+
+/**
+ * Compara dos listas ordenadas por key y agrega a [out] los bbox de las
+ * primitivas que cambiaron (viejo y nuevo), aparecieron o desaparecieron.
+ */
+void dmg_diff(const dmg_prim_t *prev, uint16_t n_prev, const dmg_prim_t *cur,
+              uint16_t n_cur, dmg_list_t *out, const dmg_rect_t &screen);
@@ -0,0 +1,209 @@
+/*
+ * Parser en streaming de mensajes JSON del mapa (ver map_json.h).
+ *
+ * Estructura esperada (la profundidad es la del contenedor del token):
+ *   {                                   1
+ *     "t":"vec", "hdg":90,              1
+ *     "pos":[x,y],                      2
+ *     "route":[[x,y],...],              2 → 3
+ *     "roads":[{"w":1,"p":[[x,y],...]}] 2 → 3 → 4 → 5
+ *     "labels":[{"p":[x,y],"n":"..."}]  2 → 3 → 4
+ *     "step":"...", "dist":"...", "eta":"...", "spd":42
+ *   }
+ * Lo que no encaja en esta forma se ignora sin invalidar el mensaje. Cada
+ * calle y la ruta son una polilínea abierta en vec_frame mientras duran.
+ */
+#include "map_json.h"
+#include "vec_frame.h"
+#include "vec_proto.h"
+
+#include <string.h>
+
+enum {
+  K_NONE = 0,
+  K_T, K_ROADS, K_ROUTE, K_LABELS, K_POS, K_HDG,
+  K_STEP, K_DIST, K_ETA, K_SPD,
+  K_W, K_P, K_N,
+};
+
+struct key_def_t { const char *name; uint8_t id; };
+
+static const key_def_t k_top_keys[] = {
+  { "t", K_T },         { "roads", K_ROADS }, { "route", K_ROUTE },
+  { "labels", K_LABELS }, { "pos", K_POS },   { "hdg", K_HDG },
+  { "step", K_STEP },   { "dist", K_DIST },   { "eta", K_ETA },
+  { "spd", K_SPD },
+};
+
+static const key_def_t k_item_keys[] = { { "w", K_W }, { "p", K_P }, { "n", K_N } };
+
+static uint8_t key_id(const key_def_t *defs, size_t n, const char *s) {
+  for (size_t i = 0; i < n; i++)
+    if (strcmp(defs[i].name, s) == 0) return defs[i].id;
+  return K_NONE;
+}
+
+static int16_t clamp16(int32_t v) {
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v < INT16_MIN) return INT16_MIN;
+  return (int16_t)v;
+}
+
+/* ── Eventos del tokenizer ───────────────────────────────────────── */
+static void on_number(map_json_t *m, uint8_t depth, int32_t v) {
+  vec_frame_t *f = m->vec;
+  uint8_t idx = m->idx++;
+
+  if (depth == 1) {
+    if (m->top_key == K_HDG && f) f->heading = clamp16(v);
+    else if (m->top_key == K_SPD) m->spd = v;
+    return;
+  }
+  if (!f) return;
+
+  switch (m->top_key) {
+  case K_POS:
+    if (depth != 2) return;
+    if (idx == 0) f->pos_x = clamp16(v);
+    else if (idx == 1) f->pos_y = clamp16(v);
+    return;
+
+  case K_ROUTE:
+    if (depth != 3) return;
+    if (idx == 0) m->px = v;
+    else if (idx == 1) {
+      if (!m->in_route) {
+        vec_frame_poly_begin(f, VEC_FRAME_ROUTE, 0);
+        m->in_route = true;
+      }
+      vec_frame_poly_add(f, { clamp16(m->px), clamp16(v) });
+    }
+    return;
+
+  case K_ROADS:
+    if (!m->in_item) return;
+    if (depth == 3 && m->sub_key == K_W) {
+      vec_frame_poly_width(f, v > 0 ? (uint8_t)v : 1);
+    } else if (depth == 5 && m->sub_key == K_P) {
+      if (idx == 0) m->px = v;
+      else if (idx == 1) vec_frame_poly_add(f, { clamp16(m->px), clamp16(v) });
+    }
+    return;
+
+  case K_LABELS:
+    if (!m->label || depth != 4 || m->sub_key != K_P) return;
+    if (idx == 0) m->label->x = clamp16(v);
+    else if (idx == 1) m->label->y = clamp16(v);
+    return;
+  }
+}
+
+static void on_string(map_json_t *m, uint8_t depth, const json_sax_t *p) {
+  if (depth == 1) {
+    switch (m->top_key) {
+    case K_T:
+      if (strcmp(p->str, "vec") == 0)      m->type = MAP_JSON_VEC;
+      else if (strcmp(p->str, "nav") == 0) m->type = MAP_JSON_NAV;
+      else if (strcmp(p->str, "gps") == 0) m->type = MAP_JSON_GPS;
+      break;
+    case K_STEP: if (m->nav) maps_copy_str(m->nav->step, sizeof(m->nav->step), p->str, p->str_len); break;
+    case K_DIST: if (m->nav) maps_copy_str(m->nav->dist, sizeof(m->nav->dist), p->str, p->str_len); break;
+    case K_ETA:  if (m->nav) maps_copy_str(m->nav->eta,  sizeof(m->nav->eta),  p->str, p->str_len); break;
+    }
+    return;
+  }
+  if (m->top_key == K_LABELS && depth == 3 && m->label && m->sub_key == K_N)
+    maps_copy_str(m->label->name, sizeof(m->label->name), p->str, p->str_len);
+}
+
+/* Apertura de una calle o un label (objeto de profundidad 3) */
+static void item_begin(map_json_t *m) {
+  vec_frame_t *f = m->vec;
+  m->in_item = false;
+  m->label = nullptr;
+  m->sub_key = K_NONE;
+  if (!f) return;
+  m->idx = 0;
+  if (m->top_key == K_ROADS) {
+    vec_frame_poly_begin(f, VEC_FRAME_ROAD, 1);
+    m->in_item = true;
+  } else if (m->top_key == K_LABELS) {
+    m->label = vec_frame_label_add(f);
+    m->in_item = m->label != nullptr;
+  }
+}
+
+static void item_end(map_json_t *m) {
+  vec_frame_t *f = m->vec;
+  if (!m->in_item || !f) return;
+  m->in_item = false;
+  if (m->top_key == K_ROADS) {
+    vec_frame_poly_end(f);
+  } else if (m->top_key == K_LABELS) {
+    if (m->idx < 2) vec_frame_label_drop(f, m->label);  /* "p" sin [x, y] */
+    m->label = nullptr;
+  }
+}
+
+static void on_event(void *ctx, json_sax_ev_t ev, const json_sax_t *p) {
+  map_json_t *m = (map_json_t *)ctx;
+  uint8_t depth = p->depth;
+
+  switch (ev) {
+  case JSON_SAX_KEY:
+    if (depth == 1) {
+      if (m->in_route && m->vec) vec_frame_poly_end(m->vec);
+      m->in_route = false;
+      m->top_key = key_id(k_top_keys, sizeof(k_top_keys) / sizeof(k_top_keys[0]), p->str);
+      m->idx = 0;
+    } else if (depth == 3) {
+      m->sub_key = key_id(k_item_keys, sizeof(k_item_keys) / sizeof(k_item_keys[0]), p->str);
+    }
+    break;
+  case JSON_SAX_OBJ_BEGIN:
+    if (depth == 3) item_begin(m);
+    break;
+  case JSON_SAX_OBJ_END:
+    if (depth == 3) item_end(m);
+    break;
+  case JSON_SAX_ARR_BEGIN:
+    m->idx = 0; /* los puntos [x, y] son siempre el array más interno */
+    break;
+  case JSON_SAX_NUMBER:
+    on_number(m, depth, p->num);
+    break;
+  case JSON_SAX_STRING:
+    on_string(m, depth, p);
+    break;
+  default:
+    break;
+  }
+}
+
+/* ── API ─────────────────────────────────────────────────────────── */
+void map_json_begin(map_json_t *m, vec_frame_t *vec, nav_step_t *nav) {
+  m->vec = vec;
+  m->nav = nav;
+  m->spd = 0;
+  m->type = MAP_JSON_NONE;
+  m->top_key = K_NONE;
+  m->sub_key = K_NONE;
+  m->idx = 0;
+  m->in_item = false;
+  m->in_route = false;
+  m->label = nullptr;
+  m->px = 0;
+  if (vec) vec_frame_begin(vec);
+  if (nav) nav->step[0] = nav->dist[0] = nav->eta[0] = '\0';
+  json_sax_begin(&m->sax, on_event, m);
+}
+
+bool map_json_feed(map_json_t *m, const char *data, size_t len) {
+  return json_sax_feed(&m->sax, data, len);
+}
+
+map_json_type_t map_json_end(map_json_t *m) {
+  if (m->vec) vec_frame_end(m->vec);
+  if (!json_sax_end(&m->sax)) return MAP_JSON_NONE;
+  return m->type;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "json_sax.h"
+#include "maps_ws_server.h"
+
+/**
+ * Parser en streaming de los mensajes JSON del mapa ("vec", "nav", "gps").
+ *
+ * Se alimenta fragmento a fragmento desde el WebSocket y escribe los campos
+ * directamente en los destinos que se le pasan en map_json_begin(), sin
+ * copiar el mensaje ni reservar memoria (el frame se arma en su propio
+ * bloque, ver vec_frame.h). Como el tipo ("t") puede llegar en
+ * cualquier posición, cada clave conocida se vuelca a su destino al pasar y
+ * el tipo solo se decide en map_json_end().
+ */
+
+typedef enum {
+  MAP_JSON_NONE = 0, /* incompleto, inválido o tipo desconocido */
+  MAP_JSON_VEC,
+  MAP_JSON_NAV,
+  MAP_JSON_GPS,
+} map_json_type_t;
+
+struct map_json_t {
+  json_sax_t sax;
+
+  /* Destinos (pueden ser nullptr si el tipo no interesa) */
+  vec_frame_t *vec;
+  nav_step_t  *nav;
+  int          spd;
+
+  /* ── Estado interno ── */
+  map_json_type_t type;
+  uint8_t  top_key;   /* clave de primer nivel en curso */
+  uint8_t  sub_key;   /* clave dentro de un objeto de roads/labels */
+  uint8_t  idx;       /* índice dentro de un punto [x, y] */
+  bool     in_item;   /* hay una calle/label abierta en vec */
+  bool     in_route;  /* la ruta es la polilínea abierta en vec */
+  vec_label_t *label; /* label en curso */
+  int32_t  px;        /* x del punto en curso */
+};
+
+/** Comienza un mensaje nuevo. */
+void map_json_begin(map_json_t *m, vec_frame_t *vec, nav_step_t *nav);
+
+/** Consume un fragmento. Devuelve false si el JSON ya es inválido. */
+bool map_json_feed(map_json_t *m, const char *data, size_t len);
+
+/** Cierra el mensaje y devuelve su tipo (MAP_JSON_NONE si no es válido). */
+map_json_type_t map_json_end(map_json_t *m);
@@ -0,0 +1,203 @@
+/*
+ * Labels de calles (ver map_labels.h).
+ *
+ * La caché es una tabla chica de slots de tamaño fijo (LBL_SLOT_BYTES): se
+ * busca linealmente por hash (decenas de entradas, más barato que cualquier
+ * estructura) y se confirma con el texto. El uso se marca con un contador
+ * que avanza en cada pedido; lo pedido desde el último lbl_cache_frame no se
+ * reemplaza.
+ */
+#include "map_labels.h"
+
+#include <string.h>
+
+#include "map_damage.h"
+
+/* Glifo más grande que se copia (montserrat 12-16 entra holgado) */
+#define LBL_GLYPH_MAX 32
+
+struct lbl_entry_t {
+  lbl_bitmap_t bmp;
+  uint32_t     hash;
+  uint32_t     used_at; /* contador de uso; 0 = slot libre */
+  char         name[VEC_LABEL_LEN + 1];
+};
+
+static const lv_font_t *s_font = nullptr;
+static uint8_t *s_pool = nullptr;
+static lbl_entry_t s_entries[LBL_CACHE_MAX];
+static uint8_t s_n_entries = 0;
+static uint32_t s_tick = 0;        /* último valor de used_at repartido */
+static uint32_t s_frame_tick = 0;  /* s_tick al empezar el frame */
+static lv_draw_buf_t *s_glyph_buf = nullptr;
+
+bool lbl_cache_init(const lv_font_t *font, void *pool, size_t bytes) {
+  s_font = font;
+  s_pool = (uint8_t *)pool;
+  size_t n = pool ? bytes / LBL_SLOT_BYTES : 0;
+  s_n_entries = n > LBL_CACHE_MAX ? LBL_CACHE_MAX : (uint8_t)n;
+  for (uint8_t i = 0; i < s_n_entries; i++)
+    s_entries[i].bmp.a8 = s_pool + (size_t)i * LBL_SLOT_BYTES;
+  if (!s_glyph_buf)
+    s_glyph_buf = lv_draw_buf_create(LBL_GLYPH_MAX, LBL_GLYPH_MAX,
+                                     LV_COLOR_FORMAT_A8, 0);
+  lbl_cache_clear();
+  return s_n_entries > 0 && s_glyph_buf;
+}
+
+void lbl_cache_clear(void) {
+  for (uint8_t i = 0; i < s_n_entries; i++)
+    s_entries[i].used_at = 0;
+  s_tick = s_frame_tick = 0;
+}
+
+void lbl_cache_frame(void) { s_frame_tick = s_tick; }
+
+/* Suma el glifo [g] (bitmap A8 con stride [stride]) en (gx, gy) saturando */
+static void put_glyph(uint8_t *dst, int16_t w, int16_t h, const uint8_t *src,
+                      uint32_t stride, const lv_font_glyph_dsc_t &g, int32_t gx,
+                      int32_t gy) {
+  for (int32_t y = 0; y < g.box_h; y++) {
+    int32_t dy = gy + y;
+    if (dy < 0 || dy >= h)
+      continue;
+    const uint8_t *s = src + y * stride;
+    uint8_t *d = dst + dy * w;
+    for (int32_t x = 0; x < g.box_w; x++) {
+      int32_t dx = gx + x;
+      if (dx < 0 || dx >= w || !s[x])
+        continue;
+      uint32_t v = d[dx] + s[x];
+      d[dx] = v > 255 ? 255 : (uint8_t)v;
+    }
+  }
+}
+
+/* Rasteriza [name] en [e]: una pasada para medir (con kerning) y otra para
+ * copiar los glifos sobre la línea base, como lo haría lv_draw_label. */
+static void raster_name(lbl_entry_t &e, const char *name) {
+  int32_t line_h = lv_font_get_line_height(s_font);
+  int32_t base = line_h - s_font->base_line;
+  lv_font_glyph_dsc_t g;
+
+  int32_t width = 0;
+  uint32_t i = 0;
+  uint32_t letter = lv_text_encoded_next(name, &i);
+  while (letter) {
+    uint32_t next = lv_text_encoded_next(name, &i);
+    memset(&g, 0, sizeof(g));
+    if (lv_font_get_glyph_dsc(s_font, &g, letter, next))
+      width += g.adv_w;
+    letter = next;
+  }
+
+  int16_t w = width < 1 ? 1 : width > LBL_MAX_W ? LBL_MAX_W : (int16_t)width;
+  int16_t h = line_h > LBL_MAX_H ? LBL_MAX_H : (int16_t)line_h;
+  uint8_t *dst = (uint8_t *)e.bmp.a8;
+  memset(dst, 0, (size_t)w * h);
+
+  int32_t pen = 0;
+  i = 0;
+  letter = lv_text_encoded_next(name, &i);
+  while (letter && pen < w) {
+    uint32_t next = lv_text_encoded_next(name, &i);
+    memset(&g, 0, sizeof(g));
+    if (lv_font_get_glyph_dsc(s_font, &g, letter, next)) {
+      if (g.box_w && g.box_h && g.box_w <= LBL_GLYPH_MAX && g.box_h <= LBL_GLYPH_MAX) {
+        const uint8_t *bmp = (const uint8_t *)lv_font_get_glyph_bitmap(&g, s_glyph_buf);
+        if (bmp)
+          put_glyph(dst, w, h, bmp,
+                    lv_draw_buf_width_to_stride(g.box_w, LV_COLOR_FORMAT_A8), g,
+                    pen + g.ofs_x, base - g.box_h - g.ofs_y);
+      }
+      pen += g.adv_w;
+    }
+    letter = next;
+  }
+  e.bmp.w = w;
+  e.bmp.h = h;
+}
+
+const lbl_bitmap_t *lbl_cache_get(const char *name) {
+  if (!s_font || !s_n_entries)
+    return nullptr;
+  size_t len = strlen(name);
+  if (len > VEC_LABEL_LEN)
+    len = VEC_LABEL_LEN;
+  uint32_t h = dmg_hash(DMG_HASH_SEED, name, len);
+
+  /* Acierto, o el slot libre / de uso más viejo fuera del frame en curso */
+  lbl_entry_t *victim = nullptr;
+  for (uint8_t i = 0; i < s_n_entries; i++) {
+    lbl_entry_t &e = s_entries[i];
+    if (e.used_at && e.hash == h && strncmp(e.name, name, len) == 0 &&
+        e.name[len] == '\0') {
+      e.used_at = ++s_tick;
+      return &e.bmp;
+    }
+    if (e.used_at > s_frame_tick)
+      continue;
+    if (!victim || e.used_at < victim->used_at)
+      victim = &e;
+  }
+  if (!victim)
+    return nullptr;
+
+  memcpy(victim->name, name, len);
+  victim->name[len] = '\0';
+  victim->hash = h;
+  victim->used_at = ++s_tick;
+  raster_name(*victim, victim->name);
+  return &victim->bmp;
+}
+
+/* ── Colocación ──────────────────────────────────────────────────── */
+
+void lbl_place_begin(lbl_place_t *p, const dmg_rect_t &bounds) {
+  p->bounds = bounds;
+  p->n = 0;
+}
+
+void lbl_place_block(lbl_place_t *p, const dmg_rect_t &r) {
+  if (p->n < LBL_PLACE_MAX)
+    p->box[p->n++] = r;
+}
+
+bool lbl_place_try(lbl_place_t *p, const dmg_rect_t &r) {
+  if (p->n >= LBL_PLACE_MAX || !dmg_intersects(r, p->bounds))
+    return false;
+  dmg_rect_t g = {(int16_t)(r.x1 - LBL_GAP), (int16_t)(r.y1 - LBL_GAP),
+                  (int16_t)(r.x2 + LBL_GAP), (int16_t)(r.y2 + LBL_GAP)};
+  for (uint8_t i = 0; i < p->n; i++)
+    if (dmg_intersects(g, p->box[i]))
+      return false;
+  p->box[p->n++] = r;
+  return true;
+}
+
+/* ── Blit ────────────────────────────────────────────────────────── */
+
+static void blit_a8(const rast_surface_t *s, const dmg_rect_t &clip,
+                    const lbl_bitmap_t *b, int32_t x, int32_t y, uint16_t color) {
+  int32_t x1 = x > clip.x1 ? x : clip.x1;
+  int32_t x2 = x + b->w - 1 < clip.x2 ? x + b->w - 1 : clip.x2;
+  int32_t y1 = y > clip.y1 ? y : clip.y1;
+  int32_t y2 = y + b->h - 1 < clip.y2 ? y + b->h - 1 : clip.y2;
+  if (x1 > x2)
+    return;
+  for (int32_t py = y1; py <= y2; py++)
+    rast_blend_span(s->buf + py * s->stride + x1,
+                    b->a8 + (py - y) * b->w + (x1 - x), color,
+                    (uint16_t)(x2 - x1 + 1));
+}
+
+void lbl_blit(const rast_surface_t *s, const lbl_bitmap_t *b, int16_t x, int16_t y,
+              uint16_t color, uint16_t shadow) {
+  dmg_rect_t clip = s->clip;
+  if (clip.x1 < 0) clip.x1 = 0;
+  if (clip.y1 < 0) clip.y1 = 0;
+  if (clip.x2 > s->w - 1) clip.x2 = s->w - 1;
+  if (clip.y2 > s->h - 1) clip.y2 = s->h - 1;
+  blit_a8(s, clip, b, x + 1, y + 1, shadow);
+  blit_a8(s, clip, b, x, y, color);
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <lvgl.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map_damage.h"
+#include "map_raster.h"
+
+/**
+ * Labels de calles: nombres rasterizados una sola vez, colocación sin
+ * solapes y copia directa al buffer RGB565 (sin lv_draw_label por frame).
+ *
+ *   - Caché: cada nombre distinto se arma con los glifos de la fuente de
+ *     LVGL (ya expandidos a A8 por lv_font_get_glyph_bitmap) en un slot de un
+ *     pool que reserva quien llama (PSRAM), buscado por hash del texto. Sin
+ *     slot libre se reemplaza el de uso más viejo, salvo los pedidos en el
+ *     frame en curso (sus bitmaps siguen válidos hasta el próximo frame).
+ *   - Colocación: greedy en el orden en que se proponen; un label que pisa
+ *     (con LBL_GAP de margen) a uno aceptado o a un obstáculo se descarta.
+ *   - Blit: sombra desplazada 1 px y texto, mezclados con rast_blend_span.
+ *
+ * Se usa solo desde el hilo de LVGL.
+ */
+
+/* Bitmap máximo de un nombre (lo que no entra se recorta) */
+#define LBL_MAX_W      160
+#define LBL_MAX_H      16
+#define LBL_SLOT_BYTES (LBL_MAX_W * LBL_MAX_H)
+/* Entradas máximas de la caché (el pool puede dar menos) */
+#define LBL_CACHE_MAX  96
+/* Labels aceptados por frame */
+#define LBL_PLACE_MAX  48
+/* Separación mínima entre labels (px) */
+#define LBL_GAP        4
+
+struct lbl_bitmap_t {
+  const uint8_t *a8; /* w·h coberturas (0..255), stride w */
+  int16_t        w, h;
+};
+
+/** Usa [font] y el pool [pool] de [bytes]; false si no entra ni un slot. */
+bool lbl_cache_init(const lv_font_t *font, void *pool, size_t bytes);
+
+/** Vacía la caché (las entradas se vuelven a rasterizar a demanda). */
+void lbl_cache_clear(void);
+
+/** Empieza un frame: libera para reemplazo lo pedido en el anterior. */
+void lbl_cache_frame(void);
+
+/** Bitmap de [name] (rasterizado si hace falta), o nullptr si no hay lugar. */
+const lbl_bitmap_t *lbl_cache_get(const char *name);
+
+/* ── Colocación ──────────────────────────────────────────────────── */
+
+struct lbl_place_t {
+  dmg_rect_t box[LBL_PLACE_MAX];
+  dmg_rect_t bounds;
+  uint8_t    n;
+};
+
+void lbl_place_begin(lbl_place_t *p, const dmg_rect_t &bounds);
+
+/** Reserva [r] (marcador, etc.): ningún label lo va a pisar. */
+void lbl_place_block(lbl_place_t *p, const dmg_rect_t &r);
+
+/** Acepta [r] si toca [bounds] y no pisa nada de lo aceptado. */
+bool lbl_place_try(lbl_place_t *p, const dmg_rect_t &r);
+
+/** Caja en pantalla (sombra incluida) del label centrado en (x, y). */
+static inline dmg_rect_t lbl_box(const lbl_bitmap_t *b, int16_t x, int16_t y) {
+  int16_t x1 = x - b->w / 2, y1 = y - b->h / 2;
+  return {x1, y1, (int16_t)(x1 + b->w), (int16_t)(y1 + b->h)};
+}
+
+/**
+ * Dibuja [b] con la esquina en (x, y): primero la sombra en (x + 1, y + 1)
+ * con [shadow], después el texto con [color] (RGB565), recortado al clip.
+ */
+void lbl_blit(const rast_surface_t *s, const lbl_bitmap_t *b, int16_t x, int16_t y,
+              uint16_t color, uint16_t shadow);
@@ -0,0 +1,209 @@
+/*
+ * Histogramas de latencia del mapa (ver map_latency.h).
+ *
+ * Todo es de tamaño fijo: LAT_N_STAGES histogramas de LAT_BUCKETS baldes y
+ * una ventana de LAT_CLOCK_WINDOW muestras de reloj. El balde sale del bit
+ * más alto de la duración, sin divisiones.
+ */
+#include "map_latency.h"
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <stdio.h>
+#include <string.h>
+
+#define LAT_BUCKET0_US  256
+#define LAT_MAX_AGE_MS  60000
+#define LAT_PING_GAP_MS 250
+
+static const char *const STAGE_NAMES[LAT_N_STAGES] = {
+    "link", "parse", "wait", "rast", "lvgl", "panel", "total",
+};
+
+static lat_hist_t s_hist[LAT_N_STAGES];
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+/* Reloj: celular = ESP32 + s_ofs (ms) */
+struct clock_sample_t {
+  uint32_t rtt;
+  int32_t  ofs;
+};
+static clock_sample_t s_clk[LAT_CLOCK_WINDOW];
+static uint8_t s_clk_n = 0, s_clk_next = 0;
+static volatile int32_t s_ofs = 0;
+static volatile uint32_t s_rtt = 0;
+static volatile bool s_clk_ok = false;
+static uint32_t s_ping_ms = 0;
+static uint8_t s_burst = 0;
+static bool s_pinged = false;
+
+/* Frame rasterizado camino al panel (solo desde loop) */
+enum { PH_IDLE = 0, PH_LVGL, PH_PANEL };
+static uint8_t s_phase = PH_IDLE;
+static uint32_t s_mark_us = 0;
+static uint32_t s_origin_us = 0;
+
+const char *lat_stage_name(lat_stage_t s) {
+  return s < LAT_N_STAGES ? STAGE_NAMES[s] : "?";
+}
+
+/* ── Histogramas ─────────────────────────────────────────────────── */
+
+static uint8_t bucket_of(uint32_t us) {
+  if (us < LAT_BUCKET0_US)
+    return 0;
+  uint8_t b = (uint8_t)(31 - __builtin_clz(us)) - 7; /* 256..511 → 1 */
+  return b < LAT_BUCKETS ? b : LAT_BUCKETS - 1;
+}
+
+void lat_record(lat_stage_t s, uint32_t us) {
+  if (s >= LAT_N_STAGES)
+    return;
+  uint8_t b = bucket_of(us);
+  portENTER_CRITICAL(&s_mux);
+  lat_hist_t &h = s_hist[s];
+  h.n++;
+  h.sum_us += us;
+  if (us > h.max_us)
+    h.max_us = us;
+  h.bucket[b]++;
+  portEXIT_CRITICAL(&s_mux);
+}
+
+void lat_reset(void) {
+  portENTER_CRITICAL(&s_mux);
+  memset(s_hist, 0, sizeof(s_hist));
+  portEXIT_CRITICAL(&s_mux);
+}
+
+void lat_get(lat_stage_t s, lat_hist_t *out) {
+  if (s >= LAT_N_STAGES)
+    return;
+  portENTER_CRITICAL(&s_mux);
+  *out = s_hist[s];
+  portEXIT_CRITICAL(&s_mux);
+}
+
+uint32_t lat_percentile(const lat_hist_t &h, uint8_t pct) {
+  if (!h.n)
+    return 0;
+  uint32_t target = (uint32_t)(((uint64_t)h.n * pct + 99) / 100);
+  uint32_t acc = 0;
+  for (uint8_t i = 0; i < LAT_BUCKETS - 1; i++) {
+    acc += h.bucket[i];
+    if (acc >= target) {
+      uint32_t edge = (uint32_t)LAT_BUCKET0_US << i;
+      return edge < h.max_us ? edge : h.max_us;
+    }
+  }
+  return h.max_us;
+}
+
+/* ── Reloj del celular ───────────────────────────────────────────── */
+
+void lat_clock_reset(void) {
+  s_clk_n = s_clk_next = 0;
+  s_clk_ok = false;
+  s_burst = 0;
+  s_pinged = false;
+}
+
+bool lat_clock_ping_due(uint32_t now_ms) {
+  uint32_t since = now_ms - s_ping_ms;
+  if (s_pinged && since >= LAT_CLOCK_RENEW_MS)
+    s_burst = 0;
+  if (s_pinged && (s_burst >= LAT_CLOCK_BURST || since < LAT_PING_GAP_MS))
+    return false;
+  s_pinged = true;
+  s_ping_ms = now_ms;
+  s_burst++;
+  return true;
+}
+
+void lat_clock_sample(uint32_t dev_ms, uint32_t phone_ms, uint32_t now_ms) {
+  uint32_t rtt = now_ms - dev_ms;
+  if (rtt > 5000)
+    return; /* pong de otra sesión o reloj corrupto */
+  s_clk[s_clk_next] = {rtt, (int32_t)(phone_ms - (dev_ms + rtt / 2))};
+  s_clk_next = (s_clk_next + 1) % LAT_CLOCK_WINDOW;
+  if (s_clk_n < LAT_CLOCK_WINDOW)
+    s_clk_n++;
+
+  /* La de menor ida y vuelta es la que menos asimetría puede tener */
+  const clock_sample_t *best = &s_clk[0];
+  for (uint8_t i = 1; i < s_clk_n; i++)
+    if (s_clk[i].rtt < best->rtt)
+      best = &s_clk[i];
+  s_ofs = best->ofs;
+  s_rtt = best->rtt;
+  s_clk_ok = true;
+}
+
+bool lat_phone_to_us(uint32_t phone_ms, uint32_t now_us, uint32_t *origin_us) {
+  if (!s_clk_ok)
+    return false;
+  /* El error del offset es de ±rtt/2: un origen apenas en el futuro es 0 */
+  int32_t age_ms = (int32_t)(millis() - (phone_ms - (uint32_t)s_ofs));
+  if (age_ms < -(int32_t)s_rtt || age_ms > LAT_MAX_AGE_MS)
+    return false;
+  if (age_ms < 0)
+    age_ms = 0;
+  *origin_us = now_us - (uint32_t)age_ms * 1000u;
+  if (!*origin_us)
+    *origin_us = 1; /* 0 es "sin origen" */
+  return true;
+}
+
+/* ── Seguimiento del frame hasta el panel ───────────────────────── */
+
+void lat_frame_rastered(uint32_t origin_us) {
+  s_mark_us = micros();
+  s_origin_us = origin_us;
+  s_phase = PH_LVGL;
+}
+
+void lat_lvgl_flushed(void) {
+  if (s_phase != PH_LVGL)
+    return;
+  lat_record(LAT_LVGL, micros() - s_mark_us);
+  s_phase = PH_PANEL;
+}
+
+void lat_panel_flushed(uint32_t us) {
+  if (s_phase != PH_PANEL)
+    return;
+  lat_record(LAT_PANEL, us);
+  if (s_origin_us)
+    lat_record(LAT_TOTAL, micros() - s_origin_us);
+  s_phase = PH_IDLE;
+}
+
+/* ── Exportación ─────────────────────────────────────────────────── */
+
+size_t lat_to_json(char *buf, size_t n) {
+  if (!buf || !n)
+    return 0;
+  int len = snprintf(buf, n,
+                     "{\"t\":\"lat\",\"clock\":{\"ok\":%d,\"ofs_ms\":%ld,\"rtt_ms\":%lu},"
+                     "\"bucket0_us\":%d,\"st\":{",
+                     s_clk_ok ? 1 : 0, (long)s_ofs, (unsigned long)s_rtt,
+                     LAT_BUCKET0_US);
+  for (uint8_t s = 0; s < LAT_N_STAGES && len > 0 && (size_t)len < n; s++) {
+    lat_hist_t h;
+    lat_get((lat_stage_t)s, &h);
+    len += snprintf(buf + len, n - len,
+                    "%s\"%s\":{\"n\":%lu,\"avg\":%lu,\"p50\":%lu,\"p95\":%lu,\"max\":%lu,\"h\":[",
+                    s ? "," : "", STAGE_NAMES[s], (unsigned long)h.n,
+                    (unsigned long)(h.n ? h.sum_us / h.n : 0),
+                    (unsigned long)lat_percentile(h, 50),
+                    (unsigned long)lat_percentile(h, 95), (unsigned long)h.max_us);
+    for (uint8_t i = 0; i < LAT_BUCKETS && (size_t)len < n; i++)
+      len += snprintf(buf + len, n - len, "%s%lu", i ? "," : "",
+                      (unsigned long)h.bucket[i]);
+    if ((size_t)len < n)
+      len += snprintf(buf + len, n - len, "]}");
+  }
+  if (len > 0 && (size_t)len < n)
+    len += snprintf(buf + len, n - len, "}}");
+  return len < 0 ? 0 : ((size_t)len < n ? (size_t)len : n - 1);
+}
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Latencia de punta a punta del mapa: del fix GPS en el celular a los
+ * píxeles en el panel, separada por etapas.
+ *
+ * Los mensajes binarios con MAPS_BIN_FLAG_TS traen la hora del fix en el
+ * reloj del celular; el offset entre relojes se estima al conectar con
+ * pings ({"t":"ping"} → MAPS_BIN_CLOCK), quedándose con la muestra de menor
+ * ida y vuelta de las últimas LAT_CLOCK_WINDOW. Con eso cada mensaje lleva
+ * su origen en micros() del ESP32 y cada etapa anota su duración:
+ *
+ *   LAT_LINK   fix → mensaje completo en el ESP32 (app + WiFi)
+ *   LAT_PARSE  decodificación en el task de red
+ *   LAT_WAIT   publicado → tomado por el hilo de LVGL
+ *   LAT_RAST   aplicar + rasterizar
+ *   LAT_LVGL   fin del raster → último flush_cb de LVGL al canvas
+ *   LAT_PANEL  gfx->flush() del canvas al panel por QSPI
+ *   LAT_TOTAL  fix → panel
+ *
+ * Los histogramas tienen LAT_BUCKETS baldes fijos en escala log2: el balde
+ * i cuenta las muestras < (256 µs << i) (el último, todo lo que sobra).
+ * Se anotan desde el task de red y desde loop(); una sección crítica corta
+ * protege los contadores.
+ */
+
+#define LAT_BUCKETS      16
+#define LAT_CLOCK_WINDOW 8
+#define LAT_CLOCK_BURST  5     /* pings seguidos al conectar */
+#define LAT_CLOCK_RENEW_MS 30000 /* un ping cada tanto por la deriva */
+
+typedef enum {
+  LAT_LINK = 0,
+  LAT_PARSE,
+  LAT_WAIT,
+  LAT_RAST,
+  LAT_LVGL,
+  LAT_PANEL,
+  LAT_TOTAL,
+  LAT_N_STAGES,
+} lat_stage_t;
+
+struct lat_hist_t {
+  uint32_t n;
+  uint32_t max_us;
+  uint64_t sum_us;
+  uint32_t bucket[LAT_BUCKETS];
+};
+
+/** Nombre corto de la etapa ("link", "parse", ...). */
+const char *lat_stage_name(lat_stage_t s);
+
+void lat_record(lat_stage_t s, uint32_t us);
+void lat_reset(void);
+
+/** Copia del histograma de [s]. */
+void lat_get(lat_stage_t s, lat_hist_t *out);
+
+/** Cota superior del balde que contiene el percentil [pct] (0..100), en µs. */
+uint32_t lat_percentile(const lat_hist_t &h, uint8_t pct);
+
+/* ── Reloj del celular ───────────────────────────────────────────── */
+
+/** Olvida el offset (cliente nuevo). */
+void lat_clock_reset(void);
+
+/** true si toca mandar un ping ahora; lo da por enviado. */
+bool lat_clock_ping_due(uint32_t now_ms);
+
+/** Respuesta a un ping enviado en [dev_ms] con la hora del celular [phone_ms]. */
+void lat_clock_sample(uint32_t dev_ms, uint32_t phone_ms, uint32_t now_ms);
+
+/**
+ * Origen en micros() del ESP32 de un instante [phone_ms] del celular, visto
+ * en [now_us]. false si todavía no hay offset o el resultado no tiene
+ * sentido (en el futuro o más viejo que un minuto).
+ */
+bool lat_phone_to_us(uint32_t phone_ms, uint32_t now_us, uint32_t *origin_us);
+
+/* ── Seguimiento del frame hasta el panel ───────────────────────── */
+
+/**
+ * Hilo de LVGL: se terminó de rasterizar un frame con origen [origin_us]
+ * (0 si no se conoce). Las etapas siguientes se miden desde acá.
+ */
+void lat_frame_rastered(uint32_t origin_us);
+
+/** flush_cb de LVGL, en el último bloque de un refresco. */
+void lat_lvgl_flushed(void);
+
+/** loop(), después de gfx->flush() que tardó [us]. */
+void lat_panel_flushed(uint32_t us);
+
+/* ── Exportación ─────────────────────────────────────────────────── */
+
+/**
+ * {"t":"lat",...} con el offset de reloj y los histogramas de todas las
+ * etapas en [buf]. Devuelve la longitud (truncada a n - 1).
+ */
+size_t lat_to_json(char *buf, size_t n);
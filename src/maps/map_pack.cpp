@@ -0,0 +1,211 @@
+/*
+ * Lector de paquetes de mapa offline (ver map_pack.h).
+ *
+ * Como la caché de tiles: una tabla chica de páginas buscada linealmente
+ * (decenas a cientos de entradas, nada comparado con leer la tarjeta) y un
+ * contador de uso que avanza en cada pedido.
+ */
+#include "map_pack.h"
+
+#include <string.h>
+
+#define NO_PAGE 0xFFFFFFFFu
+
+static uint32_t rd_u32(const uint8_t *b) {
+  return (uint32_t)b[0] | (uint32_t)b[1] << 8 | (uint32_t)b[2] << 16 | (uint32_t)b[3] << 24;
+}
+
+/* ── Caché de páginas ────────────────────────────────────────────── */
+
+/* Página [page] en la caché, leyéndola si hace falta y se puede */
+static const uint8_t *page_get(map_pack_t *p, uint32_t page, bool io,
+                               map_pack_res_t *res) {
+  int32_t victim = 0;
+  for (uint16_t i = 0; i < p->n_pages; i++) {
+    map_pack_page_t &m = p->meta[i];
+    if (m.page == page) {
+      m.used_at = ++p->tick;
+      p->hits++;
+      return p->pages + (size_t)i * MAP_PACK_PAGE_BYTES;
+    }
+    if (m.page == NO_PAGE || (p->meta[victim].page != NO_PAGE &&
+                              m.used_at < p->meta[victim].used_at))
+      victim = i;
+  }
+  if (!io) {
+    *res = MAP_PACK_MISS;
+    return nullptr;
+  }
+  uint32_t off = page * MAP_PACK_PAGE_BYTES;
+  uint32_t len = p->file_len - off < MAP_PACK_PAGE_BYTES ? p->file_len - off
+                                                         : MAP_PACK_PAGE_BYTES;
+  uint8_t *dst = p->pages + (size_t)victim * MAP_PACK_PAGE_BYTES;
+  map_pack_page_t &m = p->meta[victim];
+  m.page = NO_PAGE;
+  if (!p->read(p->ctx, off, dst, len)) {
+    *res = MAP_PACK_ERROR;
+    return nullptr;
+  }
+  m.page = page;
+  m.used_at = ++p->tick;
+  p->reads++;
+  return dst;
+}
+
+map_pack_res_t map_pack_read(map_pack_t *p, uint32_t off, void *dst, uint32_t len,
+                             bool io) {
+  if (off > p->file_len || len > p->file_len - off)
+    return MAP_PACK_ERROR;
+  uint8_t *out = (uint8_t *)dst;
+  while (len) {
+    map_pack_res_t res = MAP_PACK_OK;
+    const uint8_t *pg = page_get(p, off / MAP_PACK_PAGE_BYTES, io, &res);
+    if (!pg)
+      return res;
+    uint32_t at = off % MAP_PACK_PAGE_BYTES;
+    uint32_t n = MAP_PACK_PAGE_BYTES - at < len ? MAP_PACK_PAGE_BYTES - at : len;
+    if (out) {
+      memcpy(out, pg + at, n);
+      out += n;
+    }
+    off += n;
+    len -= n;
+  }
+  return MAP_PACK_OK;
+}
+
+map_pack_res_t map_pack_fetch(map_pack_t *p, uint32_t off, uint32_t len) {
+  return map_pack_read(p, off, nullptr, len, true);
+}
+
+/* ── Apertura ────────────────────────────────────────────────────── */
+bool map_pack_open(map_pack_t *p, map_arena_t *arena, uint16_t n_pages,
+                   map_pack_read_t read, void *ctx) {
+  memset(p, 0, sizeof(*p));
+  uint8_t h[MAP_PACK_HDR_BYTES];
+  if (!n_pages || !read(ctx, 0, h, sizeof(h)) ||
+      memcmp(h, MAP_PACK_MAGIC, sizeof(MAP_PACK_MAGIC)) != 0 || h[4] != MAP_PACK_VERSION ||
+      h[5] < MAP_PACK_ZOOM_MIN || h[5] > MAP_PACK_ZOOM_MAX)
+    return false;
+
+  p->read = read;
+  p->ctx = ctx;
+  p->zoom = h[5];
+  p->n_tiles = rd_u32(h + 8);
+  p->dir_off = rd_u32(h + 12);
+  uint32_t idx_off = rd_u32(h + 16);
+  p->min_x = (int32_t)rd_u32(h + 20);
+  p->min_y = (int32_t)rd_u32(h + 24);
+  p->max_x = (int32_t)rd_u32(h + 28);
+  p->max_y = (int32_t)rd_u32(h + 32);
+  p->file_len = rd_u32(h + 36);
+  p->n_blocks = (p->n_tiles + MAP_PACK_DIR_BLOCK - 1) / MAP_PACK_DIR_BLOCK;
+  if ((uint64_t)p->dir_off + (uint64_t)p->n_tiles * MAP_PACK_DIR_ENTRY > p->file_len ||
+      (uint64_t)idx_off + (uint64_t)p->n_blocks * 4 > p->file_len)
+    return false;
+
+  p->block_key = (uint32_t *)map_arena_alloc(arena, p->n_blocks * 4 + 4);
+  p->meta = (map_pack_page_t *)map_arena_alloc(arena, n_pages * sizeof(map_pack_page_t));
+  p->pages = (uint8_t *)map_arena_alloc(arena, (size_t)n_pages * MAP_PACK_PAGE_BYTES);
+  if (!p->block_key || !p->meta || !p->pages)
+    return false;
+  p->n_pages = n_pages;
+  for (uint16_t i = 0; i < n_pages; i++)
+    p->meta[i] = {NO_PAGE, 0};
+  if (p->n_blocks && !read(ctx, idx_off, p->block_key, p->n_blocks * 4))
+    return false;
+  /* El índice llega en little-endian, igual que la memoria del ESP32 y de x86 */
+  for (uint32_t i = 0; i < p->n_blocks; i++)
+    p->block_key[i] = rd_u32((const uint8_t *)&p->block_key[i]);
+  return true;
+}
+
+/* ── Directorio ──────────────────────────────────────────────────── */
+map_pack_res_t map_pack_find(map_pack_t *p, uint16_t x, uint16_t y,
+                             map_pack_entry_t *out, bool io) {
+  uint32_t key = map_pack_key(x, y);
+  /* Último bloque cuya primera key es <= key */
+  uint32_t lo = 0, hi = p->n_blocks;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    if (p->block_key[mid] <= key) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == 0)
+    return MAP_PACK_NONE;
+  uint32_t b = lo - 1;
+  uint32_t first = b * MAP_PACK_DIR_BLOCK;
+  uint32_t n = p->n_tiles - first < MAP_PACK_DIR_BLOCK ? p->n_tiles - first
+                                                       : MAP_PACK_DIR_BLOCK;
+
+  /* Búsqueda binaria dentro del bloque, entrada por entrada desde la caché */
+  lo = 0;
+  hi = n;
+  while (lo < hi) {
+    uint32_t mid = (lo + hi) / 2;
+    uint8_t e[MAP_PACK_DIR_ENTRY];
+    map_pack_res_t res = map_pack_read(p, p->dir_off + (first + mid) * MAP_PACK_DIR_ENTRY,
+                                       e, sizeof(e), io);
+    if (res != MAP_PACK_OK)
+      return res;
+    uint32_t k = rd_u32(e);
+    if (k == key) {
+      out->key = k;
+      out->off = rd_u32(e + 4);
+      out->len = rd_u32(e + 8);
+      if (out->len > MAP_PACK_TILE_MAX || out->off > p->file_len ||
+          out->len > p->file_len - out->off)
+        return MAP_PACK_ERROR;
+      return MAP_PACK_OK;
+    }
+    if (k < key) lo = mid + 1;
+    else hi = mid;
+  }
+  return MAP_PACK_NONE;
+}
+
+/* ── Ventana ─────────────────────────────────────────────────────── */
+static int32_t clamp_tile(int64_t v, int32_t n) {
+  return v < 0 ? 0 : v >= n ? n - 1 : (int32_t)v;
+}
+
+uint8_t map_pack_window(const map_pack_t *p, int32_t x, int32_t y, int32_t r,
+                        map_pack_xy_t *out, uint8_t max) {
+  const uint8_t shift = 28 - p->zoom;
+  const int32_t n = (int32_t)1 << p->zoom;
+  /* Fuera de la geometría del paquete no hay nada que buscar */
+  if ((int64_t)x + r < p->min_x || (int64_t)x - r > p->max_x ||
+      (int64_t)y + r < p->min_y || (int64_t)y - r > p->max_y)
+    return 0;
+  int32_t x1 = clamp_tile(((int64_t)x - r) >> shift, n);
+  int32_t x2 = clamp_tile(((int64_t)x + r) >> shift, n);
+  int32_t y1 = clamp_tile(((int64_t)y - r) >> shift, n);
+  int32_t y2 = clamp_tile(((int64_t)y + r) >> shift, n);
+
+  /* Orden por distancia del centro del tile al punto (cuadrados chicos:
+   * inserción) */
+  uint8_t m = 0;
+  int64_t dist[32];
+  if (max > 32) max = 32;
+  const int64_t half = (int64_t)1 << (shift - 1);
+  for (int32_t ty = y1; ty <= y2; ty++) {
+    for (int32_t tx = x1; tx <= x2; tx++) {
+      int64_t dx = ((int64_t)tx << shift) + half - x;
+      int64_t dy = ((int64_t)ty << shift) + half - y;
+      int64_t d = dx * dx + dy * dy;
+      uint8_t i = m < max ? m++ : max;
+      while (i > 0 && dist[i - 1] > d) {
+        if (i < max) {
+          dist[i] = dist[i - 1];
+          out[i] = out[i - 1];
+        }
+        i--;
+      }
+      if (i < max) {
+        dist[i] = d;
+        out[i] = {(uint16_t)tx, (uint16_t)ty};
+      }
+    }
+  }
+  return m;
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "map_arena.h"
+
+/**
+ * Paquetes de mapa offline (tarjeta SD): formato y lector paginado.
+ *
+ * Un paquete son tiles vectoriales de un zoom fijo (MAP_PACK_ZOOM_MIN..MAX)
+ * con calles y labels en coordenadas de mundo (vec_store.h). Todo en
+ * little-endian:
+ *
+ *   Cabecera (MAP_PACK_HDR_BYTES):
+ *     [0..3]   "MPK1"
+ *     [4]      versión (MAP_PACK_VERSION)
+ *     [5]      zoom de los tiles
+ *     [6..7]   reservado (0)
+ *     [8..11]  n_tiles
+ *     [12..15] offset del directorio
+ *     [16..19] offset del índice de bloques
+ *     [20..35] bbox de la geometría: min_x, min_y, max_x, max_y (int32)
+ *     [36..39] tamaño del archivo
+ *   Directorio: n_tiles × (u32 key, u32 offset, u32 bytes), ordenado por
+ *     key = y << 16 | x (el tile x, y del zoom del paquete). Se lee en
+ *     bloques de MAP_PACK_DIR_BLOCK entradas.
+ *   Índice de bloques: la key de la primera entrada de cada bloque (u32).
+ *     Es lo único que queda en memoria: ubicar un tile es una búsqueda
+ *     binaria en el índice y otra dentro de un bloque.
+ *   Tile: las operaciones de un MAPS_BIN_DELTA (varint n_ops, ops; ver
+ *     vec_proto.h), solo MAPS_OP_ROAD y MAPS_OP_LABEL, con el cursor de
+ *     puntos en la esquina superior izquierda del tile: las polilíneas van
+ *     delta-codificadas en varints zig-zag. Los ids son locales al tile
+ *     (< MAP_PACK_TILE_IDS) y las calles ya vienen recortadas al tile y
+ *     partidas a VEC_STORE_ITEM_PTS puntos, las más anchas primero.
+ *
+ * El lector no abre archivos: lee con un callback por offset, en páginas
+ * de MAP_PACK_PAGE_BYTES que guarda en una caché LRU (en PSRAM en el ESP32).
+ * Las funciones con [io] en false no leen: si falta una página devuelven
+ * MAP_PACK_MISS, así el hilo de render nunca espera a la tarjeta.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+#define MAP_PACK_VERSION    1
+#define MAP_PACK_HDR_BYTES  40
+#define MAP_PACK_ZOOM_MIN   12
+#define MAP_PACK_ZOOM_MAX   16 /* x, y entran en 16 bits */
+#define MAP_PACK_PAGE_BYTES 4096
+#define MAP_PACK_DIR_ENTRY  12
+#define MAP_PACK_DIR_BLOCK  256
+#define MAP_PACK_TILE_IDS   4096        /* ids por tile (calles + labels) */
+#define MAP_PACK_TILE_MAX   (64 * 1024) /* bytes de un tile */
+
+static const uint8_t MAP_PACK_MAGIC[4] = {'M', 'P', 'K', '1'};
+
+typedef enum {
+  MAP_PACK_OK = 0,
+  MAP_PACK_NONE,  /* el tile no está en el paquete */
+  MAP_PACK_MISS,  /* falta una página en la caché (io = false) */
+  MAP_PACK_ERROR, /* lectura fallida o paquete corrupto */
+} map_pack_res_t;
+
+/** Lee [len] bytes desde [off]; false si falla. */
+typedef bool (*map_pack_read_t)(void *ctx, uint32_t off, void *dst, uint32_t len);
+
+struct map_pack_entry_t {
+  uint32_t key;
+  uint32_t off;
+  uint32_t len;
+};
+
+struct map_pack_xy_t {
+  uint16_t x, y;
+};
+
+struct map_pack_page_t {
+  uint32_t page;    /* UINT32_MAX: libre */
+  uint32_t used_at; /* contador de uso (LRU) */
+};
+
+struct map_pack_t {
+  map_pack_read_t read;
+  void    *ctx;
+  uint8_t  zoom;
+  uint32_t n_tiles;
+  uint32_t dir_off;
+  uint32_t file_len;
+  int32_t  min_x, min_y, max_x, max_y;
+  uint32_t *block_key; /* índice de bloques */
+  uint32_t n_blocks;
+
+  uint8_t *pages;
+  map_pack_page_t *meta;
+  uint16_t n_pages;
+  uint32_t tick;
+  uint32_t reads;     /* páginas leídas del archivo */
+  uint32_t hits;      /* pedidos resueltos desde la caché */
+};
+
+static inline uint32_t map_pack_key(uint16_t x, uint16_t y) {
+  return (uint32_t)y << 16 | x;
+}
+
+/* Lado de un tile del paquete en unidades de mundo */
+static inline int32_t map_pack_tile_size(const map_pack_t *p) {
+  return (int32_t)1 << (28 - p->zoom);
+}
+
+/**
+ * Lee la cabecera y el índice de bloques y reserva [n_pages] páginas de
+ * caché, todo de [arena]. Devuelve false si el archivo no es un paquete
+ * válido o la arena no alcanza.
+ */
+bool map_pack_open(map_pack_t *p, map_arena_t *arena, uint16_t n_pages,
+                   map_pack_read_t read, void *ctx);
+
+/** Entrada del directorio del tile (x, y). */
+map_pack_res_t map_pack_find(map_pack_t *p, uint16_t x, uint16_t y,
+                             map_pack_entry_t *out, bool io);
+
+/** Copia [len] bytes desde [off] a [dst] pasando por la caché. */
+map_pack_res_t map_pack_read(map_pack_t *p, uint32_t off, void *dst, uint32_t len,
+                             bool io);
+
+/** Trae a la caché las páginas de [off, off + len) (lectura anticipada). */
+map_pack_res_t map_pack_fetch(map_pack_t *p, uint32_t off, uint32_t len);
+
+/**
+ * Tiles del paquete que tocan el cuadrado de lado 2·[r] centrado en el
+ * punto de mundo (x, y), el que lo contiene primero y el resto por
+ * distancia al centro. Escribe a lo sumo [max] en [out] y devuelve cuántos.
+ */
+uint8_t map_pack_window(const map_pack_t *p, int32_t x, int32_t y, int32_t r,
+                        map_pack_xy_t *out, uint8_t max);
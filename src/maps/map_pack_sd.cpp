@@ -0,0 +1,254 @@
+/*
+ * Paquete de mapa offline desde la SD (ver map_pack_sd.h).
+ *
+ * El lector (map_pack) no es thread-safe: lo protege un mutex. El task lo
+ * toma por tile (un puñado de páginas de SD); el hilo de LVGL lo intenta
+ * sin esperar y, si está ocupado, carga en el próximo fix. Los slots de
+ * tiles cargados en el conjunto son solo del hilo de LVGL.
+ */
+#include "map_pack_sd.h"
+#include "map_pack.h"
+#include "../audio_mgr.h"
+
+#include <Arduino.h>
+#include <SD.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#define PACK_PAGES      96   /* caché de páginas: 384 KB de PSRAM */
+#define PACK_ARENA_BYTES (PACK_PAGES * (MAP_PACK_PAGE_BYTES + 8) + 16 * 1024)
+#define PACK_SLOTS      16   /* 16 × MAP_PACK_TILE_IDS: todos los ids de 16 bits */
+/* Radio de lo cargado en unidades de mundo (~600 m en el ecuador, lo que la
+ * app le pide a Overpass) y el de lo que se mantiene, un poco mayor para no
+ * cargar y bajar el mismo tile yendo y viniendo por un borde */
+#define PACK_RADIUS     4096
+#define PACK_KEEP       (PACK_RADIUS * 5 / 4)
+#define PACK_WIN_MAX    16
+#define PACK_REQ_MAX    16
+#define PACK_TASK_STACK 4096
+#define PACK_TASK_PRIO  1
+#define PACK_TASK_CORE  0 /* LVGL corre en el 1 */
+
+static_assert(PACK_SLOTS * MAP_PACK_TILE_IDS <= 0x10000, "los ids de los slots no entran en 16 bits");
+
+struct pack_slot_t {
+  map_pack_xy_t t;
+  bool used;
+};
+
+static map_pack_t s_pack;
+static bool s_open = false;
+static File s_file;
+static uint8_t *s_arena_mem = nullptr;
+static uint8_t *s_tile_buf = nullptr;
+static SemaphoreHandle_t s_lock = nullptr;
+static TaskHandle_t s_task = nullptr;
+
+/* Pedidos al task (lo que falta y la lectura anticipada) */
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static map_pack_xy_t s_req[PACK_REQ_MAX];
+static uint8_t s_n_req = 0;
+
+/* Hilo de LVGL */
+static pack_slot_t s_slots[PACK_SLOTS];
+static uint32_t s_ahead_key = UINT32_MAX; /* tile de la última lectura anticipada */
+
+static bool sd_read(void *ctx, uint32_t off, void *dst, uint32_t len) {
+  (void)ctx;
+  return s_file.seek(off) && s_file.read((uint8_t *)dst, len) == len;
+}
+
+/* ── Task de lectura ─────────────────────────────────────────────── */
+static void pack_task(void *arg) {
+  (void)arg;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    map_pack_xy_t req[PACK_REQ_MAX];
+    portENTER_CRITICAL(&s_mux);
+    uint8_t n = s_n_req;
+    memcpy(req, s_req, n * sizeof(map_pack_xy_t));
+    s_n_req = 0;
+    portEXIT_CRITICAL(&s_mux);
+
+    for (uint8_t i = 0; i < n; i++) {
+      xSemaphoreTake(s_lock, portMAX_DELAY);
+      map_pack_entry_t e;
+      if (s_open && map_pack_find(&s_pack, req[i].x, req[i].y, &e, true) == MAP_PACK_OK)
+        map_pack_fetch(&s_pack, e.off, e.len);
+      xSemaphoreGive(s_lock);
+    }
+  }
+}
+
+static void request(const map_pack_xy_t *t, uint8_t n) {
+  if (!n)
+    return;
+  portENTER_CRITICAL(&s_mux);
+  for (uint8_t i = 0; i < n && s_n_req < PACK_REQ_MAX; i++)
+    s_req[s_n_req++] = t[i];
+  portEXIT_CRITICAL(&s_mux);
+  xTaskNotifyGive(s_task);
+}
+
+/* ── Apertura ────────────────────────────────────────────────────── */
+bool map_pack_sd_open(void) {
+  if (s_open)
+    return true;
+  audio_mgr_state_t st = audio_mgr_get_state();
+  if (st == AUDIO_UNINIT || st == AUDIO_NO_SD)
+    return false;
+  if (!SD.exists(MAP_PACK_PATH))
+    return false;
+
+  if (!s_lock && !(s_lock = xSemaphoreCreateMutex()))
+    return false;
+  if (!s_arena_mem)
+    s_arena_mem = (uint8_t *)heap_caps_malloc(PACK_ARENA_BYTES,
+                                              MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!s_tile_buf)
+    s_tile_buf = (uint8_t *)heap_caps_malloc(MAP_PACK_TILE_MAX,
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!s_arena_mem || !s_tile_buf) {
+    Serial.println("[Maps] pack: sin memoria para la caché");
+    return false;
+  }
+
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  s_file = SD.open(MAP_PACK_PATH, FILE_READ);
+  map_arena_t arena;
+  map_arena_init(&arena, s_arena_mem, PACK_ARENA_BYTES);
+  s_open = s_file && map_pack_open(&s_pack, &arena, PACK_PAGES, sd_read, nullptr);
+  if (!s_open && s_file)
+    s_file.close();
+  xSemaphoreGive(s_lock);
+  if (!s_open) {
+    Serial.println("[Maps] pack: " MAP_PACK_PATH " no es un paquete válido");
+    return false;
+  }
+
+  if (!s_task &&
+      xTaskCreatePinnedToCore(pack_task, "pack", PACK_TASK_STACK, nullptr, PACK_TASK_PRIO,
+                              &s_task, PACK_TASK_CORE) != pdPASS) {
+    s_task = nullptr;
+    map_pack_sd_close();
+    return false;
+  }
+  map_pack_sd_forget();
+  Serial.printf("[Maps] pack: %lu tiles z%u, caché de %u KB\n",
+                (unsigned long)s_pack.n_tiles, s_pack.zoom,
+                PACK_PAGES * MAP_PACK_PAGE_BYTES / 1024);
+  return true;
+}
+
+void map_pack_sd_close(void) {
+  if (!s_lock)
+    return;
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  if (s_open) {
+    Serial.printf("[Maps] pack: %lu páginas leídas, %lu aciertos de caché\n",
+                  (unsigned long)s_pack.reads, (unsigned long)s_pack.hits);
+    s_file.close();
+  }
+  s_open = false;
+  xSemaphoreGive(s_lock);
+}
+
+bool map_pack_sd_ready(void) { return s_open; }
+
+void map_pack_sd_forget(void) {
+  memset(s_slots, 0, sizeof(s_slots));
+  s_ahead_key = UINT32_MAX;
+}
+
+/* ── Hilo de LVGL ────────────────────────────────────────────────── */
+static int8_t slot_of(const map_pack_xy_t &t) {
+  for (uint8_t i = 0; i < PACK_SLOTS; i++)
+    if (s_slots[i].used && s_slots[i].t.x == t.x && s_slots[i].t.y == t.y)
+      return i;
+  return -1;
+}
+
+static bool in_list(const map_pack_xy_t *l, uint8_t n, const map_pack_xy_t &t) {
+  for (uint8_t i = 0; i < n; i++)
+    if (l[i].x == t.x && l[i].y == t.y)
+      return true;
+  return false;
+}
+
+/* Carga un tile que ya está en la caché; false si falta leerlo */
+static bool load_tile(vec_store_t *s, const map_pack_xy_t &t) {
+  map_pack_entry_t e = {};
+  map_pack_res_t res = map_pack_find(&s_pack, t.x, t.y, &e, false);
+  if (res == MAP_PACK_OK)
+    res = map_pack_read(&s_pack, e.off, s_tile_buf, e.len, false);
+  if (res == MAP_PACK_MISS)
+    return false;
+
+  /* Un tile que no existe o no se pudo leer también ocupa su slot: así
+   * no se vuelve a buscar en cada fix */
+  int8_t slot = -1;
+  for (uint8_t i = 0; i < PACK_SLOTS && slot < 0; i++)
+    if (!s_slots[i].used)
+      slot = i;
+  if (slot < 0)
+    return true;
+  s_slots[slot] = {t, true};
+  if (res == MAP_PACK_ERROR)
+    Serial.printf("[Maps] pack: tile %u,%u ilegible\n", t.x, t.y);
+  if (res != MAP_PACK_OK)
+    return true;
+
+  const uint8_t shift = 28 - s_pack.zoom;
+  if (!vec_store_apply_ops(s, s_tile_buf, e.len, (int32_t)t.x << shift,
+                           (int32_t)t.y << shift, (uint16_t)(slot * MAP_PACK_TILE_IDS)))
+    Serial.printf("[Maps] pack: tile %u,%u no entró entero en el conjunto\n", t.x, t.y);
+  return true;
+}
+
+void map_pack_sd_sync(vec_store_t *s) {
+  if (!s_open)
+    return;
+  map_pack_xy_t keep[PACK_WIN_MAX], want[PACK_WIN_MAX], need[PACK_REQ_MAX];
+  uint8_t n_keep = map_pack_window(&s_pack, s->pos_x, s->pos_y, PACK_KEEP, keep, PACK_WIN_MAX);
+  uint8_t n_want = map_pack_window(&s_pack, s->pos_x, s->pos_y, PACK_RADIUS, want, PACK_WIN_MAX);
+  uint8_t n_need = 0;
+
+  /* Bajas: lo que quedó fuera del radio mayor */
+  for (uint8_t i = 0; i < PACK_SLOTS; i++) {
+    if (!s_slots[i].used || in_list(keep, n_keep, s_slots[i].t))
+      continue;
+    vec_store_remove_range(s, (uint16_t)(i * MAP_PACK_TILE_IDS),
+                           (uint16_t)(i * MAP_PACK_TILE_IDS + MAP_PACK_TILE_IDS - 1));
+    s_slots[i].used = false;
+  }
+
+  /* Altas, la del vehículo primero */
+  if (xSemaphoreTake(s_lock, 0) == pdTRUE) {
+    for (uint8_t i = 0; i < n_want; i++)
+      if (slot_of(want[i]) < 0 && !load_tile(s, want[i]))
+        need[n_need++] = want[i];
+    xSemaphoreGive(s_lock);
+  }
+
+  /* Lectura anticipada: la ventana un tile más adelante en el rumbo, una
+   * vez por tile */
+  if (s->heading >= 0) {
+    const int32_t ts = map_pack_tile_size(&s_pack);
+    uint16_t a = vec_angle_deg(s->heading);
+    int32_t ax = s->pos_x + (int32_t)(((int64_t)vec_sin_q15(a) * ts) >> 15);
+    int32_t ay = s->pos_y - (int32_t)(((int64_t)vec_cos_q15(a) * ts) >> 15);
+    uint32_t key = map_pack_key((uint16_t)(ax / ts), (uint16_t)(ay / ts));
+    if (key != s_ahead_key) {
+      s_ahead_key = key;
+      map_pack_xy_t ahead[PACK_WIN_MAX];
+      uint8_t n = map_pack_window(&s_pack, ax, ay, PACK_RADIUS, ahead, PACK_WIN_MAX);
+      for (uint8_t i = 0; i < n && n_need < PACK_REQ_MAX; i++)
+        if (!in_list(want, n_want, ahead[i]))
+          need[n_need++] = ahead[i];
+    }
+  }
+  request(need, n_need);
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "vec_store.h"
+
+/**
+ * Mapa offline: calles y labels de un paquete en la SD (map_pack.h) sobre
+ * el conjunto persistente, alrededor de la posición que manda la app.
+ *
+ * La tarjeta la monta audio_mgr_init al arrancar. Las lecturas las hace un
+ * task de prioridad baja (lo que falta y la lectura anticipada en el
+ * sentido de la marcha) hacia una caché de páginas en PSRAM; el hilo de
+ * LVGL solo carga tiles que ya están en la caché, así nunca espera a la SD.
+ *
+ * Cada tile cargado ocupa un slot con MAP_PACK_TILE_IDS ids propios en el
+ * conjunto. Con un paquete abierto el hello anuncia "pack" y la app deja de
+ * mandar calles y labels: por el enlace viajan la posición y la ruta.
+ */
+
+#define MAP_PACK_PATH "/maps.mpk"
+
+/** Abre MAP_PACK_PATH y arranca el task; false si no hay tarjeta o paquete. */
+bool map_pack_sd_open(void);
+
+/** Cierra el paquete (el task queda para la próxima vez). */
+void map_pack_sd_close(void);
+
+bool map_pack_sd_ready(void);
+
+/** El conjunto se vació (RESET de la app): los tiles se vuelven a cargar. */
+void map_pack_sd_forget(void);
+
+/**
+ * Hilo de LVGL: baja los tiles que quedaron lejos de s->pos, carga los
+ * cercanos que ya estén en la caché y le pide al task el resto.
+ */
+void map_pack_sd_sync(vec_store_t *s);
@@ -0,0 +1,454 @@
+/*
+ * Rasterizador de polilíneas gruesas (ver map_raster.h).
+ *
+ * Cada pieza (cuadrilátero de un tramo, cuña de una unión, disco de una
+ * unión o extremo redondo) es convexa: por fila de muestreo alcanza con el
+ * borde izquierdo y el derecho. Los spans resultantes se acumulan ordenados
+ * y fusionados por fila y se escriben al cerrar cada banda de filas, una vez
+ * por polilínea.
+ *
+ * Con antialias cada fila de píxeles se muestrea en RAST_AA_SUB subfilas con
+ * spans en Q4; la cobertura de cada píxel (0..16·SUB) sale de sumar los
+ * spans de sus subfilas. Lo cubierto del todo se rellena y los bordes pasan
+ * por rast_blend_span.
+ */
+#include "map_raster.h"
+
+#include <string.h>
+
+/* Q4: 16 subpíxeles por píxel; el centro del píxel p está en p*16 + 8 */
+#define Q       4
+#define Q_ONE   (1 << Q)
+#define Q_HALF  (Q_ONE / 2)
+/* Inglete máximo: 2× el semigrosor (como cortar a ~60°) */
+#define MITER_LIMIT_SQ 4
+/* Cobertura de un píxel entero con antialias */
+#define COV_FULL (Q_ONE * RAST_AA_SUB)
+
+/* Multiplicaciones en vez de << (valores negativos) */
+#define TO_Q(v) ((int32_t)(v) * Q_ONE)
+#define FX16    65536
+
+#define MAX_SAMPLES (RAST_BAND_ROWS * RAST_AA_SUB)
+
+struct q4_t {
+  int32_t x, y;
+};
+
+struct span_t {
+  int16_t x1, x2;
+};
+
+/* Estado de la polilínea en curso (hilo LVGL, una a la vez). Los spans van
+ * en píxeles inclusivos sin antialias y en Q4 [x1, x2) con antialias. */
+static span_t   s_spans[MAX_SAMPLES][RAST_ROW_SPANS];
+static uint8_t  s_nspans[MAX_SAMPLES];
+static int32_t  s_xl[MAX_SAMPLES], s_xr[MAX_SAMPLES];
+static uint8_t  s_cov[RAST_MAX_COLS + 1];
+static int8_t   s_cover[RAST_MAX_COLS + 1]; /* delta de subfilas cubiertas enteras */
+static uint8_t  s_alpha[RAST_MAX_COLS];
+static int16_t  s_row_min, s_row_max;       /* muestras tocadas en la banda */
+static dmg_rect_t s_clip, s_band;
+static uint16_t *s_buf;
+static int16_t   s_stride;
+static uint16_t  s_color;
+static bool      s_aa;
+static uint8_t   s_sub;   /* muestras por fila de píxeles: 1 o RAST_AA_SUB */
+static uint8_t   s_shift; /* log2 del paso entre muestras en Q4 */
+
+/* ── Blender RGB565 ──────────────────────────────────────────────── */
+/* SWAR: el píxel expandido a 32 bits deja 5-6 bits libres sobre cada canal
+ * (G arriba, R en el medio, B abajo), así que una sola multiplicación por
+ * alfa de 5 bits mezcla los tres canales a la vez. */
+#define RGB565_SPREAD 0x07E0F81Fu
+
+static inline uint32_t spread(uint16_t c) {
+  return (c | ((uint32_t)c << 16)) & RGB565_SPREAD;
+}
+
+void rast_blend_span(uint16_t *dst, const uint8_t *alpha, uint16_t color,
+                     uint16_t n) {
+  uint32_t fg = spread(color);
+  for (uint16_t i = 0; i < n; i++) {
+    uint32_t a = ((uint32_t)alpha[i] + 4) >> 3; /* 0..32 */
+    if (a == 0) continue;
+    if (a >= 32) {
+      dst[i] = color;
+      continue;
+    }
+    uint32_t bg = spread(dst[i]);
+    uint32_t m = ((fg * a + bg * (32 - a)) >> 5) & RGB565_SPREAD;
+    dst[i] = (uint16_t)(m | (m >> 16));
+  }
+}
+
+/* ── Spans por muestra ───────────────────────────────────────────── */
+static void flush_pixel_row(int16_t py);
+
+/* Inserta [x1, x2] manteniendo la muestra ordenada y sin solapes; sin
+ * antialias también se fusionan los spans de píxeles contiguos */
+static void add_span(int16_t k, int16_t x1, int16_t x2) {
+  span_t *sp = s_spans[k];
+  uint8_t n = s_nspans[k];
+  int16_t adj = s_aa ? 0 : 1;
+  uint8_t i = 0;
+  while (i < n && sp[i].x2 + adj < x1) i++;
+  uint8_t j = i;
+  while (j < n && sp[j].x1 <= x2 + adj) {
+    if (sp[j].x1 < x1) x1 = sp[j].x1;
+    if (sp[j].x2 > x2) x2 = sp[j].x2;
+    j++;
+  }
+  if (j == i) {
+    if (n == RAST_ROW_SPANS) {
+      /* Muestra llena: se escribe ya su fila de píxeles */
+      flush_pixel_row(k / s_sub);
+      n = 0;
+      i = 0;
+    }
+    memmove(&sp[i + 1], &sp[i], (n - i) * sizeof(span_t));
+    n++;
+  } else if (j > i + 1) {
+    memmove(&sp[i + 1], &sp[j], (n - j) * sizeof(span_t));
+    n -= j - i - 1;
+  }
+  sp[i] = {x1, x2};
+  s_nspans[k] = n;
+  if (k < s_row_min) s_row_min = k;
+  if (k > s_row_max) s_row_max = k;
+}
+
+/* Muestra k cubre [xl, xr) en Q4 */
+static void add_q4_span(int16_t k, int32_t xl, int32_t xr) {
+  if (s_aa) {
+    if (xl < TO_Q(s_band.x1)) xl = TO_Q(s_band.x1);
+    if (xr > TO_Q(s_band.x2 + 1)) xr = TO_Q(s_band.x2 + 1);
+    if (xl < xr) add_span(k, (int16_t)xl, (int16_t)xr);
+    return;
+  }
+  /* Píxeles cuyo centro cae en [xl, xr) */
+  int32_t p1 = (xl - Q_HALF + Q_ONE - 1) >> Q;
+  int32_t p2 = ((xr - Q_HALF + Q_ONE - 1) >> Q) - 1;
+  if (p1 < s_band.x1) p1 = s_band.x1;
+  if (p2 > s_band.x2) p2 = s_band.x2;
+  if (p1 <= p2) add_span(k, (int16_t)p1, (int16_t)p2);
+}
+
+/* y (Q4) de la muestra k de la banda: centro de cada subfila */
+static inline int32_t sample_y(int16_t k) {
+  return TO_Q(s_band.y1) + ((int32_t)k << s_shift) + (1 << s_shift) / 2;
+}
+
+/* Muestras de la banda cuya y cae en [y0, y1) */
+static bool sample_range(int32_t y0, int32_t y1, int16_t &k0, int16_t &k1) {
+  int32_t base = TO_Q(s_band.y1) + (1 << s_shift) / 2;
+  int32_t step = 1 << s_shift;
+  int32_t a = (y0 - base + step - 1) >> s_shift;
+  int32_t b = ((y1 - base + step - 1) >> s_shift) - 1;
+  int32_t last = (s_band.y2 - s_band.y1 + 1) * s_sub - 1;
+  if (a < 0) a = 0;
+  if (b > last) b = last;
+  if (a > b) return false;
+  k0 = (int16_t)a;
+  k1 = (int16_t)b;
+  return true;
+}
+
+/* ── Escritura ───────────────────────────────────────────────────── */
+static void fill_solid(uint16_t *p, int16_t n) {
+  while (n-- > 0) *p++ = s_color;
+}
+
+/* Fila de píxeles py (relativa a la banda) a partir de sus muestras */
+static void flush_pixel_row(int16_t py) {
+  uint16_t *row = s_buf + (int32_t)(s_band.y1 + py) * s_stride;
+  if (!s_aa) {
+    for (uint8_t i = 0; i < s_nspans[py]; i++)
+      fill_solid(row + s_spans[py][i].x1, s_spans[py][i].x2 - s_spans[py][i].x1 + 1);
+    s_nspans[py] = 0;
+    return;
+  }
+
+  /* Rango de píxeles tocado por las subfilas */
+  int16_t k0 = py * s_sub;
+  int32_t xa = INT32_MAX, xb = INT32_MIN;
+  for (int16_t k = k0; k < k0 + s_sub; k++) {
+    if (!s_nspans[k]) continue;
+    if ((s_spans[k][0].x1 >> Q) < xa) xa = s_spans[k][0].x1 >> Q;
+    if (((s_spans[k][s_nspans[k] - 1].x2 - 1) >> Q) > xb)
+      xb = (s_spans[k][s_nspans[k] - 1].x2 - 1) >> Q;
+  }
+  if (xa > xb) return;
+  int32_t ox = s_band.x1;
+  memset(&s_cov[xa - ox], 0, xb - xa + 2);
+  memset(&s_cover[xa - ox], 0, xb - xa + 2);
+
+  /* Bordes parciales a s_cov; el interior como delta en s_cover */
+  for (int16_t k = k0; k < k0 + s_sub; k++) {
+    for (uint8_t i = 0; i < s_nspans[k]; i++) {
+      int32_t xl = s_spans[k][i].x1, xr = s_spans[k][i].x2;
+      int32_t pl = xl >> Q, pr = (xr - 1) >> Q;
+      if (pl == pr) {
+        s_cov[pl - ox] += (uint8_t)(xr - xl);
+        continue;
+      }
+      s_cov[pl - ox] += (uint8_t)(Q_ONE - (xl & (Q_ONE - 1)));
+      s_cov[pr - ox] += (uint8_t)(xr - TO_Q(pr));
+      if (pr > pl + 1) {
+        s_cover[pl + 1 - ox] += Q_ONE;
+        s_cover[pr - ox] -= Q_ONE;
+      }
+    }
+    s_nspans[k] = 0;
+  }
+  int32_t run = 0;
+  for (int32_t x = xa; x <= xb; x++) {
+    run += s_cover[x - ox];
+    s_cov[x - ox] += (uint8_t)run;
+  }
+
+  /* Corridas cubiertas del todo con relleno, bordes con el blender */
+  for (int32_t x = xa; x <= xb;) {
+    uint8_t c = s_cov[x - ox];
+    if (c == 0) {
+      x++;
+      continue;
+    }
+    int32_t start = x;
+    if (c >= COV_FULL) {
+      while (x <= xb && s_cov[x - ox] >= COV_FULL) x++;
+      fill_solid(row + start, (int16_t)(x - start));
+    } else {
+      uint16_t m = 0;
+      while (x <= xb && s_cov[x - ox] && s_cov[x - ox] < COV_FULL)
+        s_alpha[m++] = (uint8_t)(s_cov[x++ - ox] * 255 / COV_FULL);
+      rast_blend_span(row + start, s_alpha, s_color, m);
+    }
+  }
+}
+
+/* ── Piezas convexas ─────────────────────────────────────────────── */
+static void fill_convex(const q4_t *v, uint8_t n) {
+  int32_t ymin = v[0].y, ymax = v[0].y;
+  for (uint8_t i = 1; i < n; i++) {
+    if (v[i].y < ymin) ymin = v[i].y;
+    if (v[i].y > ymax) ymax = v[i].y;
+  }
+  int16_t k0, k1;
+  if (!sample_range(ymin, ymax, k0, k1)) return;
+  for (int16_t k = k0; k <= k1; k++) {
+    s_xl[k] = INT32_MAX;
+    s_xr[k] = INT32_MIN;
+  }
+
+  /* Cada borde aporta su x (DDA en Q16 sobre Q4) a las muestras que cruza */
+  for (uint8_t i = 0; i < n; i++) {
+    q4_t a = v[i], b = v[(i + 1) % n];
+    if (a.y == b.y) continue;
+    if (a.y > b.y) {
+      q4_t t = a;
+      a = b;
+      b = t;
+    }
+    int16_t e0, e1;
+    if (!sample_range(a.y, b.y, e0, e1)) continue;
+    if (e0 < k0) e0 = k0;
+    if (e1 > k1) e1 = k1;
+    int32_t dy = b.y - a.y;
+    int32_t x = (int32_t)((int64_t)a.x * FX16 +
+                          (int64_t)(sample_y(e0) - a.y) * (b.x - a.x) * FX16 / dy);
+    int32_t step = (int32_t)((int64_t)(b.x - a.x) * ((int64_t)FX16 << s_shift) / dy);
+    for (int16_t k = e0; k <= e1; k++, x += step) {
+      int32_t xq = x >> 16;
+      if (xq < s_xl[k]) s_xl[k] = xq;
+      if (xq > s_xr[k]) s_xr[k] = xq;
+    }
+  }
+
+  for (int16_t k = k0; k <= k1; k++)
+    if (s_xl[k] < s_xr[k]) add_q4_span(k, s_xl[k], s_xr[k]);
+}
+
+static uint32_t isqrt(uint32_t v) {
+  uint32_t res = 0, bit = 1u << 30;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= res + bit) {
+      v -= res + bit;
+      res = (res >> 1) + bit;
+    } else {
+      res >>= 1;
+    }
+    bit >>= 2;
+  }
+  return res;
+}
+
+static void fill_disc(q4_t c, int32_t rad) {
+  int16_t k0, k1;
+  if (!sample_range(c.y - rad, c.y + rad, k0, k1)) return;
+  for (int16_t k = k0; k <= k1; k++) {
+    int32_t dy = sample_y(k) - c.y;
+    int32_t half = (int32_t)isqrt((uint32_t)(rad * rad - dy * dy));
+    if (half > 0) add_q4_span(k, c.x - half, c.x + half);
+  }
+}
+
+/* ── Geometría ───────────────────────────────────────────────────── */
+/* Normal izquierda de a→b con largo [hw] (Q4) */
+static q4_t normal(q4_t a, q4_t b, int32_t hw) {
+  int32_t dx = b.x - a.x, dy = b.y - a.y;
+  while (dx >= (1 << 14) || dx <= -(1 << 14) || dy >= (1 << 14) || dy <= -(1 << 14)) {
+    dx /= 2;
+    dy /= 2;
+  }
+  int32_t len = (int32_t)isqrt((uint32_t)(dx * dx + dy * dy));
+  if (len == 0) return {0, 0};
+  return {(-dy * hw + (dy < 0 ? len : -len) / 2) / len,
+          (dx * hw + (dx < 0 ? -len : len) / 2) / len};
+}
+
+/* Liang–Barsky con t en Q16; ajusta [t0, t1] a un borde */
+static bool clip_t(int32_t p, int32_t q, int32_t &t0, int32_t &t1) {
+  if (p == 0) return q >= 0;
+  int32_t r = (int32_t)((int64_t)q * FX16 / p);
+  if (p < 0) {
+    if (r > t1) return false;
+    if (r > t0) t0 = r;
+  } else {
+    if (r < t0) return false;
+    if (r < t1) t1 = r;
+  }
+  return true;
+}
+
+static bool clip_segment(q4_t &a, q4_t &b, const q4_t &lo, const q4_t &hi) {
+  int32_t dx = b.x - a.x, dy = b.y - a.y;
+  int32_t t0 = 0, t1 = FX16;
+  if (!clip_t(-dx, a.x - lo.x, t0, t1) || !clip_t(dx, hi.x - a.x, t0, t1) ||
+      !clip_t(-dy, a.y - lo.y, t0, t1) || !clip_t(dy, hi.y - a.y, t0, t1))
+    return false;
+  q4_t o = a;
+  if (t1 < FX16) b = {o.x + (int32_t)(((int64_t)dx * t1) >> 16),
+                      o.y + (int32_t)(((int64_t)dy * t1) >> 16)};
+  if (t0 > 0) a = {o.x + (int32_t)(((int64_t)dx * t0) >> 16),
+                   o.y + (int32_t)(((int64_t)dy * t0) >> 16)};
+  return true;
+}
+
+static inline bool inside(q4_t p, const q4_t &lo, const q4_t &hi) {
+  return p.x >= lo.x && p.x <= hi.x && p.y >= lo.y && p.y <= hi.y;
+}
+
+/* Cuña del lado exterior del giro en v (el interior ya lo cubren los tramos) */
+static void miter_join(q4_t v, q4_t n0, q4_t n1, q4_t next, int32_t hw) {
+  int32_t dot = n0.x * n1.x + n0.y * n1.y;
+  int32_t hw2 = hw * hw;
+  if (dot >= hw2) return; /* colineales */
+  int32_t turn = n0.x * (next.x - v.x) + n0.y * (next.y - v.y);
+  int32_t sg = turn > 0 ? -1 : 1;
+  q4_t a = {v.x + sg * n0.x, v.y + sg * n0.y};
+  q4_t b = {v.x + sg * n1.x, v.y + sg * n1.y};
+  /* largo del inglete² / hw² = 2·hw² / (hw² + dot) */
+  if ((int64_t)2 * hw2 > (int64_t)MITER_LIMIT_SQ * (hw2 + dot)) {
+    q4_t tri[3] = {v, a, b};
+    fill_convex(tri, 3);
+    return;
+  }
+  int32_t den = hw2 + dot;
+  q4_t m = {v.x + (int32_t)((int64_t)sg * (n0.x + n1.x) * hw2 / den),
+            v.y + (int32_t)((int64_t)sg * (n0.y + n1.y) * hw2 / den)};
+  q4_t quad[4] = {v, a, m, b};
+  fill_convex(quad, 4);
+}
+
+/* ── Banda ───────────────────────────────────────────────────────── */
+static void draw_band(const vec_point_t *pts, uint16_t n, int32_t hw,
+                      int32_t margin, rast_join_t join) {
+  /* Clip ensanchado: lo que queda fuera no puede tocar un píxel visible */
+  q4_t lo = {TO_Q(s_band.x1) - margin, TO_Q(s_band.y1) - margin};
+  q4_t hi = {TO_Q(s_band.x2) + margin, TO_Q(s_band.y2) + margin};
+
+  q4_t prev_n = {0, 0}, last = {0, 0};
+  bool has_prev = false;
+  for (uint16_t i = 0; i + 1 < n; i++) {
+    q4_t a = {TO_Q(pts[i].x) + Q_HALF, TO_Q(pts[i].y) + Q_HALF};
+    q4_t b = {TO_Q(pts[i + 1].x) + Q_HALF, TO_Q(pts[i + 1].y) + Q_HALF};
+    if (a.x == b.x && a.y == b.y) continue;
+    last = b;
+    /* Tramo entero por encima o por debajo de la banda: no tiene cuerpo ni
+     * uniones visibles, no hace falta su normal */
+    if ((a.y < lo.y && b.y < lo.y) || (a.y > hi.y && b.y > hi.y)) {
+      has_prev = true;
+      continue;
+    }
+    q4_t nm = normal(a, b, hw);
+
+    if (inside(a, lo, hi)) {
+      if (join == RAST_JOIN_ROUND)
+        fill_disc(a, hw);
+      else if (has_prev)
+        miter_join(a, prev_n, nm, b, hw);
+    }
+
+    q4_t ca = a, cb = b;
+    if (clip_segment(ca, cb, lo, hi)) {
+      q4_t quad[4] = {{ca.x + nm.x, ca.y + nm.y}, {cb.x + nm.x, cb.y + nm.y},
+                      {cb.x - nm.x, cb.y - nm.y}, {ca.x - nm.x, ca.y - nm.y}};
+      fill_convex(quad, 4);
+    }
+    prev_n = nm;
+    has_prev = true;
+  }
+  if (has_prev && join == RAST_JOIN_ROUND && inside(last, lo, hi))
+    fill_disc(last, hw);
+}
+
+/* ── API ─────────────────────────────────────────────────────────── */
+void rast_polyline(const rast_surface_t *s, const vec_point_t *pts, uint16_t n,
+                   uint8_t width, uint16_t color, rast_join_t join) {
+  if (n < 2 || width == 0) return;
+  s_clip = s->clip;
+  if (s_clip.x1 < 0) s_clip.x1 = 0;
+  if (s_clip.y1 < 0) s_clip.y1 = 0;
+  if (s_clip.x2 > s->w - 1) s_clip.x2 = s->w - 1;
+  if (s_clip.y2 > s->h - 1) s_clip.y2 = s->h - 1;
+  if (s_clip.x2 - s_clip.x1 >= RAST_MAX_COLS) s_clip.x2 = s_clip.x1 + RAST_MAX_COLS - 1;
+
+  /* Solo las bandas que toca el bbox de la polilínea */
+  int16_t pad = width + 2;
+  dmg_rect_t bb = {INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN};
+  for (uint16_t i = 0; i < n; i++) {
+    if (pts[i].x < bb.x1) bb.x1 = pts[i].x;
+    if (pts[i].y < bb.y1) bb.y1 = pts[i].y;
+    if (pts[i].x > bb.x2) bb.x2 = pts[i].x;
+    if (pts[i].y > bb.y2) bb.y2 = pts[i].y;
+  }
+  int32_t y1 = bb.y1 - pad > s_clip.y1 ? bb.y1 - pad : s_clip.y1;
+  int32_t y2 = bb.y2 + pad < s_clip.y2 ? bb.y2 + pad : s_clip.y2;
+  if (s_clip.x1 > s_clip.x2 || y1 > y2 || bb.x2 + pad < s_clip.x1 ||
+      bb.x1 - pad > s_clip.x2)
+    return;
+
+  s_buf = s->buf;
+  s_stride = s->stride;
+  s_color = color;
+  s_aa = s->aa;
+  s_sub = s_aa ? RAST_AA_SUB : 1;
+  s_shift = s_aa ? Q - RAST_AA_SUB_LOG2 : Q;
+
+  int32_t hw = TO_Q(width) / 2;
+  int32_t margin = TO_Q(pad);
+  s_band.x1 = s_clip.x1;
+  s_band.x2 = s_clip.x2;
+  for (int32_t by = y1; by <= y2; by += RAST_BAND_ROWS) {
+    s_band.y1 = (int16_t)by;
+    s_band.y2 = (int16_t)(by + RAST_BAND_ROWS - 1 < y2 ? by + RAST_BAND_ROWS - 1 : y2);
+    s_row_min = INT16_MAX;
+    s_row_max = -1;
+    draw_band(pts, n, hw, margin, join);
+    if (s_row_max < 0) continue;
+    for (int16_t py = s_row_min / s_sub; py <= s_row_max / s_sub; py++)
+      flush_pixel_row(py);
+  }
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include "map_damage.h"
+#include "maps_ws_server.h"
+
+#include <stdint.h>
+
+/**
+ * Rasterizador de polilíneas gruesas en punto fijo sobre RGB565.
+ *
+ * Reemplaza a lv_draw_line para calles y ruta: una llamada por polilínea (no
+ * un draw task por par de puntos) y escritura directa en el buffer del
+ * canvas.
+ *
+ *   - Coordenadas en 1/16 de píxel (Q4) muestreadas en el centro del píxel.
+ *   - Cada tramo se recorta con Liang–Barsky contra el clip ensanchado por el
+ *     grosor; lo que queda fuera no genera filas.
+ *   - Uniones en inglete (con límite → bisel) o redondas; extremos planos o
+ *     redondos.
+ *   - Tramos y uniones se convierten en spans por fila que se fusionan antes
+ *     de escribir: cada píxel de la polilínea se escribe una sola vez.
+ *   - Se rasteriza por bandas de RAST_BAND_ROWS filas (solo las que toca la
+ *     polilínea), así el estado es chico y estático.
+ *   - Antialias opcional: cobertura por píxel con RAST_AA_SUB subfilas × 16
+ *     subpíxeles, mezclada sobre el fondo con rast_blend_span.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+/* Filas de píxeles por banda */
+#define RAST_BAND_ROWS    64
+/* Ancho máximo del clip (el buffer más ancho que se dibuja) */
+#define RAST_MAX_COLS     640
+/* Spans disjuntos por fila de muestreo antes de volcar la fila al buffer */
+#define RAST_ROW_SPANS    4
+/* Subfilas por fila de píxeles con antialias */
+#define RAST_AA_SUB_LOG2  2
+#define RAST_AA_SUB       (1 << RAST_AA_SUB_LOG2)
+
+struct rast_surface_t {
+  uint16_t  *buf;
+  int16_t    w, h;
+  int16_t    stride; /* en píxeles */
+  dmg_rect_t clip;   /* inclusivo; se recorta a la superficie */
+  bool       aa;     /* bordes con antialias sobre lo ya dibujado */
+};
+
+enum rast_join_t {
+  RAST_JOIN_MITER, /* inglete (bisel si el ángulo es muy cerrado), extremos planos */
+  RAST_JOIN_ROUND, /* uniones y extremos redondos */
+};
+
+/** Dibuja [n] puntos unidos con grosor [width] px y color RGB565 [color]. */
+void rast_polyline(const rast_surface_t *s, const vec_point_t *pts, uint16_t n,
+                   uint8_t width, uint16_t color, rast_join_t join);
+
+/**
+ * Mezcla [n] píxeles RGB565 de [dst] hacia [color] con alfa por píxel
+ * (0..255; se usa con 5 bits de precisión, como el blend de LVGL en RGB565).
+ */
+void rast_blend_span(uint16_t *dst, const uint8_t *alpha, uint16_t color,
+                     uint16_t n);
@@ -0,0 +1,147 @@
+/*
+ * Grabación de sesiones en la SD (ver map_rec.h).
+ *
+ * Abrir y cerrar el archivo también pasan por la cola, como registros de
+ * control (reserved != 0) que no se escriben: así el cierre llega después
+ * del último fragmento de la sesión.
+ */
+#include "map_rec.h"
+#include "../audio_mgr.h"
+
+#include <Arduino.h>
+#include <SD.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/task.h>
+#include <string.h>
+
+#define REC_FRAG_MAX   4096 /* un fragmento más largo se graba partido */
+#define REC_TASK_STACK 4096
+#define REC_TASK_PRIO  1
+#define REC_TASK_CORE  0 /* LVGL corre en el 1 */
+
+enum { REC_DATA = 0, REC_OPEN, REC_CLOSE };
+
+static RingbufHandle_t s_ring = nullptr;
+static StaticRingbuffer_t s_ring_ctl;
+static TaskHandle_t s_task = nullptr;
+static volatile bool s_on = false;
+static uint32_t s_start_ms = 0;
+static bool s_gap = false;
+
+/* Task */
+static File s_file;
+static uint16_t s_next = 0; /* número del próximo archivo */
+
+static bool push(const map_rec_hdr_t &h, const uint8_t *data) {
+  void *p;
+  if (xRingbufferSendAcquire(s_ring, &p, sizeof(h) + h.len, 0) != pdTRUE)
+    return false;
+  memcpy(p, &h, sizeof(h));
+  if (h.len)
+    memcpy((uint8_t *)p + sizeof(h), data, h.len);
+  xRingbufferSendComplete(s_ring, p);
+  return true;
+}
+
+static void open_next(void) {
+  if (!SD.exists(MAP_REC_DIR))
+    SD.mkdir(MAP_REC_DIR);
+  char path[24];
+  do
+    snprintf(path, sizeof(path), MAP_REC_DIR "/%04u.mrs", s_next++);
+  while (SD.exists(path) && s_next < 10000);
+  s_file = SD.open(path, FILE_WRITE);
+  if (!s_file) {
+    Serial.printf("[Maps] rec: no se pudo crear %s\n", path);
+    return;
+  }
+  uint32_t reserved = 0;
+  s_file.write((const uint8_t *)MAP_REC_MAGIC, 4);
+  s_file.write((const uint8_t *)&reserved, 4);
+  Serial.printf("[Maps] rec: grabando en %s\n", path);
+}
+
+static void rec_task(void *arg) {
+  (void)arg;
+  for (;;) {
+    size_t len;
+    uint8_t *item = (uint8_t *)xRingbufferReceive(s_ring, &len, portMAX_DELAY);
+    if (!item)
+      continue;
+    map_rec_hdr_t h;
+    memcpy(&h, item, sizeof(h));
+    if (h.reserved == REC_OPEN) {
+      if (s_file)
+        s_file.close();
+      open_next();
+    } else if (h.reserved == REC_CLOSE) {
+      if (s_file) {
+        Serial.printf("[Maps] rec: %lu KB grabados\n", (unsigned long)(s_file.size() / 1024));
+        s_file.close();
+      }
+    } else if (s_file) {
+      s_file.write(item, len);
+    }
+    vRingbufferReturnItem(s_ring, item);
+  }
+}
+
+bool map_rec_begin(void) {
+  audio_mgr_state_t st = audio_mgr_get_state();
+  if (st == AUDIO_UNINIT || st == AUDIO_NO_SD)
+    return false;
+  if (!s_ring) {
+    uint8_t *storage = (uint8_t *)heap_caps_malloc(MAP_REC_RING_BYTES,
+                                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!storage)
+      return false;
+    s_ring = xRingbufferCreateStatic(MAP_REC_RING_BYTES, RINGBUF_TYPE_NOSPLIT, storage,
+                                     &s_ring_ctl);
+    if (!s_ring)
+      return false;
+  }
+  if (!s_task &&
+      xTaskCreatePinnedToCore(rec_task, "rec", REC_TASK_STACK, nullptr, REC_TASK_PRIO,
+                              &s_task, REC_TASK_CORE) != pdPASS) {
+    s_task = nullptr;
+    return false;
+  }
+  map_rec_hdr_t h = {};
+  h.reserved = REC_OPEN;
+  s_on = push(h, nullptr);
+  s_start_ms = millis();
+  s_gap = false;
+  return s_on;
+}
+
+void map_rec_feed(bool text, size_t index, size_t total, bool final, const uint8_t *data,
+                  size_t len) {
+  if (!s_on)
+    return;
+  uint32_t ms = millis() - s_start_ms;
+  do {
+    size_t n = len < REC_FRAG_MAX ? len : REC_FRAG_MAX;
+    map_rec_hdr_t h = {ms, (uint32_t)index, (uint32_t)total, (uint16_t)n, 0, REC_DATA};
+    if (text)
+      h.flags |= MAP_REC_TEXT;
+    if (final && n == len)
+      h.flags |= MAP_REC_FINAL;
+    if (s_gap)
+      h.flags |= MAP_REC_GAP;
+    s_gap = !push(h, data);
+    index += n;
+    data += n;
+    len -= n;
+  } while (len);
+}
+
+void map_rec_end(void) {
+  if (!s_on)
+    return;
+  s_on = false;
+  map_rec_hdr_t h = {};
+  h.reserved = REC_CLOSE;
+  push(h, nullptr);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Grabación de sesiones del WebSocket del mapa en la SD, para reproducirlas
+ * en host (tools/replay/map_replay.cpp) con el mismo parser y rasterizador.
+ *
+ * Se compila con MAPS_REC=1 (build_flags). Cada conexión de la app abre un
+ * archivo /rec/NNNN.mrs con cada fragmento recibido tal cual llegó, así la
+ * reproducción pasa por los mismos cortes que en el equipo:
+ *
+ *   cabecera   "MRS1" + uint32 LE reservado (0)
+ *   registro   map_rec_hdr_t (16 bytes, LE) + len bytes del fragmento
+ *
+ * El task de red solo copia a una cola en PSRAM; un task de prioridad baja
+ * escribe en la tarjeta. Si la cola se llena, el fragmento se pierde y el
+ * registro siguiente lo marca (MAP_REC_GAP).
+ *
+ * El formato (este header) no depende de Arduino.
+ */
+
+#define MAP_REC_MAGIC     "MRS1"
+#define MAP_REC_FILE_HDR  8
+#define MAP_REC_DIR       "/rec"
+#define MAP_REC_RING_BYTES (256 * 1024)
+
+enum {
+  MAP_REC_TEXT  = 1 << 0, /* mensaje de texto (si no, binario) */
+  MAP_REC_FINAL = 1 << 1, /* último frame WebSocket del mensaje */
+  MAP_REC_GAP   = 1 << 2, /* se perdieron fragmentos antes de este */
+};
+
+struct map_rec_hdr_t {
+  uint32_t ms;     /* llegada, desde que se abrió el archivo */
+  uint32_t index;  /* offset del fragmento en el mensaje */
+  uint32_t total;  /* largo del mensaje */
+  uint16_t len;    /* bytes del fragmento */
+  uint8_t  flags;
+  uint8_t  reserved;
+};
+static_assert(sizeof(map_rec_hdr_t) == 16, "map_rec_hdr_t se graba tal cual");
+
+/** Conexión nueva: abre el archivo siguiente (false sin SD). */
+bool map_rec_begin(void);
+
+/** Fragmento recibido (task de red; no bloquea). */
+void map_rec_feed(bool text, size_t index, size_t total, bool final, const uint8_t *data,
+                  size_t len);
+
+/** Desconexión: el task cierra el archivo al vaciar la cola. */
+void map_rec_end(void);
@@ -0,0 +1,204 @@
+/*
+ * Caché de tiles raster (ver map_tiles.h).
+ *
+ * Como la caché de labels: una tabla chica de slots de tamaño fijo buscada
+ * linealmente (decenas de entradas) y un contador de uso que avanza en cada
+ * pedido. Lo pedido desde el comienzo de la composición en curso no se
+ * reemplaza, así el decoder nunca escribe sobre un tile que se está copiando.
+ */
+#include "map_tiles.h"
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <string.h>
+
+enum { TILE_FREE = 0, TILE_LOADING, TILE_READY };
+
+struct tile_entry_t {
+  uint64_t key;
+  uint32_t used_at; /* contador de uso (LRU) */
+  uint8_t  state;
+};
+
+static uint8_t *s_pool = nullptr;
+static tile_entry_t s_entries[MAP_TILES_MAX];
+static uint8_t s_n_entries = 0;
+static uint32_t s_tick = 0;
+static uint32_t s_frame_tick = 0; /* s_tick al empezar la composición */
+static bool s_composing = false;
+static volatile uint32_t s_version = 0;
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint16_t *slot_px(uint8_t i) {
+  return (uint16_t *)(s_pool + (size_t)i * MAP_TILE_BYTES);
+}
+
+bool map_tiles_init(void) {
+  if (s_pool)
+    return true;
+  for (uint8_t n = MAP_TILES_MAX; n >= MAP_TILES_MIN; n /= 2) {
+    s_pool = (uint8_t *)heap_caps_malloc((size_t)n * MAP_TILE_BYTES,
+                                         MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (s_pool) {
+      s_n_entries = n;
+      break;
+    }
+  }
+  if (!s_pool)
+    return false;
+  map_tiles_clear();
+  Serial.printf("[Maps] Caché de tiles: %u × %u KB\n", s_n_entries,
+                MAP_TILE_BYTES / 1024);
+  return true;
+}
+
+void map_tiles_clear(void) {
+  portENTER_CRITICAL(&s_mux);
+  memset(s_entries, 0, sizeof(s_entries));
+  s_tick = s_frame_tick = 0;
+  s_version++;
+  portEXIT_CRITICAL(&s_mux);
+}
+
+uint32_t map_tiles_version(void) { return s_version; }
+
+/* Tile que la composición en curso ya copia o va a copiar */
+static bool pinned(const tile_entry_t &e) {
+  return s_composing && e.used_at > s_frame_tick;
+}
+
+/* ── Task del decoder ────────────────────────────────────────────── */
+
+uint16_t *map_tiles_open(uint64_t key) {
+  int16_t victim = -1;
+  portENTER_CRITICAL(&s_mux);
+  for (uint8_t i = 0; i < s_n_entries; i++) {
+    tile_entry_t &e = s_entries[i];
+    if (e.state != TILE_FREE && e.key == key) {
+      /* Reenvío de uno que ya está: se reescribe en el mismo slot si no
+       * se está componiendo, si no se busca otro */
+      if (e.state == TILE_READY && !pinned(e)) {
+        victim = i;
+        break;
+      }
+      continue;
+    }
+    if (e.state == TILE_LOADING || (e.state == TILE_READY && pinned(e)))
+      continue;
+    if (victim < 0 || e.state == TILE_FREE ||
+        (s_entries[victim].state != TILE_FREE && e.used_at < s_entries[victim].used_at))
+      victim = i;
+  }
+  if (victim >= 0) {
+    s_entries[victim].key = key;
+    s_entries[victim].state = TILE_LOADING;
+  }
+  portEXIT_CRITICAL(&s_mux);
+  return victim >= 0 ? slot_px((uint8_t)victim) : nullptr;
+}
+
+void map_tiles_close(uint64_t key, bool ok) {
+  portENTER_CRITICAL(&s_mux);
+  for (uint8_t i = 0; i < s_n_entries; i++) {
+    tile_entry_t &e = s_entries[i];
+    if (e.state != TILE_LOADING || e.key != key)
+      continue;
+    /* Si hay otra copia lista del mismo tile, la nueva la reemplaza */
+    for (uint8_t j = 0; ok && j < s_n_entries; j++)
+      if (j != i && s_entries[j].state == TILE_READY && s_entries[j].key == key &&
+          !pinned(s_entries[j]))
+        s_entries[j].state = TILE_FREE;
+    e.state = ok ? TILE_READY : TILE_FREE;
+    e.used_at = ++s_tick;
+    if (ok)
+      s_version++;
+    break;
+  }
+  portEXIT_CRITICAL(&s_mux);
+}
+
+/* ── Composición ─────────────────────────────────────────────────── */
+
+/* Tile listo [key] marcado como usado en esta composición, o nullptr */
+static const uint16_t *get_ready(uint64_t key) {
+  const uint16_t *px = nullptr;
+  portENTER_CRITICAL(&s_mux);
+  for (uint8_t i = 0; i < s_n_entries; i++) {
+    tile_entry_t &e = s_entries[i];
+    if (e.state == TILE_READY && e.key == key) {
+      e.used_at = ++s_tick;
+      px = slot_px(i);
+      break;
+    }
+  }
+  portEXIT_CRITICAL(&s_mux);
+  return px;
+}
+
+static void fill_rect(uint16_t *dst, int32_t stride, int32_t x1, int32_t y1, int32_t x2,
+                      int32_t y2, uint16_t c) {
+  for (int32_t y = y1; y < y2; y++) {
+    uint16_t *d = dst + y * stride;
+    for (int32_t x = x1; x < x2; x++)
+      d[x] = c;
+  }
+}
+
+uint8_t map_tiles_compose(uint16_t *dst, int32_t w, int32_t h, uint8_t z, int32_t px,
+                          int32_t py, uint16_t bg, maps_tile_xy_t *need) {
+  portENTER_CRITICAL(&s_mux);
+  s_frame_tick = s_tick;
+  s_composing = true;
+  portEXIT_CRITICAL(&s_mux);
+
+  int32_t n_tiles = 1 << z;
+  int32_t cx = (px + w / 2) >> 8, cy = (py + h / 2) >> 8; /* tile central */
+  uint8_t n_need = 0;
+  uint32_t need_d[MAP_TILES_NEED_MAX];
+
+  for (int32_t ty = py >> 8; ty <= (py + h - 1) >> 8; ty++) {
+    int32_t y1 = ty * MAP_TILE_PX - py, y2 = y1 + MAP_TILE_PX;
+    if (y1 < 0) y1 = 0;
+    if (y2 > h) y2 = h;
+    for (int32_t tx = px >> 8; tx <= (px + w - 1) >> 8; tx++) {
+      int32_t x1 = tx * MAP_TILE_PX - px, x2 = x1 + MAP_TILE_PX;
+      if (x1 < 0) x1 = 0;
+      if (x2 > w) x2 = w;
+
+      bool inside = tx >= 0 && ty >= 0 && tx < n_tiles && ty < n_tiles;
+      const uint16_t *t = inside ? get_ready(map_tile_key(z, tx, ty)) : nullptr;
+      if (!t) {
+        fill_rect(dst, w, x1, y1, x2, y2, bg);
+        if (!inside || !need)
+          continue;
+        /* Faltante: ordenado por distancia al tile central */
+        uint32_t d = (uint32_t)((tx - cx) * (tx - cx) + (ty - cy) * (ty - cy));
+        uint8_t k = n_need < MAP_TILES_NEED_MAX ? n_need++ : n_need;
+        while (k > 0 && need_d[k - 1] > d) {
+          if (k < MAP_TILES_NEED_MAX) {
+            need[k] = need[k - 1];
+            need_d[k] = need_d[k - 1];
+          }
+          k--;
+        }
+        if (k < MAP_TILES_NEED_MAX) {
+          need[k] = {(uint32_t)tx, (uint32_t)ty};
+          need_d[k] = d;
+        }
+        continue;
+      }
+      /* Copia fila a fila de la parte visible del tile */
+      int32_t sx = x1 + px - tx * MAP_TILE_PX;
+      int32_t sy = y1 + py - ty * MAP_TILE_PX;
+      for (int32_t y = y1; y < y2; y++)
+        memcpy(dst + y * w + x1, t + (sy + y - y1) * MAP_TILE_PX + sx,
+               (size_t)(x2 - x1) * sizeof(uint16_t));
+    }
+  }
+
+  portENTER_CRITICAL(&s_mux);
+  s_composing = false;
+  portEXIT_CRITICAL(&s_mux);
+  return n_need;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "maps_ws_server.h"
+
+/**
+ * Caché de tiles raster decodificados (RGB565, MAP_TILE_PX × MAP_TILE_PX)
+ * en PSRAM y composición de la vista a partir de ellos.
+ *
+ * La app manda tiles z/x/y (MAPS_BIN_TILE, ver vec_proto.h) y el ESP32 arma
+ * la pantalla localmente: moverse un poco o volver a una zona ya vista no
+ * cuesta bytes de red. Lo que falta se pide con maps_ws_request_tiles.
+ *
+ *   - El task del decoder JPEG reserva un slot (map_tiles_open), escribe el
+ *     tile y lo publica (map_tiles_close). Sin slot libre se reemplaza el de
+ *     uso más viejo, salvo los usados en la composición en curso.
+ *   - El hilo de LVGL compone con map_tiles_compose; map_tiles_version
+ *     cambia con cada tile publicado.
+ *
+ * Los metadatos se protegen con una sección crítica corta; los píxeles no
+ * hacen falta: un slot en carga no se compone y uno en uso no se reemplaza.
+ */
+
+#define MAP_TILE_PX    256
+#define MAP_TILE_BYTES (MAP_TILE_PX * MAP_TILE_PX * 2)
+/* Slots que se intentan reservar (5 MB de los 8 de PSRAM); con menos
+ * memoria se prueba con la mitad, hasta MAP_TILES_MIN */
+#define MAP_TILES_MAX  40
+#define MAP_TILES_MIN  6
+/* Tiles faltantes que devuelve una composición */
+#define MAP_TILES_NEED_MAX 12
+
+/* Clave de un tile: zoom (0..20) y x, y (< 2^20 al zoom 20); nunca es 0,
+ * que en jpeg_stream es la pantalla completa */
+static inline uint64_t map_tile_key(uint8_t z, uint32_t x, uint32_t y) {
+  return (1ull << 63) | ((uint64_t)z << 48) | ((uint64_t)(x & 0xFFFFFF) << 24) |
+         (y & 0xFFFFFF);
+}
+
+/** Reserva el pool en PSRAM; false si no entra ni MAP_TILES_MIN. */
+bool map_tiles_init(void);
+
+/** Descarta todos los tiles (los que están cargando terminan y se tiran). */
+void map_tiles_clear(void);
+
+/** Cambia con cada tile publicado y con map_tiles_clear. */
+uint32_t map_tiles_version(void);
+
+/* ── Task del decoder ────────────────────────────────────────────── */
+
+/** Slot donde escribir el tile [key], o nullptr si no hay lugar. */
+uint16_t *map_tiles_open(uint64_t key);
+
+/** Publica el tile [key] si [ok]; si no, libera el slot. */
+void map_tiles_close(uint64_t key, bool ok);
+
+/* ── Hilo de LVGL ────────────────────────────────────────────────── */
+
+/**
+ * Compone en [dst] ([w]×[h], stride w) la vista del zoom [z] cuya esquina
+ * superior izquierda es el píxel (px, py) de ese zoom. Lo que no está en la
+ * caché se pinta con [bg] y se anota en [need] (hasta MAP_TILES_NEED_MAX,
+ * los del centro primero); devuelve cuántos faltan.
+ */
+uint8_t map_tiles_compose(uint16_t *dst, int32_t w, int32_t h, uint8_t z, int32_t px,
+                          int32_t py, uint16_t bg, maps_tile_xy_t *need);
@@ -0,0 +1,499 @@
+/*
+ * Caché de tiles en la flash (ver map_tiles_fs.h).
+ *
+ * Índice en PSRAM ordenado por clave: tamaño y viaje (arranque) del último
+ * uso de cada archivo. Se arma al montar listando el directorio; el archivo
+ * de índice solo aporta los viajes, así un corte entre un tile y el índice
+ * no deja archivos huérfanos. Solo el task lo modifica, con el mutex
+ * tomado y sin hacer IO; el hilo de LVGL lo toma para buscar.
+ *
+ * La cola de escritura es un ring buffer en PSRAM: el task de red reserva
+ * el item al empezar el tile y copia cada fragmento en su lugar.
+ */
+#include "map_tiles_fs.h"
+#include "map_tiles.h"
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <TJpg_Decoder.h> /* trae tjpgd.h (jd_prepare / jd_decomp) */
+#include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FS_DIR        "/t"
+#define FS_INDEX      "/tiles.idx"
+#define FS_INDEX_TMP  "/tiles.tmp"
+#define FS_MAGIC      0x3149544Du /* "MTI1" */
+#define FS_BLOCK      4096        /* lo mínimo que ocupa un archivo */
+#define FS_FREE_PCT   10          /* margen para las copias de LittleFS */
+#define FS_LOAD_MAX   MAP_TILES_NEED_MAX
+#define FS_WORK_BYTES 4096        /* tjpgd, como jpeg_stream */
+#define FS_POLL_MS    1000
+#define FS_TASK_STACK 6144
+#define FS_TASK_PRIO  1
+#define FS_TASK_CORE  0 /* LVGL corre en el 1 */
+
+struct fs_entry_t {
+  uint64_t key;
+  uint32_t bytes; /* ocupado en la flash (redondeado a FS_BLOCK) */
+  uint32_t trip;  /* viaje del último uso */
+};
+
+struct fs_pend_hdr_t {
+  uint64_t key;
+  uint32_t len;
+  bool     ok; /* llegó entero */
+};
+
+/* Registro del archivo de índice */
+struct fs_rec_t {
+  uint64_t key;
+  uint32_t trip;
+};
+
+/* Destino de la decodificación de un tile desde la flash */
+struct fs_dec_t {
+  File     *f;
+  uint16_t *dst;
+};
+
+static TaskHandle_t s_task = nullptr;
+static SemaphoreHandle_t s_lock = nullptr;
+static volatile bool s_ready = false;
+static volatile bool s_dead = false; /* no se pudo montar */
+static volatile bool s_flush = false;
+
+/* Índice (solo el task lo modifica) */
+static fs_entry_t *s_idx = nullptr;
+static uint16_t s_n = 0;
+static uint32_t s_trip = 1;
+static uint32_t s_used = 0, s_budget = 0;
+static bool s_dirty = false;
+
+/* Cola de escritura */
+static RingbufHandle_t s_ring = nullptr;
+static StaticRingbuffer_t s_ring_ctl;
+static uint8_t *s_rx_item = nullptr; /* item reservado del tile en curso */
+static volatile uint32_t s_last_ms = 0;
+static uint32_t s_pend = 0; /* bytes encolados (s_mux) */
+
+/* Pedidos de carga y s_pend */
+static portMUX_TYPE s_mux = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t s_req[FS_LOAD_MAX];
+static uint8_t s_n_req = 0;
+static volatile uint64_t s_loading = 0;
+
+alignas(4) static uint8_t s_work[FS_WORK_BYTES];
+
+static void tile_path(char *out, size_t n, uint64_t key) {
+  snprintf(out, n, FS_DIR "/%016llx", (unsigned long long)key);
+}
+
+static uint32_t on_flash(uint32_t len) {
+  return (len + FS_BLOCK - 1) / FS_BLOCK * FS_BLOCK;
+}
+
+/* ── Índice ──────────────────────────────────────────────────────── */
+
+/* Posición de [key], o la de inserción con *found = false */
+static uint16_t idx_find(uint64_t key, bool *found) {
+  uint16_t lo = 0, hi = s_n;
+  while (lo < hi) {
+    uint16_t mid = (lo + hi) / 2;
+    if (s_idx[mid].key < key) lo = mid + 1;
+    else hi = mid;
+  }
+  *found = lo < s_n && s_idx[lo].key == key;
+  return lo;
+}
+
+static void idx_insert(uint64_t key, uint32_t bytes) {
+  bool found;
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  uint16_t i = idx_find(key, &found);
+  if (!found && s_n < MAP_FS_MAX_TILES) {
+    memmove(&s_idx[i + 1], &s_idx[i], (s_n - i) * sizeof(fs_entry_t));
+    s_idx[i] = {key, bytes, s_trip};
+    s_n++;
+    s_used += bytes;
+    s_dirty = true;
+  }
+  xSemaphoreGive(s_lock);
+}
+
+static void idx_remove(uint16_t i) {
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  s_used -= s_idx[i].bytes;
+  memmove(&s_idx[i], &s_idx[i + 1], (s_n - i - 1) * sizeof(fs_entry_t));
+  s_n--;
+  s_dirty = true;
+  xSemaphoreGive(s_lock);
+}
+
+static void remove_tile(uint64_t key) {
+  char path[32];
+  tile_path(path, sizeof(path), key);
+  LittleFS.remove(path);
+  bool found;
+  uint16_t i = idx_find(key, &found);
+  if (found)
+    idx_remove(i);
+}
+
+/* Libera lugar para [bytes] más y un archivo más borrando los tiles de los
+ * viajes más viejos; nunca los del viaje actual */
+static bool make_room(uint32_t bytes) {
+  while (s_used + bytes > s_budget || s_n >= MAP_FS_MAX_TILES) {
+    int32_t victim = -1;
+    for (uint16_t i = 0; i < s_n; i++)
+      if (s_idx[i].trip < s_trip && (victim < 0 || s_idx[i].trip < s_idx[victim].trip))
+        victim = i;
+    if (victim < 0)
+      return false;
+    remove_tile(s_idx[victim].key);
+  }
+  return true;
+}
+
+/* Viajes del índice; este arranque es el viaje guardado + 1 */
+static void load_index(void) {
+  File f = LittleFS.open(FS_INDEX, "r");
+  if (!f)
+    return;
+  uint32_t hdr[3];
+  if (f.read((uint8_t *)hdr, sizeof(hdr)) == sizeof(hdr) && hdr[0] == FS_MAGIC) {
+    s_trip = hdr[1] + 1;
+    fs_rec_t r;
+    for (uint32_t i = 0; i < hdr[2] && f.read((uint8_t *)&r, sizeof(r)) == sizeof(r); i++) {
+      bool found;
+      uint16_t at = idx_find(r.key, &found);
+      if (found)
+        s_idx[at].trip = r.trip;
+    }
+  }
+  f.close();
+}
+
+static void save_index(void) {
+  File f = LittleFS.open(FS_INDEX_TMP, "w");
+  if (!f)
+    return;
+  uint32_t hdr[3] = {FS_MAGIC, s_trip, s_n};
+  bool ok = f.write((const uint8_t *)hdr, sizeof(hdr)) == sizeof(hdr);
+  for (uint16_t i = 0; ok && i < s_n; i++) {
+    fs_rec_t r = {s_idx[i].key, s_idx[i].trip};
+    ok = f.write((const uint8_t *)&r, sizeof(r)) == sizeof(r);
+  }
+  f.close();
+  if (!ok) {
+    LittleFS.remove(FS_INDEX_TMP);
+    return;
+  }
+  LittleFS.remove(FS_INDEX);
+  LittleFS.rename(FS_INDEX_TMP, FS_INDEX);
+  s_dirty = false;
+}
+
+static int cmp_entry(const void *a, const void *b) {
+  uint64_t ka = ((const fs_entry_t *)a)->key, kb = ((const fs_entry_t *)b)->key;
+  return ka < kb ? -1 : ka > kb;
+}
+
+static bool mount(void) {
+  /* La primera vez formatea la partición: puede tardar unos segundos */
+  if (!LittleFS.begin(true, "/littlefs", 4, MAP_FS_LABEL)) {
+    Serial.println("[Maps] flash: no se pudo montar la partición " MAP_FS_LABEL);
+    return false;
+  }
+  s_budget = (uint32_t)((uint64_t)LittleFS.totalBytes() * (100 - FS_FREE_PCT) / 100);
+  if (!LittleFS.exists(FS_DIR))
+    LittleFS.mkdir(FS_DIR);
+
+  File dir = LittleFS.open(FS_DIR);
+  for (File f = dir.openNextFile(); f && s_n < MAP_FS_MAX_TILES; f = dir.openNextFile()) {
+    const char *name = strrchr(f.name(), '/');
+    name = name ? name + 1 : f.name();
+    uint64_t key = strtoull(name, nullptr, 16);
+    if ((key >> 63) && f.size() > 0) {
+      s_idx[s_n] = {key, on_flash(f.size()), 0};
+      s_used += s_idx[s_n].bytes;
+      s_n++;
+    }
+    f.close();
+  }
+  dir.close();
+  qsort(s_idx, s_n, sizeof(fs_entry_t), cmp_entry);
+  load_index();
+  Serial.printf("[Maps] flash: %u tiles, %lu de %lu KB, viaje %lu\n", s_n,
+                (unsigned long)(s_used / 1024), (unsigned long)(s_budget / 1024),
+                (unsigned long)s_trip);
+  return true;
+}
+
+/* ── Lectura ─────────────────────────────────────────────────────── */
+static size_t in_func(JDEC *jd, uint8_t *buf, size_t n) {
+  File *f = ((fs_dec_t *)jd->device)->f;
+  if (buf)
+    return f->read(buf, n);
+  return f->seek(n, SeekCur) ? n : 0;
+}
+
+static int out_func(JDEC *jd, void *bitmap, JRECT *rect) {
+  uint16_t *dst = ((fs_dec_t *)jd->device)->dst;
+  const uint16_t *src = (const uint16_t *)bitmap;
+  uint32_t bw = rect->right - rect->left + 1;
+  if (rect->left >= MAP_TILE_PX || rect->top >= MAP_TILE_PX)
+    return 1;
+  uint32_t w = rect->right < MAP_TILE_PX ? bw : MAP_TILE_PX - rect->left;
+  for (uint32_t y = rect->top; y <= rect->bottom && y < MAP_TILE_PX; y++)
+    memcpy(dst + y * MAP_TILE_PX + rect->left, src + (y - rect->top) * bw, w * 2);
+  return 1;
+}
+
+/* Decodifica el tile [key] a un slot de la caché de PSRAM */
+static void load_tile(uint64_t key) {
+  bool found;
+  uint16_t i = idx_find(key, &found);
+  if (!found)
+    return;
+  char path[32];
+  tile_path(path, sizeof(path), key);
+  File f = LittleFS.open(path, "r");
+  uint16_t *dst = f ? map_tiles_open(key) : nullptr;
+  if (!dst) {
+    /* Sin slot libre se vuelve a pedir en la próxima composición */
+    if (f)
+      f.close();
+    else
+      remove_tile(key);
+    return;
+  }
+  fs_dec_t dec = {&f, dst};
+  JDEC jd;
+  JRESULT r = jd_prepare(&jd, in_func, s_work, sizeof(s_work), &dec);
+  if (r == JDR_OK)
+    r = jd_decomp(&jd, out_func, 0);
+  f.close();
+  map_tiles_close(key, r == JDR_OK);
+  if (r != JDR_OK) {
+    Serial.printf("[Maps] flash: tile %016llx ilegible (%d), se borra\n",
+                  (unsigned long long)key, (int)r);
+    remove_tile(key);
+  } else if (s_idx[i].trip != s_trip) {
+    s_idx[i].trip = s_trip;
+    s_dirty = true;
+  }
+}
+
+static void load_requested(void) {
+  for (;;) {
+    portENTER_CRITICAL(&s_mux);
+    uint64_t key = 0;
+    if (s_n_req) {
+      key = s_req[0];
+      memmove(&s_req[0], &s_req[1], --s_n_req * sizeof(uint64_t));
+      s_loading = key;
+    }
+    portEXIT_CRITICAL(&s_mux);
+    if (!key)
+      break;
+    load_tile(key);
+    s_loading = 0;
+  }
+}
+
+/* ── Escritura ───────────────────────────────────────────────────── */
+static bool write_tile(uint64_t key, const uint8_t *data, uint32_t len) {
+  char path[32];
+  tile_path(path, sizeof(path), key);
+  File f = LittleFS.open(path, "w");
+  if (!f)
+    return false;
+  bool ok = f.write(data, len) == len;
+  f.close();
+  if (!ok) {
+    LittleFS.remove(path);
+    return false;
+  }
+  idx_insert(key, on_flash(len));
+  return true;
+}
+
+static void write_batch(void) {
+  uint32_t n = 0, bytes = 0, skipped = 0;
+  size_t len;
+  uint8_t *item;
+  while ((item = (uint8_t *)xRingbufferReceive(s_ring, &len, 0)) != nullptr) {
+    fs_pend_hdr_t h;
+    memcpy(&h, item, sizeof(h));
+    bool found;
+    idx_find(h.key, &found);
+    if (h.ok && !found) {
+      if (make_room(on_flash(h.len)) && write_tile(h.key, item + sizeof(h), h.len)) {
+        n++;
+        bytes += h.len;
+      } else {
+        skipped++;
+      }
+    }
+    vRingbufferReturnItem(s_ring, item);
+    portENTER_CRITICAL(&s_mux);
+    s_pend -= len;
+    portEXIT_CRITICAL(&s_mux);
+    /* Los pedidos de carga no esperan al lote entero */
+    load_requested();
+  }
+  if (n || s_dirty)
+    save_index();
+  if (n || skipped)
+    Serial.printf("[Maps] flash: %lu tiles guardados (%lu KB), %lu sin lugar; %u en total\n",
+                  (unsigned long)n, (unsigned long)(bytes / 1024), (unsigned long)skipped,
+                  s_n);
+}
+
+/* ── Task ────────────────────────────────────────────────────────── */
+static void fs_task(void *arg) {
+  (void)arg;
+  if (!mount()) {
+    s_dead = true;
+    s_task = nullptr;
+    vTaskDelete(nullptr);
+    return;
+  }
+  s_ready = true;
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(FS_POLL_MS));
+    load_requested();
+    /* A la mitad de la cola, sin tiles nuevos por un rato o al salir */
+    portENTER_CRITICAL(&s_mux);
+    uint32_t pend = s_pend;
+    portEXIT_CRITICAL(&s_mux);
+    bool idle = millis() - s_last_ms >= MAP_FS_IDLE_MS;
+    if (s_flush || pend >= MAP_FS_BATCH_BYTES / 2 || (idle && (pend || s_dirty))) {
+      s_flush = false;
+      write_batch();
+    }
+  }
+}
+
+/* ── API ─────────────────────────────────────────────────────────── */
+bool map_tiles_fs_init(void) {
+  if (s_task || s_ready)
+    return true;
+  if (s_dead)
+    return false;
+  if (!s_lock && !(s_lock = xSemaphoreCreateMutex()))
+    return false;
+  if (!s_idx)
+    s_idx = (fs_entry_t *)heap_caps_malloc(MAP_FS_MAX_TILES * sizeof(fs_entry_t),
+                                           MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!s_ring) {
+    uint8_t *storage = (uint8_t *)heap_caps_malloc(MAP_FS_BATCH_BYTES,
+                                                   MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (storage)
+      s_ring = xRingbufferCreateStatic(MAP_FS_BATCH_BYTES, RINGBUF_TYPE_NOSPLIT, storage,
+                                       &s_ring_ctl);
+  }
+  if (!s_idx || !s_ring) {
+    Serial.println("[Maps] flash: sin memoria para el índice o la cola");
+    return false;
+  }
+  if (xTaskCreatePinnedToCore(fs_task, "tilefs", FS_TASK_STACK, nullptr, FS_TASK_PRIO,
+                              &s_task, FS_TASK_CORE) != pdPASS) {
+    s_task = nullptr;
+    return false;
+  }
+  return true;
+}
+
+bool map_tiles_fs_ready(void) { return s_ready; }
+
+bool map_tiles_fs_has(uint64_t key) {
+  if (!s_ready)
+    return false;
+  bool found;
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  idx_find(key, &found);
+  xSemaphoreGive(s_lock);
+  return found;
+}
+
+void map_tiles_fs_feed(uint64_t key, size_t index, size_t total, const uint8_t *data,
+                       size_t len) {
+  if (!s_ring || s_dead)
+    return;
+  if (index == 0) {
+    /* Un tile anterior que no terminó: se completa marcado como cortado */
+    if (s_rx_item) {
+      xRingbufferSendComplete(s_ring, s_rx_item);
+      portENTER_CRITICAL(&s_mux);
+      s_pend += sizeof(fs_pend_hdr_t) + ((fs_pend_hdr_t *)s_rx_item)->len;
+      portEXIT_CRITICAL(&s_mux);
+    }
+    s_rx_item = nullptr;
+    void *p = nullptr;
+    if (total > MAP_FS_TILE_MAX ||
+        xRingbufferSendAcquire(s_ring, &p, sizeof(fs_pend_hdr_t) + total, 0) != pdTRUE)
+      return;
+    fs_pend_hdr_t h = {key, (uint32_t)total, false};
+    memcpy(p, &h, sizeof(h));
+    s_rx_item = (uint8_t *)p;
+  }
+  if (!s_rx_item || index + len > total)
+    return;
+  memcpy(s_rx_item + sizeof(fs_pend_hdr_t) + index, data, len);
+  if (index + len == total) {
+    ((fs_pend_hdr_t *)s_rx_item)->ok = true;
+    xRingbufferSendComplete(s_ring, s_rx_item);
+    portENTER_CRITICAL(&s_mux);
+    s_pend += sizeof(fs_pend_hdr_t) + total;
+    portEXIT_CRITICAL(&s_mux);
+    s_rx_item = nullptr;
+    s_last_ms = millis();
+    if (s_task)
+      xTaskNotifyGive(s_task);
+  }
+}
+
+uint8_t map_tiles_fs_claim(uint8_t z, maps_tile_xy_t *need, uint8_t n) {
+  if (!s_ready)
+    return n;
+  uint64_t keys[FS_LOAD_MAX];
+  uint8_t n_keys = 0, left = 0;
+  xSemaphoreTake(s_lock, portMAX_DELAY);
+  for (uint8_t i = 0; i < n; i++) {
+    uint64_t key = map_tile_key(z, need[i].x, need[i].y);
+    bool found;
+    idx_find(key, &found);
+    if (found && n_keys < FS_LOAD_MAX)
+      keys[n_keys++] = key;
+    else
+      need[left++] = need[i];
+  }
+  xSemaphoreGive(s_lock);
+  if (!n_keys)
+    return left;
+
+  portENTER_CRITICAL(&s_mux);
+  for (uint8_t i = 0; i < n_keys; i++) {
+    bool queued = keys[i] == s_loading;
+    for (uint8_t j = 0; j < s_n_req && !queued; j++)
+      queued = s_req[j] == keys[i];
+    if (!queued && s_n_req < FS_LOAD_MAX)
+      s_req[s_n_req++] = keys[i];
+  }
+  portEXIT_CRITICAL(&s_mux);
+  xTaskNotifyGive(s_task);
+  return left;
+}
+
+void map_tiles_fs_flush(void) {
+  if (!s_task)
+    return;
+  s_flush = true;
+  xTaskNotifyGive(s_task);
+}
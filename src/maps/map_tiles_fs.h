@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "maps_ws_server.h"
+
+/**
+ * Caché persistente de tiles raster (los JPEG de MAPS_BIN_TILE) en la
+ * partición LittleFS "tiles" de la flash (partitions_16MB.csv).
+ *
+ * Los tiles que llegan de la app se copian tal cual vienen, comprimidos, y
+ * se guardan uno por archivo. Antes de pedirle a la app lo que falta en la
+ * caché de PSRAM (map_tiles.h) se busca acá: lo que está se decodifica
+ * desde la flash y no cruza el enlace. Un recorrido repetido (el de todos
+ * los días) se compone desde el arranque sin tráfico.
+ *
+ * Escrituras: la flash se programa con la caché de instrucciones suspendida
+ * en los dos cores, así que los tiles se juntan en PSRAM y se escriben por
+ * lotes: cuando se llena la mitad de la cola (MAP_FS_BATCH_BYTES), cuando
+ * pasan MAP_FS_IDLE_MS sin tiles nuevos o al salir de la pantalla. Un tile
+ * que ya está no se reescribe y el índice (quién se usó en qué viaje) va
+ * una vez por lote.
+ * Lleno el presupuesto, se borran los tiles de los viajes más viejos.
+ *
+ * Montar (y formatear la primera vez), leer y escribir lo hace un task de
+ * prioridad baja: ni el task de red ni el hilo de LVGL tocan la flash.
+ */
+
+#define MAP_FS_LABEL       "tiles"         /* partición (partitions_16MB.csv) */
+#define MAP_FS_MAX_TILES   2048            /* tiles indexados (32 KB de PSRAM) */
+#define MAP_FS_TILE_MAX    (48 * 1024)     /* JPEG más grande que se guarda */
+#define MAP_FS_BATCH_BYTES (256 * 1024)    /* cola de escritura en PSRAM */
+#define MAP_FS_IDLE_MS     10000
+
+/** Arranca el task (monta la partición en segundo plano). */
+bool map_tiles_fs_init(void);
+
+/** true si la partición está montada e indexada. */
+bool map_tiles_fs_ready(void);
+
+/** true si el tile [key] (map_tile_key) está guardado. */
+bool map_tiles_fs_has(uint64_t key);
+
+/**
+ * Task de red: fragmento [data, len) en el offset [index] del JPEG de
+ * [total] bytes del tile [key], como jpeg_stream_feed. No bloquea: si la
+ * cola está llena el tile no se guarda.
+ */
+void map_tiles_fs_feed(uint64_t key, size_t index, size_t total, const uint8_t *data,
+                       size_t len);
+
+/**
+ * Hilo de LVGL: pide cargar desde la flash los tiles de [need] (zoom [z])
+ * que están guardados y los saca de la lista; devuelve cuántos quedan para
+ * pedirle a la app. Cada uno llega a la caché de PSRAM con map_tiles_close.
+ */
+uint8_t map_tiles_fs_claim(uint8_t z, maps_tile_xy_t *need, uint8_t n);
+
+/** Escribe lo pendiente y el índice sin esperar el lote (al salir). */
+void map_tiles_fs_flush(void);
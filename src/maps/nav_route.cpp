@@ -0,0 +1,309 @@
+/*
+ * Progreso sobre la ruta (ver nav_route.h).
+ *
+ * Las distancias de ajuste se comparan al cuadrado en unidades de mundo
+ * (float relativo al segmento, sin overflow); a metros se pasa solo al
+ * final, con la escala Mercator de la latitud del punto.
+ */
+#include "nav_route.h"
+#include "vec_proto.h"
+
+#include <math.h>
+#include <string.h>
+
+#define NAV_STACK 40
+
+/* Unidades de mundo por metro a la latitud de [y] (como dr_rebase en
+ * screen_map): 2^28 / ecuador · cosh(y Mercator) */
+static float units_per_m(int32_t y) {
+  float merc = (float)M_PI * (1.0f - 2.0f * (float)y / (float)(1 << 28));
+  return (float)(1 << 28) / 40075016.686f * coshf(merc);
+}
+
+static inline bool box_empty(const nav_box_t &b) { return b.x1 > b.x2; }
+
+static void box_add(nav_box_t &b, const vec_store_pt_t &p) {
+  if (p.x < b.x1) b.x1 = p.x;
+  if (p.x > b.x2) b.x2 = p.x;
+  if (p.y < b.y1) b.y1 = p.y;
+  if (p.y > b.y2) b.y2 = p.y;
+}
+
+static float box_d2(const nav_box_t &b, int32_t x, int32_t y) {
+  float dx = x < b.x1 ? (float)(b.x1 - x) : x > b.x2 ? (float)(x - b.x2) : 0.0f;
+  float dy = y < b.y1 ? (float)(b.y1 - y) : y > b.y2 ? (float)(y - b.y2) : 0.0f;
+  return dx * dx + dy * dy;
+}
+
+/* ── Ajuste a un segmento ────────────────────────────────────────── */
+struct nav_hit_t {
+  uint16_t seg;
+  float    t;  /* 0..1 sobre el segmento */
+  float    d2;
+};
+
+static void seg_test(const nav_route_t *r, uint16_t i, int32_t x, int32_t y, nav_hit_t *best) {
+  const vec_store_pt_t &a = r->pts[i], &b = r->pts[i + 1];
+  float dx = (float)(b.x - a.x), dy = (float)(b.y - a.y);
+  float ex = (float)(x - a.x), ey = (float)(y - a.y);
+  float len2 = dx * dx + dy * dy;
+  float t = len2 > 0 ? (ex * dx + ey * dy) / len2 : 0.0f;
+  if (t < 0) t = 0;
+  if (t > 1) t = 1;
+  float fx = ex - t * dx, fy = ey - t * dy;
+  float d2 = fx * fx + fy * fy;
+  if (d2 < best->d2) *best = {i, t, d2};
+}
+
+/* Segmento más cercano con índice >= [from]: recorre el árbol en
+ * profundidad, el hijo más cercano primero, y poda los nodos cuyo bbox ya
+ * está más lejos que el mejor. [best] puede traer una cota inicial. */
+static void search(const nav_route_t *r, int32_t x, int32_t y, uint16_t from, nav_hit_t *best) {
+  struct item_t { uint16_t node, lo, hi; }; /* hojas [lo, hi) */
+  item_t stack[NAV_STACK];
+  uint8_t sp = 0;
+  uint16_t n_seg = r->n_pts - 1;
+  stack[sp++] = {1, 0, r->n_leaves};
+  while (sp) {
+    item_t it = stack[--sp];
+    const nav_box_t &b = r->tree[it.node];
+    if (box_empty(b) || (uint32_t)it.hi * NAV_LEAF_SEGS <= from) continue;
+    if (box_d2(b, x, y) >= best->d2) continue;
+    if (it.node >= r->n_leaves) {
+      uint32_t s0 = (uint32_t)it.lo * NAV_LEAF_SEGS;
+      uint32_t s1 = s0 + NAV_LEAF_SEGS < n_seg ? s0 + NAV_LEAF_SEGS : n_seg;
+      for (uint32_t i = s0 > from ? s0 : from; i < s1; i++) seg_test(r, (uint16_t)i, x, y, best);
+      continue;
+    }
+    uint16_t mid = (it.lo + it.hi) / 2;
+    item_t a = {(uint16_t)(2 * it.node), it.lo, mid};
+    item_t c = {(uint16_t)(2 * it.node + 1), mid, it.hi};
+    if (box_d2(r->tree[a.node], x, y) > box_d2(r->tree[c.node], x, y)) {
+      item_t tmp = a;
+      a = c;
+      c = tmp;
+    }
+    if (sp + 2 > NAV_STACK) continue; /* no pasa: la profundidad es log2(hojas) */
+    stack[sp++] = c;
+    stack[sp++] = a; /* el más cercano sale primero */
+  }
+}
+
+static float along_m(const nav_route_t *r, const nav_hit_t &h) {
+  return r->cum_m[h.seg] + h.t * (r->cum_m[h.seg + 1] - r->cum_m[h.seg]);
+}
+
+/* ── Armado ──────────────────────────────────────────────────────── */
+
+/* Índices de los tramos de ruta del conjunto, ordenados por id */
+static uint16_t route_items(const vec_store_t *s, uint16_t *out) {
+  uint16_t n = 0;
+  for (uint16_t i = 0; i < s->n_items; i++) {
+    const vec_store_item_t &it = s->items[i];
+    if (!it.used || it.kind != MAPS_KIND_ROUTE) continue;
+    uint16_t k = n++;
+    while (k > 0 && s->items[out[k - 1]].id > it.id) {
+      out[k] = out[k - 1];
+      k--;
+    }
+    out[k] = i;
+  }
+  return n;
+}
+
+bool nav_route_begin(nav_route_t *r, map_arena_t *arena) {
+  memset(r, 0, sizeof(*r));
+  map_arena_reset(arena);
+  r->pts = (vec_store_pt_t *)map_arena_alloc(arena, NAV_ROUTE_MAX_PTS * sizeof(vec_store_pt_t));
+  r->cum_m = (float *)map_arena_alloc(arena, NAV_ROUTE_MAX_PTS * sizeof(float));
+  r->man = (nav_maneuver_t *)map_arena_alloc(arena,
+                                             VEC_STORE_MAX_MANEUVERS * sizeof(nav_maneuver_t));
+  return r->pts && r->cum_m && r->man;
+}
+
+void nav_route_append(nav_route_t *r, const vec_store_pt_t *pts, uint16_t n) {
+  if (!r->pts) return;
+  for (uint16_t j = 0; j < n && r->n_pts < NAV_ROUTE_MAX_PTS; j++) {
+    const vec_store_pt_t &p = pts[j];
+    if (r->n_pts && r->pts[r->n_pts - 1].x == p.x && r->pts[r->n_pts - 1].y == p.y) continue;
+    r->pts[r->n_pts++] = p;
+  }
+}
+
+bool nav_route_finish(nav_route_t *r, map_arena_t *arena, const vec_store_t *s) {
+  r->version = s->route_version;
+  if (!r->pts || !r->cum_m || !r->man || r->n_pts < 2) return false;
+
+  r->cum_m[0] = 0;
+  for (uint16_t i = 1; i < r->n_pts; i++) {
+    const vec_store_pt_t &a = r->pts[i - 1], &b = r->pts[i];
+    float dx = (float)(b.x - a.x), dy = (float)(b.y - a.y);
+    int32_t my = a.y + (b.y - a.y) / 2;
+    r->cum_m[i] = r->cum_m[i - 1] + sqrtf(dx * dx + dy * dy) / units_per_m(my);
+  }
+  r->len_m = r->cum_m[r->n_pts - 1];
+
+  /* Árbol: hojas de NAV_LEAF_SEGS segmentos, los nodos internos unen a sus hijos */
+  uint16_t n_seg = r->n_pts - 1;
+  uint16_t leaves = (n_seg + NAV_LEAF_SEGS - 1) / NAV_LEAF_SEGS;
+  r->n_leaves = 1;
+  while (r->n_leaves < leaves) r->n_leaves <<= 1;
+  r->tree = (nav_box_t *)map_arena_alloc(arena, 2 * r->n_leaves * sizeof(nav_box_t));
+  if (!r->tree) return false;
+  for (uint16_t l = 0; l < r->n_leaves; l++) {
+    nav_box_t &b = r->tree[r->n_leaves + l];
+    b = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+    uint32_t s0 = (uint32_t)l * NAV_LEAF_SEGS;
+    for (uint32_t i = s0; i < n_seg && i < s0 + NAV_LEAF_SEGS; i++) {
+      box_add(b, r->pts[i]);
+      box_add(b, r->pts[i + 1]);
+    }
+  }
+  for (uint16_t i = r->n_leaves - 1; i >= 1; i--) {
+    const nav_box_t &a = r->tree[2 * i], &c = r->tree[2 * i + 1];
+    nav_box_t &b = r->tree[i];
+    b = a;
+    if (!box_empty(c)) {
+      box_add(b, {c.x1, c.y1});
+      box_add(b, {c.x2, c.y2});
+    }
+  }
+
+  r->snap_x = r->pts[0].x;
+  r->snap_y = r->pts[0].y;
+  r->valid = true;
+  nav_route_maneuvers(r, s);
+  return true;
+}
+
+bool nav_route_build(nav_route_t *r, map_arena_t *arena, const vec_store_t *s) {
+  if (!nav_route_begin(r, arena)) {
+    r->version = s->route_version;
+    return false;
+  }
+  /* Polilínea: los tramos consecutivos comparten el extremo */
+  uint16_t order[VEC_STORE_MAX_ITEMS];
+  uint16_t n_items = route_items(s, order);
+  for (uint16_t k = 0; k < n_items; k++)
+    nav_route_append(r, s->items[order[k]].pts, s->items[order[k]].n);
+  return nav_route_finish(r, arena, s);
+}
+
+void nav_route_maneuvers(nav_route_t *r, const vec_store_t *s) {
+  r->version = s->route_version;
+  r->n_man = 0;
+  if (!r->valid) return;
+
+  /* Maniobras en orden de instrucción, cada una después de la anterior */
+  uint16_t from = 0;
+  for (;;) {
+    int32_t next = -1;
+    for (uint16_t i = 0; i < s->n_maneuvers; i++) {
+      const vec_store_maneuver_t &m = s->maneuvers[i];
+      if (!m.used || (r->n_man && m.id <= s->maneuvers[r->man[r->n_man - 1].slot].id)) continue;
+      if (next < 0 || m.id < s->maneuvers[next].id) next = i;
+    }
+    if (next < 0) break;
+    const vec_store_maneuver_t &m = s->maneuvers[next];
+    nav_hit_t h = {from, 0, INFINITY};
+    search(r, m.x, m.y, from, &h);
+    float at = along_m(r, h);
+    if (r->n_man && at < r->man[r->n_man - 1].at_m) at = r->man[r->n_man - 1].at_m;
+    r->man[r->n_man++] = {at, (uint16_t)next};
+    from = h.seg;
+  }
+
+  r->scale = 1.0f;
+  if (s->route_m && r->len_m > 1.0f) {
+    float k = (float)s->route_m / r->len_m;
+    if (k > 0.8f && k < 1.25f) r->scale = k; /* fuera de eso la ruta no es la misma */
+  }
+  r->route_s = s->route_s;
+}
+
+uint16_t nav_route_runs(const nav_route_t *r, const nav_box_t &q, uint16_t *out,
+                        uint16_t max) {
+  if (!r->valid) return 0;
+  struct item_t { uint16_t node, lo, hi; };
+  item_t stack[NAV_STACK];
+  uint8_t sp = 0;
+  uint16_t n = 0;
+  stack[sp++] = {1, 0, r->n_leaves};
+  while (sp && n < max) {
+    item_t it = stack[--sp];
+    const nav_box_t &b = r->tree[it.node];
+    if (box_empty(b) || b.x1 > q.x2 || b.x2 < q.x1 || b.y1 > q.y2 || b.y2 < q.y1) continue;
+    if (it.hi - it.lo <= NAV_RUN_LEAVES) {
+      out[n++] = it.lo / NAV_RUN_LEAVES;
+      continue;
+    }
+    uint16_t mid = (it.lo + it.hi) / 2;
+    if (sp + 2 > NAV_STACK) continue;
+    stack[sp++] = {(uint16_t)(2 * it.node + 1), mid, it.hi};
+    stack[sp++] = {(uint16_t)(2 * it.node), it.lo, mid}; /* en orden */
+  }
+  return n;
+}
+
+/* ── Seguimiento ─────────────────────────────────────────────────── */
+
+void nav_route_update(nav_route_t *r, const vec_store_t *s, int32_t x, int32_t y,
+                      uint32_t now_ms, nav_progress_t *out) {
+  if (!r->valid) return;
+  uint16_t n_seg = r->n_pts - 1;
+
+  /* Cerca del último segmento: alcanza casi siempre */
+  nav_hit_t h = {0, 0, INFINITY};
+  uint16_t lo = r->seg > 2 ? r->seg - 2 : 0;
+  uint16_t hi = r->seg + 2 * NAV_LEAF_SEGS < n_seg ? r->seg + 2 * NAV_LEAF_SEGS : n_seg;
+  for (uint16_t i = lo; i < hi; i++) seg_test(r, i, x, y, &h);
+  float upm = units_per_m(y);
+  float lim = NAV_LOCAL_M * upm;
+  if (h.d2 > lim * lim) search(r, x, y, 0, &h);
+  r->seg = h.seg;
+
+  const vec_store_pt_t &a = r->pts[h.seg], &b = r->pts[h.seg + 1];
+  r->snap_x = out->snap_x = a.x + (int32_t)lroundf(h.t * (float)(b.x - a.x));
+  r->snap_y = out->snap_y = a.y + (int32_t)lroundf(h.t * (float)(b.y - a.y));
+  float off = sqrtf(h.d2) / upm;
+  out->off_m = (uint32_t)off;
+
+  /* Fuera de ruta con histéresis: hay que pasarse un rato, y volver bien adentro */
+  if (off > NAV_OFF_ROUTE_M) {
+    if (!r->off_pending) {
+      r->off_pending = true;
+      r->off_since_ms = now_ms;
+    }
+    if (now_ms - r->off_since_ms >= NAV_OFF_ROUTE_MS) r->off_route = true;
+  } else if (off < NAV_OFF_ROUTE_M / 2) {
+    r->off_pending = false;
+    r->off_route = false;
+  }
+  out->off_route = r->off_route;
+
+  float at = along_m(r, h);
+  float remain = (r->len_m - at) * r->scale;
+  out->remain_m = (uint32_t)remain;
+  out->arrived = !r->off_route && remain < NAV_ARRIVE_M;
+  out->eta_s = r->route_s && r->len_m > 0
+                   ? (uint32_t)((float)r->route_s * (r->len_m - at) / r->len_m + 0.5f)
+                   : 0;
+
+  /* Próxima maniobra: la primera que queda a más de NAV_STEP_DONE_M */
+  float done = at + NAV_STEP_DONE_M / r->scale;
+  uint16_t l = 0, u = r->n_man;
+  while (l < u) {
+    uint16_t m = (l + u) / 2;
+    if (r->man[m].at_m > done)
+      u = m;
+    else
+      l = m + 1;
+  }
+  if (l < r->n_man) {
+    out->step = s->maneuvers[r->man[l].slot].text;
+    out->next_m = (uint32_t)((r->man[l].at_m - at) * r->scale);
+  } else {
+    out->step = r->n_man ? s->maneuvers[r->man[r->n_man - 1].slot].text : nullptr;
+    out->next_m = out->remain_m;
+  }
+}
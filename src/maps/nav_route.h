@@ -0,0 +1,132 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "map_arena.h"
+#include "vec_store.h"
+
+/**
+ * Progreso sobre la ruta, calculado en el ESP32 con la posición de cada
+ * render (no con los textos que manda la app en {"t":"nav"}).
+ *
+ * La polilínea sale de los tramos de ruta del conjunto (concatenados por
+ * id, sin repetir los extremos compartidos; se rearma cuando cambia
+ * vec_store_t.route_version) o de una ruta codificada que llega entera por
+ * MAPS_BIN_ROUTE (nav_route_begin / append / finish, ver route_poly.h).
+ * Guarda la distancia acumulada en metros por vértice y un árbol de bboxes
+ * sobre los segmentos (hojas de NAV_LEAF_SEGS, árbol binario completo
+ * implícito). Cada maniobra se proyecta sobre la ruta en orden, siempre
+ * hacia adelante de la anterior, así una ruta que vuelve por la misma calle
+ * no confunde los pasos.
+ *
+ * El render usa el mismo árbol para dibujar solo lo visible: la ruta se
+ * parte en tramos fijos de NAV_RUN_SEGS segmentos (nav_route_runs) y el
+ * punto ajustado la divide en recorrida y por recorrer.
+ *
+ * El ajuste de la posición busca primero cerca del último segmento (el
+ * caso normal: el vehículo avanza) y si queda lejos recorre el árbol
+ * podando por distancia al bbox, O(log n) en la práctica. La próxima
+ * maniobra sale de una búsqueda binaria sobre las distancias a lo largo.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host); la hora
+ * la pasa quien llama.
+ */
+
+#define NAV_ROUTE_MAX_PTS 16384
+#define NAV_LEAF_SEGS     8
+#define NAV_RUN_LEAVES    8 /* hojas por tramo de render */
+#define NAV_RUN_SEGS      (NAV_LEAF_SEGS * NAV_RUN_LEAVES)
+#define NAV_STEP_DONE_M   30 /* una maniobra a menos de esto ya se considera hecha */
+#define NAV_ARRIVE_M      30
+#define NAV_LOCAL_M       25 /* ajuste cerca del último segmento aceptado sin buscar más */
+#define NAV_OFF_ROUTE_M   60
+#define NAV_OFF_ROUTE_MS  3000 /* tiempo fuera de la tolerancia antes de avisar */
+
+/* Arena para la ruta más larga: puntos, distancias, árbol (las hojas se
+ * redondean a potencia de 2, así que a lo sumo 4× nodos) y maniobras */
+#define NAV_ROUTE_ARENA_BYTES                                                  \
+  (NAV_ROUTE_MAX_PTS * (sizeof(vec_store_pt_t) + sizeof(float)) +             \
+   4 * (NAV_ROUTE_MAX_PTS / NAV_LEAF_SEGS) * sizeof(nav_box_t) +              \
+   VEC_STORE_MAX_MANEUVERS * sizeof(nav_maneuver_t) + 64)
+
+struct nav_box_t {
+  int32_t x1, y1, x2, y2; /* x1 > x2: vacío */
+};
+
+struct nav_maneuver_t {
+  float    at_m; /* distancia a lo largo de la ruta */
+  uint16_t slot; /* índice en vec_store_t.maneuvers */
+};
+
+struct nav_route_t {
+  vec_store_pt_t *pts;
+  float          *cum_m; /* distancia acumulada hasta cada vértice */
+  nav_box_t      *tree;  /* nodos 1..2·n_leaves-1; hijos de i: 2i, 2i+1 */
+  nav_maneuver_t *man;   /* ordenadas por at_m */
+  uint16_t n_pts;
+  uint16_t n_leaves;     /* potencia de 2 */
+  uint16_t n_man;
+  float    len_m;
+  float    scale;        /* metros del ruteador / metros de la polilínea */
+  uint32_t route_s;
+  uint32_t version;      /* route_version con la que se armó */
+  bool     valid;
+
+  /* Seguimiento entre llamadas */
+  uint16_t seg;
+  int32_t  snap_x, snap_y; /* última posición ajustada (el inicio si no hubo) */
+  bool     off_route;
+  bool     off_pending;
+  uint32_t off_since_ms;
+};
+
+struct nav_progress_t {
+  const char *step;   /* instrucción de la próxima maniobra (nullptr: sin maniobras) */
+  uint32_t next_m;    /* hasta la próxima maniobra (o el destino) */
+  uint32_t remain_m;  /* hasta el destino */
+  uint32_t eta_s;     /* 0 si la app no mandó la duración */
+  uint32_t off_m;     /* distancia de la posición a la ruta */
+  int32_t  snap_x, snap_y;
+  bool     off_route; /* más de NAV_OFF_ROUTE_M durante NAV_OFF_ROUTE_MS */
+  bool     arrived;
+};
+
+/**
+ * Arma la ruta desde [s] con memoria de [arena] (se resetea). Devuelve
+ * false si no hay ruta (menos de dos puntos) o la arena no alcanza; en ese
+ * caso r->valid queda en false. r->version se actualiza igual.
+ */
+bool nav_route_build(nav_route_t *r, map_arena_t *arena, const vec_store_t *s);
+
+/**
+ * Armado por partes: begin vacía la ruta (queda inválida), append agrega
+ * puntos (lo que pasa de NAV_ROUTE_MAX_PTS se ignora) y finish calcula
+ * distancias, árbol y maniobras de [s]. finish devuelve lo mismo que
+ * nav_route_build. [pts] puede apuntar a r->pts + r->n_pts (puntos
+ * decodificados en el lugar).
+ */
+bool nav_route_begin(nav_route_t *r, map_arena_t *arena);
+void nav_route_append(nav_route_t *r, const vec_store_pt_t *pts, uint16_t n);
+bool nav_route_finish(nav_route_t *r, map_arena_t *arena, const vec_store_t *s);
+
+/**
+ * Vuelve a ubicar las maniobras y totales de [s] sin tocar la polilínea
+ * (cambiaron las maniobras pero la ruta es la misma).
+ */
+void nav_route_maneuvers(nav_route_t *r, const vec_store_t *s);
+
+/**
+ * Tramos de render (de NAV_RUN_SEGS segmentos: el k cubre los segmentos
+ * [k·NAV_RUN_SEGS, (k + 1)·NAV_RUN_SEGS)) cuyo bbox toca [q], en orden.
+ * Escribe a lo sumo [max] en [out] y devuelve cuántos.
+ */
+uint16_t nav_route_runs(const nav_route_t *r, const nav_box_t &q, uint16_t *out,
+                        uint16_t max);
+
+/**
+ * Ajusta la posición de mundo (x, y) a la ruta y completa [out]. Los
+ * textos apuntan a [s], que tiene que ser el mismo de nav_route_build.
+ * No hace nada si la ruta no es válida.
+ */
+void nav_route_update(nav_route_t *r, const vec_store_t *s, int32_t x, int32_t y,
+                      uint32_t now_ms, nav_progress_t *out);
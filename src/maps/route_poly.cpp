@@ -0,0 +1,82 @@
+/*
+ * Decoder de polilíneas codificadas (ver route_poly.h).
+ *
+ * y Mercator = 2^27 · (1 - atanh(sin φ) / π). Para la diferencia con la
+ * referencia se usa atanh(a) - atanh(b) = atanh((a - b) / (1 - a·b)) y
+ * sin φ - sin φ0 = 2 · cos((φ + φ0) / 2) · sin((φ - φ0) / 2): ninguna resta
+ * de números parecidos en float.
+ */
+#include "route_poly.h"
+
+#include <math.h>
+
+#define WORLD_SIZE (1LL << (VEC_WORLD_ZOOM + 8))
+
+static const int32_t POW10[ROUTE_POLY_MAX_PRECISION + 1] = {
+    1, 10, 100, 1000, 10000, 100000, 1000000, 10000000,
+};
+
+/* Un valor zig-zag; false si el texto se corta o trae bytes fuera de rango */
+static bool next_value(const uint8_t *&p, const uint8_t *end, int32_t *v) {
+  uint32_t acc = 0;
+  uint8_t shift = 0;
+  for (;;) {
+    if (p >= end || *p < 63 || *p > 126 || shift > 30)
+      return false;
+    uint32_t c = (uint32_t)(*p++ - 63);
+    acc |= (c & 0x1F) << shift;
+    shift += 5;
+    if (!(c & 0x20))
+      break;
+  }
+  *v = (int32_t)(acc >> 1) ^ -(int32_t)(acc & 1);
+  return true;
+}
+
+int32_t route_poly_decode(const uint8_t *s, size_t len, uint8_t precision,
+                          vec_store_pt_t *out, size_t cap) {
+  if (precision > ROUTE_POLY_MAX_PRECISION)
+    return -1;
+  const int64_t scale = POW10[precision];
+  const float rad = (float)(M_PI / 180.0) / (float)scale; /* punto fijo → radianes */
+  const float k = (float)(WORLD_SIZE / 2) / (float)M_PI;
+
+  const uint8_t *p = s, *end = s + len;
+  int32_t lat = 0, lon = 0;
+  int32_t lat0 = 0;
+  float sin0 = 0;
+  double y0 = 0;
+  size_t n = 0;
+  while (p < end) {
+    int32_t dlat, dlon;
+    if (!next_value(p, end, &dlat) || !next_value(p, end, &dlon))
+      return -1;
+    lat += dlat;
+    lon += dlon;
+    if (lat > 90 * scale || lat < -90 * scale || lon > 180 * scale || lon < -180 * scale)
+      return -1;
+    if (n >= cap)
+      continue;
+
+    int64_t x = ((int64_t)lon + 180 * scale) * WORLD_SIZE / (360 * scale);
+    double y;
+    if (n == 0) {
+      lat0 = lat;
+      double phi = (double)lat / (double)scale * M_PI / 180.0;
+      sin0 = (float)sin(phi);
+      y0 = (double)(WORLD_SIZE / 2) * (1.0 - atanh(sin(phi)) / M_PI);
+      y = y0;
+    } else {
+      float d = (float)(lat - lat0) * rad;
+      float mid = ((float)lat0 * rad + (float)lat * rad) * 0.5f;
+      float sin1 = sinf((float)lat * rad);
+      float df = atanhf(2.0f * cosf(mid) * sinf(d * 0.5f) / (1.0f - sin1 * sin0));
+      y = y0 - (double)(k * df);
+    }
+    if (x >= WORLD_SIZE) x = WORLD_SIZE - 1;
+    if (y < 0) y = 0;
+    if (y >= (double)WORLD_SIZE) y = (double)(WORLD_SIZE - 1);
+    out[n++] = {(int32_t)x, (int32_t)lround(y)};
+  }
+  return (int32_t)n;
+}
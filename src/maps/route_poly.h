@@ -0,0 +1,33 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "vec_store.h"
+
+/**
+ * Polilínea codificada (algoritmo de Google, el mismo de points_encoded en
+ * GraphHopper): cada punto es (lat, lon) en punto fijo con [precision]
+ * decimales, como diferencia con el anterior, en zig-zag y partida en grupos
+ * de 5 bits (el menos significativo primero) + 63, con 0x20 marcando que
+ * sigue otro grupo. Todo ASCII imprimible.
+ *
+ * Se decodifica directo a coordenadas de mundo (Web Mercator al zoom
+ * VEC_WORLD_ZOOM, ver vec_store.h). La x es exacta con enteros; la y sale
+ * de una referencia en double (el primer punto) más la diferencia Mercator
+ * con ella en float, con una fórmula que no pierde precisión en
+ * diferencias chicas: menos de una unidad de mundo de error y un par de
+ * operaciones float por punto en vez de log/tan en double.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+#define ROUTE_POLY_MAX_PRECISION 7
+
+/**
+ * Decodifica [s, len) a lo sumo [cap] puntos en [out]. Devuelve los puntos
+ * escritos, o -1 si el texto está corrupto o [precision] no es válida.
+ * Lo que no entra en [cap] se ignora.
+ */
+int32_t route_poly_decode(const uint8_t *s, size_t len, uint8_t precision,
+                          vec_store_pt_t *out, size_t cap);
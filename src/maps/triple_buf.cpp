@@ -0,0 +1,29 @@
+/*
+ * Triple buffer SPSC (ver triple_buf.h).
+ *
+ * Invariante: write, read y (mid & 3) son siempre los tres índices 0..2 en
+ * algún orden. Cada lado solo intercambia su índice con el del medio.
+ */
+#include "triple_buf.h"
+
+void tbuf_init(tbuf_t *b, void *s0, void *s1, void *s2) {
+  b->slot[0] = s0;
+  b->slot[1] = s1;
+  b->slot[2] = s2;
+  b->write = 0;
+  b->read = 1;
+  b->mid.store(2, std::memory_order_release);
+}
+
+void tbuf_publish(tbuf_t *b) {
+  /* release: lo escrito en el slot es visible antes que el índice */
+  uint32_t prev = b->mid.exchange(b->write | TBUF_FRESH, std::memory_order_acq_rel);
+  b->write = (uint8_t)(prev & 3);
+}
+
+void *tbuf_take(tbuf_t *b) {
+  if (!(b->mid.load(std::memory_order_acquire) & TBUF_FRESH)) return nullptr;
+  uint32_t prev = b->mid.exchange(b->read, std::memory_order_acq_rel);
+  b->read = (uint8_t)(prev & 3);
+  return b->slot[b->read];
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+/**
+ * Triple buffer lock-free para un productor y un consumidor (SPSC).
+ *
+ * Tres slots del mismo tipo: uno es del productor (lo llena en el lugar),
+ * otro del consumidor (lo lee sin copiar) y el tercero queda en el medio con
+ * el último valor publicado. Publicar y tomar son un intercambio atómico del
+ * índice del medio, así que ninguno bloquea ni ve un slot a medio escribir;
+ * si el productor publica dos veces antes de que el consumidor tome, el
+ * valor intermedio se pierde (siempre se lee el más nuevo).
+ *
+ * Los slots los reserva quien usa el buffer (PSRAM en el ESP32).
+ */
+
+#define TBUF_FRESH 0x4u /* bit en mid: el slot del medio no fue tomado */
+
+struct tbuf_t {
+  void                 *slot[3];
+  std::atomic<uint32_t> mid;   /* índice del slot del medio | TBUF_FRESH */
+  uint8_t               write; /* solo lo toca el productor */
+  uint8_t               read;  /* solo lo toca el consumidor */
+};
+
+void tbuf_init(tbuf_t *b, void *s0, void *s1, void *s2);
+
+/** Productor: slot donde escribir el próximo valor (siempre el mismo hasta publicar). */
+static inline void *tbuf_write_slot(tbuf_t *b) { return b->slot[b->write]; }
+
+/** Productor: publica el slot escrito y pasa a escribir en el que estaba en el medio. */
+void tbuf_publish(tbuf_t *b);
+
+/**
+ * Consumidor: el último valor publicado desde la toma anterior, o nullptr si
+ * no hay nada nuevo. El puntero vale hasta la próxima llamada.
+ */
+void *tbuf_take(tbuf_t *b);
+
+/** Consumidor: true si hay un valor publicado sin tomar. */
+static inline bool tbuf_pending(const tbuf_t *b) {
+  return b->mid.load(std::memory_order_acquire) & TBUF_FRESH;
+}
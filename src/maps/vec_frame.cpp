@@ -0,0 +1,172 @@
+/*
+ * Armado del frame vectorial (ver vec_frame.h).
+ *
+ *   mem: [pool de puntos →   ...libre...   ← registro de entradas]
+ *
+ * Cada entrada reserva al agregarse lo que va a ocupar en las tablas, así
+ * vec_frame_end nunca se queda sin lugar. El registro se recorre desde la
+ * entrada más nueva (la de dirección más baja), así que las tablas se
+ * llenan de atrás hacia adelante.
+ */
+#include "vec_frame.h"
+
+#include <string.h>
+
+#define POLY_ENTRY  ((uint32_t)sizeof(vec_poly_t))
+#define LABEL_ENTRY ((uint32_t)((sizeof(vec_label_t) + 3) & ~(size_t)3))
+#define POLY_TABLE  ((uint32_t)sizeof(vec_poly_t))
+#define LABEL_TABLE ((uint32_t)sizeof(uint32_t))
+
+/* ¿Entran [entry] bytes más de registro, [table] de tablas y [pts] puntos? */
+static bool fits(const vec_frame_t *f, uint32_t entry, uint32_t table, uint32_t pts) {
+  uint32_t need = (f->n_pts + pts) * (uint32_t)sizeof(vec_point_t) + f->reserve + table;
+  return f->log >= entry && need <= f->log - entry;
+}
+
+/* Descarta la polilínea abierta con los tramos ya cerrados si se partió:
+ * son las últimas entradas del registro */
+static void poly_drop(vec_frame_t *f, uint8_t kind) {
+  if (kind == VEC_FRAME_ROUTE) f->n_routes -= f->pieces;
+  else f->n_roads -= f->pieces;
+  f->n_pts = f->start_pts;
+  f->log = f->start_log;
+  f->reserve = f->start_reserve;
+  f->pieces = 0;
+  f->open = nullptr;
+}
+
+/* Abre un tramo de la polilínea en curso */
+static bool piece_begin(vec_frame_t *f, uint8_t kind, uint8_t w) {
+  if (!fits(f, POLY_ENTRY, POLY_TABLE, 0)) {
+    f->full = true;
+    return false;
+  }
+  f->log -= POLY_ENTRY;
+  f->reserve += POLY_TABLE;
+  f->open = (vec_poly_t *)(f->mem + f->log);
+  *f->open = {kind, (uint8_t)(w ? w : 1), 0, f->n_pts};
+  return true;
+}
+
+void vec_frame_init(vec_frame_t *f, void *mem, uint32_t cap) {
+  f->mem = (uint8_t *)mem;
+  f->cap = mem ? cap & ~3u : 0;
+  vec_frame_begin(f);
+}
+
+void vec_frame_begin(vec_frame_t *f) {
+  f->pts = (vec_point_t *)f->mem;
+  f->n_pts = 0;
+  f->roads = f->routes = nullptr;
+  f->label_off = nullptr;
+  f->n_roads = f->n_routes = f->n_labels = 0;
+  f->used = 0;
+  f->full = false;
+  f->pos_x = f->pos_y = 0;
+  f->heading = -1;
+  f->log = f->cap;
+  f->reserve = 0;
+  f->open = nullptr;
+  f->pieces = 0;
+}
+
+void vec_frame_poly_begin(vec_frame_t *f, uint8_t kind, uint8_t w) {
+  vec_frame_poly_end(f);
+  f->start_log = f->log;
+  f->start_reserve = f->reserve;
+  f->start_pts = f->n_pts;
+  f->pieces = 0;
+  piece_begin(f, kind, w);
+}
+
+void vec_frame_poly_width(vec_frame_t *f, uint8_t w) {
+  if (f->open) f->open->w = w ? w : 1;
+}
+
+void vec_frame_poly_add(vec_frame_t *f, vec_point_t p) {
+  if (!f->open) return;
+  if (f->open->n == VEC_FRAME_POLY_PTS) {
+    /* Se parte: la siguiente arranca en el último punto de esta */
+    vec_point_t last = f->pts[f->n_pts - 1];
+    uint8_t kind = f->open->kind, w = f->open->w;
+    if (kind == VEC_FRAME_ROUTE) f->n_routes++;
+    else f->n_roads++;
+    f->pieces++;
+    f->open = nullptr;
+    if (!piece_begin(f, kind, w)) {
+      poly_drop(f, kind);
+      return;
+    }
+    vec_frame_poly_add(f, last);
+    if (!f->open) return;
+  }
+  if (!fits(f, 0, 0, 1)) {
+    f->full = true;
+    poly_drop(f, f->open->kind);
+    return;
+  }
+  f->pts[f->n_pts++] = p;
+  f->open->n++;
+}
+
+void vec_frame_poly_end(vec_frame_t *f) {
+  if (!f->open) return;
+  if (f->open->n < 2) {
+    poly_drop(f, f->open->kind);
+    return;
+  }
+  if (f->open->kind == VEC_FRAME_ROUTE) f->n_routes++;
+  else f->n_roads++;
+  f->pieces = 0;
+  f->open = nullptr;
+}
+
+vec_label_t *vec_frame_label_add(vec_frame_t *f) {
+  vec_frame_poly_end(f);
+  if (!fits(f, LABEL_ENTRY, LABEL_TABLE, 0)) {
+    f->full = true;
+    return nullptr;
+  }
+  f->log -= LABEL_ENTRY;
+  f->reserve += LABEL_TABLE;
+  f->n_labels++;
+  vec_label_t *l = (vec_label_t *)(f->mem + f->log);
+  memset(l, 0, sizeof(*l));
+  l->kind = VEC_FRAME_LABEL;
+  return l;
+}
+
+void vec_frame_label_drop(vec_frame_t *f, vec_label_t *l) {
+  if (!l || (uint8_t *)l != f->mem + f->log) return;
+  f->log += LABEL_ENTRY;
+  f->reserve -= LABEL_TABLE;
+  f->n_labels--;
+}
+
+void vec_frame_end(vec_frame_t *f) {
+  vec_frame_poly_end(f);
+  uint32_t at = f->n_pts * (uint32_t)sizeof(vec_point_t);
+  vec_poly_t *roads = (vec_poly_t *)(f->mem + at);
+  at += f->n_roads * POLY_TABLE;
+  vec_poly_t *routes = (vec_poly_t *)(f->mem + at);
+  at += f->n_routes * POLY_TABLE;
+  uint32_t *label_off = (uint32_t *)(f->mem + at);
+  at += f->n_labels * LABEL_TABLE;
+
+  uint16_t r = f->n_roads, q = f->n_routes, k = f->n_labels;
+  for (uint32_t e = f->log; e < f->cap;) {
+    if (f->mem[e] == VEC_FRAME_LABEL) {
+      label_off[--k] = e;
+      e += LABEL_ENTRY;
+      continue;
+    }
+    const vec_poly_t &p = *(const vec_poly_t *)(f->mem + e);
+    if (p.kind == VEC_FRAME_ROUTE) routes[--q] = p;
+    else roads[--r] = p;
+    e += POLY_ENTRY;
+  }
+  f->roads = roads;
+  f->routes = routes;
+  f->label_off = label_off;
+  f->used = at + (f->cap - f->log);
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "maps_ws_server.h"
+
+/**
+ * Armado de vec_frame_t (ver maps_ws_server.h) sobre su bloque de memoria.
+ *
+ * Los puntos se agregan al pool desde el comienzo del bloque; cada calle,
+ * tramo de ruta o label deja una entrada en un registro que crece desde el
+ * final. vec_frame_end recorre el registro y deja las tablas (en orden de
+ * llegada) justo después del pool. Así el frame ocupa lo que trae y no hay
+ * topes por tipo: solo el tamaño del bloque.
+ *
+ * Las polilíneas se arman de a una (begin / add / end); empezar otra, un
+ * label o terminar el frame cierra la abierta. Una polilínea de más de
+ * VEC_FRAME_POLY_PTS puntos se parte en varias que comparten el extremo. Si
+ * algo no entra se descarta entero, con todos los tramos de una polilínea
+ * partida (no queda una calle a medias), y vec_frame_t.full queda en true.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+#define VEC_FRAME_ROAD  0
+#define VEC_FRAME_ROUTE 1
+#define VEC_FRAME_LABEL 2
+
+/** Asocia [mem] ([cap] bytes, alineado a 4) al frame. */
+void vec_frame_init(vec_frame_t *f, void *mem, uint32_t cap);
+
+/** Vacía el frame (geometría, posición y heading). */
+void vec_frame_begin(vec_frame_t *f);
+
+void vec_frame_poly_begin(vec_frame_t *f, uint8_t kind, uint8_t w);
+void vec_frame_poly_width(vec_frame_t *f, uint8_t w);
+void vec_frame_poly_add(vec_frame_t *f, vec_point_t p);
+/** Cierra la polilínea abierta; con menos de dos puntos se descarta. */
+void vec_frame_poly_end(vec_frame_t *f);
+
+/**
+ * Label nuevo (nombre vacío en (0, 0)) para completar, o nullptr si no
+ * entra. vec_frame_label_drop lo descarta si todavía es lo último agregado.
+ */
+vec_label_t *vec_frame_label_add(vec_frame_t *f);
+void vec_frame_label_drop(vec_frame_t *f, vec_label_t *l);
+
+/** Cierra lo abierto y arma las tablas. */
+void vec_frame_end(vec_frame_t *f);
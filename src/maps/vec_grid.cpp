@@ -0,0 +1,104 @@
+/*
+ * Grilla uniforme (ver vec_grid.h).
+ *
+ * Armado en dos pasadas: contar referencias por celda, sumas prefijas y
+ * repartir. Las celdas vacías no ocupan lugar en refs.
+ */
+#include "vec_grid.h"
+
+#include <string.h>
+
+static inline bool empty(const vec_grid_box_t &b) { return b.x1 > b.x2 || b.y1 > b.y2; }
+
+/* Celdas [c0, c1] × [r0, r1] que toca b; false si cae fuera de la grilla */
+static bool cell_range(const vec_grid_t *g, const vec_grid_box_t &b, int32_t &c0,
+                       int32_t &c1, int32_t &r0, int32_t &r1) {
+  int64_t x1 = ((int64_t)b.x1 - g->ox) >> g->shift;
+  int64_t x2 = ((int64_t)b.x2 - g->ox) >> g->shift;
+  int64_t y1 = ((int64_t)b.y1 - g->oy) >> g->shift;
+  int64_t y2 = ((int64_t)b.y2 - g->oy) >> g->shift;
+  if (x2 < 0 || y2 < 0 || x1 >= g->cols || y1 >= g->rows) return false;
+  c0 = x1 < 0 ? 0 : (int32_t)x1;
+  r0 = y1 < 0 ? 0 : (int32_t)y1;
+  c1 = x2 >= g->cols ? g->cols - 1 : (int32_t)x2;
+  r1 = y2 >= g->rows ? g->rows - 1 : (int32_t)y2;
+  return true;
+}
+
+bool vec_grid_build(vec_grid_t *g, map_arena_t *arena, const vec_grid_box_t *boxes,
+                    uint16_t n) {
+  memset(g, 0, sizeof(*g));
+  g->n_entries = n;
+
+  vec_grid_box_t ext = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+  for (uint16_t i = 0; i < n; i++) {
+    if (empty(boxes[i])) continue;
+    if (boxes[i].x1 < ext.x1) ext.x1 = boxes[i].x1;
+    if (boxes[i].y1 < ext.y1) ext.y1 = boxes[i].y1;
+    if (boxes[i].x2 > ext.x2) ext.x2 = boxes[i].x2;
+    if (boxes[i].y2 > ext.y2) ext.y2 = boxes[i].y2;
+  }
+  if (empty(ext)) return true;
+
+  int64_t w = (int64_t)ext.x2 - ext.x1, h = (int64_t)ext.y2 - ext.y1;
+  uint8_t shift = 0;
+  while ((w >> shift) >= VEC_GRID_MAX_DIM || (h >> shift) >= VEC_GRID_MAX_DIM) shift++;
+
+  uint32_t cells = (uint32_t)(((w >> shift) + 1) * ((h >> shift) + 1));
+  uint32_t *start = (uint32_t *)map_arena_alloc(arena, (cells + 1) * sizeof(uint32_t));
+  if (!start) return false;
+  memset(start, 0, (cells + 1) * sizeof(uint32_t));
+  g->ox = ext.x1;
+  g->oy = ext.y1;
+  g->shift = shift;
+  g->cols = (uint16_t)((w >> shift) + 1);
+  g->rows = (uint16_t)((h >> shift) + 1);
+
+  /* Pasada 1: referencias por celda (en start[celda + 1]) */
+  int32_t c0, c1, r0, r1;
+  for (uint16_t i = 0; i < n; i++) {
+    if (empty(boxes[i]) || !cell_range(g, boxes[i], c0, c1, r0, r1)) continue;
+    for (int32_t r = r0; r <= r1; r++)
+      for (int32_t c = c0; c <= c1; c++) start[r * g->cols + c + 1]++;
+  }
+  for (uint32_t c = 0; c < cells; c++) start[c + 1] += start[c];
+
+  uint16_t *refs = (uint16_t *)map_arena_alloc(arena, start[cells] * sizeof(uint16_t), 2);
+  if (!refs && start[cells] > 0) {
+    g->cols = g->rows = 0;
+    return false;
+  }
+
+  /* Pasada 2: repartir usando start[celda] como cursor; al terminar cada
+   * cursor quedó en el inicio de la celda siguiente, se corre uno */
+  for (uint16_t i = 0; i < n; i++) {
+    if (empty(boxes[i]) || !cell_range(g, boxes[i], c0, c1, r0, r1)) continue;
+    for (int32_t r = r0; r <= r1; r++)
+      for (int32_t c = c0; c <= c1; c++) refs[start[r * g->cols + c]++] = i;
+  }
+  for (uint32_t c = cells; c > 0; c--) start[c] = start[c - 1];
+  start[0] = 0;
+
+  g->start = start;
+  g->refs = refs;
+  g->n_refs = start[cells];
+  return true;
+}
+
+void vec_grid_query(const vec_grid_t *g, const vec_grid_box_t *boxes,
+                    const vec_grid_box_t &q, uint32_t *bits) {
+  int32_t c0, c1, r0, r1;
+  if (!g->cols || empty(q) || !cell_range(g, q, c0, c1, r0, r1)) return;
+  for (int32_t r = r0; r <= r1; r++) {
+    for (int32_t c = c0; c <= c1; c++) {
+      uint32_t cell = r * g->cols + c;
+      for (uint32_t k = g->start[cell]; k < g->start[cell + 1]; k++) {
+        uint16_t i = g->refs[k];
+        if (vec_grid_test(bits, i)) continue;
+        const vec_grid_box_t &b = boxes[i];
+        if (b.x1 <= q.x2 && q.x1 <= b.x2 && b.y1 <= q.y2 && q.y1 <= b.y2)
+          bits[i >> 5] |= 1u << (i & 31);
+      }
+    }
+  }
+}
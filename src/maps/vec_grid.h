@@ -0,0 +1,57 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "map_arena.h"
+
+/**
+ * Índice espacial de grilla uniforme sobre bboxes en coordenadas de mundo.
+ *
+ * Se arma de una vez (cuando cambia la geometría, no por frame) en una
+ * arena: la grilla cubre el bbox de todas las entradas con celdas de 2^shift
+ * unidades y a lo sumo VEC_GRID_MAX_DIM por eje, y cada celda lista en forma
+ * compacta (CSR) las entradas cuyo bbox la toca. Una consulta por rectángulo
+ * visita solo las celdas que toca y devuelve un bitset por índice de entrada,
+ * sin duplicados y ya en orden.
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+#define VEC_GRID_MAX_DIM 64
+
+/* Palabras de 32 bits de un bitset de [n] entradas */
+#define VEC_GRID_WORDS(n) (((n) + 31) / 32)
+
+/* Rectángulo inclusivo; x1 > x2 marca una entrada vacía (no se indexa) */
+struct vec_grid_box_t {
+  int32_t x1, y1, x2, y2;
+};
+
+struct vec_grid_t {
+  int32_t   ox, oy; /* esquina de la celda (0, 0) */
+  uint8_t   shift;  /* lado de la celda: 2^shift unidades */
+  uint16_t  cols, rows;
+  uint32_t *start;  /* cols·rows + 1 offsets en refs */
+  uint16_t *refs;   /* índices de entrada */
+  uint32_t  n_refs;
+  uint16_t  n_entries;
+};
+
+/**
+ * Arma el índice de [n] bboxes con memoria de [arena]. [boxes] tiene que
+ * seguir vivo para las consultas. Devuelve false si la arena no alcanza
+ * (el índice queda vacío).
+ */
+bool vec_grid_build(vec_grid_t *g, map_arena_t *arena, const vec_grid_box_t *boxes,
+                    uint16_t n);
+
+/**
+ * Marca en [bits] (VEC_GRID_WORDS(n) palabras, a limpiar por quien llama)
+ * las entradas cuyo bbox toca [r].
+ */
+void vec_grid_query(const vec_grid_t *g, const vec_grid_box_t *boxes,
+                    const vec_grid_box_t &r, uint32_t *bits);
+
+static inline bool vec_grid_test(const uint32_t *bits, uint16_t i) {
+  return bits[i >> 5] & (1u << (i & 31));
+}
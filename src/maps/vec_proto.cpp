@@ -0,0 +1,131 @@
+/*
+ * Decoder del protocolo binario de mapas (ver vec_proto.h).
+ *
+ * Lectura secuencial con un cursor acotado (maps_bin_rd_t): el chequeo de
+ * error se hace una sola vez al final de cada bloque.
+ */
+#include "vec_proto.h"
+#include "vec_frame.h"
+
+#include <string.h>
+
+/* ── Cursor de lectura ───────────────────────────────────────────── */
+uint8_t maps_bin_rd_u8(maps_bin_rd_t &r) {
+  if (r.p >= r.end) { r.ok = false; return 0; }
+  return *r.p++;
+}
+
+uint32_t maps_bin_rd_varint(maps_bin_rd_t &r) {
+  uint32_t v = 0;
+  for (uint8_t shift = 0; shift < 35; shift += 7) {
+    if (r.p >= r.end) { r.ok = false; return 0; }
+    uint8_t b = *r.p++;
+    v |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) return v;
+  }
+  r.ok = false; /* varint de más de 5 bytes */
+  return 0;
+}
+
+int32_t maps_bin_rd_zz(maps_bin_rd_t &r) {
+  uint32_t v = maps_bin_rd_varint(r);
+  return (int32_t)(v >> 1) ^ -(int32_t)(v & 1);
+}
+
+static int16_t clamp16(int32_t v) {
+  if (v > INT16_MAX) return INT16_MAX;
+  if (v < INT16_MIN) return INT16_MIN;
+  return (int16_t)v;
+}
+
+/* Punto delta-codificado respecto del cursor [cx, cy] */
+static vec_point_t rd_point(maps_bin_rd_t &r, int32_t &cx, int32_t &cy) {
+  cx += maps_bin_rd_zz(r);
+  cy += maps_bin_rd_zz(r);
+  return { clamp16(cx), clamp16(cy) };
+}
+
+/* ── Cabecera ────────────────────────────────────────────────────── */
+bool maps_bin_is_proto(const uint8_t *data, size_t len) {
+  return data && len >= 1 && data[0] == MAPS_BIN_MAGIC;
+}
+
+bool maps_bin_parse_hdr(const uint8_t *data, size_t len, maps_bin_hdr_t *hdr) {
+  if (!data || len < MAPS_BIN_HDR_LEN || data[0] != MAPS_BIN_MAGIC) return false;
+  if (data[1] != MAPS_BIN_VERSION) return false;
+  hdr->version = data[1];
+  hdr->type    = data[2];
+  hdr->flags   = data[3];
+  hdr->seq     = (uint16_t)(data[4] | (data[5] << 8));
+  hdr->len     = MAPS_BIN_HDR_LEN;
+  hdr->t_phone = 0;
+  if (hdr->flags & MAPS_BIN_FLAG_TS) {
+    if (len < MAPS_BIN_HDR_LEN + 4u) return false;
+    const uint8_t *t = data + MAPS_BIN_HDR_LEN;
+    hdr->t_phone = (uint32_t)t[0] | ((uint32_t)t[1] << 8) | ((uint32_t)t[2] << 16) |
+                   ((uint32_t)t[3] << 24);
+    hdr->len += 4;
+  }
+  return true;
+}
+
+/* ── Tile raster ─────────────────────────────────────────────────── */
+size_t maps_bin_parse_tile(const uint8_t *payload, size_t len, uint8_t *z, uint32_t *x,
+                           uint32_t *y) {
+  if (!payload) return 0;
+  maps_bin_rd_t r = { payload, payload + len, true };
+  *z = maps_bin_rd_u8(r);
+  *x = maps_bin_rd_varint(r);
+  *y = maps_bin_rd_varint(r);
+  if (!r.ok || *z > 20 || *x >= (1u << *z) || *y >= (1u << *z)) return 0;
+  return (size_t)(r.p - payload);
+}
+
+/* ── Frame vectorial ─────────────────────────────────────────────── */
+bool maps_bin_decode_vec(const uint8_t *payload, size_t len, vec_frame_t *frame) {
+  if (!payload || !frame) return false;
+
+  maps_bin_rd_t r = { payload, payload + len, true };
+  int32_t cx = 0, cy = 0;
+  vec_frame_t &f = *frame;
+  vec_frame_begin(&f);
+
+  /* Calles */
+  uint32_t n_roads = maps_bin_rd_varint(r);
+  for (uint32_t i = 0; i < n_roads && r.ok; i++) {
+    uint8_t  w = maps_bin_rd_u8(r);
+    uint32_t n = maps_bin_rd_varint(r);
+    vec_frame_poly_begin(&f, VEC_FRAME_ROAD, w);
+    for (uint32_t j = 0; j < n && r.ok; j++) vec_frame_poly_add(&f, rd_point(r, cx, cy));
+    vec_frame_poly_end(&f);
+  }
+
+  /* Ruta */
+  uint32_t n_route = maps_bin_rd_varint(r);
+  vec_frame_poly_begin(&f, VEC_FRAME_ROUTE, 0);
+  for (uint32_t i = 0; i < n_route && r.ok; i++) vec_frame_poly_add(&f, rd_point(r, cx, cy));
+  vec_frame_poly_end(&f);
+
+  /* Nombres de calles */
+  uint32_t n_labels = maps_bin_rd_varint(r);
+  for (uint32_t i = 0; i < n_labels && r.ok; i++) {
+    vec_point_t pt = rd_point(r, cx, cy);
+    uint8_t n = maps_bin_rd_u8(r);
+    if ((size_t)(r.end - r.p) < n) { r.ok = false; break; }
+    vec_label_t *l = vec_frame_label_add(&f);
+    if (l) {
+      l->x = pt.x;
+      l->y = pt.y;
+      maps_copy_str(l->name, sizeof(l->name), (const char *)r.p, n);
+    }
+    r.p += n;
+  }
+  vec_frame_end(&f);
+
+  /* Posición (absoluta) */
+  f.pos_x   = clamp16(maps_bin_rd_zz(r));
+  f.pos_y   = clamp16(maps_bin_rd_zz(r));
+  f.heading = clamp16(maps_bin_rd_zz(r));
+
+  return r.ok;
+}
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "maps_ws_server.h"
+
+/**
+ * Protocolo binario de mapas (mensajes WS_BINARY).
+ *
+ * Cabecera común (6 bytes):
+ *   [0]    MAPS_BIN_MAGIC (0xA5). Un JPEG empieza con 0xFF 0xD8, así que el
+ *          primer byte alcanza para distinguirlo del tile legacy.
+ *   [1]    versión del protocolo (MAPS_BIN_VERSION)
+ *   [2]    tipo de mensaje (maps_bin_type_t)
+ *   [3]    flags (MAPS_BIN_FLAG_*)
+ *   [4..5] número de secuencia, uint16 little-endian
+ *   Con MAPS_BIN_FLAG_TS siguen 4 bytes: uint32 LE con la hora del fix GPS
+ *   en ms del reloj del celular (ver map_latency.h); el payload empieza
+ *   después (maps_bin_hdr_t.len).
+ *   Con MAPS_BIN_FLAG_HS el payload (no la cabecera) va comprimido en
+ *   formato heatshrink (hs_decode.h); el receptor lo descomprime antes de
+ *   parsearlo. No se usa con MAPS_BIN_TILE.
+ *
+ * Payload MAPS_BIN_VEC (equivalente al JSON {"t":"vec",...}):
+ *   varint n_roads
+ *     por calle: u8 w, varint n, n × punto
+ *   varint n_route, n_route × punto
+ *   varint n_labels
+ *     por label: punto, u8 len, len bytes UTF-8 (sin null)
+ *   zz pos_x, zz pos_y, zz heading
+ *
+ * Cada "punto" son dos zig-zag varints (dx, dy) relativos al punto anterior
+ * del mensaje (calles, ruta y labels comparten el cursor, que arranca en 0,0).
+ *
+ * Payload MAPS_BIN_DELTA (operaciones sobre el conjunto persistente de
+ * calles/ruta/labels del ESP32, ver vec_store.h):
+ *   u8 flags (MAPS_DELTA_RESET: vaciar el conjunto antes de aplicar)
+ *   zz pos_x, zz pos_y   posición del vehículo en coordenadas de mundo
+ *   zz heading           grados, -1 si no disponible
+ *   u8 zoom              zoom de la vista (el ESP32 proyecta con él)
+ *   varint n_ops, n_ops × op:
+ *     MAPS_OP_ROAD   varint id, u8 w, varint n, n × punto   (alta o reemplazo)
+ *     MAPS_OP_ROUTE  varint id, varint n, n × punto         (tramo de ruta)
+ *     MAPS_OP_LABEL  varint id, punto, u8 len, len bytes
+ *     MAPS_OP_REMOVE u8 kind, varint id
+ *     MAPS_OP_CLEAR  u8 kind                                (todos los de ese tipo)
+ *     MAPS_OP_MANEUVER   varint id, punto, u8 len, len bytes (instrucción)
+ *     MAPS_OP_ROUTE_INFO varint metros, varint segundos      (totales de la ruta)
+ *   En las operaciones el cursor de puntos arranca en (pos_x, pos_y).
+ *   Las coordenadas de mundo son Web Mercator en punto fijo: píxeles al zoom
+ *   VEC_WORLD_ZOOM (ver vec_store.h), independientes de la vista, así que un
+ *   cambio de zoom o de posición no obliga a reenviar geometría.
+ *   Los tramos de ruta van en orden de id y comparten extremos; las
+ *   maniobras (una por instrucción, en su punto de la ruta) y los totales
+ *   solo los manda una app que vio la capacidad "nav": con ellos el ESP32
+ *   calcula el progreso sobre la ruta (nav_route.h). Un MAPS_OP_CLEAR de
+ *   MAPS_KIND_ROUTE borra también los totales.
+ *
+ * Payload MAPS_BIN_TILE (tile raster de 256×256, ver map_tiles.h):
+ *   u8 z, varint x, varint y, bytes JPEG hasta el final del mensaje
+ *   La posición y el zoom de la vista siguen llegando por MAPS_BIN_DELTA
+ *   (sin operaciones); el ESP32 pide los tiles que le faltan con
+ *   {"t":"tiles","z":Z,"need":[[x,y],...]}. El JPEG no se ensambla: se
+ *   decodifica a medida que llegan los fragmentos (jpeg_stream.h).
+ *
+ * Payload MAPS_BIN_ROUTE (ruta completa, una vez por ruta; capacidad "route"):
+ *   varint id        distinto en cada ruta nueva; 0 = sin ruta
+ *   varint total     puntos de la ruta completa
+ *   varint first     índice del primer punto de esta parte
+ *   u8 precision     decimales del punto fijo (5 o 6, como points_encoded)
+ *   polilínea codificada (lat, lon) hasta el final del mensaje (route_poly.h)
+ *   Una ruta larga se parte en varios mensajes consecutivos (a lo sumo
+ *   MAPS_ROUTE_PART_MAX bytes cada uno); cada parte arranca la polilínea de
+ *   cero, así se decodifica sola. Con esta ruta la app ya no manda
+ *   MAPS_OP_ROUTE: las maniobras y totales siguen llegando por los deltas.
+ *
+ * Payload MAPS_BIN_CLOCK (respuesta a {"t":"ping","d":ms}):
+ *   varint d (el del ping), varint hora del celular en ms (uint32)
+ *
+ * Payload MAPS_BIN_LAT (pedido de histogramas de latencia):
+ *   u8 flags (MAPS_LAT_RESET: vaciarlos después de mandarlos)
+ *   El ESP32 responde {"t":"lat",...} (lat_to_json).
+ */
+
+#define MAPS_BIN_MAGIC   0xA5
+#define MAPS_BIN_VERSION 1
+#define MAPS_BIN_HDR_LEN 6
+
+typedef enum {
+  MAPS_BIN_VEC   = 1, /* frame vectorial completo */
+  MAPS_BIN_DELTA = 2, /* operaciones sobre el conjunto persistente */
+  MAPS_BIN_TILE  = 3, /* tile raster z/x/y (JPEG) */
+  MAPS_BIN_CLOCK = 4, /* respuesta a un ping de reloj */
+  MAPS_BIN_LAT   = 5, /* pedido de histogramas de latencia */
+  MAPS_BIN_ROUTE = 6, /* ruta completa codificada (polilínea) */
+} maps_bin_type_t;
+
+#define MAPS_BIN_FLAG_TS 0x01 /* la cabecera trae la hora del fix */
+#define MAPS_BIN_FLAG_HS 0x02 /* payload comprimido (heatshrink) */
+
+#define MAPS_DELTA_RESET 0x01
+#define MAPS_LAT_RESET   0x01
+
+#define MAPS_ROUTE_PART_MAX (16 * 1024) /* una parte entra entera en la cola de deltas */
+
+typedef enum {
+  MAPS_OP_ROAD   = 1,
+  MAPS_OP_ROUTE  = 2,
+  MAPS_OP_LABEL  = 3,
+  MAPS_OP_REMOVE = 4,
+  MAPS_OP_CLEAR  = 5,
+  MAPS_OP_MANEUVER   = 6,
+  MAPS_OP_ROUTE_INFO = 7,
+} maps_op_t;
+
+typedef enum {
+  MAPS_KIND_ROAD  = 0,
+  MAPS_KIND_ROUTE = 1,
+  MAPS_KIND_LABEL = 2,
+  MAPS_KIND_MANEUVER = 3,
+} maps_kind_t;
+
+struct maps_bin_hdr_t {
+  uint8_t  version;
+  uint8_t  type;
+  uint8_t  flags;
+  uint16_t seq;
+  uint8_t  len;     /* cabecera completa: MAPS_BIN_HDR_LEN (+4 con TS) */
+  uint32_t t_phone; /* hora del fix (ms, reloj del celular) si MAPS_BIN_FLAG_TS */
+};
+
+/* ── Lectura secuencial acotada ──────────────────────────────────
+ * Cualquier lectura fuera de rango marca el cursor como inválido (ok=false)
+ * y las siguientes devuelven 0: el error se chequea una vez por bloque. */
+struct maps_bin_rd_t {
+  const uint8_t *p;
+  const uint8_t *end;
+  bool ok;
+};
+
+uint8_t  maps_bin_rd_u8(maps_bin_rd_t &r);
+uint32_t maps_bin_rd_varint(maps_bin_rd_t &r);
+int32_t  maps_bin_rd_zz(maps_bin_rd_t &r);
+
+/** Copia [len] bytes de texto a [dst] ([cap] con el '\0') truncando sin
+ *  partir un carácter UTF-8 multibyte. */
+static inline void maps_copy_str(char *dst, size_t cap, const char *src, size_t len) {
+  if (len >= cap) {
+    len = cap - 1;
+    while (len > 0 && ((uint8_t)src[len] & 0xC0) == 0x80) len--;
+  }
+  memcpy(dst, src, len);
+  dst[len] = '\0';
+}
+
+/** true si el mensaje empieza con la cabecera del protocolo binario. */
+bool maps_bin_is_proto(const uint8_t *data, size_t len);
+
+/**
+ * Lee la cabecera. Devuelve false si falta la magia, la versión no se
+ * soporta o el mensaje no alcanza para la cabecera extendida.
+ */
+bool maps_bin_parse_hdr(const uint8_t *data, size_t len, maps_bin_hdr_t *hdr);
+
+/**
+ * Lee la cabecera z/x/y de un MAPS_BIN_TILE al comienzo de [payload] (que
+ * puede ser solo el primer fragmento). Devuelve los bytes que ocupa, o 0 si
+ * no entra o está fuera de rango.
+ */
+size_t maps_bin_parse_tile(const uint8_t *payload, size_t len, uint8_t *z, uint32_t *x,
+                           uint32_t *y);
+
+/**
+ * Decodifica el payload de un MAPS_BIN_VEC directamente sobre [frame]
+ * (vec_frame.h, en su propio bloque). Lo que no entre en el bloque se
+ * consume y se descarta (frame->full). Devuelve false si el payload está
+ * truncado o corrupto.
+ */
+bool maps_bin_decode_vec(const uint8_t *payload, size_t len, vec_frame_t *frame);
@@ -0,0 +1,363 @@
+/*
+ * Conjunto persistente de geometría del mapa (ver vec_store.h).
+ *
+ * Los slots se buscan por (kind, id) con un recorrido lineal: las
+ * operaciones por frame son pocas y un RESET completo (cientos de altas)
+ * sigue costando menos de un milisegundo.
+ *
+ * La importancia de los vértices se calcula al dar de alta cada polilínea
+ * (Douglas–Peucker con una pila explícita, a lo sumo VEC_STORE_ITEM_PTS
+ * puntos), así el render solo compara un byte por vértice.
+ */
+#include "vec_store.h"
+#include "vec_proto.h"
+
+#include <string.h>
+
+/* ── Búsqueda de slots ───────────────────────────────────────────── */
+static vec_store_item_t *find_item(vec_store_t *s, uint8_t kind, uint16_t id) {
+  for (uint16_t i = 0; i < s->n_items; i++) {
+    vec_store_item_t &it = s->items[i];
+    if (it.used && it.kind == kind && it.id == id) return &it;
+  }
+  return nullptr;
+}
+
+static vec_store_item_t *alloc_item(vec_store_t *s) {
+  for (uint16_t i = 0; i < s->n_items; i++)
+    if (!s->items[i].used) return &s->items[i];
+  if (s->n_items < VEC_STORE_MAX_ITEMS) return &s->items[s->n_items++];
+  return nullptr;
+}
+
+static vec_store_label_t *find_label(vec_store_t *s, uint16_t id) {
+  for (uint16_t i = 0; i < s->n_labels; i++)
+    if (s->labels[i].used && s->labels[i].id == id) return &s->labels[i];
+  return nullptr;
+}
+
+static vec_store_label_t *alloc_label(vec_store_t *s) {
+  for (uint16_t i = 0; i < s->n_labels; i++)
+    if (!s->labels[i].used) return &s->labels[i];
+  if (s->n_labels < VEC_STORE_MAX_LABELS) return &s->labels[s->n_labels++];
+  return nullptr;
+}
+
+static vec_store_maneuver_t *find_maneuver(vec_store_t *s, uint16_t id) {
+  for (uint16_t i = 0; i < s->n_maneuvers; i++)
+    if (s->maneuvers[i].used && s->maneuvers[i].id == id) return &s->maneuvers[i];
+  return nullptr;
+}
+
+static vec_store_maneuver_t *alloc_maneuver(vec_store_t *s) {
+  for (uint16_t i = 0; i < s->n_maneuvers; i++)
+    if (!s->maneuvers[i].used) return &s->maneuvers[i];
+  if (s->n_maneuvers < VEC_STORE_MAX_MANEUVERS) return &s->maneuvers[s->n_maneuvers++];
+  return nullptr;
+}
+
+static void remove_kind(vec_store_t *s, uint8_t kind, bool all, uint16_t id) {
+  if (kind == MAPS_KIND_MANEUVER) {
+    for (uint16_t i = 0; i < s->n_maneuvers; i++)
+      if (s->maneuvers[i].used && (all || s->maneuvers[i].id == id))
+        s->maneuvers[i].used = false;
+    return;
+  }
+  if (kind == MAPS_KIND_ROUTE && all) s->route_m = s->route_s = 0;
+  if (kind == MAPS_KIND_LABEL) {
+    for (uint16_t i = 0; i < s->n_labels; i++)
+      if (s->labels[i].used && (all || s->labels[i].id == id)) s->labels[i].used = false;
+    return;
+  }
+  for (uint16_t i = 0; i < s->n_items; i++) {
+    vec_store_item_t &it = s->items[i];
+    if (it.used && it.kind == kind && (all || it.id == id)) it.used = false;
+  }
+}
+
+/* ── Nivel de detalle ────────────────────────────────────────────── */
+static uint32_t isqrt64(uint64_t v) {
+  uint64_t r = 0, bit = 1ull << 62;
+  while (bit > v) bit >>= 2;
+  while (bit) {
+    if (v >= r + bit) {
+      v -= r + bit;
+      r = (r >> 1) + bit;
+    } else {
+      r >>= 1;
+    }
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+static uint8_t log2_floor(uint64_t v) { return v ? 63 - __builtin_clzll(v) : 0; }
+
+/* Importancia de cada vértice: log2 de su distancia a la cuerda del tramo en
+ * que Douglas–Peucker lo elige, acotada por la del tramo padre para que los
+ * conjuntos de cada nivel queden anidados (bajar la tolerancia solo agrega
+ * vértices). */
+static void lod_compute(vec_store_item_t *it) {
+  uint8_t n = it->n;
+  if (n == 0) return;
+  it->lod[0] = it->lod[n - 1] = VEC_LOD_KEEP;
+  struct seg_t { uint8_t a, b, cap; };
+  seg_t stack[VEC_STORE_ITEM_PTS];
+  uint8_t sp = 0;
+  if (n > 2) stack[sp++] = { 0, (uint8_t)(n - 1), VEC_LOD_KEEP - 1 };
+  while (sp) {
+    seg_t s = stack[--sp];
+    const vec_store_pt_t &a = it->pts[s.a], &b = it->pts[s.b];
+    int64_t dx = (int64_t)b.x - a.x, dy = (int64_t)b.y - a.y;
+    uint32_t len = isqrt64((uint64_t)(dx * dx + dy * dy));
+    uint64_t best_d = 0;
+    uint8_t best = s.a + 1;
+    for (uint8_t i = s.a + 1; i < s.b; i++) {
+      int64_t ex = (int64_t)it->pts[i].x - a.x, ey = (int64_t)it->pts[i].y - a.y;
+      uint64_t d;
+      if (len) {
+        int64_t c = dx * ey - dy * ex;
+        d = (uint64_t)(c < 0 ? -c : c) / len;
+      } else {
+        d = isqrt64((uint64_t)(ex * ex + ey * ey));
+      }
+      if (d >= best_d) {
+        best_d = d;
+        best = i;
+      }
+    }
+    uint8_t level = log2_floor(best_d);
+    if (level > s.cap) level = s.cap;
+    it->lod[best] = level;
+    if (best - s.a >= 2) stack[sp++] = { s.a, best, level };
+    if (s.b - best >= 2) stack[sp++] = { best, s.b, level };
+  }
+}
+
+/* ── Operaciones ─────────────────────────────────────────────────── */
+
+/* Alta o reemplazo de una polilínea. Si no hay lugar se consume igual. Con
+ * más de VEC_STORE_ITEM_PTS puntos (la app y el paquete offline las parten)
+ * no se guarda recortada: se da de baja y cuenta como alta que no entró. */
+static bool op_polyline(vec_store_t *s, maps_bin_rd_t &r, uint8_t kind,
+                        int32_t cx, int32_t cy, uint16_t id_base) {
+  uint16_t id = (uint16_t)(id_base + maps_bin_rd_varint(r));
+  uint8_t  w  = kind == MAPS_KIND_ROAD ? maps_bin_rd_u8(r) : 0;
+  uint32_t n  = maps_bin_rd_varint(r);
+
+  vec_store_item_t *it = find_item(s, kind, id);
+  if (!it) it = alloc_item(s);
+  if (it) {
+    it->used = true;
+    it->kind = kind;
+    it->id = id;
+    it->w = w ? w : 1;
+    it->n = 0;
+    it->min_x = it->min_y = INT32_MAX;
+    it->max_x = it->max_y = INT32_MIN;
+  }
+  bool fits = n <= VEC_STORE_ITEM_PTS;
+  for (uint32_t j = 0; j < n && r.ok; j++) {
+    cx += maps_bin_rd_zz(r);
+    cy += maps_bin_rd_zz(r);
+    if (!it || !fits) continue;
+    it->pts[it->n++] = { cx, cy };
+    if (cx < it->min_x) it->min_x = cx;
+    if (cx > it->max_x) it->max_x = cx;
+    if (cy < it->min_y) it->min_y = cy;
+    if (cy > it->max_y) it->max_y = cy;
+  }
+  if (it && it->n == 0) it->used = false;
+  if (it && it->used) lod_compute(it);
+  return it != nullptr && fits;
+}
+
+static bool op_label(vec_store_t *s, maps_bin_rd_t &r, int32_t cx, int32_t cy,
+                     uint16_t id_base) {
+  uint16_t id = (uint16_t)(id_base + maps_bin_rd_varint(r));
+  int32_t  x  = cx + maps_bin_rd_zz(r);
+  int32_t  y  = cy + maps_bin_rd_zz(r);
+  uint8_t  n  = maps_bin_rd_u8(r);
+  if ((size_t)(r.end - r.p) < n) { r.ok = false; return true; }
+
+  vec_store_label_t *l = find_label(s, id);
+  if (!l) l = alloc_label(s);
+  if (l) {
+    l->used = true;
+    l->id = id;
+    l->x = x;
+    l->y = y;
+    maps_copy_str(l->name, sizeof(l->name), (const char *)r.p, n);
+  }
+  r.p += n;
+  return l != nullptr;
+}
+
+static bool op_maneuver(vec_store_t *s, maps_bin_rd_t &r, int32_t cx, int32_t cy) {
+  uint16_t id = (uint16_t)maps_bin_rd_varint(r);
+  int32_t  x  = cx + maps_bin_rd_zz(r);
+  int32_t  y  = cy + maps_bin_rd_zz(r);
+  uint8_t  n  = maps_bin_rd_u8(r);
+  if ((size_t)(r.end - r.p) < n) { r.ok = false; return true; }
+
+  vec_store_maneuver_t *m = find_maneuver(s, id);
+  if (!m) m = alloc_maneuver(s);
+  if (m) {
+    m->used = true;
+    m->id = id;
+    m->x = x;
+    m->y = y;
+    maps_copy_str(m->text, sizeof(m->text), (const char *)r.p, n);
+  }
+  r.p += n;
+  return m != nullptr;
+}
+
+/* Lista de operaciones (varint n_ops, ops) con el cursor en (cx, cy) */
+static bool apply_ops(vec_store_t *s, maps_bin_rd_t &r, int32_t cx, int32_t cy,
+                      uint16_t id_base, bool *route) {
+  bool fits = true;
+  uint32_t n_ops = maps_bin_rd_varint(r);
+  for (uint32_t i = 0; i < n_ops && r.ok; i++) {
+    switch (maps_bin_rd_u8(r)) {
+    case MAPS_OP_ROAD:  fits &= op_polyline(s, r, MAPS_KIND_ROAD, cx, cy, id_base); break;
+    case MAPS_OP_ROUTE:
+      fits &= op_polyline(s, r, MAPS_KIND_ROUTE, cx, cy, id_base);
+      *route = true;
+      break;
+    case MAPS_OP_LABEL: fits &= op_label(s, r, cx, cy, id_base); break;
+    case MAPS_OP_MANEUVER:
+      fits &= op_maneuver(s, r, cx, cy);
+      *route = true;
+      break;
+    case MAPS_OP_ROUTE_INFO:
+      s->route_m = maps_bin_rd_varint(r);
+      s->route_s = maps_bin_rd_varint(r);
+      *route = true;
+      break;
+    case MAPS_OP_REMOVE: {
+      uint8_t kind = maps_bin_rd_u8(r);
+      uint16_t id = (uint16_t)(id_base + maps_bin_rd_varint(r));
+      remove_kind(s, kind, false, id);
+      *route |= kind == MAPS_KIND_ROUTE || kind == MAPS_KIND_MANEUVER;
+      break;
+    }
+    case MAPS_OP_CLEAR: {
+      uint8_t kind = maps_bin_rd_u8(r);
+      remove_kind(s, kind, true, 0);
+      *route |= kind == MAPS_KIND_ROUTE || kind == MAPS_KIND_MANEUVER;
+      break;
+    }
+    default:
+      r.ok = false; /* op desconocida: no se puede saltear */
+      break;
+    }
+  }
+  if (n_ops > 0) s->geom_version++;
+  return fits;
+}
+
+/* ── API ─────────────────────────────────────────────────────────── */
+void vec_store_clear(vec_store_t *s) {
+  s->n_items = 0;
+  s->n_labels = 0;
+  s->n_maneuvers = 0;
+  s->route_m = 0;
+  s->route_s = 0;
+  s->pos_x = 0;
+  s->pos_y = 0;
+  s->heading = -1;
+  s->zoom = 0;
+  s->geom_version++;
+  s->route_version++;
+}
+
+bool vec_store_apply(vec_store_t *s, const uint8_t *payload, size_t len) {
+  maps_bin_rd_t r = { payload, payload + len, true };
+
+  uint8_t flags = maps_bin_rd_u8(r);
+  int32_t px    = maps_bin_rd_zz(r);
+  int32_t py    = maps_bin_rd_zz(r);
+  int32_t hdg   = maps_bin_rd_zz(r);
+  uint8_t zoom  = maps_bin_rd_u8(r);
+  if (!r.ok) return false;
+
+  if (flags & MAPS_DELTA_RESET) vec_store_clear(s);
+  s->pos_x = px;
+  s->pos_y = py;
+  s->heading = (int16_t)hdg;
+  s->zoom = zoom;
+
+  bool route = false;
+  bool fits = apply_ops(s, r, px, py, 0, &route);
+  if (route) s->route_version++;
+  return r.ok && fits;
+}
+
+bool vec_store_apply_ops(vec_store_t *s, const uint8_t *ops, size_t len, int32_t cx,
+                         int32_t cy, uint16_t id_base) {
+  maps_bin_rd_t r = { ops, ops + len, true };
+  bool route = false;
+  bool fits = apply_ops(s, r, cx, cy, id_base, &route);
+  if (route) s->route_version++;
+  return r.ok && fits;
+}
+
+void vec_store_remove_range(vec_store_t *s, uint16_t lo, uint16_t hi) {
+  bool any = false;
+  for (uint16_t i = 0; i < s->n_items; i++) {
+    vec_store_item_t &it = s->items[i];
+    if (it.used && it.kind == MAPS_KIND_ROAD && it.id >= lo && it.id <= hi) {
+      it.used = false;
+      any = true;
+    }
+  }
+  for (uint16_t i = 0; i < s->n_labels; i++) {
+    vec_store_label_t &l = s->labels[i];
+    if (l.used && l.id >= lo && l.id <= hi) {
+      l.used = false;
+      any = true;
+    }
+  }
+  if (any) s->geom_version++;
+}
+
+/* ── Proyección ──────────────────────────────────────────────────── */
+void vec_view_init(vec_view_t *v, const vec_store_t *s, int32_t anchor_x, int32_t anchor_y) {
+  v->pos_x = s->pos_x;
+  v->pos_y = s->pos_y;
+  v->anchor_x = anchor_x;
+  v->anchor_y = anchor_y;
+  vec_view_zoom(v, s->zoom);
+  if (s->heading >= 0)
+    vec_view_rotate(v, vec_angle_deg(s->heading));
+  else
+    vec_view_north_up(v);
+}
+
+uint8_t vec_view_project_item(const vec_view_t *v, const vec_store_item_t *it,
+                              vec_point_t *out) {
+  uint8_t m = 0;
+  for (uint8_t j = 0; j < it->n; j++)
+    if (it->lod[j] >= v->lod) out[m++] = vec_view_project(v, it->pts[j].x, it->pts[j].y);
+  return m;
+}
+
+bool vec_view_item_near(const vec_view_t *v, const vec_store_item_t *it, int32_t radius) {
+  /* Distancia del vehículo al bbox en unidades de mundo (la rotación no la cambia) */
+  int64_t r = (int64_t)radius << v->shift;
+  int64_t dx = 0, dy = 0;
+  if (v->pos_x < it->min_x) dx = (int64_t)it->min_x - v->pos_x;
+  else if (v->pos_x > it->max_x) dx = (int64_t)v->pos_x - it->max_x;
+  if (v->pos_y < it->min_y) dy = (int64_t)it->min_y - v->pos_y;
+  else if (v->pos_y > it->max_y) dy = (int64_t)v->pos_y - it->max_y;
+  if (dx > r || dy > r) return false;
+  return dx * dx + dy * dy <= r * r;
+}
+
+bool vec_view_point_near(const vec_view_t *v, int32_t x, int32_t y, int32_t radius) {
+  int64_t r = (int64_t)radius << v->shift;
+  int64_t dx = (int64_t)x - v->pos_x;
+  int64_t dy = (int64_t)y - v->pos_y;
+  return dx <= r && dx >= -r && dy <= r && dy >= -r;
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "maps_ws_server.h"
+#include "vec_trig.h"
+
+/**
+ * Conjunto persistente de calles, tramos de ruta, labels y maniobras del
+ * mapa.
+ *
+ * Cada elemento tiene un id estable asignado por la app y coordenadas de
+ * mundo (Web Mercator en punto fijo, ver VEC_WORLD_ZOOM) que no dependen de
+ * la vista: entre frames solo viajan la posición, el heading, el zoom y las
+ * altas/bajas (MAPS_BIN_DELTA, ver vec_proto.h). El render proyecta a
+ * pantalla con vec_view_t, solo con enteros.
+ *
+ * Cada vértice de una polilínea guarda su importancia (nivel de detalle):
+ * el log2 de la tolerancia de Douglas–Peucker, en unidades de mundo, a
+ * partir de la cual se descarta. La vista proyecta solo los vértices que
+ * importan a su zoom, así la cantidad por pantalla queda acotada al alejar
+ * el zoom sin pedirle geometría nueva a la app.
+ *
+ * La estructura es grande (~300 KB): reservarla en PSRAM y mutarla solo
+ * desde un hilo (el de LVGL).
+ */
+
+#define VEC_STORE_MAX_ITEMS  512 /* calles + tramos de ruta */
+#define VEC_STORE_ITEM_PTS    64 /* puntos por elemento (la app parte las más largas) */
+#define VEC_STORE_MAX_LABELS 128
+#define VEC_STORE_MAX_MANEUVERS 128
+#define VEC_MANEUVER_LEN 63 /* bytes de instrucción (se corta lo que sobra) */
+
+/* Coordenadas de mundo: píxeles Mercator (tiles de 256 px) al zoom 20. El
+ * mundo mide 2^28 unidades (~0,15 m en el ecuador), siempre positivas en
+ * int32; al zoom z un píxel de pantalla son 2^(20 - z) unidades. */
+#define VEC_WORLD_ZOOM 20
+
+/* Importancia de los extremos: se dibujan a cualquier zoom */
+#define VEC_LOD_KEEP 0xFF
+
+struct vec_store_pt_t { int32_t x, y; };
+
+struct vec_store_item_t {
+  vec_store_pt_t pts[VEC_STORE_ITEM_PTS];
+  uint8_t  lod[VEC_STORE_ITEM_PTS];    /* importancia por vértice (log2) */
+  int32_t  min_x, min_y, max_x, max_y; /* bbox en coordenadas de mapa */
+  uint16_t id;
+  uint8_t  kind;  /* MAPS_KIND_ROAD / MAPS_KIND_ROUTE */
+  uint8_t  w;     /* grosor de calle (1..3) */
+  uint8_t  n;
+  bool     used;
+};
+
+struct vec_store_label_t {
+  int32_t  x, y;
+  uint16_t id;
+  bool     used;
+  char     name[VEC_LABEL_LEN + 1];
+};
+
+/* Punto de maniobra de la ruta: la instrucción a mostrar al acercarse */
+struct vec_store_maneuver_t {
+  int32_t  x, y;
+  uint16_t id;    /* orden de la instrucción en la ruta */
+  bool     used;
+  char     text[VEC_MANEUVER_LEN + 1];
+};
+
+struct vec_store_t {
+  vec_store_item_t  items[VEC_STORE_MAX_ITEMS];
+  vec_store_label_t labels[VEC_STORE_MAX_LABELS];
+  vec_store_maneuver_t maneuvers[VEC_STORE_MAX_MANEUVERS];
+  uint16_t n_items;   /* marca de agua: slots [0, n_items) pueden estar en uso */
+  uint16_t n_labels;
+  uint16_t n_maneuvers;
+
+  /* Totales de la ruta según el ruteador (0 si no llegaron) */
+  uint32_t route_m, route_s;
+
+  /* Vista: posición del vehículo en coordenadas de mundo */
+  int32_t  pos_x, pos_y;
+  int16_t  heading;   /* -1 si no disponible */
+  uint8_t  zoom;
+
+  uint32_t geom_version;  /* cambia con cada alta/baja/reemplazo */
+  uint32_t route_version; /* cambia solo con la ruta, sus maniobras o totales */
+};
+
+/** Vacía el conjunto (también la vista). */
+void vec_store_clear(vec_store_t *s);
+
+/**
+ * Aplica el payload de un MAPS_BIN_DELTA. Devuelve false si está corrupto o
+ * si alguna alta no entró por falta de lugar o por traer más de
+ * VEC_STORE_ITEM_PTS puntos (la app debe resincronizar).
+ */
+bool vec_store_apply(vec_store_t *s, const uint8_t *payload, size_t len);
+
+/**
+ * Aplica solo una lista de operaciones (varint n_ops y las ops de un
+ * MAPS_BIN_DELTA) con el cursor de puntos en (cx, cy), sumando [id_base] a
+ * los ids, sin tocar la vista. Es como se cargan los tiles de un paquete
+ * offline (map_pack.h). Devuelve lo mismo que vec_store_apply.
+ */
+bool vec_store_apply_ops(vec_store_t *s, const uint8_t *ops, size_t len, int32_t cx,
+                         int32_t cy, uint16_t id_base);
+
+/** Baja de las calles y labels con id entre [lo] y [hi] inclusive. */
+void vec_store_remove_range(vec_store_t *s, uint16_t lo, uint16_t hi);
+
+/* ── Proyección a pantalla ───────────────────────────────────────── */
+
+/**
+ * Transformación mundo → pantalla: escala al zoom de la vista (shift),
+ * traslada (pos_x, pos_y) a (anchor_x, anchor_y) y, si hay heading, rota
+ * para que el rumbo quede hacia arriba (igual que VectorRenderer.rotatePoints
+ * en la app). La rotación es entera: seno y coseno Q15 de tabla (vec_trig).
+ */
+struct vec_view_t {
+  int32_t pos_x, pos_y;
+  int32_t anchor_x, anchor_y;
+  int32_t cos_q, sin_q; /* Q15 */
+  uint8_t shift;        /* VEC_WORLD_ZOOM - zoom */
+  uint8_t lod;          /* importancia mínima de los vértices proyectados */
+  bool    rotate;
+};
+
+/* Límite de la distancia proyectada antes de rotar: evita overflow en Q15
+ * con tramos largos; el rasterizador recorta igual lo que cae fuera. */
+#define VEC_VIEW_CLAMP 8192
+
+void vec_view_init(vec_view_t *v, const vec_store_t *s, int32_t anchor_x, int32_t anchor_y);
+
+/**
+ * Cambia el zoom de la vista (el del conjunto es el que pide la app). El
+ * nivel de detalle pasa a medio píxel: un vértice que se aparta menos que
+ * eso de la polilínea simplificada no se proyecta.
+ */
+static inline void vec_view_zoom(vec_view_t *v, uint8_t zoom) {
+  v->shift = VEC_WORLD_ZOOM - (zoom < VEC_WORLD_ZOOM ? zoom : VEC_WORLD_ZOOM);
+  v->lod = v->shift ? v->shift - 1 : 0;
+}
+
+/** Rota para que el rumbo [heading] (ángulo binario, ver vec_trig.h) quede arriba. */
+static inline void vec_view_rotate(vec_view_t *v, uint16_t heading) {
+  v->cos_q = vec_cos_q15(heading);
+  v->sin_q = -vec_sin_q15(heading);
+  v->rotate = true;
+}
+
+/** Sin rotación (norte arriba). */
+static inline void vec_view_north_up(vec_view_t *v) {
+  v->cos_q = 32768;
+  v->sin_q = 0;
+  v->rotate = false;
+}
+
+static inline int32_t vec_view_scale(const vec_view_t *v, int32_t d) {
+  if (v->shift) d = (d + (1 << (v->shift - 1))) >> v->shift;
+  if (d > VEC_VIEW_CLAMP) return VEC_VIEW_CLAMP;
+  if (d < -VEC_VIEW_CLAMP) return -VEC_VIEW_CLAMP;
+  return d;
+}
+
+static inline vec_point_t vec_view_project(const vec_view_t *v, int32_t x, int32_t y) {
+  int32_t dx = vec_view_scale(v, x - v->pos_x);
+  int32_t dy = vec_view_scale(v, y - v->pos_y);
+  if (v->rotate) {
+    int32_t rx = (dx * v->cos_q - dy * v->sin_q + (1 << 14)) >> 15;
+    int32_t ry = (dx * v->sin_q + dy * v->cos_q + (1 << 14)) >> 15;
+    dx = rx;
+    dy = ry;
+  }
+  return { (int16_t)(v->anchor_x + dx), (int16_t)(v->anchor_y + dy) };
+}
+
+/** Inversa de vec_view_project: punto de pantalla → coordenadas de mundo. */
+static inline vec_store_pt_t vec_view_unproject(const vec_view_t *v, int32_t sx, int32_t sy) {
+  int32_t dx = sx - v->anchor_x;
+  int32_t dy = sy - v->anchor_y;
+  if (v->rotate) {
+    int32_t rx = (dx * v->cos_q + dy * v->sin_q + (1 << 14)) >> 15;
+    int32_t ry = (-dx * v->sin_q + dy * v->cos_q + (1 << 14)) >> 15;
+    dx = rx;
+    dy = ry;
+  }
+  return { (int32_t)(v->pos_x + (int64_t)dx * (1 << v->shift)),
+           (int32_t)(v->pos_y + (int64_t)dy * (1 << v->shift)) };
+}
+
+/**
+ * Proyecta en [out] los vértices de [it] con importancia >= v->lod (los
+ * extremos siempre); devuelve cuántos.
+ */
+uint8_t vec_view_project_item(const vec_view_t *v, const vec_store_item_t *it,
+                              vec_point_t *out);
+
+/** true si el bbox del elemento puede caer dentro de un círculo de [radius] px. */
+bool vec_view_item_near(const vec_view_t *v, const vec_store_item_t *it, int32_t radius);
+
+/** true si el punto de mundo (x, y) está a menos de [radius] px (por eje). */
+bool vec_view_point_near(const vec_view_t *v, int32_t x, int32_t y, int32_t radius);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+/**
+ * Trigonometría entera para rotar la vista.
+ *
+ * Ángulos binarios: una vuelta son 65536 unidades (uint16_t), así la resta
+ * de dos ángulos vista como int16_t ya es la diferencia por el arco corto.
+ * Resultados en Q15 (32768 = 1.0).
+ *
+ * Sin dependencias de LVGL ni Arduino (se puede probar en host).
+ */
+
+#define VEC_ANGLE_TURN 65536
+
+/** Grados (cualquier signo) → ángulo binario. */
+static inline uint16_t vec_angle_deg(int32_t deg) {
+  return (uint16_t)(((deg % 360) + 360) % 360 * VEC_ANGLE_TURN / 360);
+}
+
+int32_t vec_sin_q15(uint16_t angle);
+
+static inline int32_t vec_cos_q15(uint16_t angle) {
+  return vec_sin_q15((uint16_t)(angle + VEC_ANGLE_TURN / 4));
+}
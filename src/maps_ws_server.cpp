@@ -1,106 +1,251 @@
 /*
  * AP "ESP32-NAV" + WebSocket :8080/ws.
  *
- * Mensajes binarios  → tile JPEG (legacy) decodificado a buffer RGB565.
+ * Mensajes binarios  → protocolo binario (magia 0xA5, ver maps/vec_proto.h)
+ *                      o tile JPEG (legacy), decodificado en streaming a
+ *                      buffer RGB565 (maps/jpeg_stream.h).
  * Mensajes de texto  → JSON con "t":"vec" (frame vectorial) o "t":"nav" (paso).
+ *                      Se parsean en streaming (maps/map_json.h) a medida que
+ *                      llegan los fragmentos, sin copiar el mensaje ni límite
+ *                      de tamaño. Con MAPS_JSON_STREAM=0 se usa el camino
+ *                      anterior (s_text_buf + JsonDocument) para comparar,
+ *                      con filtros y una arena fija en lugar del heap.
  *
- * Fragmentación: info->index indica el offset del chunk; se ensambla en
- * s_jpeg_buf (binario) o s_text_buf (texto) y se procesa cuando el frame
- * está completo (info->index + len == info->len && info->final).
+ * Frames, pasos de navegación y velocidad se entregan por buzones triple
+ * buffer (maps_ws_take_*): el parser escribe directo en el slot libre.
+ *
+ * Al conectar, el ESP32 envía {"t":"hello",...} con la versión del protocolo
+ * binario y las capacidades; un cliente que no lo entienda sigue usando JSON.
+ * Con "ack" la app sabe que va a recibir un {"t":"ack",...} por cada render
+ * (maps_ws_send_ack) y puede dejar de mandar a ciegas. Con "lat" el ESP32
+ * manda {"t":"ping","d":ms} al conectar y cada tanto para estimar el reloj
+ * del celular (maps/map_latency.h).
+ *
+ * Fragmentación: info->index indica el offset del chunk. Los mensajes del
+ * protocolo binario se ensamblan en s_bin_buf y se procesan cuando el frame
+ * está completo (info->index + len == info->len && info->final); los JPEG
+ * (legacy o MAPS_BIN_TILE) y el texto se pasan chunk a chunk (al decoder
+ * JPEG y al parser JSON). Con MAPS_BIN_FLAG_HS el payload viene comprimido
+ * (LZSS/heatshrink, maps/hs_decode.h) y se descomprime fragmento a fragmento
+ * en s_bin_buf: al completarse el mensaje queda igual que uno sin comprimir.
+ * El ensamblado está en maps/bin_rx.h, que comparte el reproductor de host.
+ *
+ * Con MAPS_REC=1 cada fragmento recibido se graba además en la SD
+ * (maps/map_rec.h) para reproducirlo en host con tools/replay.
  */
 #include "maps_ws_server.h"
+#include "maps/bin_rx.h"
+#include "maps/jpeg_stream.h"
+#include "maps/map_arena.h"
+#include "maps/map_latency.h"
+#include "maps/map_json.h"
+#include "maps/map_rec.h"
+#include "maps/map_tiles.h"
+#include "maps/map_tiles_fs.h"
+#include "maps/triple_buf.h"
+#include "maps/vec_frame.h"
+#include "maps/vec_proto.h"
 #include <Arduino.h>
 #include <ArduinoJson.h>
 #include <AsyncTCP.h>
 #include <ESPAsyncWebServer.h>
-#include <TJpg_Decoder.h>
 #include <WiFi.h>
 #include <cstring>
 
 #define MAPS_AP_SSID   "ESP32-NAV"
 #define MAPS_AP_PASS   "esp32nav12"
 #define MAPS_WS_PORT   8080
-#define MAPS_JPEG_MAX  (120 * 1024)
-#define MAPS_TEXT_MAX  (14 * 1024)   /* 14 KB para el JSON vectorial */
+#define MAPS_BIN_MAX   (64 * 1024)    /* mensaje del protocolo binario */
+#define MAPS_TEXT_MAX  (14 * 1024)   /* solo MAPS_JSON_STREAM=0 */
+#define MAPS_JSON_POOL (96 * 1024)   /* arena de los JsonDocument (MAPS_JSON_STREAM=0) */
+#define MAPS_JSON_STATS_MS 10000     /* cada cuánto se loguean sus contadores */
+#define MAPS_LAT_JSON_MAX 1536        /* respuesta {"t":"lat",...} */
+#define MAPS_CAPS      "\"jpeg\",\"vecb\",\"vecd\",\"tile\",\"ack\",\"lat\",\"hs\",\"nav\",\"route\""  /* capacidades anunciadas en el hello */
+
+#ifndef MAPS_JSON_STREAM
+#define MAPS_JSON_STREAM 1
+#endif
+
+#ifndef MAPS_REC
+#define MAPS_REC 0
+#endif
 
 static AsyncWebServer    *s_server   = nullptr;
 static AsyncWebSocket    *s_ws       = nullptr;
 static uint16_t          *s_map_buf  = nullptr;
 static maps_ws_on_frame_t s_on_frame = nullptr;
-static maps_ws_on_vec_t   s_on_vec   = nullptr;
-static maps_ws_on_nav_t   s_on_nav   = nullptr;
-static maps_ws_on_gps_t   s_on_gps   = nullptr;
+static maps_ws_on_delta_t s_on_delta = nullptr;
 static bool               s_has_client = false;
-static uint8_t           *s_jpeg_buf = nullptr;
+static bool               s_pack       = false; /* anunciar "pack" en el hello */
+static uint8_t           *s_bin_buf  = nullptr;   /* protocolo binario */
+static bin_rx_t           s_rx;               /* ensamblado sobre s_bin_buf */
+static uint16_t           s_rx_seq   = 0;
+static volatile uint32_t  s_parse_us = 0;   /* último mensaje parseado (ack) */
+
+/* Buzones: 3 slots cada uno (el bloque de cada vec_frame_t, en PSRAM) */
+static vec_frame_t        s_vec_slots[3];
+static uint8_t           *s_vec_mem = nullptr;
+static nav_step_t         s_nav_slots[3];
+static int                s_gps_slots[3];
+static tbuf_t             s_vec_mb;
+static tbuf_t             s_nav_mb;
+static tbuf_t             s_gps_mb;
+#if MAPS_JSON_STREAM
+static map_json_t         s_json;
+static uint32_t           s_json_us = 0;    /* parseo acumulado del mensaje */
+#else
 static char              *s_text_buf = nullptr;
-static vec_frame_t       *s_vec_frame = nullptr;
-
-/* ── JPEG output callback ────────────────────────────────────────── */
-static bool maps_jpeg_output(int16_t x, int16_t y, uint16_t w, uint16_t h,
-                             uint16_t *bitmap) {
-  if (!s_map_buf) return 0;
-  if (y + h > MAPS_WS_MAP_H || x + w > MAPS_WS_MAP_W) return 1;
-  for (uint16_t row = 0; row < h; row++) {
-    memcpy(s_map_buf + (y + row) * MAPS_WS_MAP_W + x,
-           bitmap + row * w, (size_t)w * 2);
+static bool               s_text_big = false; /* el mensaje no entra en s_text_buf */
+#endif
+static uint32_t           s_json_msgs = 0;     /* mensajes de texto (json_stats) */
+static uint32_t           s_json_stats_ms = 0;
+
+static void log_vec(const vec_frame_t &f) {
+  Serial.printf("[Maps] vec: roads=%u route=%u labels=%u %lu B%s pos=(%d,%d)\n",
+                f.n_roads, f.n_routes, f.n_labels, (unsigned long)f.used,
+                f.full ? " (lleno)" : "", f.pos_x, f.pos_y);
+}
+
+#if !MAPS_JSON_STREAM
+/* ── Memoria de ArduinoJson ──────────────────────────────────────────
+ * Los JsonDocument piden memoria a una arena fija en PSRAM que se vacía al
+ * empezar cada mensaje: un "gps" de 20 bytes o un "vec" de 14 KB no tocan
+ * el heap desde el task de AsyncTCP. Lo que no entra en la arena va al
+ * heap y se cuenta aparte. Cada bloque lleva su largo delante para poder
+ * agrandarlo (ArduinoJson agranda y achica el último pool de slots). */
+#define JSON_BLK_HDR 8 /* largo del bloque; deja el bloque alineado a 8 */
+
+struct json_pool_t : ArduinoJson::Allocator {
+  map_arena_t arena = {nullptr, 0, 0};
+  uint8_t *last = nullptr; /* último bloque: se agranda en el lugar */
+  size_t   peak = 0;       /* máximo usado por un mensaje */
+  uint32_t n_alloc = 0;    /* pedidos de ArduinoJson (antes, todos al heap) */
+  uint32_t n_heap = 0;     /* los que no entraron en la arena */
+
+  bool owns(const void *p) const {
+    return (const uint8_t *)p >= arena.base && (const uint8_t *)p < arena.base + arena.cap;
+  }
+  void reset() {
+    if (arena.used > peak) peak = arena.used;
+    map_arena_reset(&arena);
+    last = nullptr;
+  }
+  void *allocate(size_t size) override {
+    n_alloc++;
+    uint8_t *p = (uint8_t *)map_arena_alloc(&arena, JSON_BLK_HDR + size, 8);
+    if (!p) {
+      n_heap++;
+      return heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    *(size_t *)p = size;
+    return last = p + JSON_BLK_HDR;
   }
-  return 1;
+  void deallocate(void *ptr) override {
+    if (!owns(ptr)) {
+      heap_caps_free(ptr);
+    } else if (ptr == last) {
+      arena.used = (size_t)(last - JSON_BLK_HDR - arena.base);
+      last = nullptr;
+    }
+  }
+  void *reallocate(void *ptr, size_t size) override {
+    if (!ptr) return allocate(size);
+    n_alloc++;
+    if (!owns(ptr)) {
+      n_heap++;
+      return heap_caps_realloc(ptr, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    }
+    uint8_t *p = (uint8_t *)ptr;
+    size_t old = *(size_t *)(p - JSON_BLK_HDR);
+    if (p == last && size <= arena.cap - (size_t)(p - arena.base)) {
+      *(size_t *)(p - JSON_BLK_HDR) = size;
+      arena.used = (size_t)(p - arena.base) + size;
+      return p;
+    }
+    if (size <= old) return p;
+    n_alloc--; /* allocate lo vuelve a contar */
+    void *q = allocate(size);
+    if (q) memcpy(q, p, old);
+    return q;
+  }
+};
+
+static json_pool_t   s_json_pool;
+
+/* Filtros: solo se materializan los campos que se leen */
+static JsonDocument  s_vec_filter;
+static JsonDocument  s_nav_filter;
+static JsonDocument  s_gps_filter;
+
+/* Sin PSRAM para la arena todo va al heap, como antes */
+static void json_pool_init(void) {
+  uint8_t *mem = (uint8_t *)heap_caps_malloc(MAPS_JSON_POOL,
+                                             MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  if (!mem) Serial.println("[Maps] json: sin memoria para la arena, se usa el heap");
+  map_arena_init(&s_json_pool.arena, mem, MAPS_JSON_POOL);
+
+  s_vec_filter["roads"][0]["w"] = true;
+  s_vec_filter["roads"][0]["p"] = true;
+  s_vec_filter["route"] = true;
+  s_vec_filter["labels"][0]["p"] = true;
+  s_vec_filter["labels"][0]["n"] = true;
+  s_vec_filter["pos"] = true;
+  s_vec_filter["hdg"] = true;
+  s_nav_filter["step"] = true;
+  s_nav_filter["dist"] = true;
+  s_nav_filter["eta"] = true;
+  s_gps_filter["spd"] = true;
+}
+
+static DeserializationError json_parse(JsonDocument &doc, const char *json, size_t len,
+                                       const JsonDocument &filter) {
+  return deserializeJson(doc, json, len, DeserializationOption::Filter(filter));
 }
 
 /* ── Parser de velocidad GPS ─────────────────────────────────────── */
 static void parse_gps_spd(const char *json, size_t len) {
-  if (!s_on_gps) return;
-  JsonDocument doc;
-  if (deserializeJson(doc, json, len) != DeserializationError::Ok) return;
-  s_on_gps(doc["spd"] | 0);
+  JsonDocument doc(&s_json_pool);
+  if (json_parse(doc, json, len, s_gps_filter) != DeserializationError::Ok) return;
+  *(int *)tbuf_write_slot(&s_gps_mb) = doc["spd"] | 0;
+  tbuf_publish(&s_gps_mb);
 }
 
 /* ── Parser de frame vectorial ───────────────────────────────────── */
 static void parse_vec_frame(const char *json, size_t len) {
-  if (!s_on_vec) return;
-
-  JsonDocument doc;
-  if (deserializeJson(doc, json, len) != DeserializationError::Ok) {
+  JsonDocument doc(&s_json_pool);
+  if (json_parse(doc, json, len, s_vec_filter) != DeserializationError::Ok) {
     Serial.println("[Maps] vec: error deserializeJson");
     return;
   }
 
-  if (!s_vec_frame) return;
-  vec_frame_t &frame = *s_vec_frame;
-  memset(&frame, 0, sizeof(frame));
+  vec_frame_t &frame = *(vec_frame_t *)tbuf_write_slot(&s_vec_mb);
+  vec_frame_begin(&frame);
 
   /* Calles */
   JsonArray roads = doc["roads"];
   for (JsonObject road : roads) {
-    if (frame.n_roads >= VEC_MAX_ROAD_SEGS) break;
-    vec_road_t &r = frame.roads[frame.n_roads];
-    r.w = road["w"] | 1;
-    for (JsonArray pt : road["p"].as<JsonArray>()) {
-      if (r.n >= VEC_MAX_PTS_PER_SEG) break;
-      r.pts[r.n] = { (int16_t)pt[0].as<int>(), (int16_t)pt[1].as<int>() };
-      r.n++;
-    }
-    if (r.n > 0) frame.n_roads++;
+    vec_frame_poly_begin(&frame, VEC_FRAME_ROAD, road["w"] | 1);
+    for (JsonArray pt : road["p"].as<JsonArray>())
+      vec_frame_poly_add(&frame, { (int16_t)pt[0].as<int>(), (int16_t)pt[1].as<int>() });
+    vec_frame_poly_end(&frame);
   }
 
   /* Ruta */
-  for (JsonArray pt : doc["route"].as<JsonArray>()) {
-    if (frame.n_route >= VEC_MAX_ROUTE_PTS) break;
-    frame.route[frame.n_route] = { (int16_t)pt[0].as<int>(), (int16_t)pt[1].as<int>() };
-    frame.n_route++;
-  }
+  vec_frame_poly_begin(&frame, VEC_FRAME_ROUTE, 0);
+  for (JsonArray pt : doc["route"].as<JsonArray>())
+    vec_frame_poly_add(&frame, { (int16_t)pt[0].as<int>(), (int16_t)pt[1].as<int>() });
 
   /* Nombres de calles */
   for (JsonObject lbl : doc["labels"].as<JsonArray>()) {
-    if (frame.n_labels >= VEC_MAX_LABELS) break;
     JsonArray p = lbl["p"];
     if (p.size() < 2) continue;
-    vec_label_t &l = frame.labels[frame.n_labels];
-    l.x = p[0].as<int>();
-    l.y = p[1].as<int>();
-    strlcpy(l.name, lbl["n"] | "", sizeof(l.name));
-    frame.n_labels++;
+    vec_label_t *l = vec_frame_label_add(&frame);
+    if (!l) break;
+    l->x = p[0].as<int>();
+    l->y = p[1].as<int>();
+    strlcpy(l->name, lbl["n"] | "", sizeof(l->name));
   }
+  vec_frame_end(&frame);
 
   /* Posición */
   JsonArray pos = doc["pos"];
@@ -110,88 +255,266 @@ static void parse_vec_frame(const char *json, size_t len) {
   }
   frame.heading = doc["hdg"] | -1;
 
-  Serial.printf("[Maps] vec: roads=%u route=%u labels=%u pos=(%d,%d)\n",
-                frame.n_roads, frame.n_route, frame.n_labels, frame.pos_x, frame.pos_y);
-  s_on_vec(frame);
+  log_vec(frame);
+  frame.seq = 0;
+  frame.origin_us = 0;
+  frame.pub_us = micros();
+  tbuf_publish(&s_vec_mb);
 }
 
 /* ── Parser de paso de navegación ────────────────────────────────── */
 static void parse_nav_step(const char *json, size_t len) {
-  if (!s_on_nav) return;
-
-  JsonDocument doc;
-  if (deserializeJson(doc, json, len) != DeserializationError::Ok) return;
+  JsonDocument doc(&s_json_pool);
+  if (json_parse(doc, json, len, s_nav_filter) != DeserializationError::Ok) return;
 
-  static nav_step_t step;
+  nav_step_t &step = *(nav_step_t *)tbuf_write_slot(&s_nav_mb);
   strlcpy(step.step, doc["step"] | "", sizeof(step.step));
   strlcpy(step.dist, doc["dist"] | "", sizeof(step.dist));
   strlcpy(step.eta,  doc["eta"]  | "", sizeof(step.eta));
 
   Serial.printf("[Maps] nav: %s  %s  ETA %s\n", step.step, step.dist, step.eta);
-  s_on_nav(step);
+  tbuf_publish(&s_nav_mb);
+}
+#endif /* !MAPS_JSON_STREAM */
+
+/* ── Contadores del parseo de texto ──────────────────────────────────
+ * Cada MAPS_JSON_STATS_MS, por segundo: mensajes de texto y pedidos de
+ * memoria del parser. El de streaming no pide memoria; con
+ * MAPS_JSON_STREAM=0, "allocs" es lo que iba al heap con el allocator por
+ * defecto de ArduinoJson y "al heap" lo que sigue yendo con la arena. */
+static void json_stats(void) {
+  s_json_msgs++;
+  uint32_t now = millis();
+  uint32_t dt = now - s_json_stats_ms;
+  if (dt < MAPS_JSON_STATS_MS) return;
+#if MAPS_JSON_STREAM
+  Serial.printf("[Maps] json stream: %lu msgs/s, 0 allocs/s\n",
+                (unsigned long)(s_json_msgs * 1000ull / dt));
+#else
+  Serial.printf("[Maps] json doc: %lu msgs/s, %lu allocs/s, %lu al heap/s, arena máx %u/%u KB\n",
+                (unsigned long)(s_json_msgs * 1000ull / dt),
+                (unsigned long)(s_json_pool.n_alloc * 1000ull / dt),
+                (unsigned long)(s_json_pool.n_heap * 1000ull / dt),
+                (unsigned)(s_json_pool.peak / 1024), (unsigned)(MAPS_JSON_POOL / 1024));
+  s_json_pool.n_alloc = s_json_pool.n_heap = 0;
+#endif
+  s_json_msgs = 0;
+  s_json_stats_ms = now;
+}
+
+/* ── Reloj y latencia ────────────────────────────────────────────── */
+static void send_ping(void) {
+  if (!s_ws || !s_has_client) return;
+  uint32_t now = millis();
+  if (!lat_clock_ping_due(now)) return;
+  char msg[40];
+  snprintf(msg, sizeof(msg), "{\"t\":\"ping\",\"d\":%lu}", (unsigned long)now);
+  s_ws->textAll(msg);
+}
+
+static void send_lat(bool reset) {
+  static char msg[MAPS_LAT_JSON_MAX];
+  lat_to_json(msg, sizeof(msg));
+  if (reset) lat_reset();
+  s_ws->textAll(msg);
+}
+
+/* ── Mensaje del protocolo binario ───────────────────────────────── */
+static void parse_bin_msg(const uint8_t *data, size_t len) {
+  maps_bin_hdr_t hdr;
+  if (!maps_bin_parse_hdr(data, len, &hdr)) {
+    Serial.println("[Maps] bin: cabecera inválida o versión no soportada");
+    return;
+  }
+  if (hdr.type == MAPS_BIN_VEC || hdr.type == MAPS_BIN_DELTA || hdr.type == MAPS_BIN_ROUTE) {
+    if ((uint16_t)(hdr.seq - s_rx_seq) > 1 && s_rx_seq != 0)
+      Serial.printf("[Maps] bin: saltó seq %u → %u\n", s_rx_seq, hdr.seq);
+    s_rx_seq = hdr.seq;
+  }
+
+  const uint8_t *payload = data + hdr.len;
+  size_t         plen    = len - hdr.len;
+
+  uint32_t t0 = micros();
+  uint32_t origin = 0;
+  if ((hdr.flags & MAPS_BIN_FLAG_TS) && lat_phone_to_us(hdr.t_phone, t0, &origin))
+    lat_record(LAT_LINK, t0 - origin);
+
+  switch (hdr.type) {
+  case MAPS_BIN_VEC: {
+    vec_frame_t *frame = (vec_frame_t *)tbuf_write_slot(&s_vec_mb);
+    if (!maps_bin_decode_vec(payload, plen, frame)) {
+      Serial.println("[Maps] vecb: payload inválido");
+      return;
+    }
+    frame->seq = hdr.seq;
+    frame->origin_us = origin;
+    frame->pub_us = micros();
+    s_parse_us = frame->pub_us - t0;
+    lat_record(LAT_PARSE, s_parse_us);
+    tbuf_publish(&s_vec_mb);
+    break;
+  }
+  case MAPS_BIN_DELTA:
+  case MAPS_BIN_ROUTE:
+    /* Se aplica en el hilo de LVGL: el tiempo que cuenta es el de render */
+    s_parse_us = 0;
+    if (s_on_delta) s_on_delta(hdr.type, hdr.seq, origin, payload, plen);
+    break;
+  case MAPS_BIN_CLOCK: {
+    maps_bin_rd_t r = { payload, payload + plen, true };
+    uint32_t d = maps_bin_rd_varint(r);
+    uint32_t p = maps_bin_rd_varint(r);
+    if (r.ok) lat_clock_sample(d, p, millis());
+    send_ping(); /* el siguiente de la ráfaga, si toca */
+    break;
+  }
+  case MAPS_BIN_LAT: {
+    maps_bin_rd_t r = { payload, payload + plen, true };
+    uint8_t flags = maps_bin_rd_u8(r);
+    send_lat(r.ok && (flags & MAPS_LAT_RESET));
+    break;
+  }
+  default:
+    Serial.printf("[Maps] bin: tipo desconocido %u\n", hdr.type);
+    break;
+  }
 }
 
 /* ── WebSocket event handler ─────────────────────────────────────── */
 static void on_ws_event(AsyncWebSocket *ws, AsyncWebSocketClient *client,
                         AwsEventType type, void *arg, uint8_t *data,
                         size_t len) {
-  (void)ws; (void)client;
+  (void)ws;
 
   if (type == WS_EVT_CONNECT) {
     Serial.println("[Maps] cliente conectado");
     s_has_client = true;
+    s_rx_seq = 0;
+    char hello[128];
+    snprintf(hello, sizeof(hello), "{\"t\":\"hello\",\"v\":%d,\"caps\":[" MAPS_CAPS "%s]}",
+             MAPS_BIN_VERSION, s_pack ? ",\"pack\"" : "");
+    client->text(hello);
+    lat_clock_reset();
+    s_json_msgs = 0;
+    s_json_stats_ms = millis();
+    send_ping();
+#if MAPS_REC
+    map_rec_begin();
+#endif
     return;
   }
   if (type == WS_EVT_DISCONNECT) {
     Serial.println("[Maps] cliente desconectado");
     s_has_client = false;
+#if MAPS_REC
+    map_rec_end();
+#endif
     return;
   }
   if (type != WS_EVT_DATA || len == 0) return;
 
   AwsFrameInfo *info = (AwsFrameInfo *)arg;
+#if MAPS_REC
+  map_rec_feed(info->message_opcode == WS_TEXT, (size_t)info->index, (size_t)info->len,
+               info->final, data, len);
+#endif
 
-  /* ── Mensajes binarios (JPEG legacy) ──────────────────────────── */
+  /* ── Mensajes binarios (protocolo binario o JPEG legacy) ──────── */
   if (info->message_opcode == WS_BINARY) {
-    if (!s_map_buf || !s_on_frame) return;
-
-    if (!s_jpeg_buf) {
-      s_jpeg_buf = (uint8_t *)heap_caps_malloc(
-          MAPS_JPEG_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-      if (!s_jpeg_buf)
-        s_jpeg_buf = (uint8_t *)heap_caps_malloc(
-            MAPS_JPEG_MAX, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
-      if (!s_jpeg_buf) {
-        Serial.println("[Maps] ERROR: sin memoria para jpeg_buf");
+    if (!s_bin_buf) {
+      s_bin_buf = (uint8_t *)heap_caps_malloc(
+          MAPS_BIN_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+      if (!s_bin_buf)
+        s_bin_buf = (uint8_t *)heap_caps_malloc(
+            MAPS_BIN_MAX, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+      if (!s_bin_buf) {
+        Serial.println("[Maps] ERROR: sin memoria para bin_buf");
         return;
       }
+      bin_rx_init(&s_rx, s_bin_buf, MAPS_BIN_MAX);
     }
 
-    if (info->index == 0)
-      Serial.printf("[Maps] JPEG iniciando, total: %llu bytes\n", info->len);
-
-    if (info->index + len > MAPS_JPEG_MAX) {
-      Serial.printf("[Maps] JPEG demasiado grande (%llu bytes)\n", info->len);
-      return;
-    }
-
-    memcpy(s_jpeg_buf + info->index, data, len);
-    if (info->index + len < info->len || !info->final) return;
-
-    Serial.printf("[Maps] JPEG completo, %llu bytes\n", info->len);
-    TJpgDec.setCallback(maps_jpeg_output);
-    JRESULT r = TJpgDec.drawJpg(0, 0, s_jpeg_buf, (uint32_t)info->len);
-    if (r == JDR_OK) {
-      Serial.println("[Maps] JPEG decodificado OK");
-      s_on_frame();
-    } else {
-      Serial.printf("[Maps] JPEG decode error %d\n", (int)r);
+    bin_rx_out_t out;
+    switch (bin_rx_feed(&s_rx, (size_t)info->index, (size_t)info->len, info->final, data,
+                        len, &out)) {
+    case BIN_RX_MSG:
+      parse_bin_msg(out.data, out.len);
+      break;
+    case BIN_RX_JPEG:
+      if (out.tag) {
+        /* Tile raster: el JPEG va al decoder como el legacy, con su clave,
+         * y una copia comprimida a la flash */
+        jpeg_stream_feed(out.tag, out.index, out.total, out.data, out.len);
+        map_tiles_fs_feed(out.tag, out.index, out.total, out.data, out.len);
+        break;
+      }
+      /* JPEG: cada fragmento va directo al decoder, sin ensamblar */
+      if (!s_map_buf) break;
+      if (out.index == 0)
+        Serial.printf("[Maps] JPEG iniciando, total: %llu bytes\n", info->len);
+      jpeg_stream_feed(0, out.index, out.total, out.data, out.len);
+      break;
+    case BIN_RX_ERR_TILE_HS:
+      Serial.println("[Maps] tile: comprimido no soportado");
+      break;
+    case BIN_RX_ERR_TILE_HDR:
+      Serial.println("[Maps] tile: cabecera inválida");
+      break;
+    case BIN_RX_ERR_HS_BIG:
+      Serial.println("[Maps] hs: descomprimido demasiado grande");
+      break;
+    case BIN_RX_ERR_BIG:
+      Serial.printf("[Maps] binario demasiado grande (%llu bytes)\n", info->len);
+      break;
+    default:
+      break;
     }
     return;
   }
 
   /* ── Mensajes de texto (JSON vectorial / nav) ─────────────────── */
   if (info->message_opcode == WS_TEXT) {
+#if MAPS_JSON_STREAM
+    /* El parser escribe directo en los slots libres de los buzones; el
+     * que corresponde al tipo del mensaje se publica al final. */
+    vec_frame_t *vec = (vec_frame_t *)tbuf_write_slot(&s_vec_mb);
+    nav_step_t  *nav = (nav_step_t *)tbuf_write_slot(&s_nav_mb);
+    uint32_t t0 = micros();
+    if (info->num == 0 && info->index == 0) {
+      map_json_begin(&s_json, vec, nav);
+      s_json_us = 0;
+    }
+    map_json_feed(&s_json, (const char *)data, len);
+    s_json_us += micros() - t0;
+    if (info->index + len < info->len || !info->final) return;
+
+    map_json_type_t kind = map_json_end(&s_json);
+    s_parse_us = s_json_us;
+    switch (kind) {
+    case MAP_JSON_VEC:
+      vec->seq = 0;
+      vec->origin_us = 0;
+      vec->pub_us = micros();
+      lat_record(LAT_PARSE, s_parse_us);
+      log_vec(*vec);
+      tbuf_publish(&s_vec_mb);
+      break;
+    case MAP_JSON_NAV:
+      Serial.printf("[Maps] nav: %s  %s  ETA %s\n", nav->step, nav->dist,
+                    nav->eta);
+      tbuf_publish(&s_nav_mb);
+      break;
+    case MAP_JSON_GPS:
+      *(int *)tbuf_write_slot(&s_gps_mb) = s_json.spd;
+      tbuf_publish(&s_gps_mb);
+      break;
+    default:
+      Serial.println("[Maps] texto: JSON inválido o tipo desconocido");
+      break;
+    }
+    json_stats();
+#else
     if (!s_text_buf) {
       s_text_buf = (char *)heap_caps_malloc(
           MAPS_TEXT_MAX, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
@@ -202,11 +525,19 @@ static void on_ws_event(AsyncWebSocket *ws, AsyncWebSocketClient *client,
         Serial.println("[Maps] ERROR: sin memoria para text_buf");
         return;
       }
+      json_pool_init();
     }
 
-    if (info->index + len >= MAPS_TEXT_MAX) return;
-    memcpy(s_text_buf + info->index, data, len);
+    if (info->num == 0 && info->index == 0) s_text_big = false;
+    if (info->index + len >= MAPS_TEXT_MAX) s_text_big = true;
+    else if (!s_text_big) memcpy(s_text_buf + info->index, data, len);
     if (info->index + len < info->len || !info->final) return;
+    if (s_text_big) {
+      Serial.printf("[Maps] texto: %llu bytes no entran en text_buf, pidiendo resync\n",
+                    info->len);
+      maps_ws_request_resync();
+      return;
+    }
 
     /* Null-terminate y parsear */
     size_t total = (size_t)info->len;
@@ -217,37 +548,50 @@ static void on_ws_event(AsyncWebSocket *ws, AsyncWebSocketClient *client,
     if (!t_start) return;
     t_start += 5;
 
-    if (strncmp(t_start, "vec", 3) == 0)
+    s_json_pool.reset();
+    if (strncmp(t_start, "vec", 3) == 0) {
+      uint32_t t0 = micros();
       parse_vec_frame(s_text_buf, total);
-    else if (strncmp(t_start, "nav", 3) == 0)
+      s_parse_us = micros() - t0;
+      lat_record(LAT_PARSE, s_parse_us);
+    } else if (strncmp(t_start, "nav", 3) == 0)
       parse_nav_step(s_text_buf, total);
     else if (strncmp(t_start, "gps", 3) == 0)
       parse_gps_spd(s_text_buf, total);
+    json_stats();
+#endif
   }
 }
 
 /* ── maps_ws_start ───────────────────────────────────────────────── */
-bool maps_ws_start(uint16_t *map_buf, maps_ws_on_frame_t on_frame,
-                   maps_ws_on_vec_t on_vec, maps_ws_on_nav_t on_nav) {
+bool maps_ws_start(uint16_t *map_buf, maps_ws_on_frame_t on_frame) {
   if (s_server) return true;
   if (!map_buf || !on_frame) return false;
 
-  if (!s_vec_frame) {
-    s_vec_frame = (vec_frame_t *)heap_caps_malloc(
-        sizeof(vec_frame_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
-    if (!s_vec_frame) {
+  if (!s_vec_mem) {
+    s_vec_mem = (uint8_t *)heap_caps_malloc(
+        3 * VEC_FRAME_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_vec_mem) {
       Serial.println("[Maps] ERROR: sin memoria para vec_frame");
       return false;
     }
   }
-
+  for (uint8_t i = 0; i < 3; i++)
+    vec_frame_init(&s_vec_slots[i], s_vec_mem + i * VEC_FRAME_BYTES, VEC_FRAME_BYTES);
+  tbuf_init(&s_vec_mb, &s_vec_slots[0], &s_vec_slots[1], &s_vec_slots[2]);
+  tbuf_init(&s_nav_mb, &s_nav_slots[0], &s_nav_slots[1], &s_nav_slots[2]);
+  tbuf_init(&s_gps_mb, &s_gps_slots[0], &s_gps_slots[1], &s_gps_slots[2]);
+
+  if (!jpeg_stream_start(map_buf, MAPS_WS_MAP_W, MAPS_WS_MAP_H, on_frame)) {
+    Serial.println("[Maps] ERROR: sin memoria para el decoder JPEG");
+    return false;
+  }
   s_map_buf  = map_buf;
   s_on_frame = on_frame;
-  s_on_vec   = on_vec;
-  s_on_nav   = on_nav;
 
   WiFi.mode(WIFI_AP);
   if (!WiFi.softAP(MAPS_AP_SSID, MAPS_AP_PASS, 1, 0, 4)) {
+    jpeg_stream_stop();
     s_map_buf = nullptr; s_on_frame = nullptr;
     return false;
   }
@@ -263,21 +607,84 @@ bool maps_ws_start(uint16_t *map_buf, maps_ws_on_frame_t on_frame,
   return true;
 }
 
-/* ── maps_ws_set_gps_cb ──────────────────────────────────────────── */
-void maps_ws_set_gps_cb(maps_ws_on_gps_t cb) { s_on_gps = cb; }
+/* ── maps_ws_set_delta_cb ────────────────────────────────────────── */
+void maps_ws_set_delta_cb(maps_ws_on_delta_t cb) { s_on_delta = cb; }
+
+void maps_ws_set_pack(bool on) { s_pack = on; }
+
+/* ── Buzones ─────────────────────────────────────────────────────── */
+const vec_frame_t *maps_ws_take_vec(void) {
+  return s_server ? (const vec_frame_t *)tbuf_take(&s_vec_mb) : nullptr;
+}
+
+const nav_step_t *maps_ws_take_nav(void) {
+  return s_server ? (const nav_step_t *)tbuf_take(&s_nav_mb) : nullptr;
+}
+
+bool maps_ws_take_gps(int *speed_kmh) {
+  const int *v = s_server ? (const int *)tbuf_take(&s_gps_mb) : nullptr;
+  if (!v) return false;
+  *speed_kmh = *v;
+  return true;
+}
+
+/* ── maps_ws_request_resync ──────────────────────────────────────── */
+void maps_ws_request_resync(void) {
+  if (s_ws && s_has_client) s_ws->textAll("{\"t\":\"resync\"}");
+}
+
+/* ── maps_ws_send_route_cap ──────────────────────────────────────── */
+void maps_ws_send_route_cap(uint32_t id, uint32_t max) {
+  if (!s_ws || !s_has_client) return;
+  char msg[64];
+  snprintf(msg, sizeof(msg), "{\"t\":\"route_cap\",\"id\":%lu,\"max\":%lu}",
+           (unsigned long)id, (unsigned long)max);
+  s_ws->textAll(msg);
+}
+
+/* ── maps_ws_send_ack ────────────────────────────────────────────── */
+void maps_ws_send_ack(uint16_t seq, uint32_t rast_us) {
+  if (!s_ws || !s_has_client) return;
+  char msg[128];
+  snprintf(msg, sizeof(msg),
+           "{\"t\":\"ack\",\"seq\":%u,\"parse_us\":%lu,\"rast_us\":%lu,"
+           "\"heap\":%u,\"psram\":%u}",
+           seq, (unsigned long)s_parse_us, (unsigned long)rast_us,
+           (unsigned)heap_caps_get_free_size(MALLOC_CAP_INTERNAL),
+           (unsigned)heap_caps_get_free_size(MALLOC_CAP_SPIRAM));
+  s_ws->textAll(msg);
+  send_ping(); /* renovar el offset de reloj cada LAT_CLOCK_RENEW_MS */
+}
+
+/* ── maps_ws_request_tiles ────────────────────────────────────────── */
+void maps_ws_request_tiles(uint8_t z, const maps_tile_xy_t *xy, uint8_t n) {
+  if (!s_ws || !s_has_client || !n) return;
+  char msg[48 + MAP_TILES_NEED_MAX * 24];
+  int len = snprintf(msg, sizeof(msg), "{\"t\":\"tiles\",\"z\":%u,\"need\":[", z);
+  for (uint8_t i = 0; i < n && len < (int)sizeof(msg) - 26; i++)
+    len += snprintf(msg + len, sizeof(msg) - len, "%s[%lu,%lu]", i ? "," : "",
+                    (unsigned long)xy[i].x, (unsigned long)xy[i].y);
+  snprintf(msg + len, sizeof(msg) - len, "]}");
+  s_ws->textAll(msg);
+}
 
 /* ── maps_ws_stop ────────────────────────────────────────────────── */
 void maps_ws_stop(void) {
   if (s_server) { s_server->end(); delete s_server; s_server = nullptr; }
   if (s_ws)     { delete s_ws;     s_ws     = nullptr; }
-  if (s_jpeg_buf)  { heap_caps_free(s_jpeg_buf);  s_jpeg_buf  = nullptr; }
+  jpeg_stream_stop();
+  if (s_bin_buf)   { heap_caps_free(s_bin_buf);   s_bin_buf   = nullptr; }
+#if !MAPS_JSON_STREAM
   if (s_text_buf)  { heap_caps_free(s_text_buf);  s_text_buf  = nullptr; }
-  if (s_vec_frame) { heap_caps_free(s_vec_frame); s_vec_frame = nullptr; }
+  if (s_json_pool.arena.base) {
+    heap_caps_free(s_json_pool.arena.base);
+    map_arena_init(&s_json_pool.arena, nullptr, 0);
+  }
+#endif
+  if (s_vec_mem)   { heap_caps_free(s_vec_mem);   s_vec_mem   = nullptr; }
   s_map_buf  = nullptr;
   s_on_frame = nullptr;
-  s_on_vec   = nullptr;
-  s_on_nav   = nullptr;
-  s_on_gps     = nullptr;
+  s_on_delta = nullptr;
   s_has_client = false;
   WiFi.softAPdisconnect(true);
 }
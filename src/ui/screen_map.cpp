@@ -1,23 +1,53 @@
 /*
  * Pantalla Mapas – portrait 320×480.
  *
- * Renderiza un frame vectorial recibido por WebSocket:
- *   - Fondo oscuro (#1C1C2E)
- *   - Calles grises (grosor 1-3 px según tipo)
- *   - Ruta azul (#4488FF, grosor 3 px)
- *   - Marcador de posición: círculo blanco + punto azul
- *   - Label de navegación en la parte inferior
+ * Dibuja el mapa que manda la app por WebSocket en una de tres fuentes:
+ *   - Frame vectorial completo, ya proyectado por la app (fallback)
+ *   - Conjunto persistente en PSRAM ("vecd", vec_store en coordenadas de
+ *     mundo), proyectado acá con posición, heading y zoom de cada delta
+ *   - Tiles raster z/x/y de la caché LRU (map_tiles) o de la flash
+ *     (map_tiles_fs); solo se piden a la app los que faltan
  *
- * El canvas comparte el mismo buffer RGB565 en PSRAM que antes.
+ * Calles (3/5/8 px según tipo) y ruta (5 px, lo recorrido más apagado) se
+ * rasterizan directo sobre el buffer RGB565 con map_raster; los labels se
+ * copian sin solapes desde la caché de map_labels y solo el marcador pasa
+ * por LVGL. El render es incremental: map_damage compara las primitivas con
+ * las del frame anterior y solo se repintan e invalidan esos rectángulos.
+ *
+ * Con el conjunto, la posición se extrapola entre fixes y el mapa se anima
+ * a ~30 fps moviendo una ventana sobre un buffer rasterizado con margen; se
+ * vuelve a rasterizar si cambia algo más que la posición o la ventana sale
+ * del margen, y con la ventana quieta solo se copia lo repintado. La ruta codificada ("route") vive entera en nav_route y, con
+ * las maniobras ("nav"), da giro, distancia y ETA aunque la app se corte.
+ *
+ * Doble toque / toque largo ajustan el zoom local; un toque largo en el
+ * botón de orientación muestra las latencias por etapa (map_latency).
  * El botón "Volver" flota en la esquina superior izquierda.
  */
 #include "screen_map.h"
 #include "../dispcfg.h"
+#include "../maps/jpeg_stream.h"
+#include "../maps/map_damage.h"
+#include "../maps/map_labels.h"
+#include "../maps/map_latency.h"
+#include "../maps/map_pack_sd.h"
+#include "../maps/map_raster.h"
+#include "../maps/map_tiles.h"
+#include "../maps/map_tiles_fs.h"
+#include "../maps/nav_route.h"
+#include "../maps/route_poly.h"
+#include "../maps/vec_grid.h"
+#include "../maps/vec_proto.h"
+#include "../maps/vec_store.h"
 #include "maps_ws_server.h"
 #include "ui.h"
 
+#include <Arduino.h>
+#include <cmath>
 #include <cstring>
 #include <esp_heap_caps.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/ringbuf.h>
 #include <lvgl.h>
 
 #define COLOR_BG lv_color_hex(0x1C1C2E)
@@ -25,12 +55,78 @@
 #define COLOR_ROAD_2 lv_color_hex(0x555580)  /* calle secundaria */
 #define COLOR_ROAD_3 lv_color_hex(0x7777AA)  /* autopista */
 #define COLOR_ROUTE lv_color_hex(0x4488FF)   /* ruta activa */
+#define COLOR_ROUTE_DONE lv_color_hex(0x34507A) /* ruta ya recorrida */
 #define COLOR_POS_OUT lv_color_hex(0xFFFFFF) /* borde del marcador */
 #define COLOR_POS_IN lv_color_hex(0x4488FF)  /* centro del marcador */
 #define COLOR_BTN_BG lv_color_hex(0x1A1A2E)
 #define COLOR_ACCENT lv_color_hex(0xE94560)
 #define COLOR_TEXT lv_color_hex(0xEEEEEE)
 #define COLOR_NAV_BG lv_color_hex(0x12122A)
+#define COLOR_LABEL lv_color_hex(0xFFFFFF)        /* nombre de calle */
+#define COLOR_LABEL_SHADOW lv_color_hex(0x000000) /* sombra 1 px */
+
+/* Ancla del vehículo en modo delta (misma que usa la app en modo completo) */
+#define MAP_POS_X (MAPS_WS_MAP_W / 2)
+#define MAP_POS_Y (MAPS_WS_MAP_H * 3 / 4)
+/* Radio de dibujo: esquina más lejana al ancla en el buffer extendido
+ * (~466 px, ver MAP_OVER_X/Y) + grosor máximo */
+#define MAP_CULL_RADIUS 480
+/* Cola WS → LVGL de payloads delta (un RESET denso ocupa ~20-30 KB) */
+#define MAP_DELTA_RING_BYTES (64 * 1024)
+/* Bordes de calles y ruta con antialias (0 = aliasado, algo más barato) */
+#ifndef MAP_AA
+#define MAP_AA 1
+#endif
+/* Tramos visibles de la ruta codificada (de NAV_RUN_SEGS segmentos) y
+ * cuánto se mueve (px) el punto que la divide antes de redibujarla */
+#define MAP_ROUTE_RUNS 128
+#define MAP_SPLIT_PX 3
+/* Primitivas por frame: el máximo entre frame completo y conjunto
+ * persistente (cada tramo de ruta da hasta dos: recorrido y por recorrer) */
+#define MAP_MAX_PRIMS (VEC_STORE_MAX_ITEMS + VEC_STORE_MAX_LABELS + 2 * MAP_ROUTE_RUNS + 1)
+/* Polilíneas de un frame completo que entran en la lista (lo que sobra
+ * queda sin dibujar; los labels usan los mismos buffers que el conjunto) */
+#define MAP_FRAME_POLYS (MAP_MAX_PRIMS - VEC_STORE_MAX_LABELS - 1)
+/* Índice espacial del conjunto: elementos y después labels */
+#define MAP_GRID_ENTRIES (VEC_STORE_MAX_ITEMS + VEC_STORE_MAX_LABELS)
+#define MAP_GRID_ARENA_BYTES (96 * 1024)
+/* Margen (px) de las consultas por rectángulo: grosor de calle y media caja
+ * del label más ancho */
+#define MAP_GRID_PAD (LBL_MAX_W / 2 + 4)
+/* Animación del modo delta: ventana a ~30 fps sobre un buffer con margen
+ * por lado (~470 KB en PSRAM); el vertical es mayor porque con heading
+ * arriba el mapa se mueve casi siempre en vertical */
+#define MAP_ANIM_MS 33
+#define MAP_OVER_X 32
+#define MAP_OVER_Y 64
+#define MAP_OVER_W (MAPS_WS_MAP_W + 2 * MAP_OVER_X)
+#define MAP_OVER_H (MAPS_WS_MAP_H + 2 * MAP_OVER_Y)
+/* Puntos proyectados de una polilínea (conjunto, frame des-rotado o medio
+ * tramo de ruta: NAV_RUN_SEGS + 1 vértices más el punto de corte) */
+#define MAP_PROJ_PTS \
+  (VEC_FRAME_POLY_PTS > VEC_STORE_ITEM_PTS ? VEC_FRAME_POLY_PTS : VEC_STORE_ITEM_PTS)
+static_assert(MAP_PROJ_PTS >= NAV_RUN_SEGS + 2, "MAP_PROJ_PTS no alcanza para un tramo de ruta");
+/* Suavizado del ángulo con heading arriba: 1/MAP_ROT_EASE de lo que falta
+ * cada MAP_ANIM_MS, cuantizado a MAP_ROT_STEP (ángulo binario, ~0,35°) */
+#define MAP_ROT_EASE 4
+#define MAP_ROT_STEP 64
+/* Tope de la extrapolación sin fixes nuevos */
+#define MAP_DR_MAX_MS 1500
+/* Caché de nombres rasterizados (slots de LBL_SLOT_BYTES, ~160 KB) */
+#define MAP_LABEL_POOL_BYTES (64 * LBL_SLOT_BYTES)
+/* Tolerancia (px) al tocar una calle */
+#define MAP_PICK_PX 14
+/* Zoom local: límites, doble toque y tope de vértices proyectados por
+ * render (si se pasa, el nivel de detalle sube un escalón) */
+#define MAP_ZOOM_MIN 10
+#define MAP_DTAP_MS 350
+#define MAP_DTAP_PX 30
+#define MAP_VERTEX_BUDGET 3000
+#define MAP_LOD_BIAS_MAX 6
+/* Reintento de un pedido de tiles que no llegó (ms) */
+#define MAP_TILE_REQ_MS 2000
+/* Refresco del overlay de latencia */
+#define MAP_LAT_OVERLAY_MS 1000
 
 static lv_obj_t *scr = nullptr;
 static lv_obj_t *canvas = nullptr;
@@ -40,128 +136,149 @@ static lv_obj_t *lbl_dist = nullptr;   /* distancia al próximo giro */
 static lv_obj_t *lbl_eta = nullptr;    /* ETA al destino */
 static lv_obj_t *lbl_spd = nullptr;    /* velocidad GPS */
 static lv_obj_t *spd_circle = nullptr; /* contenedor del círculo */
+static lv_obj_t *lbl_lat = nullptr;    /* overlay de latencia */
 static uint16_t *s_map_buf = nullptr;
 
-static volatile bool s_vec_dirty = false;
-static volatile bool s_nav_dirty = false;
-static volatile bool s_spd_dirty = false;
-static volatile bool s_has_received_frame = false;
-static volatile int s_pending_spd = 0;
+/* Frames, nav y velocidad llegan por los buzones de maps_ws (maps_ws_take_*):
+ * el timer lee el slot publicado más nuevo sin copiarlo. */
+static bool s_has_received_frame = false;
 static lv_timer_t *s_dirty_timer = nullptr;
+static lv_timer_t *s_anim_timer = nullptr;
 
-/* Copias seguras para acceso desde el timer (hilo LVGL) – en PSRAM */
-static vec_frame_t *s_pending_vec = nullptr;
-static nav_step_t s_pending_nav;
+/* Modo delta: conjunto persistente (solo lo toca el hilo LVGL) y la cola
+ * por la que llegan los payloads desde el task del WebSocket. Los deltas no
+ * se pueden descartar como un frame completo: si la cola se llena se pide
+ * un resync a la app. */
+static vec_store_t *s_store = nullptr;
+static RingbufHandle_t s_delta_ring = nullptr;
+static StaticRingbuffer_t s_delta_ring_ctl;
+static volatile bool s_delta_lost = false;
 
-/* ── Callbacks del WebSocket (ISR context) ───────────────────────── */
+/* ── Callbacks del WebSocket (task de red) ───────────────────────── */
 static void on_map_frame(void) {
   /* JPEG legacy: no hacemos nada en modo vectorial */
 }
 
-static void on_vec_frame(const vec_frame_t &f) {
-  if (!s_pending_vec)
-    return;
-  memcpy(s_pending_vec, &f, sizeof(vec_frame_t));
-  s_has_received_frame = true;
-  s_vec_dirty = true;
-}
+/* Cada item de la cola: delta_hdr_t + payload (MAPS_BIN_DELTA o MAPS_BIN_ROUTE) */
+struct delta_hdr_t {
+  uint32_t origin_us; /* fix GPS (0 si no se sabe) */
+  uint32_t pub_us;    /* encolado */
+  uint16_t seq;
+  uint8_t  type;
+};
 
-static void on_nav_step(const nav_step_t &n) {
-  memcpy(&s_pending_nav, &n, sizeof(nav_step_t));
-  s_nav_dirty = true;
+static void on_delta(uint8_t type, uint16_t seq, uint32_t origin_us,
+                     const uint8_t *payload, size_t len) {
+  if (!s_delta_ring)
+    return;
+  void *p;
+  if (xRingbufferSendAcquire(s_delta_ring, &p, sizeof(delta_hdr_t) + len, 0) != pdTRUE) {
+    s_delta_lost = true;
+    return;
+  }
+  delta_hdr_t hdr = {origin_us, micros(), seq, type};
+  memcpy(p, &hdr, sizeof(hdr));
+  memcpy((uint8_t *)p + sizeof(hdr), payload, len);
+  xRingbufferSendComplete(s_delta_ring, p);
 }
 
-static void on_gps_speed(int speed_kmh) {
-  s_pending_spd = speed_kmh;
-  s_spd_dirty = true;
-}
+/* ── Ruta codificada (MAPS_BIN_ROUTE) ────────────────────────────────
+ * Las partes se decodifican en el lugar, al final de la polilínea de
+ * s_nav, a medida que salen de la cola; con la última se arman distancias y
+ * árbol. Mientras tanto s_nav queda inválida. Una parte fuera de orden
+ * descarta la ruta y pide resync (la app la vuelve a mandar entera). Si
+ * s_nav se llena antes de la última parte, la ruta se cierra ahí, el resto
+ * se descarta y se avisa a la app con route_cap para que la mande diezmada.
+ * El id 0 vuelve a la ruta de los tramos del conjunto. */
+static map_arena_t s_nav_arena = {nullptr, 0, 0};
+static nav_route_t s_nav;
+static uint32_t s_route_id = 0;   /* ruta codificada completa en s_nav (0: ninguna) */
+static uint32_t s_route_rx = 0;   /* la que está llegando (0: ninguna) */
+static uint32_t s_route_next = 0; /* primer punto esperado de la próxima parte */
+static uint32_t s_route_total = 0;
+static uint32_t s_route_gen = 0;  /* cambia con cada ruta codificada nueva o borrada */
+static bool s_nav_rebuild = false; /* volver a armar s_nav desde el conjunto */
 
-/* ── Dibujo del frame vectorial sobre el canvas ──────────────────── */
-static void render_vec_frame(const vec_frame_t &f) {
-  if (!canvas)
-    return;
+static bool route_rx(const uint8_t *payload, size_t len) {
+  maps_bin_rd_t r = {payload, payload + len, true};
+  uint32_t id = maps_bin_rd_varint(r);
+  uint32_t total = maps_bin_rd_varint(r);
+  uint32_t first = maps_bin_rd_varint(r);
+  uint8_t precision = maps_bin_rd_u8(r);
+  if (!r.ok)
+    return false;
+  if (!s_nav_arena.base)
+    return true; /* sin arena no hay guía; no es un error del enlace */
+  if (id == 0) {
+    if (s_route_id || s_route_rx)
+      s_route_gen++;
+    s_route_id = s_route_rx = 0;
+    s_nav_rebuild = true;
+    return true;
+  }
+  if (first == 0) {
+    nav_route_begin(&s_nav, &s_nav_arena);
+    s_route_id = 0;
+    s_route_rx = id;
+    s_route_total = total;
+    s_route_gen++;
+  } else if (id == s_route_id) {
+    return true; /* resto de una ruta truncada; la app ya recibió route_cap */
+  } else if (id != s_route_rx || first != s_route_next) {
+    s_route_rx = 0;
+    s_nav_rebuild = true;
+    return false;
+  }
 
-  lv_canvas_fill_bg(canvas, COLOR_BG, LV_OPA_COVER);
+  uint16_t at = s_nav.n_pts;
+  int32_t n = route_poly_decode(r.p, r.end - r.p, precision, s_nav.pts + at,
+                                NAV_ROUTE_MAX_PTS - at);
+  if (n < 0) {
+    s_route_rx = 0;
+    s_nav_rebuild = true;
+    return false;
+  }
+  nav_route_append(&s_nav, s_nav.pts + at, (uint16_t)n);
+  s_route_next = first + (uint32_t)n;
+  /* nav_route_append salta duplicados, así que s_nav puede tener lugar aunque
+   * la decodificación haya llegado al tope; en ese caso el resto de la parte
+   * ya se perdió y la próxima no seguiría donde quedó s_route_next. */
+  bool cut = at + n >= NAV_ROUTE_MAX_PTS || s_nav.n_pts >= NAV_ROUTE_MAX_PTS;
+  if (s_route_next < s_route_total && !cut)
+    return true;
+  if (s_route_next < s_route_total) {
+    Serial.printf("[Maps] Ruta %lu truncada en %u de %lu puntos\n", (unsigned long)s_route_rx,
+                  s_nav.n_pts, (unsigned long)s_route_total);
+    maps_ws_send_route_cap(s_route_rx, NAV_ROUTE_MAX_PTS);
+  }
 
-  lv_layer_t layer;
-  lv_canvas_init_layer(canvas, &layer);
+  nav_route_finish(&s_nav, &s_nav_arena, s_store);
+  s_route_id = s_route_rx;
+  s_route_rx = 0;
+  s_route_gen++;
+  Serial.printf("[Maps] Ruta codificada: %u puntos (%lu enviados), %.1f km, arena %u KB\n",
+                s_nav.n_pts, (unsigned long)s_route_total, s_nav.len_m / 1000.0f,
+                (unsigned)(s_nav_arena.used / 1024));
+  return true;
+}
 
-  /* Calles */
-  lv_draw_line_dsc_t road_dsc;
-  lv_draw_line_dsc_init(&road_dsc);
-  road_dsc.opa = LV_OPA_COVER;
-
-  /* En LVGL 9.2, p1/p2 son campos del descriptor (no argumentos separados) */
-  for (uint8_t i = 0; i < f.n_roads; i++) {
-    const vec_road_t &r = f.roads[i];
-    switch (r.w) {
-    case 3:
-      road_dsc.color = COLOR_ROAD_3;
-      road_dsc.width = 8;
-      break;
-    case 2:
-      road_dsc.color = COLOR_ROAD_2;
-      road_dsc.width = 5;
-      break;
-    default:
-      road_dsc.color = COLOR_ROAD_1;
-      road_dsc.width = 3;
-      break;
-    }
-    for (uint8_t j = 0; j + 1 < r.n; j++) {
-      road_dsc.p1.x = r.pts[j].x;
-      road_dsc.p1.y = r.pts[j].y;
-      road_dsc.p2.x = r.pts[j + 1].x;
-      road_dsc.p2.y = r.pts[j + 1].y;
-      lv_draw_line(&layer, &road_dsc);
-    }
-  }
+/* ── Primitivas de dibujo ────────────────────────────────────────── */
+#define ROUTE_WIDTH 5
 
-  /* Ruta */
-  if (f.n_route >= 2) {
-    lv_draw_line_dsc_t rte_dsc;
-    lv_draw_line_dsc_init(&rte_dsc);
-    rte_dsc.color = COLOR_ROUTE;
-    rte_dsc.width = 5;
-    rte_dsc.opa = LV_OPA_COVER;
-    rte_dsc.round_start = 1;
-    rte_dsc.round_end = 1;
-    for (uint16_t j = 0; j + 1 < f.n_route; j++) {
-      rte_dsc.p1.x = f.route[j].x;
-      rte_dsc.p1.y = f.route[j].y;
-      rte_dsc.p2.x = f.route[j + 1].x;
-      rte_dsc.p2.y = f.route[j + 1].y;
-      lv_draw_line(&layer, &rte_dsc);
-    }
-  }
+static int32_t road_width(uint8_t w) { return w == 3 ? 8 : w == 2 ? 5 : 3; }
 
-  /* Nombres de calles */
-  if (f.n_labels > 0) {
-    lv_draw_label_dsc_t lbl_dsc;
-    lv_draw_label_dsc_init(&lbl_dsc);
-    lbl_dsc.font = &lv_font_montserrat_12;
-    lbl_dsc.opa = LV_OPA_COVER;
-    lbl_dsc.align = LV_TEXT_ALIGN_CENTER;
-    for (uint8_t i = 0; i < f.n_labels; i++) {
-      int32_t lx = f.labels[i].x;
-      int32_t ly = f.labels[i].y;
-      lv_area_t area = {lx - 55, ly - 8, lx + 55, ly + 8};
-      /* Sombra oscura desplazada 1 px para legibilidad */
-      lv_area_t shadow = {area.x1 + 1, area.y1 + 1, area.x2 + 1, area.y2 + 1};
-      lbl_dsc.color = lv_color_hex(0x000000);
-      lbl_dsc.text = f.labels[i].name;
-      lv_draw_label(&layer, &lbl_dsc, &shadow);
-      /* Texto blanco */
-      lbl_dsc.color = lv_color_white();
-      lv_draw_label(&layer, &lbl_dsc, &area);
-    }
-  }
+static uint16_t road_color(uint8_t w) {
+  return lv_color_to_u16(w == 3   ? COLOR_ROAD_3
+                         : w == 2 ? COLOR_ROAD_2
+                                  : COLOR_ROAD_1);
+}
 
-  /* Marcador de posición: círculo blanco (radio 8) + punto azul (radio 5) */
+/* Marcador de posición: círculo blanco (radio 8) + punto azul (radio 5) */
+static void draw_pos_marker(lv_layer_t *layer, int32_t x, int32_t y) {
   lv_draw_arc_dsc_t arc;
   lv_draw_arc_dsc_init(&arc);
-  arc.center.x = f.pos_x;
-  arc.center.y = f.pos_y;
+  arc.center.x = x;
+  arc.center.y = y;
   arc.start_angle = 0;
   arc.end_angle = 360;
   arc.opa = LV_OPA_COVER;
@@ -169,45 +286,1231 @@ static void render_vec_frame(const vec_frame_t &f) {
   arc.color = COLOR_POS_OUT;
   arc.radius = 8;
   arc.width = 8;
-  lv_draw_arc(&layer, &arc);
+  lv_draw_arc(layer, &arc);
 
   arc.color = COLOR_POS_IN;
   arc.radius = 5;
   arc.width = 5;
-  lv_draw_arc(&layer, &arc);
+  lv_draw_arc(layer, &arc);
+}
+
+/* ── Render incremental ──────────────────────────────────────────
+ * Cada frame se convierte en una lista de primitivas (clave estable, hash
+ * de lo dibujado y bbox en pantalla). La diferencia con la lista anterior da
+ * los rectángulos sucios: solo ahí se repinta el fondo, se redibujan las
+ * primitivas que los tocan (con el clip del layer) y se invalida el área. */
+enum { PRIM_ROAD, PRIM_ROUTE, PRIM_LABEL, PRIM_MARKER };
+
+/* Una fuente: frame completo (ya proyectado) o conjunto persistente + vista */
+struct map_src_t {
+  const vec_frame_t *frame;
+  const vec_store_t *store;
+  vec_view_t view;
+};
+
+static dmg_prim_t *s_prims[2] = {nullptr, nullptr}; /* anterior / actual */
+static uint16_t s_n_prims[2] = {0, 0};
+static uint8_t s_prim_cur = 0;
+static bool s_redraw_all = true;
+static bool s_last_src_store = false; /* cambio de fuente → todo sucio */
+static vec_point_t s_proj[MAP_PROJ_PTS];
+static uint16_t s_n_verts = 0; /* vértices proyectados en el último render */
+
+static const dmg_rect_t k_screen = {0, 0, MAPS_WS_MAP_W - 1,
+                                    MAPS_WS_MAP_H - 1};
+
+/* Destino del render: el buffer del canvas o el extendido del modo delta */
+struct map_target_t {
+  uint16_t  *buf;
+  dmg_rect_t rect;   /* (0, 0, w - 1, h - 1); stride = w */
+  bool       canvas; /* marcador por layer de LVGL + invalidar el canvas */
+};
+
+/* Índice espacial del conjunto persistente en una arena de PSRAM: se rearma
+ * cuando cambia geom_version y lo usan el culling de la vista, el de cada
+ * rectángulo sucio y la selección por toque. Si no entra en la arena se
+ * vuelve al recorrido lineal. */
+#define MAP_NO_PRIM 0xFFFF
+static map_arena_t s_grid_arena = {nullptr, 0, 0};
+static vec_grid_t s_grid;
+static vec_grid_box_t *s_grid_boxes = nullptr;
+static uint32_t s_grid_version = 0;
+static bool s_grid_valid = false;
+static bool s_grid_ok = false;
+static uint32_t s_grid_bits[VEC_GRID_WORDS(MAP_GRID_ENTRIES)];
+static uint16_t s_prim_of_src[MAP_GRID_ENTRIES]; /* entrada → primitiva actual */
+
+/* Calle resaltada por toque (slot del conjunto + id para validarlo) */
+static int16_t s_pick = -1;
+static uint16_t s_pick_id = 0;
+static bool s_pick_dirty = false;
+
+static bool grid_sync(const vec_store_t &s) {
+  if (!s_grid_arena.base)
+    return false;
+  if (s_grid_valid && s_grid_version == s.geom_version)
+    return s_grid_ok;
+
+  map_arena_reset(&s_grid_arena);
+  s_grid_boxes = (vec_grid_box_t *)map_arena_alloc(
+      &s_grid_arena, MAP_GRID_ENTRIES * sizeof(vec_grid_box_t));
+  if (s_grid_boxes) {
+    for (uint16_t i = 0; i < MAP_GRID_ENTRIES; i++)
+      s_grid_boxes[i] = {1, 1, 0, 0}; /* vacía */
+    for (uint16_t i = 0; i < s.n_items; i++) {
+      const vec_store_item_t &it = s.items[i];
+      if (it.used)
+        s_grid_boxes[i] = {it.min_x, it.min_y, it.max_x, it.max_y};
+    }
+    for (uint16_t i = 0; i < s.n_labels; i++) {
+      const vec_store_label_t &l = s.labels[i];
+      if (l.used)
+        s_grid_boxes[VEC_STORE_MAX_ITEMS + i] = {l.x, l.y, l.x, l.y};
+    }
+  }
+  s_grid_ok = s_grid_boxes && vec_grid_build(&s_grid, &s_grid_arena,
+                                             s_grid_boxes, MAP_GRID_ENTRIES);
+  if (!s_grid_ok)
+    Serial.printf("[Maps] Índice espacial sin lugar, recorrido lineal\n");
+  s_grid_version = s.geom_version;
+  s_grid_valid = true;
+  return s_grid_ok;
+}
+
+/* Rectángulo de pantalla (más [pad] px) → bbox en coordenadas de mundo */
+static vec_grid_box_t world_rect(const vec_view_t *v, const dmg_rect_t &r,
+                                 int32_t pad) {
+  const int32_t xs[2] = {r.x1 - pad, r.x2 + pad};
+  const int32_t ys[2] = {r.y1 - pad, r.y2 + pad};
+  vec_grid_box_t b = {INT32_MAX, INT32_MAX, INT32_MIN, INT32_MIN};
+  for (uint8_t i = 0; i < 4; i++) {
+    vec_store_pt_t w = vec_view_unproject(v, xs[i & 1], ys[i >> 1]);
+    if (w.x < b.x1) b.x1 = w.x;
+    if (w.y < b.y1) b.y1 = w.y;
+    if (w.x > b.x2) b.x2 = w.x;
+    if (w.y > b.y2) b.y2 = w.y;
+  }
+  return b;
+}
+
+/* Próximo índice >= i marcado en s_grid_bits, o [end] */
+static uint16_t next_bit(uint16_t i, uint16_t end) {
+  while (i < end) {
+    uint32_t w = s_grid_bits[i >> 5] >> (i & 31);
+    if (w) {
+      i += __builtin_ctz(w);
+      return i < end ? i : end;
+    }
+    i = (i | 31) + 1;
+  }
+  return end;
+}
+
+/* Puntos de un frame en pantalla: tal cual los rotó la app o, si la
+ * orientación en el equipo es otra, corregidos alrededor del marcador */
+static const vec_point_t *frame_pts(const map_src_t &src, const vec_point_t *pts,
+                                    uint16_t n) {
+  if (!src.view.rotate)
+    return pts;
+  for (uint16_t i = 0; i < n; i++)
+    s_proj[i] = vec_view_project(&src.view, pts[i].x, pts[i].y);
+  return s_proj;
+}
+
+/* Tramos de la ruta codificada: fuente MAP_RUN_SRC + 2·k (lo recorrido) y
+ * MAP_RUN_SRC + 2·k + 1 (lo que falta) para el tramo k de nav_route_runs.
+ * El corte (segmento y punto ajustado) se fija al armar la lista, así el
+ * dibujo de cada rectángulo sucio proyecta exactamente lo mismo. */
+#define MAP_RUN_SRC 0x8000
+static uint16_t s_runs[MAP_ROUTE_RUNS];
+static uint16_t s_run_first = 0, s_run_n = 0; /* sus primitivas en la lista actual */
+static uint32_t s_run_seg = 0;
+static vec_store_pt_t s_run_cut = {0, 0};
+static vec_point_t s_run_cut_px = {0, 0}; /* s_run_cut en la vista del render */
+static uint32_t s_run_gen = 0;            /* s_route_gen del render */
+
+static bool route_runs_on(void) { return s_route_id && s_nav.valid; }
+
+static void run_put(const vec_view_t *v, int32_t x, int32_t y, uint16_t &m) {
+  vec_point_t p = vec_view_project(v, x, y);
+  if (m && p.x == s_proj[m - 1].x && p.y == s_proj[m - 1].y)
+    return; /* menos de un píxel: no aporta nada al trazo */
+  s_proj[m++] = p;
+}
+
+/* Mitad [src] de un tramo proyectada en s_proj; devuelve cuántos puntos */
+static uint16_t run_project(const vec_view_t *v, uint16_t src) {
+  const uint32_t n_seg = s_nav.n_pts - 1u;
+  uint32_t a = (uint32_t)((src - MAP_RUN_SRC) >> 1) * NAV_RUN_SEGS;
+  uint32_t b = a + NAV_RUN_SEGS < n_seg ? a + NAV_RUN_SEGS : n_seg;
+  bool ahead = src & 1, cut = s_run_seg >= a && s_run_seg < b;
+  if (ahead ? s_run_seg >= b : s_run_seg < a)
+    return 0;
+  uint16_t m = 0;
+  uint32_t i0 = a, i1 = b;
+  if (ahead && cut) {
+    run_put(v, s_run_cut.x, s_run_cut.y, m);
+    i0 = s_run_seg + 1;
+  } else if (!ahead && cut) {
+    i1 = s_run_seg;
+  }
+  for (uint32_t i = i0; i <= i1; i++)
+    run_put(v, s_nav.pts[i].x, s_nav.pts[i].y, m);
+  if (!ahead && cut)
+    run_put(v, s_run_cut.x, s_run_cut.y, m);
+  return m;
+}
+
+static void line_prim(dmg_prim_t &p, uint8_t type, uint16_t idx,
+                      const vec_point_t *pts, uint16_t n, uint8_t w,
+                      bool hl = false) {
+  /* Un inglete puede salir hasta un grosor completo del vértice */
+  int16_t half = (type == PRIM_ROUTE ? ROUTE_WIDTH : road_width(w)) + 1;
+  dmg_rect_t b = {INT16_MAX, INT16_MAX, INT16_MIN, INT16_MIN};
+  for (uint16_t i = 0; i < n; i++) {
+    if (pts[i].x < b.x1) b.x1 = pts[i].x;
+    if (pts[i].y < b.y1) b.y1 = pts[i].y;
+    if (pts[i].x > b.x2) b.x2 = pts[i].x;
+    if (pts[i].y > b.y2) b.y2 = pts[i].y;
+  }
+  p.key = dmg_key(type, idx);
+  uint8_t style[2] = {w, hl};
+  p.hash = dmg_hash(dmg_hash(DMG_HASH_SEED, style, 2), pts, n * sizeof(vec_point_t));
+  p.box = {(int16_t)(b.x1 - half), (int16_t)(b.y1 - half),
+           (int16_t)(b.x2 + half), (int16_t)(b.y2 + half)};
+  p.src = idx;
+  p.type = type;
+}
+
+static void label_prim(dmg_prim_t &p, uint16_t idx, const dmg_rect_t &box,
+                       const char *name) {
+  p.key = dmg_key(PRIM_LABEL, idx);
+  p.hash = dmg_hash(dmg_hash(DMG_HASH_SEED, &box, sizeof(box)), name, strlen(name));
+  p.box = box; /* bitmap + sombra */
+  p.src = idx;
+  p.type = PRIM_LABEL;
+}
+
+static dmg_rect_t marker_box(int16_t x, int16_t y) {
+  return {(int16_t)(x - 10), (int16_t)(y - 10), (int16_t)(x + 10),
+          (int16_t)(y + 10)};
+}
+
+static void marker_prim(dmg_prim_t &p, int16_t x, int16_t y) {
+  vec_point_t at = {x, y};
+  p.key = dmg_key(PRIM_MARKER, 0);
+  p.hash = dmg_hash(DMG_HASH_SEED, &at, sizeof(at));
+  p.box = marker_box(x, y);
+  p.src = 0;
+  p.type = PRIM_MARKER;
+}
+
+/* ── Labels: colocación sin solapes ──────────────────────────────────
+ * build_prims junta los candidatos visibles (en orden de índice) y
+ * place_labels decide cuáles se dibujan: primero los que ya estaban en
+ * pantalla, para que uno nuevo no desplace a uno existente (sin parpadeo
+ * al moverse), después el resto en orden de la fuente. */
+struct label_cand_t {
+  const char *name;
+  int16_t     x, y;
+  uint16_t    idx; /* índice en la fuente */
+};
+
+static label_cand_t s_lbl_cand[VEC_STORE_MAX_LABELS];
+static dmg_rect_t s_lbl_box[VEC_STORE_MAX_LABELS];            /* por candidato */
+static const lbl_bitmap_t *s_lbl_bmp[VEC_STORE_MAX_LABELS];   /* por índice */
+static uint32_t s_lbl_shown[VEC_GRID_WORDS(VEC_STORE_MAX_LABELS)]; /* aceptados */
+static uint16_t s_n_lbl_cand = 0;
+static lbl_place_t s_place;
+static void *s_lbl_pool = nullptr; /* slots de la caché (PSRAM) */
+
+static uint16_t place_labels(dmg_prim_t *out, uint16_t n, const dmg_rect_t &bounds,
+                             int16_t mx, int16_t my, bool from_store) {
+  uint32_t shown[VEC_GRID_WORDS(VEC_STORE_MAX_LABELS)] = {0};
+  uint32_t accepted[VEC_GRID_WORDS(VEC_STORE_MAX_LABELS)] = {0};
 
+  lbl_cache_frame();
+  lbl_place_begin(&s_place, bounds);
+  lbl_place_block(&s_place, marker_box(mx, my));
+  for (uint8_t pass = 0; pass < 2; pass++) {
+    for (uint16_t k = 0; k < s_n_lbl_cand; k++) {
+      const label_cand_t &c = s_lbl_cand[k];
+      if (vec_grid_test(s_lbl_shown, c.idx) != (pass == 0))
+        continue;
+      const lbl_bitmap_t *b = lbl_cache_get(c.name);
+      if (!b)
+        continue;
+      s_lbl_box[k] = lbl_box(b, c.x, c.y);
+      if (!lbl_place_try(&s_place, s_lbl_box[k]))
+        continue;
+      s_lbl_bmp[c.idx] = b;
+      shown[c.idx >> 5] |= 1u << (c.idx & 31);
+      accepted[k >> 5] |= 1u << (k & 31);
+    }
+  }
+  memcpy(s_lbl_shown, shown, sizeof(shown));
+
+  /* Primitivas en orden de clave */
+  for (uint16_t k = 0; k < s_n_lbl_cand; k++) {
+    if (!vec_grid_test(accepted, k))
+      continue;
+    const label_cand_t &c = s_lbl_cand[k];
+    if (from_store)
+      s_prim_of_src[VEC_STORE_MAX_ITEMS + c.idx] = n;
+    label_prim(out[n++], c.idx, s_lbl_box[k], c.name);
+  }
+  return n;
+}
+
+/* Lista de primitivas en orden de dibujo, que también es orden de clave */
+static uint16_t build_prims(const map_src_t &src, const map_target_t &t,
+                            dmg_prim_t *out) {
+  uint16_t n = 0;
+  if (src.frame) {
+    const vec_frame_t &f = *src.frame;
+    /* La ruta tiene prioridad sobre las calles si no entra todo */
+    uint16_t n_routes = f.n_routes < MAP_FRAME_POLYS ? f.n_routes : MAP_FRAME_POLYS;
+    uint16_t n_roads = f.n_roads < MAP_FRAME_POLYS - n_routes ? f.n_roads
+                                                              : MAP_FRAME_POLYS - n_routes;
+    for (uint16_t i = 0; i < n_roads; i++) {
+      const vec_poly_t &r = f.roads[i];
+      line_prim(out[n++], PRIM_ROAD, i, frame_pts(src, vec_frame_poly_pts(&f, r), r.n),
+                r.n, r.w);
+    }
+    for (uint16_t k = 0; k < n_routes; k++) {
+      const vec_poly_t &r = f.routes[k];
+      line_prim(out[n++], PRIM_ROUTE, k, frame_pts(src, vec_frame_poly_pts(&f, r), r.n),
+                r.n, 0);
+    }
+    s_n_lbl_cand = 0;
+    uint16_t n_labels = f.n_labels < VEC_STORE_MAX_LABELS ? f.n_labels : VEC_STORE_MAX_LABELS;
+    for (uint16_t i = 0; i < n_labels; i++) {
+      const vec_label_t &l = vec_frame_label(&f, i);
+      vec_point_t at = {l.x, l.y};
+      if (src.view.rotate)
+        at = vec_view_project(&src.view, at.x, at.y);
+      s_lbl_cand[s_n_lbl_cand++] = {l.name, at.x, at.y, i};
+    }
+    n = place_labels(out, n, t.rect, f.pos_x, f.pos_y, false);
+    marker_prim(out[n++], f.pos_x, f.pos_y);
+    return n;
+  }
+
+  const vec_store_t &s = *src.store;
+  const vec_view_t *v = &src.view;
+  /* Candidatos: lo que el índice ubica cerca del vehículo, o todo */
+  if (grid_sync(s)) {
+    memset(s_grid_bits, 0, sizeof(s_grid_bits));
+    int64_t r = (int64_t)MAP_CULL_RADIUS << v->shift;
+    vec_grid_box_t q = {(int32_t)(v->pos_x - r), (int32_t)(v->pos_y - r),
+                        (int32_t)(v->pos_x + r), (int32_t)(v->pos_y + r)};
+    vec_grid_query(&s_grid, s_grid_boxes, q, s_grid_bits);
+  } else {
+    memset(s_grid_bits, 0xFF, sizeof(s_grid_bits));
+  }
+  for (uint16_t i = 0; i < MAP_GRID_ENTRIES; i++)
+    s_prim_of_src[i] = MAP_NO_PRIM;
+  s_n_verts = 0;
+
+  /* Calles y luego ruta, para que la ruta quede encima */
+  for (uint8_t type = PRIM_ROAD; type <= PRIM_ROUTE; type++) {
+    uint8_t kind = type == PRIM_ROAD ? MAPS_KIND_ROAD : MAPS_KIND_ROUTE;
+    for (uint16_t i = next_bit(0, s.n_items); i < s.n_items;
+         i = next_bit(i + 1, s.n_items)) {
+      const vec_store_item_t &it = s.items[i];
+      if (!it.used || it.kind != kind || !vec_view_item_near(v, &it, MAP_CULL_RADIUS))
+        continue;
+      uint8_t m = vec_view_project_item(v, &it, s_proj);
+      s_n_verts += m;
+      s_prim_of_src[i] = n;
+      line_prim(out[n++], type, i, s_proj, m, it.w, i == s_pick && it.id == s_pick_id);
+    }
+  }
+  /* Ruta codificada: solo los tramos que caen cerca, encima de las calles */
+  s_run_first = n;
+  s_run_n = 0;
+  s_run_gen = s_route_gen;
+  if (route_runs_on()) {
+    s_run_seg = s_nav.seg;
+    s_run_cut = {s_nav.snap_x, s_nav.snap_y};
+    s_run_cut_px = vec_view_project(v, s_run_cut.x, s_run_cut.y);
+    int64_t r = (int64_t)MAP_CULL_RADIUS << v->shift;
+    nav_box_t q = {(int32_t)(v->pos_x - r), (int32_t)(v->pos_y - r),
+                   (int32_t)(v->pos_x + r), (int32_t)(v->pos_y + r)};
+    uint16_t nr = nav_route_runs(&s_nav, q, s_runs, MAP_ROUTE_RUNS);
+    for (uint16_t j = 0; j < nr; j++) {
+      for (uint16_t h = 0; h < 2; h++) {
+        uint16_t idx = MAP_RUN_SRC + 2 * s_runs[j] + h;
+        uint16_t m = run_project(v, idx);
+        if (m >= 2)
+          line_prim(out[n++], PRIM_ROUTE, idx, s_proj, m, 0);
+      }
+    }
+    s_run_n = n - s_run_first;
+  }
+  s_n_lbl_cand = 0;
+  const uint16_t lab_end = VEC_STORE_MAX_ITEMS + s.n_labels;
+  for (uint16_t e = next_bit(VEC_STORE_MAX_ITEMS, lab_end); e < lab_end;
+       e = next_bit(e + 1, lab_end)) {
+    uint16_t i = e - VEC_STORE_MAX_ITEMS;
+    const vec_store_label_t &l = s.labels[i];
+    if (!l.used || !vec_view_point_near(v, l.x, l.y, MAP_CULL_RADIUS))
+      continue;
+    vec_point_t p = vec_view_project(v, l.x, l.y);
+    if (p.x < -LBL_MAX_W / 2 || p.x > t.rect.x2 + LBL_MAX_W / 2 ||
+        p.y < -LBL_MAX_H || p.y > t.rect.y2 + LBL_MAX_H)
+      continue;
+    s_lbl_cand[s_n_lbl_cand++] = {l.name, p.x, p.y, i};
+  }
+  n = place_labels(out, n, t.rect, v->anchor_x, v->anchor_y, true);
+  /* En el buffer extendido el marcador no va: queda fijo sobre la ventana */
+  if (t.canvas)
+    marker_prim(out[n++], v->anchor_x, v->anchor_y);
+  return n;
+}
+
+/* Calles, ruta y labels van directo al buffer (map_raster, map_labels); el
+ * marcador, por el layer de LVGL, que lo dibuja encima al cerrar el layer. */
+static void draw_prim(lv_layer_t *layer, const rast_surface_t &surf,
+                      const map_src_t &src, const dmg_prim_t &p) {
+  const vec_frame_t *f = src.frame;
+  const vec_store_t *s = src.store;
+  switch (p.type) {
+  case PRIM_ROAD:
+  case PRIM_ROUTE: {
+    const vec_point_t *pts;
+    uint16_t n;
+    uint8_t w;
+    if (f) {
+      const vec_poly_t &r = p.type == PRIM_ROAD ? f->roads[p.src] : f->routes[p.src];
+      n = r.n;
+      w = p.type == PRIM_ROAD ? r.w : 0;
+      pts = frame_pts(src, vec_frame_poly_pts(f, r), n);
+    } else if (p.src >= MAP_RUN_SRC) {
+      n = run_project(&src.view, p.src);
+      pts = s_proj;
+      w = 0;
+    } else {
+      const vec_store_item_t &it = s->items[p.src];
+      n = vec_view_project_item(&src.view, &it, s_proj);
+      pts = s_proj;
+      w = it.w;
+    }
+    if (p.type == PRIM_ROAD)
+      rast_polyline(&surf, pts, n, road_width(w),
+                    !f && p.src == s_pick && s->items[p.src].id == s_pick_id
+                        ? lv_color_to_u16(COLOR_ACCENT)
+                        : road_color(w),
+                    RAST_JOIN_MITER);
+    else
+      rast_polyline(&surf, pts, n, ROUTE_WIDTH,
+                    !f && p.src >= MAP_RUN_SRC && !(p.src & 1)
+                        ? lv_color_to_u16(COLOR_ROUTE_DONE)
+                        : lv_color_to_u16(COLOR_ROUTE),
+                    RAST_JOIN_ROUND);
+    break;
+  }
+  case PRIM_LABEL:
+    /* Bitmap fijado por place_labels en este mismo frame */
+    lbl_blit(&surf, s_lbl_bmp[p.src], p.box.x1, p.box.y1,
+             lv_color_to_u16(COLOR_LABEL), lv_color_to_u16(COLOR_LABEL_SHADOW));
+    break;
+  case PRIM_MARKER:
+    if (f)
+      draw_pos_marker(layer, f->pos_x, f->pos_y);
+    else
+      draw_pos_marker(layer, src.view.anchor_x, src.view.anchor_y);
+    break;
+  }
+}
+
+/* Relleno directo del buffer RGB565: más barato que un draw task por rect */
+static void fill_bg_rect(const map_target_t &t, const dmg_rect_t &r) {
+  uint16_t c = lv_color_to_u16(COLOR_BG);
+  for (int32_t y = r.y1; y <= r.y2; y++) {
+    uint16_t *row = t.buf + y * (t.rect.x2 + 1);
+    for (int32_t x = r.x1; x <= r.x2; x++)
+      row[x] = c;
+  }
+}
+
+/* Dibuja lo que toca [r]. Con índice solo se visitan las primitivas cuya
+ * fuente cae cerca del rectángulo, en el mismo orden que la lista (calles,
+ * ruta, tramos de la ruta codificada, labels y marcador); sin índice (o en
+ * modo frame) se recorre todo. Los tramos no están en el índice: son pocos
+ * y se prueban por bbox. */
+static void draw_rect(lv_layer_t *layer, const rast_surface_t &surf,
+                      const map_src_t &src, const dmg_prim_t *prims, uint16_t n,
+                      const dmg_rect_t &r) {
+  if (src.frame || !s_grid_ok) {
+    for (uint16_t k = 0; k < n; k++)
+      if (dmg_intersects(prims[k].box, r))
+        draw_prim(layer, surf, src, prims[k]);
+    return;
+  }
+
+  memset(s_grid_bits, 0, sizeof(s_grid_bits));
+  vec_grid_query(&s_grid, s_grid_boxes, world_rect(&src.view, r, MAP_GRID_PAD),
+                 s_grid_bits);
+  for (uint8_t type = PRIM_ROAD; type <= PRIM_LABEL; type++) {
+    if (type == PRIM_LABEL)
+      for (uint16_t k = s_run_first; k < s_run_first + s_run_n; k++)
+        if (dmg_intersects(prims[k].box, r))
+          draw_prim(layer, surf, src, prims[k]);
+    uint16_t from = type == PRIM_LABEL ? VEC_STORE_MAX_ITEMS : 0;
+    uint16_t end = type == PRIM_LABEL ? MAP_GRID_ENTRIES : VEC_STORE_MAX_ITEMS;
+    for (uint16_t i = next_bit(from, end); i < end; i = next_bit(i + 1, end)) {
+      uint16_t k = s_prim_of_src[i];
+      if (k != MAP_NO_PRIM && prims[k].type == type &&
+          dmg_intersects(prims[k].box, r))
+        draw_prim(layer, surf, src, prims[k]);
+    }
+  }
+  if (n && prims[n - 1].type == PRIM_MARKER && dmg_intersects(prims[n - 1].box, r))
+    draw_prim(layer, surf, src, prims[n - 1]);
+}
+
+/* Sin canvas (buffer extendido) los rectángulos repintados se suman a
+ * [out], en coordenadas del buffer, para que scroll_to copie solo eso */
+static void render_prims(const map_src_t &src, const map_target_t &t,
+                         dmg_list_t *out = nullptr) {
+  if (!canvas || !s_prims[0] || !s_prims[1])
+    return;
+
+  dmg_prim_t *cur = s_prims[s_prim_cur];
+  const dmg_prim_t *prev = s_prims[s_prim_cur ^ 1];
+  uint16_t n = build_prims(src, t, cur);
+
+  dmg_list_t dmg;
+  dmg_clear(&dmg);
+  bool from_store = src.frame == nullptr;
+  if (s_redraw_all || from_store != s_last_src_store)
+    dmg_full(&dmg, t.rect);
+  else
+    dmg_diff(prev, s_n_prims[s_prim_cur ^ 1], cur, n, &dmg, t.rect);
+  s_n_prims[s_prim_cur] = n;
+  s_prim_cur ^= 1;
+  s_redraw_all = false;
+  s_last_src_store = from_store;
+  if (dmg.n == 0)
+    return;
+
+  for (uint8_t i = 0; i < dmg.n; i++)
+    fill_bg_rect(t, dmg.r[i]);
+
+  lv_layer_t layer;
+  if (t.canvas)
+    lv_canvas_init_layer(canvas, &layer);
+
+  int16_t w = t.rect.x2 + 1, h = t.rect.y2 + 1;
+  rast_surface_t surf = {t.buf, w, h, w, t.rect, MAP_AA};
+
+  for (uint8_t i = 0; i < dmg.n; i++) {
+    const dmg_rect_t &r = dmg.r[i];
+    if (t.canvas)
+      layer._clip_area = {r.x1, r.y1, r.x2, r.y2};
+    surf.clip = r;
+    draw_rect(&layer, surf, src, cur, n, r);
+  }
+
+  if (!t.canvas) {
+    for (uint8_t i = 0; out && i < dmg.n; i++)
+      dmg_add(out, dmg.r[i], t.rect);
+    return; /* la ventana la copia scroll_to */
+  }
   lv_canvas_finish_layer(canvas, &layer);
+
+  for (uint8_t i = 0; i < dmg.n; i++) {
+    lv_area_t a = {dmg.r[i].x1, dmg.r[i].y1, dmg.r[i].x2, dmg.r[i].y2};
+    lv_obj_invalidate_area(canvas, &a);
+  }
+}
+
+/* ── Orientación ─────────────────────────────────────────────────────
+ * Norte arriba o heading arriba (botón de la esquina). Con heading arriba la
+ * vista rota alrededor del marcador con seno/coseno Q15 de tabla durante la
+ * proyección; el ángulo sigue al heading de los fixes suavizado y por el
+ * arco corto, así un heading ruidoso no hace temblar el mapa. */
+static bool s_heading_up = true;
+static bool s_rot_valid = false; /* hubo algún heading desde el inicio */
+static uint16_t s_rot = 0;       /* ángulo suavizado (binario) */
+static uint32_t s_rot_ms = 0;
+
+static void rot_step(int16_t heading) {
+  uint32_t now = millis();
+  uint32_t steps = (now - s_rot_ms) / MAP_ANIM_MS;
+  if (heading < 0)
+    return; /* sin rumbo se queda donde estaba */
+  uint16_t target = vec_angle_deg(heading);
+  if (!s_rot_valid) {
+    s_rot = target;
+    s_rot_valid = true;
+    s_rot_ms = now;
+    return;
+  }
+  if (steps == 0)
+    return;
+  s_rot_ms += steps * MAP_ANIM_MS;
+  for (; steps > 0; steps--) {
+    int16_t diff = (int16_t)(target - s_rot);
+    if (diff > -MAP_ROT_STEP && diff < MAP_ROT_STEP) {
+      s_rot = target;
+      break;
+    }
+    s_rot += diff / MAP_ROT_EASE;
+  }
+}
+
+/* Ángulo que se muestra: el suavizado, cuantizado; 0 con norte arriba */
+static uint16_t rot_shown(void) {
+  if (!s_heading_up || !s_rot_valid)
+    return 0;
+  return (uint16_t)((s_rot + MAP_ROT_STEP / 2) & ~(MAP_ROT_STEP - 1));
+}
+
+static void view_orient(vec_view_t *v) {
+  if (s_heading_up && s_rot_valid)
+    vec_view_rotate(v, rot_shown());
+  else
+    vec_view_north_up(v);
+}
+
+static void on_orient_click(lv_event_t *e) {
+  s_heading_up = !s_heading_up;
+  lv_obj_t *lbl = lv_obj_get_child((lv_obj_t *)lv_event_get_target(e), 0);
+  lv_label_set_text(lbl, s_heading_up ? LV_SYMBOL_UP : "N");
+  Serial.printf("[Maps] Orientación: %s\n",
+                s_heading_up ? "heading arriba" : "norte arriba");
+}
+
+/* ── Overlay de latencia ─────────────────────────────────────────── */
+static uint32_t s_lat_ms = 0;
+
+static void lat_overlay_update(void) {
+  char txt[256];
+  int len = snprintf(txt, sizeof(txt), "ms     p50    p95    max");
+  for (uint8_t i = 0; i < LAT_N_STAGES && len < (int)sizeof(txt); i++) {
+    lat_hist_t h;
+    lat_get((lat_stage_t)i, &h);
+    len += snprintf(txt + len, sizeof(txt) - len, "\n%-5s %6.1f %6.1f %6.1f",
+                    lat_stage_name((lat_stage_t)i), lat_percentile(h, 50) / 1000.0f,
+                    lat_percentile(h, 95) / 1000.0f, h.max_us / 1000.0f);
+  }
+  lv_label_set_text(lbl_lat, txt);
+}
+
+static void on_orient_long(lv_event_t *e) {
+  (void)e;
+  if (!lbl_lat)
+    return;
+  if (lv_obj_has_flag(lbl_lat, LV_OBJ_FLAG_HIDDEN)) {
+    lat_overlay_update();
+    s_lat_ms = lv_tick_get();
+    lv_obj_clear_flag(lbl_lat, LV_OBJ_FLAG_HIDDEN);
+  } else {
+    lv_obj_add_flag(lbl_lat, LV_OBJ_FLAG_HIDDEN);
+  }
+}
+
+/* ── Zoom local ──────────────────────────────────────────────────────
+ * s_zoom_ofs se suma al zoom que manda la app (que sigue pudiendo
+ * cambiarlo, p. ej. según la velocidad). s_lod_bias sube el nivel de
+ * detalle mínimo si un render proyectó más de MAP_VERTEX_BUDGET vértices y
+ * lo baja cuando sobra margen. */
+static int8_t s_zoom_ofs = 0;
+static bool s_zoom_dirty = false;
+static uint8_t s_lod_bias = 0;
+
+static uint8_t map_zoom(const vec_store_t &s) {
+  int32_t z = s.zoom + s_zoom_ofs;
+  return z < MAP_ZOOM_MIN ? MAP_ZOOM_MIN : z > VEC_WORLD_ZOOM ? VEC_WORLD_ZOOM : z;
+}
+
+/* Vista del conjunto: zoom local, nivel de detalle y orientación */
+static void store_view(vec_view_t *v, const vec_store_t &s, int32_t ax, int32_t ay) {
+  vec_view_init(v, &s, ax, ay);
+  vec_view_zoom(v, map_zoom(s));
+  v->lod += s_lod_bias;
+  view_orient(v);
+}
+
+static void lod_adjust(void) {
+  if (s_n_verts > MAP_VERTEX_BUDGET && s_lod_bias < MAP_LOD_BIAS_MAX)
+    s_lod_bias++;
+  else if (s_n_verts < MAP_VERTEX_BUDGET / 3 && s_lod_bias > 0)
+    s_lod_bias--;
+}
+
+static void zoom_by(int8_t d) {
+  if (!s_store || !s_store->zoom)
+    return;
+  uint8_t from = map_zoom(*s_store);
+  s_zoom_ofs += d;
+  uint8_t to = map_zoom(*s_store);
+  s_zoom_ofs = (int8_t)(to - s_store->zoom);
+  if (to == from)
+    return;
+  s_lod_bias = 0;
+  s_zoom_dirty = true;
+  Serial.printf("[Maps] Zoom %u (app %u)\n", to, s_store->zoom);
+}
+
+/* ── Dibujo del frame vectorial sobre el canvas ──────────────────── */
+static void render_vec_frame(const vec_frame_t &f) {
+  /* La app ya rotó el frame con su heading: se corrige la diferencia con
+   * el ángulo que se quiere mostrar (vista en coordenadas de pantalla) */
+  map_src_t src = {&f, nullptr, {}};
+  src.view.pos_x = src.view.anchor_x = f.pos_x;
+  src.view.pos_y = src.view.anchor_y = f.pos_y;
+  src.view.shift = 0;
+  vec_view_north_up(&src.view);
+  if (f.heading >= 0) {
+    rot_step(f.heading);
+    uint16_t fix = (uint16_t)(rot_shown() - vec_angle_deg(f.heading));
+    if (fix)
+      vec_view_rotate(&src.view, fix);
+  }
+  render_prims(src, {s_map_buf, k_screen, true});
+}
+
+/* ── Dead reckoning ──────────────────────────────────────────────────
+ * Entre fixes (un delta cada ~100 ms, a veces menos) la posición se
+ * extrapola con el último heading y la velocidad GPS, en unidades de mundo
+ * por ms. El tope MAP_DR_MAX_MS evita que el mapa siga de largo si se corta
+ * el enlace. */
+static int s_speed_kmh = 0;
+static uint32_t s_fix_ms = 0;
+static int32_t s_fix_x = 0, s_fix_y = 0;
+static float s_vel_x = 0, s_vel_y = 0; /* unidades de mundo / ms */
+
+/* Fija la extrapolación en (x, y) ahora, con el heading y la velocidad actuales */
+static void dr_rebase(const vec_store_t &s, int32_t x, int32_t y) {
+  s_fix_ms = millis();
+  s_fix_x = x;
+  s_fix_y = y;
+  s_vel_x = s_vel_y = 0;
+  if (s.heading < 0 || s_speed_kmh <= 0)
+    return;
+  /* Unidades de mundo por metro a esta latitud: 2^28 / ecuador / cos(lat),
+   * con 1 / cos(lat) = cosh(y Mercator) */
+  float merc = (float)M_PI * (1.0f - 2.0f * (float)y / (float)(1 << 28));
+  float upm = (float)(1 << 28) / 40075016.686f * coshf(merc);
+  float d = (float)s_speed_kmh / 3600.0f * upm; /* por ms */
+  float rad = (float)s.heading * (float)M_PI / 180.0f;
+  s_vel_x = sinf(rad) * d;
+  s_vel_y = -cosf(rad) * d;
+}
+
+static void dr_predict(int32_t *x, int32_t *y) {
+  uint32_t dt = millis() - s_fix_ms;
+  if (dt > MAP_DR_MAX_MS)
+    dt = MAP_DR_MAX_MS;
+  *x = s_fix_x + (int32_t)lroundf(s_vel_x * (float)dt);
+  *y = s_fix_y + (int32_t)lroundf(s_vel_y * (float)dt);
+}
+
+/* ── Dibujo del conjunto persistente (modo delta) ────────────────────
+ * El conjunto se rasteriza en un buffer MAP_OVER_X/Y px más grande por lado
+ * que la pantalla, centrado en la posición extrapolada; la pantalla es una
+ * ventana que scroll_to corre 30 veces por segundo copiando filas. Solo se
+ * vuelve a rasterizar si cambia la geometría, el heading o el zoom, o si la
+ * ventana se sale del margen. Sin ese buffer se dibuja directo al canvas. */
+static uint16_t *s_over_buf = nullptr;
+static vec_view_t s_over_view;      /* vista con la que se rasterizó */
+static uint32_t s_over_version = 0; /* geom_version rasterizada */
+static uint16_t s_over_rot = 0;     /* ángulo rasterizado */
+static uint8_t s_over_zoom = 0;
+static bool s_over_valid = false;
+static int16_t s_win_x = 0, s_win_y = 0; /* ventana visible en s_over_buf */
+static bool s_win_valid = false;
+static dmg_list_t s_win_dmg; /* repintado en s_over_buf desde la última copia */
+
+static const map_target_t k_over = {
+    nullptr, {0, 0, MAP_OVER_W - 1, MAP_OVER_H - 1}, false};
+
+static void render_store(const vec_store_t &s, int32_t x, int32_t y) {
+  map_src_t src = {nullptr, &s, {}};
+  rot_step(s.heading);
+  s_zoom_dirty = false;
+  if (!s_over_buf) {
+    store_view(&src.view, s, MAP_POS_X, MAP_POS_Y);
+    render_prims(src, {s_map_buf, k_screen, true});
+    lod_adjust();
+    return;
+  }
+  store_view(&src.view, s, MAP_POS_X + MAP_OVER_X, MAP_POS_Y + MAP_OVER_Y);
+  src.view.pos_x = x;
+  src.view.pos_y = y;
+  map_target_t t = k_over;
+  t.buf = s_over_buf;
+  render_prims(src, t);
+  lod_adjust();
+  s_over_view = src.view;
+  s_over_version = s.geom_version;
+  s_over_rot = rot_shown();
+  s_over_zoom = map_zoom(s);
+  s_over_valid = true;
+  s_win_valid = false;
+}
+
+/* Copia la ventana (wx, wy) del buffer extendido al canvas y pone el
+ * marcador encima, fijo en el ancla. Si la ventana no se movió copia e
+ * invalida solo lo repintado (s_win_dmg) que cae adentro. */
+static void scroll_to(int16_t wx, int16_t wy) {
+  if (!s_win_valid || wx != s_win_x || wy != s_win_y) {
+    const uint16_t *src = s_over_buf + wy * MAP_OVER_W + wx;
+    for (int32_t y = 0; y < MAPS_WS_MAP_H; y++)
+      memcpy(s_map_buf + y * MAPS_WS_MAP_W, src + y * MAP_OVER_W,
+             MAPS_WS_MAP_W * sizeof(uint16_t));
+    s_win_x = wx;
+    s_win_y = wy;
+    s_win_valid = true;
+    dmg_clear(&s_win_dmg);
+
+    lv_layer_t layer;
+    lv_canvas_init_layer(canvas, &layer);
+    draw_pos_marker(&layer, MAP_POS_X, MAP_POS_Y);
+    lv_canvas_finish_layer(canvas, &layer);
+    lv_obj_invalidate(canvas);
+    return;
+  }
+
+  bool marker = false;
+  const dmg_rect_t mk = marker_box(MAP_POS_X, MAP_POS_Y);
+  const dmg_rect_t win = {wx, wy, (int16_t)(wx + MAPS_WS_MAP_W - 1),
+                          (int16_t)(wy + MAPS_WS_MAP_H - 1)};
+  for (uint8_t i = 0; i < s_win_dmg.n; i++) {
+    dmg_rect_t r = s_win_dmg.r[i];
+    if (!dmg_intersects(r, win))
+      continue;
+    /* recortado a la ventana y pasado a coordenadas de pantalla */
+    r.x1 = (r.x1 < win.x1 ? win.x1 : r.x1) - wx;
+    r.y1 = (r.y1 < win.y1 ? win.y1 : r.y1) - wy;
+    r.x2 = (r.x2 > win.x2 ? win.x2 : r.x2) - wx;
+    r.y2 = (r.y2 > win.y2 ? win.y2 : r.y2) - wy;
+    const uint16_t *src = s_over_buf + (wy + r.y1) * MAP_OVER_W + wx + r.x1;
+    for (int32_t y = r.y1; y <= r.y2; y++, src += MAP_OVER_W)
+      memcpy(s_map_buf + y * MAPS_WS_MAP_W + r.x1, src,
+             (r.x2 - r.x1 + 1) * sizeof(uint16_t));
+    lv_area_t a = {r.x1, r.y1, r.x2, r.y2};
+    lv_obj_invalidate_area(canvas, &a);
+    marker |= dmg_intersects(r, mk);
+  }
+  dmg_clear(&s_win_dmg);
+  if (!marker)
+    return;
+  lv_layer_t layer;
+  lv_canvas_init_layer(canvas, &layer);
+  draw_pos_marker(&layer, MAP_POS_X, MAP_POS_Y);
+  lv_canvas_finish_layer(canvas, &layer);
+}
+
+/* La ruta codificada cambió o el corte recorrido / por recorrer se movió
+ * MAP_SPLIT_PX en el buffer extendido */
+static bool route_split_moved(void) {
+  if (s_run_gen != s_route_gen)
+    return true;
+  if (!route_runs_on())
+    return false;
+  vec_point_t p = vec_view_project(&s_over_view, s_nav.snap_x, s_nav.snap_y);
+  return abs(p.x - s_run_cut_px.x) >= MAP_SPLIT_PX ||
+         abs(p.y - s_run_cut_px.y) >= MAP_SPLIT_PX;
+}
+
+/* Vuelve a rasterizar con la misma vista: el daño queda en los tramos que
+ * cambiaron y la ventana sigue donde estaba, así que scroll_to copia solo eso */
+static void rerender_over(const vec_store_t &s) {
+  map_src_t src = {nullptr, &s, s_over_view};
+  map_target_t t = k_over;
+  t.buf = s_over_buf;
+  render_prims(src, t, &s_win_dmg);
+}
+
+/* Un paso de animación: ventana según la posición extrapolada */
+static void animate_store(void) {
+  if (!s_over_buf || !s_store || !s_over_valid || !s_last_src_store)
+    return;
+  int32_t x, y;
+  dr_predict(&x, &y);
+  rot_step(s_store->heading);
+  bool rotate = s_heading_up && s_rot_valid;
+  if (s_store->geom_version != s_over_version || map_zoom(*s_store) != s_over_zoom ||
+      rotate != s_over_view.rotate || rot_shown() != s_over_rot)
+    render_store(*s_store, x, y);
+  else if (route_split_moved())
+    rerender_over(*s_store);
+
+  vec_point_t q = vec_view_project(&s_over_view, x, y);
+  int32_t wx = q.x - MAP_POS_X, wy = q.y - MAP_POS_Y;
+  if (wx < 0 || wx > 2 * MAP_OVER_X || wy < 0 || wy > 2 * MAP_OVER_Y) {
+    render_store(*s_store, x, y);
+    wx = MAP_OVER_X;
+    wy = MAP_OVER_Y;
+  }
+  scroll_to(wx, wy);
+}
+
+/* ── Modo raster (tiles) ─────────────────────────────────────────────
+ * Con tiles en la caché la pantalla se compone de ellos en vez de
+ * rasterizar el conjunto: una copia por fila de cada tile visible, solo si
+ * cambió el píxel de la posición, el zoom o llegó un tile. Los faltantes se
+ * piden a la app; el mismo pedido no se repite antes de MAP_TILE_REQ_MS.
+ * La caché sobrevive entre sesiones: el modo se activa con el primer tile
+ * que llega en la sesión y desde ahí lo ya visto no se vuelve a pedir. Lo
+ * que falta se busca primero en la flash (map_tiles_fs.h); si el tile del
+ * vehículo está guardado, el modo arranca con él sin esperar a la app. */
+static uint32_t s_tiles_start = 0;   /* map_tiles_version al empezar */
+static uint32_t s_tiles_version = 0; /* map_tiles_version compuesta */
+static int32_t s_tiles_px = 0, s_tiles_py = 0;
+static uint8_t s_tiles_z = 0;
+static bool s_tiles_valid = false;
+static uint32_t s_tiles_req_hash = 0;
+static uint32_t s_tiles_req_ms = 0;
+static uint64_t s_tiles_fs_key = 0; /* tile del vehículo buscado en la flash */
+static bool s_tiles_fs = false;
+
+static bool tiles_active(void) {
+  if (!s_store || !s_store->zoom)
+    return false;
+  if (map_tiles_version() != s_tiles_start)
+    return true;
+  if (!map_tiles_fs_ready())
+    return false;
+  uint8_t z = map_zoom(*s_store);
+  uint8_t shift = VEC_WORLD_ZOOM - z + 8; /* tiles de 256 px */
+  uint64_t key = map_tile_key(z, s_store->pos_x >> shift, s_store->pos_y >> shift);
+  if (key != s_tiles_fs_key) {
+    s_tiles_fs_key = key;
+    s_tiles_fs = map_tiles_fs_has(key);
+  }
+  return s_tiles_fs;
+}
+
+static void compose_tiles(void) {
+  int32_t x, y;
+  dr_predict(&x, &y);
+  uint8_t z = map_zoom(*s_store);
+  uint8_t shift = VEC_WORLD_ZOOM - z;
+  int32_t px = (x >> shift) - MAP_POS_X, py = (y >> shift) - MAP_POS_Y;
+  uint32_t version = map_tiles_version();
+  if (s_tiles_valid && px == s_tiles_px && py == s_tiles_py && z == s_tiles_z &&
+      version == s_tiles_version)
+    return;
+
+  maps_tile_xy_t need[MAP_TILES_NEED_MAX];
+  uint8_t n = map_tiles_compose(s_map_buf, MAPS_WS_MAP_W, MAPS_WS_MAP_H, z, px, py,
+                                lv_color_to_u16(COLOR_BG), need);
+  s_tiles_px = px;
+  s_tiles_py = py;
+  s_tiles_z = z;
+  s_tiles_version = version;
+  s_tiles_valid = true;
+  /* El render vectorial no sabe qué quedó en el canvas */
+  s_redraw_all = true;
+  s_over_valid = false;
+  s_win_valid = false;
+
+  lv_layer_t layer;
+  lv_canvas_init_layer(canvas, &layer);
+  draw_pos_marker(&layer, MAP_POS_X, MAP_POS_Y);
+  lv_canvas_finish_layer(canvas, &layer);
+  lv_obj_invalidate(canvas);
+
+  n = map_tiles_fs_claim(z, need, n);
+  if (!n)
+    return;
+  uint32_t h = dmg_hash(dmg_hash(DMG_HASH_SEED, &z, 1), need, n * sizeof(need[0]));
+  uint32_t now = millis();
+  if (h == s_tiles_req_hash && now - s_tiles_req_ms < MAP_TILE_REQ_MS)
+    return;
+  s_tiles_req_hash = h;
+  s_tiles_req_ms = now;
+  maps_ws_request_tiles(z, need, n);
+}
+
+/* ── Selección de calle por toque ────────────────────────────────── */
+
+/* Distancia² (px²) de (px, py) al segmento a–b */
+static int64_t seg_dist2(vec_point_t a, vec_point_t b, int32_t px, int32_t py) {
+  int64_t dx = b.x - a.x, dy = b.y - a.y;
+  int64_t ex = px - a.x, ey = py - a.y;
+  int64_t len2 = dx * dx + dy * dy;
+  int64_t t = dx * ex + dy * ey;
+  if (len2 == 0 || t <= 0)
+    return ex * ex + ey * ey;
+  if (t >= len2) {
+    ex = px - b.x;
+    ey = py - b.y;
+    return ex * ex + ey * ey;
+  }
+  int64_t c = dx * ey - dy * ex; /* área del paralelogramo */
+  return c * c / len2;
+}
+
+/* Resalta la calle más cercana a (sx, sy) o, si no hay ninguna a menos de
+ * MAP_PICK_PX, quita el resaltado. Solo en modo delta (hay índice). */
+static void pick_road(int32_t sx, int32_t sy) {
+  if (!s_store || !s_last_src_store || !grid_sync(*s_store))
+    return;
+  /* La vista de lo que está en pantalla: con buffer extendido, la de la
+   * última rasterización corrida por la ventana */
+  vec_view_t v;
+  if (s_over_buf && s_over_valid && s_win_valid) {
+    v = s_over_view;
+    sx += s_win_x;
+    sy += s_win_y;
+  } else {
+    store_view(&v, *s_store, MAP_POS_X, MAP_POS_Y);
+  }
+
+  memset(s_grid_bits, 0, sizeof(s_grid_bits));
+  dmg_rect_t r = {(int16_t)(sx - MAP_PICK_PX), (int16_t)(sy - MAP_PICK_PX),
+                  (int16_t)(sx + MAP_PICK_PX), (int16_t)(sy + MAP_PICK_PX)};
+  vec_grid_query(&s_grid, s_grid_boxes, world_rect(&v, r, 0), s_grid_bits);
+
+  int64_t best = (int64_t)MAP_PICK_PX * MAP_PICK_PX;
+  int16_t pick = -1;
+  for (uint16_t i = next_bit(0, s_store->n_items); i < s_store->n_items;
+       i = next_bit(i + 1, s_store->n_items)) {
+    const vec_store_item_t &it = s_store->items[i];
+    if (!it.used || it.kind != MAPS_KIND_ROAD)
+      continue;
+    vec_point_t a = vec_view_project(&v, it.pts[0].x, it.pts[0].y);
+    for (uint8_t j = 1; j < it.n; j++) {
+      vec_point_t b = vec_view_project(&v, it.pts[j].x, it.pts[j].y);
+      int64_t d = seg_dist2(a, b, sx, sy);
+      if (d <= best) {
+        best = d;
+        pick = i;
+      }
+      a = b;
+    }
+  }
+
+  s_pick = pick;
+  s_pick_id = pick >= 0 ? s_store->items[pick].id : 0;
+  s_pick_dirty = true;
+  Serial.printf("[Maps] Toque (%ld,%ld): calle %d\n", (long)sx, (long)sy,
+                pick >= 0 ? (int)s_pick_id : -1);
+}
+
+/* Gestos sobre el mapa: toque selecciona una calle, doble toque acerca y
+ * toque largo aleja (el táctil reporta un solo dedo, no hay pellizco) */
+static uint32_t s_tap_ms = 0;
+static lv_point_t s_tap_at = {0, 0};
+static bool s_tap_skip = false; /* el toque largo ya se usó */
+
+static void on_canvas_event(lv_event_t *e) {
+  lv_event_code_t code = lv_event_get_code(e);
+  if (code == LV_EVENT_PRESSED) {
+    s_tap_skip = false;
+    return;
+  }
+  if (code == LV_EVENT_LONG_PRESSED) {
+    s_tap_skip = true;
+    s_tap_ms = 0;
+    zoom_by(-1);
+    return;
+  }
+  if (s_tap_skip)
+    return;
+  lv_point_t p;
+  lv_indev_get_point(lv_indev_active(), &p);
+  uint32_t now = lv_tick_get();
+  if (s_tap_ms && now - s_tap_ms < MAP_DTAP_MS &&
+      LV_ABS(p.x - s_tap_at.x) < MAP_DTAP_PX && LV_ABS(p.y - s_tap_at.y) < MAP_DTAP_PX) {
+    s_tap_ms = 0;
+    zoom_by(+1);
+    return;
+  }
+  s_tap_ms = now;
+  s_tap_at = p;
+  pick_road(p.x, p.y);
+}
+
+/* ── Guía sobre la ruta ──────────────────────────────────────────────
+ * nav_route se rearma cuando cambia la ruta del conjunto (con una ruta
+ * codificada solo se reubican las maniobras) y se consulta en cada refresco
+ * con la posición extrapolada: también fija el corte entre lo recorrido y
+ * lo que falta que usa el dibujo. Los labels se tocan solo si
+ * cambia el texto (la distancia va redondeada a 10 m). El último {"t":"nav"}
+ * de la app se guarda para volver a él si la ruta deja de tener maniobras. */
+static nav_step_t s_phone_nav;
+static bool s_phone_nav_new = false;
+static bool s_nav_shown = false; /* los labels muestran nav_route */
+
+static void set_text_if(lv_obj_t *lbl, const char *txt) {
+  if (std::strcmp(lv_label_get_text(lbl), txt) != 0)
+    lv_label_set_text(lbl, txt);
+}
+
+static void nav_panel_show(const char *step, const char *dist, const char *eta) {
+  set_text_if(lbl_nav, step);
+  set_text_if(lbl_dist, dist);
+  set_text_if(lbl_eta, eta);
+  lv_obj_t *nav_panel = lv_obj_get_parent(lbl_nav);
+  if (!step[0] || std::strcmp(step, "Sin navegación") == 0)
+    lv_obj_add_flag(nav_panel, LV_OBJ_FLAG_HIDDEN);
+  else
+    lv_obj_clear_flag(nav_panel, LV_OBJ_FLAG_HIDDEN);
+}
+
+/* Como formatEtaMinutes en la app */
+static void format_eta(char *buf, size_t n, uint32_t eta_s) {
+  uint32_t min = (eta_s + 30) / 60;
+  if (min < 60)
+    snprintf(buf, n, "%lu min", (unsigned long)min);
+  else if (min % 60 == 0)
+    snprintf(buf, n, "%lu h", (unsigned long)(min / 60));
+  else
+    snprintf(buf, n, "%lu h %lu min", (unsigned long)(min / 60), (unsigned long)(min % 60));
+}
+
+static void format_dist(char *buf, size_t n, uint32_t m) {
+  if (m >= 1000)
+    snprintf(buf, n, "%.1f km", m / 1000.0f);
+  else
+    snprintf(buf, n, "%lu m", (unsigned long)((m + 5) / 10 * 10));
+}
+
+static void nav_update(void) {
+  if (!lbl_nav || !lbl_dist || !lbl_eta)
+    return;
+  if (s_route_id && s_store && s_store->route_version != s_nav.version) {
+    nav_route_maneuvers(&s_nav, s_store);
+  } else if (!s_route_id && !s_route_rx && s_store && s_nav_arena.base &&
+             (s_nav_rebuild || s_store->route_version != s_nav.version)) {
+    nav_route_build(&s_nav, &s_nav_arena, s_store);
+    s_nav_rebuild = false;
+    if (s_nav.valid)
+      Serial.printf("[Maps] Ruta: %u puntos, %u maniobras, %.1f km\n", s_nav.n_pts,
+                    s_nav.n_man, s_nav.len_m / 1000.0f);
+  }
+
+  nav_progress_t p;
+  bool guide = s_store && s_nav.valid;
+  if (guide) {
+    int32_t x, y;
+    dr_predict(&x, &y);
+    nav_route_update(&s_nav, s_store, x, y, millis(), &p);
+  }
+  if (!guide || !s_nav.n_man) {
+    if (s_phone_nav_new || s_nav_shown)
+      nav_panel_show(s_phone_nav.step, s_phone_nav.dist, s_phone_nav.eta);
+    s_phone_nav_new = false;
+    s_nav_shown = false;
+    return;
+  }
+
+  char dist[24], eta[24];
+  if (p.off_route) {
+    snprintf(dist, sizeof(dist), "a %lu m de la ruta", (unsigned long)p.off_m);
+    format_eta(eta, sizeof(eta), p.eta_s);
+    nav_panel_show("Fuera de ruta", dist, eta);
+  } else if (p.arrived) {
+    nav_panel_show("Llegaste al destino", "0 m", "0 min");
+  } else {
+    format_dist(dist, sizeof(dist), p.next_m);
+    format_eta(eta, sizeof(eta), p.eta_s);
+    nav_panel_show(p.step, dist, eta);
+  }
+  s_nav_shown = true;
+  s_phone_nav_new = false;
 }
 
 /* ── Timer de refresco (hilo LVGL, 100 ms) ───────────────────────── */
 static void dirty_timer_cb(lv_timer_t *t) {
   (void)t;
 
+  /* Renderizar frame vectorial (el slot es nuestro hasta el próximo take)
+   * y avisar a la app qué se dibujó y cuánto costó */
+  const vec_frame_t *vf = maps_ws_take_vec();
+  if (vf) {
+    s_has_received_frame = true;
+    uint32_t t0 = micros();
+    lat_record(LAT_WAIT, t0 - vf->pub_us);
+    render_vec_frame(*vf);
+    uint32_t rast = micros() - t0;
+    lat_record(LAT_RAST, rast);
+    lat_frame_rastered(vf->origin_us);
+    maps_ws_send_ack(vf->seq, rast);
+  }
+
+  /* Aplicar los deltas encolados y renderizar desde el conjunto */
+  if (s_delta_ring && s_store) {
+    bool applied = false, resync = false;
+    delta_hdr_t hdr = {};
+    uint32_t origin = 0;
+    uint32_t t0 = micros();
+    size_t len;
+    void *item;
+    while ((item = xRingbufferReceive(s_delta_ring, &len, 0)) != nullptr) {
+      /* on_delta siempre encola la cabecera + payload */
+      memcpy(&hdr, item, sizeof(hdr));
+      lat_record(LAT_WAIT, t0 - hdr.pub_us);
+      if (hdr.origin_us)
+        origin = hdr.origin_us;
+      const uint8_t *payload = (const uint8_t *)item + sizeof(hdr);
+      /* Un RESET vacía el conjunto, también los tiles del paquete offline */
+      if (hdr.type == MAPS_BIN_DELTA && len > sizeof(hdr) && (payload[0] & MAPS_DELTA_RESET))
+        map_pack_sd_forget();
+      if (hdr.type == MAPS_BIN_ROUTE ? !route_rx(payload, len - sizeof(hdr))
+                                     : !vec_store_apply(s_store, payload, len - sizeof(hdr)))
+        resync = true;
+      vRingbufferReturnItem(s_delta_ring, item);
+      applied = true;
+    }
+    if (s_delta_lost || resync) {
+      s_delta_lost = false;
+      Serial.printf("[Maps] Delta perdido o inválido, pidiendo resync\n");
+      maps_ws_request_resync();
+    }
+    if (applied) {
+      s_has_received_frame = true;
+      map_pack_sd_sync(s_store);
+      dr_rebase(*s_store, s_store->pos_x, s_store->pos_y);
+    }
+    /* Con el buffer extendido ya rasterizado, un fix nuevo solo corre la
+     * ventana (animate_store rasteriza si cambió algo más) */
+    if (tiles_active()) {
+      compose_tiles();
+    } else if (applied || s_pick_dirty || s_zoom_dirty) {
+      if (!s_over_valid || !s_last_src_store || s_pick_dirty || s_zoom_dirty) {
+        int32_t x, y;
+        dr_predict(&x, &y);
+        render_store(*s_store, x, y);
+      }
+      s_pick_dirty = false;
+      animate_store();
+    }
+    if (applied) {
+      uint32_t rast = micros() - t0;
+      lat_record(LAT_RAST, rast);
+      lat_frame_rastered(origin);
+      maps_ws_send_ack(hdr.seq, rast);
+    }
+  }
+
+  if (lbl_lat && !lv_obj_has_flag(lbl_lat, LV_OBJ_FLAG_HIDDEN) &&
+      lv_tick_get() - s_lat_ms >= MAP_LAT_OVERLAY_MS) {
+    s_lat_ms = lv_tick_get();
+    lat_overlay_update();
+  }
+
   /* Ocultar label de espera cuando llega el primer frame */
   if (s_has_received_frame && lbl_waiting &&
       !lv_obj_has_flag(lbl_waiting, LV_OBJ_FLAG_HIDDEN)) {
     lv_obj_add_flag(lbl_waiting, LV_OBJ_FLAG_HIDDEN);
   }
 
-  /* Renderizar frame vectorial */
-  if (s_vec_dirty && s_pending_vec) {
-    s_vec_dirty = false;
-    render_vec_frame(*s_pending_vec);
-    lv_obj_invalidate(canvas);
-  }
-
-  /* Actualizar label de navegación (instrucción, distancia al giro, ETA) */
-  if (s_nav_dirty && lbl_nav && lbl_dist && lbl_eta) {
-    s_nav_dirty = false;
-    lv_label_set_text(lbl_nav, s_pending_nav.step);
-    lv_label_set_text(lbl_dist, s_pending_nav.dist);
-    lv_label_set_text(lbl_eta, s_pending_nav.eta);
-    lv_obj_t *nav_panel = lv_obj_get_parent(lbl_nav);
-    if (std::strcmp(s_pending_nav.step, "Sin navegación") == 0)
-      lv_obj_add_flag(nav_panel, LV_OBJ_FLAG_HIDDEN);
-    else
-      lv_obj_clear_flag(nav_panel, LV_OBJ_FLAG_HIDDEN);
+  /* Actualizar label de navegación (instrucción, distancia al giro, ETA):
+   * de nav_route si la ruta trae maniobras, si no el último de la app */
+  const nav_step_t *nav = maps_ws_take_nav();
+  if (nav) {
+    s_phone_nav = *nav;
+    s_phone_nav_new = true;
   }
+  nav_update();
 
   /* Mostrar/ocultar círculo de velocidad según conexión */
   if (spd_circle) {
@@ -220,17 +1523,84 @@ static void dirty_timer_cb(lv_timer_t *t) {
   }
 
   /* Actualizar velocidad GPS */
-  if (s_spd_dirty && lbl_spd) {
-    s_spd_dirty = false;
-    lv_label_set_text_fmt(lbl_spd, "%d", (int)s_pending_spd);
+  int spd;
+  if (maps_ws_take_gps(&spd)) {
+    if (lbl_spd)
+      lv_label_set_text_fmt(lbl_spd, "%d", spd);
+    /* La extrapolación sigue desde donde va, con la velocidad nueva */
+    if (s_store && s_speed_kmh != spd) {
+      int32_t x, y;
+      dr_predict(&x, &y);
+      s_speed_kmh = spd;
+      dr_rebase(*s_store, x, y);
+    }
   }
 }
 
+/* ── Timer de animación (hilo LVGL, MAP_ANIM_MS) ─────────────────── */
+static void anim_timer_cb(lv_timer_t *t) {
+  (void)t;
+  if (tiles_active())
+    compose_tiles();
+  else
+    animate_store();
+}
+
 /* ── screen_map_create ───────────────────────────────────────────── */
 void screen_map_create(void) {
-  if (!s_pending_vec)
-    s_pending_vec = (vec_frame_t *)heap_caps_malloc(
-        sizeof(vec_frame_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+  /* ── Conjunto persistente + cola de deltas (PSRAM) ──────────── */
+  if (!s_store) {
+    s_store = (vec_store_t *)heap_caps_malloc(
+        sizeof(vec_store_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (s_store)
+      memset(s_store, 0, sizeof(vec_store_t));
+  }
+  if (!s_delta_ring) {
+    uint8_t *storage = (uint8_t *)heap_caps_malloc(
+        MAP_DELTA_RING_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (storage)
+      s_delta_ring = xRingbufferCreateStatic(
+          MAP_DELTA_RING_BYTES, RINGBUF_TYPE_NOSPLIT, storage,
+          &s_delta_ring_ctl);
+  }
+  if (!s_store || !s_delta_ring)
+    Serial.printf("[Maps] Sin memoria para modo delta\n");
+  if (!s_grid_arena.base)
+    map_arena_init(&s_grid_arena,
+                   heap_caps_malloc(MAP_GRID_ARENA_BYTES,
+                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT),
+                   MAP_GRID_ARENA_BYTES);
+  if (!s_nav_arena.base)
+    map_arena_init(&s_nav_arena,
+                   heap_caps_malloc(NAV_ROUTE_ARENA_BYTES,
+                                    MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT),
+                   NAV_ROUTE_ARENA_BYTES);
+  if (map_tiles_init()) {
+    jpeg_stream_set_tiles(map_tiles_open, map_tiles_close, MAP_TILE_PX);
+    map_tiles_fs_init();
+  } else
+    Serial.printf("[Maps] Sin memoria para tiles raster\n");
+  if (!s_lbl_pool) {
+    s_lbl_pool = heap_caps_malloc(MAP_LABEL_POOL_BYTES,
+                                  MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!lbl_cache_init(&lv_font_montserrat_12, s_lbl_pool, MAP_LABEL_POOL_BYTES))
+      Serial.printf("[Maps] Sin memoria para labels\n");
+  }
+
+  /* Buffer extendido para la animación del modo delta */
+  if (!s_over_buf) {
+    s_over_buf = (uint16_t *)heap_caps_malloc(
+        MAP_OVER_W * MAP_OVER_H * sizeof(uint16_t),
+        MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!s_over_buf)
+      Serial.printf("[Maps] Sin memoria para animar, dibujo directo\n");
+  }
+
+  /* Listas de primitivas del render incremental (anterior / actual) */
+  for (uint8_t i = 0; i < 2; i++)
+    if (!s_prims[i])
+      s_prims[i] = (dmg_prim_t *)heap_caps_malloc(
+          MAP_MAX_PRIMS * sizeof(dmg_prim_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 
   scr = lv_obj_create(NULL);
   lv_obj_set_size(scr, MAPS_WS_MAP_W, MAPS_WS_MAP_H);
@@ -254,6 +1624,10 @@ void screen_map_create(void) {
                          LV_COLOR_FORMAT_RGB565);
     lv_obj_set_size(canvas, MAPS_WS_MAP_W, MAPS_WS_MAP_H);
     lv_obj_align(canvas, LV_ALIGN_TOP_LEFT, 0, 0);
+    lv_obj_add_flag(canvas, LV_OBJ_FLAG_CLICKABLE);
+    lv_obj_add_event_cb(canvas, on_canvas_event, LV_EVENT_CLICKED, nullptr);
+    lv_obj_add_event_cb(canvas, on_canvas_event, LV_EVENT_PRESSED, nullptr);
+    lv_obj_add_event_cb(canvas, on_canvas_event, LV_EVENT_LONG_PRESSED, nullptr);
 
     /* Fondo inicial */
     lv_canvas_fill_bg(canvas, COLOR_BG, LV_OPA_COVER);
@@ -329,6 +1703,24 @@ void screen_map_create(void) {
   lv_obj_set_style_text_color(lbl_back, COLOR_TEXT, 0);
   lv_obj_center(lbl_back);
 
+  /* ── Botón de orientación (heading arriba / norte arriba) ───── */
+  lv_obj_t *btn_orient = lv_button_create(scr);
+  lv_obj_set_size(btn_orient, 44, 38);
+  lv_obj_align(btn_orient, LV_ALIGN_TOP_RIGHT, -10, 10);
+  lv_obj_set_style_bg_color(btn_orient, COLOR_BTN_BG, 0);
+  lv_obj_set_style_bg_opa(btn_orient, LV_OPA_80, 0);
+  lv_obj_set_style_border_color(btn_orient, COLOR_ACCENT, 0);
+  lv_obj_set_style_border_width(btn_orient, 1, 0);
+  lv_obj_set_style_radius(btn_orient, 10, 0);
+  lv_obj_add_event_cb(btn_orient, on_orient_click, LV_EVENT_SHORT_CLICKED, nullptr);
+  lv_obj_add_event_cb(btn_orient, on_orient_long, LV_EVENT_LONG_PRESSED, nullptr);
+
+  lv_obj_t *lbl_orient = lv_label_create(btn_orient);
+  lv_label_set_text(lbl_orient, s_heading_up ? LV_SYMBOL_UP : "N");
+  lv_obj_set_style_text_font(lbl_orient, &lv_font_montserrat_14, 0);
+  lv_obj_set_style_text_color(lbl_orient, COLOR_TEXT, 0);
+  lv_obj_center(lbl_orient);
+
   /* ── Círculo de velocidad (arriba del panel de indicaciones) ────────── */
   spd_circle = lv_obj_create(scr);
   lv_obj_set_size(spd_circle, 64, 64);
@@ -358,8 +1750,19 @@ void screen_map_create(void) {
   lv_obj_set_style_text_align(lbl_unit, LV_TEXT_ALIGN_CENTER, 0);
   lv_obj_align(lbl_unit, LV_ALIGN_CENTER, 0, 12);
 
+  /* ── Overlay de latencia (toque largo en orientación) ───────── */
+  lbl_lat = lv_label_create(scr);
+  lv_obj_align(lbl_lat, LV_ALIGN_TOP_LEFT, 10, 56);
+  lv_obj_set_style_bg_color(lbl_lat, COLOR_NAV_BG, 0);
+  lv_obj_set_style_bg_opa(lbl_lat, LV_OPA_80, 0);
+  lv_obj_set_style_pad_all(lbl_lat, 6, 0);
+  lv_obj_set_style_text_font(lbl_lat, &lv_font_montserrat_12, 0);
+  lv_obj_set_style_text_color(lbl_lat, COLOR_TEXT, 0);
+  lv_obj_add_flag(lbl_lat, LV_OBJ_FLAG_HIDDEN);
+
   /* ── Timer de refresco ──────────────────────────────────────── */
   s_dirty_timer = lv_timer_create(dirty_timer_cb, 100, nullptr);
+  s_anim_timer = lv_timer_create(anim_timer_cb, MAP_ANIM_MS, nullptr);
 }
 
 lv_obj_t *screen_map_get(void) { return scr; }
@@ -370,14 +1773,55 @@ void screen_map_start(void) {
     lv_obj_set_size(canvas, MAPS_WS_MAP_W, MAPS_WS_MAP_H);
 
   s_has_received_frame = false;
-  s_vec_dirty = false;
-  s_nav_dirty = false;
+  s_delta_lost = false;
+  s_redraw_all = true;
+  s_grid_valid = false;
+  s_grid_ok = false;
+  s_pick = -1;
+  s_pick_dirty = false;
+  memset(s_lbl_shown, 0, sizeof(s_lbl_shown));
+  s_over_valid = false;
+  s_win_valid = false;
+  s_speed_kmh = 0;
+  s_rot_valid = false;
+  s_tiles_valid = false;
+  s_tiles_req_hash = 0;
+  s_zoom_ofs = 0;
+  s_zoom_dirty = false;
+  s_lod_bias = 0;
+  s_tiles_start = map_tiles_version();
+  s_tiles_fs_key = 0;
+  s_nav.valid = false;
+  s_nav_rebuild = true;
+  s_route_id = s_route_rx = 0;
+  s_route_gen++;
+  s_nav_shown = false;
+  memset(&s_phone_nav, 0, sizeof(s_phone_nav));
+  s_phone_nav_new = false;
+  if (s_store) {
+    vec_store_clear(s_store);
+    map_pack_sd_forget();
+  }
+  if (s_delta_ring) {
+    /* Descartar deltas de una sesión anterior */
+    size_t len;
+    void *item;
+    while ((item = xRingbufferReceive(s_delta_ring, &len, 0)) != nullptr)
+      vRingbufferReturnItem(s_delta_ring, item);
+  }
   if (lbl_waiting)
     lv_obj_clear_flag(lbl_waiting, LV_OBJ_FLAG_HIDDEN);
   if (s_map_buf) {
-    maps_ws_start(s_map_buf, on_map_frame, on_vec_frame, on_nav_step);
-    maps_ws_set_gps_cb(on_gps_speed);
+    /* Con paquete offline la app manda solo posición y ruta */
+    maps_ws_set_pack(s_store && s_delta_ring && map_pack_sd_open());
+    maps_ws_start(s_map_buf, on_map_frame);
+    if (s_store && s_delta_ring)
+      maps_ws_set_delta_cb(on_delta);
   }
 }
 
-void screen_map_stop(void) { maps_ws_stop(); }
+void screen_map_stop(void) {
+  maps_ws_stop();
+  map_pack_sd_close();
+  map_tiles_fs_flush();
+}
@@ -0,0 +1,248 @@
+/*
+ * Benchmark en host: compresión LZSS/heatshrink de los mensajes binarios
+ * (src/maps/hs_decode). Mide ratio, throughput del encoder (el mismo
+ * algoritmo que HsEncoder.kt en la app) y del decoder alimentado de a
+ * fragmentos, y verifica que la ida y vuelta sea exacta.
+ *
+ * Compilar desde la raíz del repo:
+ *
+ *   g++ -O2 -std=gnu++17 -Isrc -Iinclude \
+ *       tools/bench/bench_hs.cpp src/maps/hs_decode.cpp src/maps/vec_proto.cpp \
+ *       src/maps/vec_frame.cpp -o bench_hs
+ *
+ * Uso:
+ *   ./bench_hs [sesion.bin] [chunk]
+ *
+ * sesion.bin es una sesión grabada: mensajes binarios del WebSocket como
+ * uint32 LE con el largo + los bytes del mensaje. Sin archivo (o con "-")
+ * se generan deltas sintéticos (un RESET con la geometría de un barrio en
+ * damero y ticks de solo posición). [chunk] es el tamaño de fragmento
+ * (default 1436).
+ */
+#include "maps/hs_decode.h"
+#include "maps/vec_proto.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using clk = std::chrono::steady_clock;
+using bytes = std::vector<uint8_t>;
+
+/* ── Encoder (greedy con cadenas de hash sobre 2 bytes) ──────────── */
+#define HS_MIN_MATCH 2
+#define HS_MAX_MATCH (1 << HS_COUNT_BITS)
+#define HS_MAX_CHAIN 64
+
+struct bit_writer_t {
+  bytes out;
+  uint32_t acc = 0;
+  uint8_t n = 0;
+  void put(uint32_t v, uint8_t bits) {
+    for (int i = bits - 1; i >= 0; i--) {
+      acc = (acc << 1) | ((v >> i) & 1);
+      if (++n == 8) {
+        out.push_back((uint8_t)acc);
+        acc = n = 0;
+      }
+    }
+  }
+  void flush() {
+    if (n) out.push_back((uint8_t)(acc << (8 - n)));
+    acc = n = 0;
+  }
+};
+
+static bytes hs_encode(const uint8_t *in, size_t len) {
+  static std::vector<int32_t> head(1 << 16);
+  std::vector<int32_t> prev(len);
+  std::fill(head.begin(), head.end(), -1);
+  bit_writer_t w;
+  size_t i = 0;
+  auto insert = [&](size_t p) {
+    if (p + 1 >= len) return;
+    uint32_t h = in[p] | (in[p + 1] << 8);
+    prev[p] = head[h];
+    head[h] = (int32_t)p;
+  };
+  while (i < len) {
+    size_t best = 0, best_dist = 0;
+    if (i + 1 < len) {
+      int32_t c = head[in[i] | (in[i + 1] << 8)];
+      for (int chain = 0; c >= 0 && i - c <= HS_WINDOW_SIZE && chain < HS_MAX_CHAIN;
+           chain++, c = prev[c]) {
+        size_t n = 0;
+        while (n < HS_MAX_MATCH && i + n < len && in[c + n] == in[i + n]) n++;
+        if (n > best) {
+          best = n;
+          best_dist = i - c;
+          if (n == HS_MAX_MATCH) break;
+        }
+      }
+    }
+    if (best >= HS_MIN_MATCH) {
+      w.put(0, 1);
+      w.put((uint32_t)(best_dist - 1), HS_WINDOW_BITS);
+      w.put((uint32_t)(best - 1), HS_COUNT_BITS);
+      for (size_t k = 0; k < best; k++) insert(i + k);
+      i += best;
+    } else {
+      w.put(1, 1);
+      w.put(in[i], 8);
+      insert(i);
+      i++;
+    }
+  }
+  w.flush();
+  return w.out;
+}
+
+/* ── Sesión ──────────────────────────────────────────────────────── */
+static std::vector<bytes> load_session(const char *path) {
+  std::vector<bytes> out;
+  FILE *f = fopen(path, "rb");
+  if (!f) { perror(path); exit(1); }
+  uint8_t l[4];
+  while (fread(l, 1, 4, f) == 4) {
+    uint32_t n = l[0] | (l[1] << 8) | (l[2] << 16) | ((uint32_t)l[3] << 24);
+    bytes m(n);
+    if (fread(m.data(), 1, n, f) != n) break;
+    out.push_back(std::move(m));
+  }
+  fclose(f);
+  return out;
+}
+
+struct msg_writer_t {
+  bytes b;
+  void u8(uint32_t v) { b.push_back((uint8_t)v); }
+  void varint(uint32_t v) {
+    while (v & ~0x7Fu) { b.push_back((uint8_t)((v & 0x7F) | 0x80)); v >>= 7; }
+    b.push_back((uint8_t)v);
+  }
+  void zz(int32_t v) { varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31)); }
+  void hdr(uint8_t type, uint16_t seq) {
+    u8(MAPS_BIN_MAGIC); u8(MAPS_BIN_VERSION); u8(type); u8(0); u8(seq & 0xFF); u8(seq >> 8);
+  }
+};
+
+/* Mismo formato que DeltaFrameEncoder.kt: cuadras de un damero (tramos
+ * rectos con vértices a paso casi fijo, como los de OSM en una ciudad) y
+ * algunas calles curvas; nombres repetidos */
+static std::vector<bytes> synth_session(void) {
+  std::vector<bytes> out;
+  srand(1);
+  int32_t px = 143000000, py = 160000000;
+  msg_writer_t m;
+  m.hdr(MAPS_BIN_DELTA, 1);
+  m.u8(MAPS_DELTA_RESET);
+  m.zz(px); m.zz(py); m.zz(90); m.u8(17);
+  const int roads = 300, labels = 40;
+  m.varint(roads + labels);
+  for (int r = 0; r < roads; r++) {
+    m.u8(MAPS_OP_ROAD); m.varint(r + 1); m.u8(1 + r % 3);
+    bool grid = r % 4 != 0;
+    int n = grid ? 2 + rand() % 4 : 4 + rand() % 26;
+    m.varint(n);
+    int32_t cx = px, cy = py;
+    int32_t x = px + (rand() % 40 - 20) * 1100, y = py + (rand() % 40 - 20) * 1100;
+    int dx = grid ? (r & 1 ? 1100 : 0) : rand() % 400 - 200;
+    int dy = grid ? (r & 1 ? 0 : 1100) : rand() % 400 - 200;
+    for (int k = 0; k < n; k++) {
+      if (k) {
+        x += dx + (grid ? 0 : rand() % 21 - 10);
+        y += dy + (grid ? 0 : rand() % 21 - 10);
+      }
+      m.zz(x - cx); m.zz(y - cy);
+      cx = x; cy = y;
+    }
+  }
+  static const char *names[] = {"Avenida Corrientes", "Calle Florida", "Avenida de Mayo",
+                                "Calle Lavalle", "Avenida Santa Fe", "Calle Tucuman"};
+  for (int l = 0; l < labels; l++) {
+    m.u8(MAPS_OP_LABEL); m.varint(1000 + l);
+    m.zz(rand() % 40000 - 20000); m.zz(rand() % 40000 - 20000);
+    const char *s = names[l % 6];
+    m.u8((uint8_t)strlen(s));
+    m.b.insert(m.b.end(), s, s + strlen(s));
+  }
+  out.push_back(m.b);
+  for (uint16_t t = 0; t < 50; t++) {
+    msg_writer_t p;
+    p.hdr(MAPS_BIN_DELTA, (uint16_t)(2 + t));
+    px += 120; py -= 40;
+    p.u8(0); p.zz(px); p.zz(py); p.zz(90); p.u8(17); p.varint(0);
+    out.push_back(p.b);
+  }
+  return out;
+}
+
+template <typename F>
+static double time_us(F fn, int iters) {
+  auto t0 = clk::now();
+  for (int i = 0; i < iters; i++) fn();
+  return std::chrono::duration<double, std::micro>(clk::now() - t0).count() / iters;
+}
+
+int main(int argc, char **argv) {
+  std::vector<bytes> msgs =
+      argc > 1 && strcmp(argv[1], "-") ? load_session(argv[1]) : synth_session();
+  size_t chunk = argc > 2 ? (size_t)atoi(argv[2]) : 1436;
+  if (msgs.empty() || chunk == 0) { fprintf(stderr, "sin mensajes\n"); return 1; }
+
+  /* Se comprime solo el payload (la cabecera viaja igual) y solo si ayuda,
+   * como hace la app */
+  size_t raw = 0, packed = 0, n_packed = 0, big_raw = 0, big_packed = 0;
+  std::vector<bytes> enc(msgs.size());
+  for (size_t i = 0; i < msgs.size(); i++) {
+    const bytes &m = msgs[i];
+    raw += m.size();
+    maps_bin_hdr_t hdr;
+    bool proto = maps_bin_parse_hdr(m.data(), m.size(), &hdr) && hdr.type != MAPS_BIN_TILE;
+    if (proto) enc[i] = hs_encode(m.data() + hdr.len, m.size() - hdr.len);
+    size_t sz = proto && enc[i].size() + hdr.len < m.size() ? enc[i].size() + hdr.len : m.size();
+    if (sz < m.size()) n_packed++;
+    packed += sz;
+    if (m.size() >= 1024) { big_raw += m.size(); big_packed += sz; }
+  }
+  printf("%zu mensajes, %zu bytes promedio, chunk %zu\n", msgs.size(), raw / msgs.size(), chunk);
+  printf("ratio     : %.2f:1 total (%zu → %zu bytes), %zu comprimidos\n",
+         (double)raw / packed, raw, packed, n_packed);
+  if (big_raw)
+    printf("            %.2f:1 en mensajes >= 1 KB\n", (double)big_raw / big_packed);
+
+  /* Encoder */
+  const int iters = 20;
+  double us_enc = time_us([&] {
+    for (auto &m : msgs) hs_encode(m.data(), m.size());
+  }, iters);
+  printf("encoder   : %8.1f us/sesión  %6.1f MB/s\n", us_enc, raw / us_enc);
+
+  /* Decoder de a fragmentos, como en maps_ws_server */
+  static hs_dec_t dec;
+  static uint8_t out[64 * 1024];
+  int bad = 0;
+  double us_dec = time_us([&] {
+    for (size_t i = 0; i < msgs.size(); i++) {
+      const bytes &m = msgs[i];
+      const bytes &e = enc[i];
+      if (e.empty()) continue;
+      hs_dec_init(&dec);
+      size_t o = 0;
+      for (size_t off = 0; off < e.size(); off += chunk) {
+        size_t n = e.size() - off < chunk ? e.size() - off : chunk;
+        int32_t r = hs_dec_feed(&dec, e.data() + off, n, out + o, sizeof(out) - o);
+        if (r < 0) { bad++; break; }
+        o += (size_t)r;
+      }
+      maps_bin_hdr_t hdr;
+      maps_bin_parse_hdr(m.data(), m.size(), &hdr);
+      if (o != m.size() - hdr.len || memcmp(out, m.data() + hdr.len, o)) bad++;
+    }
+  }, iters);
+  printf("decoder   : %8.1f us/sesión  %6.1f MB/s de salida, %zu B de estado, %d errores\n",
+         us_dec, raw / us_dec, sizeof(hs_dec_t), bad / iters);
+  return bad ? 1 : 0;
+}
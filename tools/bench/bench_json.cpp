@@ -0,0 +1,242 @@
+/*
+ * Benchmark en host: parser JSON en streaming (src/maps/map_json) vs. el
+ * camino anterior (copia a s_text_buf + strstr + JsonDocument de ArduinoJson).
+ *
+ * Compilar desde la raíz del repo (ArduinoJson es opcional; sin él solo se
+ * mide el parser en streaming):
+ *
+ *   g++ -O2 -std=gnu++17 -Isrc -Iinclude \
+ *       -I.pio/libdeps/JC3248W535EN/ArduinoJson/src \
+ *       tools/bench/bench_json.cpp src/maps/json_sax.cpp src/maps/map_json.cpp \
+ *       src/maps/vec_frame.cpp -o bench_json
+ *
+ * Uso:
+ *   ./bench_json [frames.jsonl] [chunk]
+ *
+ * frames.jsonl tiene un mensaje por línea (p. ej. los frames "vec" logueados
+ * por la app); sin archivo se genera un frame denso sintético con los
+ * viejos topes fijos de vec_frame_t. [chunk] es el tamaño de fragmento WebSocket con
+ * el que se alimenta el parser en streaming (default 1436, un MSS típico).
+ */
+#include "maps/map_json.h"
+#include "maps/vec_frame.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if __has_include(<ArduinoJson.h>)
+#include <ArduinoJson.h>
+#define HAVE_ARDUINOJSON 1
+#else
+#define HAVE_ARDUINOJSON 0
+#endif
+
+using clk = std::chrono::steady_clock;
+
+static std::vector<std::string> load_frames(const char *path) {
+  std::vector<std::string> out;
+  FILE *f = fopen(path, "rb");
+  if (!f) { perror(path); exit(1); }
+  std::string line;
+  int c;
+  while ((c = fgetc(f)) != EOF) {
+    if (c == '\n') {
+      if (!line.empty()) out.push_back(line);
+      line.clear();
+    } else {
+      line.push_back((char)c);
+    }
+  }
+  if (!line.empty()) out.push_back(line);
+  fclose(f);
+  return out;
+}
+
+#define SYN_ROADS     80
+#define SYN_ROAD_PTS  30
+#define SYN_ROUTE_PTS 100
+#define SYN_LABELS    20
+
+/* Frame con el mismo formato que VectorRenderer.buildFrame() en la app */
+static std::string synth_frame(unsigned seed) {
+  srand(seed);
+  std::string s = "{\"t\":\"vec\",\"roads\":[";
+  for (int i = 0; i < SYN_ROADS; i++) {
+    if (i) s += ',';
+    s += "{\"p\":[";
+    int x = rand() % 320, y = rand() % 480;
+    for (int j = 0; j < SYN_ROAD_PTS; j++) {
+      if (j) s += ',';
+      x += rand() % 21 - 10;
+      y += rand() % 21 - 10;
+      s += "[" + std::to_string(x) + "," + std::to_string(y) + "]";
+    }
+    s += "],\"w\":" + std::to_string(1 + i % 3) + "}";
+  }
+  s += "],\"route\":[";
+  for (int j = 0; j < SYN_ROUTE_PTS; j++) {
+    if (j) s += ',';
+    s += "[" + std::to_string(160 + j) + "," + std::to_string(360 - 3 * j) + "]";
+  }
+  s += "],\"labels\":[";
+  for (int i = 0; i < SYN_LABELS; i++) {
+    if (i) s += ',';
+    s += "{\"p\":[" + std::to_string(rand() % 320) + "," + std::to_string(rand() % 480) +
+         "],\"n\":\"Calle numero " + std::to_string(i) + "\"}";
+  }
+  s += "],\"pos\":[160,360],\"hdg\":90}";
+  return s;
+}
+
+/* ── Camino en streaming ─────────────────────────────────────────── */
+alignas(4) static uint8_t g_frame_mem[VEC_FRAME_BYTES];
+static vec_frame_t g_frame;
+static nav_step_t  g_nav;
+
+static map_json_type_t run_stream(const std::string &msg, size_t chunk) {
+  static map_json_t m;
+  map_json_begin(&m, &g_frame, &g_nav);
+  for (size_t off = 0; off < msg.size(); off += chunk) {
+    size_t n = msg.size() - off < chunk ? msg.size() - off : chunk;
+    map_json_feed(&m, msg.data() + off, n);
+  }
+  return map_json_end(&m);
+}
+
+#if HAVE_ARDUINOJSON
+/* ── Camino anterior (copia de parse_vec_frame en maps_ws_server.cpp) ── */
+static size_t g_allocs = 0;
+
+struct CountingAllocator : ArduinoJson::Allocator {
+  void *allocate(size_t n) override { g_allocs++; return malloc(n); }
+  void deallocate(void *p) override { free(p); }
+  void *reallocate(void *p, size_t n) override { g_allocs++; return realloc(p, n); }
+};
+static CountingAllocator g_alloc;
+
+alignas(4) static uint8_t g_legacy_mem[VEC_FRAME_BYTES];
+static vec_frame_t g_legacy;
+static char        g_text_buf[64 * 1024];
+
+static bool run_legacy(const std::string &msg, size_t chunk) {
+  if (msg.size() >= sizeof(g_text_buf)) return false;
+  for (size_t off = 0; off < msg.size(); off += chunk) {
+    size_t n = msg.size() - off < chunk ? msg.size() - off : chunk;
+    memcpy(g_text_buf + off, msg.data() + off, n);
+  }
+  g_text_buf[msg.size()] = '\0';
+  const char *t = strstr(g_text_buf, "\"t\":\"");
+  if (!t || strncmp(t + 5, "vec", 3) != 0) return false;
+
+  JsonDocument doc(&g_alloc);
+  if (deserializeJson(doc, g_text_buf, msg.size()) != DeserializationError::Ok) return false;
+  vec_frame_t &frame = g_legacy;
+  vec_frame_begin(&frame);
+  for (JsonObject road : doc["roads"].as<JsonArray>()) {
+    vec_frame_poly_begin(&frame, VEC_FRAME_ROAD, road["w"] | 1);
+    for (JsonArray pt : road["p"].as<JsonArray>())
+      vec_frame_poly_add(&frame, { (int16_t)pt[0].as<int>(), (int16_t)pt[1].as<int>() });
+    vec_frame_poly_end(&frame);
+  }
+  vec_frame_poly_begin(&frame, VEC_FRAME_ROUTE, 0);
+  for (JsonArray pt : doc["route"].as<JsonArray>())
+    vec_frame_poly_add(&frame, { (int16_t)pt[0].as<int>(), (int16_t)pt[1].as<int>() });
+  for (JsonObject lbl : doc["labels"].as<JsonArray>()) {
+    JsonArray p = lbl["p"];
+    if (p.size() < 2) continue;
+    vec_label_t *l = vec_frame_label_add(&frame);
+    if (!l) break;
+    l->x = p[0].as<int>();
+    l->y = p[1].as<int>();
+    const char *n = lbl["n"] | "";
+    snprintf(l->name, sizeof(l->name), "%s", n);
+  }
+  vec_frame_end(&frame);
+  JsonArray pos = doc["pos"];
+  if (pos.size() >= 2) {
+    frame.pos_x = pos[0].as<int>();
+    frame.pos_y = pos[1].as<int>();
+  }
+  frame.heading = doc["hdg"] | -1;
+  return true;
+}
+
+static bool same_polys(const vec_frame_t &a, const vec_frame_t &b, const vec_poly_t *pa,
+                       const vec_poly_t *pb, uint16_t n) {
+  for (uint16_t i = 0; i < n; i++) {
+    if (pa[i].n != pb[i].n || pa[i].w != pb[i].w) return false;
+    if (memcmp(vec_frame_poly_pts(&a, pa[i]), vec_frame_poly_pts(&b, pb[i]),
+               pa[i].n * sizeof(vec_point_t)))
+      return false;
+  }
+  return true;
+}
+
+static bool same_frame(const vec_frame_t &a, const vec_frame_t &b) {
+  if (a.n_roads != b.n_roads || a.n_routes != b.n_routes || a.n_labels != b.n_labels) return false;
+  if (a.pos_x != b.pos_x || a.pos_y != b.pos_y || a.heading != b.heading) return false;
+  if (!same_polys(a, b, a.roads, b.roads, a.n_roads)) return false;
+  if (!same_polys(a, b, a.routes, b.routes, a.n_routes)) return false;
+  for (uint16_t i = 0; i < a.n_labels; i++) {
+    const vec_label_t &la = vec_frame_label(&a, i), &lb = vec_frame_label(&b, i);
+    if (la.x != lb.x || la.y != lb.y || strcmp(la.name, lb.name)) return false;
+  }
+  return true;
+}
+#endif
+
+template <typename F>
+static double time_us(F fn, int iters) {
+  auto t0 = clk::now();
+  for (int i = 0; i < iters; i++) fn();
+  return std::chrono::duration<double, std::micro>(clk::now() - t0).count() / iters;
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> frames;
+  if (argc > 1) frames = load_frames(argv[1]);
+  else for (unsigned i = 0; i < 8; i++) frames.push_back(synth_frame(i));
+  size_t chunk = argc > 2 ? (size_t)atoi(argv[2]) : 1436;
+  vec_frame_init(&g_frame, g_frame_mem, sizeof(g_frame_mem));
+#if HAVE_ARDUINOJSON
+  vec_frame_init(&g_legacy, g_legacy_mem, sizeof(g_legacy_mem));
+#endif
+  if (frames.empty() || chunk == 0) { fprintf(stderr, "sin frames\n"); return 1; }
+
+  size_t total = 0;
+  for (auto &f : frames) total += f.size();
+  printf("%zu mensajes, %zu bytes promedio, chunk %zu\n", frames.size(),
+         total / frames.size(), chunk);
+
+  const int iters = 200;
+  int bad = 0;
+  double us_stream = time_us([&] {
+    for (auto &f : frames) if (run_stream(f, chunk) == MAP_JSON_NONE) bad++;
+  }, iters) / frames.size();
+  printf("streaming : %8.1f us/msg  %6.1f MB/s  (0 allocs, %d inválidos)\n", us_stream,
+         (total / frames.size()) / us_stream, bad / iters);
+
+#if HAVE_ARDUINOJSON
+  g_allocs = 0;
+  double us_legacy = time_us([&] {
+    for (auto &f : frames) run_legacy(f, chunk);
+  }, iters) / frames.size();
+  printf("legacy    : %8.1f us/msg  %6.1f MB/s  (%.1f allocs/msg)\n", us_legacy,
+         (total / frames.size()) / us_legacy, (double)g_allocs / iters / frames.size());
+  printf("speedup   : %.2fx\n", us_legacy / us_stream);
+
+  int mismatch = 0;
+  for (auto &f : frames) {
+    if (run_stream(f, chunk) != MAP_JSON_VEC) continue;
+    if (run_legacy(f, chunk) && !same_frame(g_frame, g_legacy)) mismatch++;
+  }
+  printf("frames distintos entre parsers: %d\n", mismatch);
+#else
+  printf("legacy    : (compilar con -I<ArduinoJson/src> para comparar)\n");
+#endif
+  return 0;
+}
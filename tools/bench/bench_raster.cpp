@@ -0,0 +1,224 @@
+/*
+ * Benchmark en host: rasterizador de polilíneas (src/maps/map_raster), con y
+ * sin antialias, vs. el camino anterior (un lv_draw_line por par de puntos).
+ *
+ * LVGL no se compila en host, así que el camino anterior se modela con la
+ * misma estructura de costo que el draw unit por software de LVGL 9.2 para
+ * líneas oblicuas: un task por tramo, máscara de cobertura con antialias
+ * sobre todo el bbox del tramo (más los extremos redondos de la ruta) y
+ * mezcla RGB565 píxel a píxel. Sirve para comparar órdenes de magnitud; la
+ * medición final es en el equipo.
+ *
+ * Compilar desde la raíz del repo:
+ *
+ *   g++ -O2 -std=gnu++17 -Isrc -Iinclude \
+ *       tools/bench/bench_raster.cpp src/maps/map_raster.cpp -o bench_raster
+ *
+ * Uso:
+ *   ./bench_raster [iteraciones]
+ *
+ * Además del tiempo por frame informa cuántos píxeles difieren entre ambos
+ * caminos (el modelo anterior umbralizado al 50 % de cobertura), como
+ * control de que el rasterizador dibuja la misma geometría, y prueba
+ * rast_blend_span contra una mezcla exacta por canal.
+ */
+#include "maps/map_raster.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+using clk = std::chrono::steady_clock;
+
+#define W 320
+#define H 480
+
+struct line_t {
+  std::vector<vec_point_t> pts;
+  uint8_t  width;
+  uint16_t color;
+  bool     round;
+};
+
+/* Frame denso sintético (los viejos topes fijos de vec_frame_t), mismos
+ * grosores que screen_map */
+#define SYN_ROADS     80
+#define SYN_ROAD_PTS  30
+#define SYN_ROUTE_PTS 100
+
+static std::vector<line_t> synth_frame(unsigned seed) {
+  srand(seed);
+  std::vector<line_t> out;
+  for (int i = 0; i < SYN_ROADS; i++) {
+    line_t l;
+    uint8_t w = 1 + i % 3;
+    l.width = w == 3 ? 8 : w == 2 ? 5 : 3;
+    l.color = 0x39CB + w * 0x1000;
+    l.round = false;
+    int x = rand() % W, y = rand() % H;
+    int dx = rand() % 21 - 10, dy = rand() % 21 - 10;
+    for (int j = 0; j < SYN_ROAD_PTS; j++) {
+      l.pts.push_back({(int16_t)x, (int16_t)y});
+      dx += rand() % 7 - 3;
+      dy += rand() % 7 - 3;
+      x += dx;
+      y += dy;
+    }
+    out.push_back(l);
+  }
+  line_t route;
+  route.width = 5;
+  route.color = 0x445F;
+  route.round = true;
+  for (int j = 0; j < SYN_ROUTE_PTS; j++)
+    route.pts.push_back({(int16_t)(160 + 40 * sin(j * 0.2)), (int16_t)(360 - 4 * j)});
+  out.push_back(route);
+  return out;
+}
+
+/* ── Camino anterior (modelo de lv_draw_line por tramo) ──────────── */
+static uint16_t blend565(uint16_t bg, uint16_t fg, uint8_t a) {
+  if (a >= 255) return fg;
+  uint32_t rb = ((fg & 0xF81F) * a + (bg & 0xF81F) * (255 - a)) >> 8;
+  uint32_t g  = ((fg & 0x07E0) * a + (bg & 0x07E0) * (255 - a)) >> 8;
+  return (uint16_t)((rb & 0xF81F) | (g & 0x07E0));
+}
+
+static void legacy_segment(uint16_t *buf, vec_point_t p1, vec_point_t p2, float width,
+                           uint16_t color, bool round) {
+  float hw = width / 2;
+  float ax = p1.x + 0.5f, ay = p1.y + 0.5f, bx = p2.x + 0.5f, by = p2.y + 0.5f;
+  float dx = bx - ax, dy = by - ay, len2 = dx * dx + dy * dy;
+  int x1 = (int)floorf(fminf(ax, bx) - hw - 1), x2 = (int)ceilf(fmaxf(ax, bx) + hw + 1);
+  int y1 = (int)floorf(fminf(ay, by) - hw - 1), y2 = (int)ceilf(fmaxf(ay, by) + hw + 1);
+  if (x1 < 0) x1 = 0;
+  if (y1 < 0) y1 = 0;
+  if (x2 > W - 1) x2 = W - 1;
+  if (y2 > H - 1) y2 = H - 1;
+  static uint8_t mask[W];
+  for (int y = y1; y <= y2; y++) {
+    float cy = y + 0.5f;
+    for (int x = x1; x <= x2; x++) {
+      float cx = x + 0.5f;
+      float t = len2 > 0 ? ((cx - ax) * dx + (cy - ay) * dy) / len2 : 0;
+      float d;
+      if (t < 0 || t > 1) {
+        if (!round) { mask[x] = 0; continue; }
+        float ex = t < 0 ? ax : bx, ey = t < 0 ? ay : by;
+        d = sqrtf((cx - ex) * (cx - ex) + (cy - ey) * (cy - ey));
+      } else {
+        float px = ax + t * dx - cx, py = ay + t * dy - cy;
+        d = sqrtf(px * px + py * py);
+      }
+      float cov = hw + 0.5f - d;
+      mask[x] = cov <= 0 ? 0 : cov >= 1 ? 255 : (uint8_t)(cov * 255);
+    }
+    uint16_t *row = buf + y * W;
+    for (int x = x1; x <= x2; x++)
+      if (mask[x]) row[x] = blend565(row[x], color, mask[x]);
+  }
+}
+
+static void draw_legacy(uint16_t *buf, const std::vector<line_t> &frame) {
+  for (auto &l : frame)
+    for (size_t j = 0; j + 1 < l.pts.size(); j++)
+      legacy_segment(buf, l.pts[j], l.pts[j + 1], l.width, l.color, l.round);
+}
+
+/* ── Rasterizador nuevo ──────────────────────────────────────────── */
+static void draw_raster(uint16_t *buf, const std::vector<line_t> &frame, dmg_rect_t clip,
+                        bool aa) {
+  rast_surface_t s = {buf, W, H, W, clip, aa};
+  for (auto &l : frame)
+    rast_polyline(&s, l.pts.data(), (uint16_t)l.pts.size(), l.width, l.color,
+                  l.round ? RAST_JOIN_ROUND : RAST_JOIN_MITER);
+}
+
+template <typename F>
+static double time_us(F fn, int iters) {
+  auto t0 = clk::now();
+  for (int i = 0; i < iters; i++) fn();
+  return std::chrono::duration<double, std::micro>(clk::now() - t0).count() / iters;
+}
+
+int main(int argc, char **argv) {
+  int iters = argc > 1 ? atoi(argv[1]) : 50;
+  if (iters <= 0) iters = 1;
+  std::vector<std::vector<line_t>> frames;
+  for (unsigned i = 0; i < 8; i++) frames.push_back(synth_frame(i));
+
+  static uint16_t a[W * H], b[W * H];
+  const dmg_rect_t full = {0, 0, W - 1, H - 1};
+  printf("%zu frames, %d calles × %d puntos + ruta de %d puntos\n", frames.size(),
+         SYN_ROADS, SYN_ROAD_PTS, SYN_ROUTE_PTS);
+
+  double us_legacy = time_us([&] {
+    for (auto &f : frames) { memset(a, 0, sizeof(a)); draw_legacy(a, f); }
+  }, iters) / frames.size();
+  double us_raster = time_us([&] {
+    for (auto &f : frames) { memset(b, 0, sizeof(b)); draw_raster(b, f, full, false); }
+  }, iters) / frames.size();
+  double us_aa = time_us([&] {
+    for (auto &f : frames) { memset(b, 0, sizeof(b)); draw_raster(b, f, full, true); }
+  }, iters) / frames.size();
+  /* Un rectángulo sucio típico del render incremental (~1/8 de pantalla) */
+  const dmg_rect_t dirty = {60, 300, 260, 400};
+  double us_dirty = time_us([&] {
+    for (auto &f : frames) draw_raster(b, f, dirty, true);
+  }, iters) / frames.size();
+
+  printf("por tramo : %8.1f us/frame\n", us_legacy);
+  printf("polilínea : %8.1f us/frame  (%.2fx)\n", us_raster, us_legacy / us_raster);
+  printf("  con AA  : %8.1f us/frame  (%.2fx)\n", us_aa, us_legacy / us_aa);
+  printf("  AA, rect %dx%d: %6.1f us/frame\n", dirty.x2 - dirty.x1 + 1, dirty.y2 - dirty.y1 + 1,
+         us_dirty);
+
+  /* Control: misma cobertura (umbral 50 %); difieren bordes y las uniones,
+   * que el camino anterior dejaba abiertas */
+  long diff = 0, painted = 0;
+  for (auto &f : frames) {
+    memset(a, 0, sizeof(a));
+    memset(b, 0, sizeof(b));
+    for (auto &l : f) {
+      std::vector<line_t> one = {l};
+      one[0].color = 0xFFFF;
+      draw_legacy(a, one);
+      draw_raster(b, one, full, false);
+    }
+    for (int i = 0; i < W * H; i++) {
+      bool pa = (a[i] >> 11) >= 16, pb = b[i] != 0;
+      painted += pb;
+      diff += pa != pb;
+    }
+  }
+  printf("píxeles distintos: %ld de %ld pintados (%.2f %%)\n", diff, painted,
+         painted ? 100.0 * diff / painted : 0.0);
+
+  /* Blender: error máximo por canal (en LSB) contra la mezcla exacta */
+  int err[3] = {0, 0, 0};
+  uint8_t alpha[256];
+  uint16_t dst[256];
+  srand(1);
+  for (int t = 0; t < 4096; t++) {
+    uint16_t fg = rand() & 0xFFFF, bg = rand() & 0xFFFF;
+    for (int i = 0; i < 256; i++) {
+      alpha[i] = (uint8_t)i;
+      dst[i] = bg;
+    }
+    rast_blend_span(dst, alpha, fg, 256);
+    for (int i = 0; i < 256; i++) {
+      const int sh[3] = {11, 5, 0}, mk[3] = {31, 63, 31};
+      for (int ch = 0; ch < 3; ch++) {
+        int f = fg >> sh[ch] & mk[ch], g = bg >> sh[ch] & mk[ch];
+        int want = (f * i + g * (255 - i) + 127) / 255;
+        int e = abs((dst[i] >> sh[ch] & mk[ch]) - want);
+        if (e > err[ch]) err[ch] = e;
+      }
+    }
+  }
+  printf("blend RGB565: error máximo R %d, G %d, B %d LSB\n", err[0], err[1], err[2]);
+  return err[0] > 1 || err[1] > 2 || err[2] > 1;
+}
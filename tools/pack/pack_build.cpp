@@ -0,0 +1,517 @@
+/*
+ * Armador de paquetes de mapa offline (src/maps/map_pack.h) a partir de
+ * extractos JSON de Overpass guardados.
+ *
+ * Compilar desde la raíz del repo:
+ *
+ *   g++ -O2 -std=gnu++17 -Isrc -Iinclude \
+ *       tools/pack/pack_build.cpp src/maps/json_sax.cpp src/maps/map_pack.cpp \
+ *       src/maps/vec_store.cpp src/maps/vec_proto.cpp src/maps/vec_frame.cpp \
+ *       src/maps/vec_trig.cpp -o pack_build
+ *
+ * Uso:
+ *   ./pack_build [-z zoom] [-o maps.mpk] extracto.json [...]
+ *
+ * Cada extracto es la respuesta de Overpass a una consulta de calles, con
+ * "out geom;" (la geometría viene en cada way, como la que hace la app) o
+ * con "out body; >; out skel qt;" (los ways traen ids de nodos y los nodos
+ * vienen aparte). Un way repetido en varios extractos se toma una vez.
+ * [zoom] es el de los tiles (default 16, ~600 m de lado en el ecuador).
+ * El archivo va a la raíz de la SD como MAP_PACK_PATH (/maps.mpk).
+ *
+ * Las calles se simplifican con la misma tolerancia que la app, se
+ * recortan a cada tile y se parten a VEC_STORE_ITEM_PTS puntos; los labels
+ * van uno por nombre y por tile. Al terminar se relee el paquete con el
+ * mismo lector del firmware y se carga cada tile en un vec_store como
+ * control.
+ */
+#include "maps/json_sax.h"
+#include "maps/map_pack.h"
+#include "maps/vec_proto.h"
+#include "maps/vec_store.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define SIMPLIFY_EPS 3.0 /* unidades de mundo, como DeltaFrameEncoder.SIMPLIFY_EPS */
+#define TILE_LABELS  24  /* labels por tile: la ventana carga varios y el conjunto tiene 128 */
+#define READ_CHUNK   (64 * 1024)
+
+struct pt_t { int32_t x, y; };
+using line_t = std::vector<pt_t>;
+using bytes = std::vector<uint8_t>;
+
+struct way_t {
+  uint8_t w = 0;
+  std::string name;
+  std::vector<std::pair<double, double>> geom; /* lat, lon */
+  std::vector<int64_t> nodes;
+};
+
+/* ── Lectura de Overpass ─────────────────────────────────────────── */
+struct overpass_t {
+  std::map<int64_t, way_t> ways;
+  std::unordered_map<int64_t, std::pair<double, double>> nodes;
+
+  /* Elemento en curso */
+  std::string type, key3, key4, key5;
+  int64_t id = 0;
+  way_t way;
+  bool has_lat = false, has_lon = false;
+  double lat = 0, lon = 0;
+  std::string highway;
+};
+
+/* Grosor de calle como VectorFetcher.highwayWidth; 0 = no es una calle que se dibuje */
+static uint8_t highway_width(const std::string &h) {
+  std::string base = h;
+  if (base.size() > 5 && base.compare(base.size() - 5, 5, "_link") == 0)
+    base.resize(base.size() - 5);
+  if (base == "motorway" || base == "trunk") return 3;
+  if (base == "primary" || base == "secondary") return 2;
+  if (base == "tertiary" || base == "residential" || base == "service" ||
+      base == "unclassified" || base == "living_street")
+    return 1;
+  return 0;
+}
+
+static void on_event(void *ctx, json_sax_ev_t ev, const json_sax_t *p) {
+  overpass_t &o = *(overpass_t *)ctx;
+  switch (ev) {
+  case JSON_SAX_OBJ_BEGIN:
+    if (p->depth == 3) {
+      o.type.clear();
+      o.id = 0;
+      o.way = way_t();
+      o.highway.clear();
+      o.has_lat = o.has_lon = false;
+    } else if (p->depth == 5 && o.key3 == "geometry") {
+      o.has_lat = o.has_lon = false;
+    }
+    break;
+  case JSON_SAX_OBJ_END:
+    if (p->depth == 5 && o.key3 == "geometry" && o.has_lat && o.has_lon) {
+      o.way.geom.push_back({o.lat, o.lon});
+    } else if (p->depth == 3) {
+      if (o.type == "node" && o.has_lat && o.has_lon) {
+        o.nodes[o.id] = {o.lat, o.lon};
+      } else if (o.type == "way") {
+        o.way.w = highway_width(o.highway);
+        if (o.way.w && !o.ways.count(o.id))
+          o.ways[o.id] = std::move(o.way);
+      }
+    }
+    break;
+  case JSON_SAX_KEY:
+    if (p->depth == 3) o.key3 = p->str;
+    else if (p->depth == 4) o.key4 = p->str;
+    else if (p->depth == 5) o.key5 = p->str;
+    break;
+  case JSON_SAX_NUMBER: {
+    /* num viene saturado a 32 bits: ids y coordenadas salen del texto */
+    const std::string &k = p->depth == 3 ? o.key3 : o.key5;
+    if (p->depth == 3 && k == "id") {
+      o.id = strtoll(p->str, nullptr, 10);
+    } else if ((p->depth == 3 || (p->depth == 5 && o.key3 == "geometry")) &&
+               (k == "lat" || k == "lon")) {
+      double v = strtod(p->str, nullptr);
+      if (k == "lat") { o.lat = v; o.has_lat = true; }
+      else            { o.lon = v; o.has_lon = true; }
+    } else if (p->depth == 4 && o.key3 == "nodes") {
+      o.way.nodes.push_back(strtoll(p->str, nullptr, 10));
+    }
+    break;
+  }
+  case JSON_SAX_STRING:
+    if (p->depth == 3 && o.key3 == "type") o.type = p->str;
+    else if (p->depth == 4 && o.key3 == "tags" && o.key4 == "highway") o.highway = p->str;
+    else if (p->depth == 4 && o.key3 == "tags" && o.key4 == "name") o.way.name = p->str;
+    break;
+  default:
+    break;
+  }
+}
+
+static bool load_extract(const char *path, overpass_t *o) {
+  FILE *f = fopen(path, "rb");
+  if (!f) { perror(path); return false; }
+  static json_sax_t sax;
+  static char buf[READ_CHUNK];
+  json_sax_begin(&sax, on_event, o);
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0) json_sax_feed(&sax, buf, n);
+  fclose(f);
+  if (!json_sax_end(&sax)) {
+    fprintf(stderr, "%s: JSON inválido\n", path);
+    return false;
+  }
+  return true;
+}
+
+/* ── Geometría ───────────────────────────────────────────────────── */
+
+/* Igual que VectorRenderer.latLonToWorld en la app */
+static pt_t to_world(double lat, double lon) {
+  const double size = 256.0 * (double)(1 << VEC_WORLD_ZOOM);
+  double s = sin(lat * M_PI / 180.0);
+  double x = (lon + 180.0) / 360.0 * size;
+  double y = (0.5 - log((1.0 + s) / (1.0 - s)) / (4.0 * M_PI)) * size;
+  return {(int32_t)lround(x), (int32_t)lround(y)};
+}
+
+static double seg_dist(const pt_t &p, const pt_t &a, const pt_t &b) {
+  double dx = b.x - a.x, dy = b.y - a.y;
+  double len = sqrt(dx * dx + dy * dy);
+  if (len == 0) return hypot(p.x - a.x, p.y - a.y);
+  return fabs(dx * (p.y - a.y) - dy * (p.x - a.x)) / len;
+}
+
+/* Douglas–Peucker (como VectorRenderer.simplify) */
+static line_t simplify(const line_t &in, double eps) {
+  if (in.size() <= 2) return in;
+  std::vector<bool> keep(in.size(), false);
+  keep.front() = keep.back() = true;
+  std::vector<std::pair<size_t, size_t>> stack = {{0, in.size() - 1}};
+  while (!stack.empty()) {
+    auto [a, b] = stack.back();
+    stack.pop_back();
+    double best = 0;
+    size_t at = a;
+    for (size_t i = a + 1; i < b; i++) {
+      double d = seg_dist(in[i], in[a], in[b]);
+      if (d > best) { best = d; at = i; }
+    }
+    if (best > eps) {
+      keep[at] = true;
+      stack.push_back({a, at});
+      stack.push_back({at, b});
+    }
+  }
+  line_t out;
+  for (size_t i = 0; i < in.size(); i++)
+    if (keep[i]) out.push_back(in[i]);
+  return out;
+}
+
+/* Recorta el segmento a-b al rectángulo (Liang–Barsky); false si no lo toca */
+static bool clip(double x0, double y0, double x1, double y1, double rx1, double ry1,
+                 double rx2, double ry2, double *t0, double *t1) {
+  double dx = x1 - x0, dy = y1 - y0;
+  double p[4] = {-dx, dx, -dy, dy};
+  double q[4] = {x0 - rx1, rx2 - x0, y0 - ry1, ry2 - y0};
+  *t0 = 0;
+  *t1 = 1;
+  for (int i = 0; i < 4; i++) {
+    if (p[i] == 0) {
+      if (q[i] < 0) return false;
+      continue;
+    }
+    double t = q[i] / p[i];
+    if (p[i] < 0) { if (t > *t1) return false; if (t > *t0) *t0 = t; }
+    else          { if (t < *t0) return false; if (t < *t1) *t1 = t; }
+  }
+  return true;
+}
+
+/* Tramos de [line] dentro del tile (tx, ty), sin puntos repetidos */
+static std::vector<line_t> clip_to_tile(const line_t &line, int32_t tx, int32_t ty,
+                                        uint8_t shift) {
+  const double x1 = (double)((int64_t)tx << shift), y1 = (double)((int64_t)ty << shift);
+  const double x2 = x1 + (double)(1 << shift), y2 = y1 + (double)(1 << shift);
+  std::vector<line_t> out;
+  line_t cur;
+  for (size_t i = 0; i + 1 < line.size(); i++) {
+    const pt_t &a = line[i], &b = line[i + 1];
+    double t0, t1;
+    if (!clip(a.x, a.y, b.x, b.y, x1, y1, x2, y2, &t0, &t1)) {
+      if (cur.size() >= 2) out.push_back(cur);
+      cur.clear();
+      continue;
+    }
+    pt_t p0 = {(int32_t)lround(a.x + t0 * (b.x - a.x)), (int32_t)lround(a.y + t0 * (b.y - a.y))};
+    pt_t p1 = {(int32_t)lround(a.x + t1 * (b.x - a.x)), (int32_t)lround(a.y + t1 * (b.y - a.y))};
+    if (!cur.empty() && (cur.back().x != p0.x || cur.back().y != p0.y)) {
+      if (cur.size() >= 2) out.push_back(cur);
+      cur.clear();
+    }
+    if (cur.empty()) cur.push_back(p0);
+    if (p1.x != cur.back().x || p1.y != cur.back().y) cur.push_back(p1);
+    if (t1 < 1) {
+      if (cur.size() >= 2) out.push_back(cur);
+      cur.clear();
+    }
+  }
+  if (cur.size() >= 2) out.push_back(cur);
+  return out;
+}
+
+/* ── Tiles ───────────────────────────────────────────────────────── */
+struct piece_t {
+  line_t pts;
+  uint8_t w;
+};
+
+struct label_t {
+  std::string name;
+  pt_t at;
+  uint8_t w;
+  size_t n; /* puntos del tramo en que va: el más largo gana */
+};
+
+struct tile_t {
+  std::vector<piece_t> pieces;
+  std::map<std::string, label_t> labels;
+};
+
+struct writer_t {
+  bytes b;
+  void u8(uint8_t v) { b.push_back(v); }
+  void varint(uint32_t v) {
+    while (v >= 0x80) { b.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+    b.push_back((uint8_t)v);
+  }
+  void zz(int32_t v) { varint(((uint32_t)v << 1) ^ (uint32_t)(v >> 31)); }
+  void u32(uint32_t v) { for (int i = 0; i < 4; i++) b.push_back((uint8_t)(v >> (8 * i))); }
+};
+
+/* Prefijo UTF-8 de hasta [max] bytes sin cortar caracteres */
+static std::string utf8_prefix(const std::string &s, size_t max) {
+  if (s.size() <= max) return s;
+  size_t n = max;
+  while (n > 0 && ((uint8_t)s[n] & 0xC0) == 0x80) n--;
+  return s.substr(0, n);
+}
+
+/* Operaciones del tile con el cursor en su esquina; descarta del final
+ * (lo menos ancho) si no entra en MAP_PACK_TILE_MAX o en los ids */
+static bytes encode_tile(const tile_t &t, pt_t origin, size_t *dropped) {
+  /* Partido a VEC_STORE_ITEM_PTS compartiendo el extremo */
+  std::vector<piece_t> parts;
+  for (auto &p : t.pieces) {
+    for (size_t i = 0; i + 1 < p.pts.size(); i += VEC_STORE_ITEM_PTS - 1) {
+      size_t end = std::min(p.pts.size(), i + VEC_STORE_ITEM_PTS);
+      parts.push_back({line_t(p.pts.begin() + i, p.pts.begin() + end), p.w});
+    }
+  }
+  std::stable_sort(parts.begin(), parts.end(),
+                   [](const piece_t &a, const piece_t &b) { return a.w > b.w; });
+  std::vector<const label_t *> labels;
+  for (auto &kv : t.labels) labels.push_back(&kv.second);
+  std::stable_sort(labels.begin(), labels.end(), [](const label_t *a, const label_t *b) {
+    return a->w != b->w ? a->w > b->w : a->n > b->n;
+  });
+  if (labels.size() > TILE_LABELS) labels.resize(TILE_LABELS);
+
+  size_t n_parts = std::min(parts.size(), (size_t)MAP_PACK_TILE_IDS - labels.size());
+  for (;;) {
+    writer_t w;
+    w.varint((uint32_t)(n_parts + labels.size()));
+    uint32_t id = 0;
+    for (size_t i = 0; i < n_parts; i++) {
+      const piece_t &p = parts[i];
+      w.u8(MAPS_OP_ROAD);
+      w.varint(id++);
+      w.u8(p.w);
+      w.varint((uint32_t)p.pts.size());
+      pt_t c = origin;
+      for (const pt_t &q : p.pts) {
+        w.zz(q.x - c.x);
+        w.zz(q.y - c.y);
+        c = q;
+      }
+    }
+    for (const label_t *l : labels) {
+      std::string name = utf8_prefix(l->name, VEC_LABEL_LEN);
+      w.u8(MAPS_OP_LABEL);
+      w.varint(id++);
+      w.zz(l->at.x - origin.x);
+      w.zz(l->at.y - origin.y);
+      w.u8((uint8_t)name.size());
+      w.b.insert(w.b.end(), name.begin(), name.end());
+    }
+    if (w.b.size() <= MAP_PACK_TILE_MAX || n_parts == 0) {
+      *dropped = parts.size() - n_parts;
+      return w.b;
+    }
+    n_parts = n_parts * 9 / 10;
+  }
+}
+
+/* ── Verificación con el lector del firmware ─────────────────────── */
+static bool file_read(void *ctx, uint32_t off, void *dst, uint32_t len) {
+  FILE *f = (FILE *)ctx;
+  return fseek(f, off, SEEK_SET) == 0 && fread(dst, 1, len, f) == len;
+}
+
+static bool verify(const char *path, const std::vector<uint32_t> &keys) {
+  FILE *f = fopen(path, "rb");
+  if (!f) { perror(path); return false; }
+  static uint8_t arena_mem[1 << 20];
+  map_arena_t arena;
+  map_arena_init(&arena, arena_mem, sizeof(arena_mem));
+  map_pack_t p;
+  if (!map_pack_open(&p, &arena, 32, file_read, f)) {
+    fprintf(stderr, "verificación: no se pudo abrir el paquete\n");
+    fclose(f);
+    return false;
+  }
+  static vec_store_t store;
+  static uint8_t tile[MAP_PACK_TILE_MAX];
+  size_t items = 0, labels = 0, bad = 0, full = 0;
+  for (uint32_t key : keys) {
+    uint16_t tx = key & 0xFFFF, ty = key >> 16;
+    map_pack_entry_t e;
+    if (map_pack_find(&p, tx, ty, &e, true) != MAP_PACK_OK ||
+        map_pack_read(&p, e.off, tile, e.len, true) != MAP_PACK_OK) {
+      bad++;
+      continue;
+    }
+    vec_store_clear(&store);
+    const uint8_t shift = 28 - p.zoom;
+    if (!vec_store_apply_ops(&store, tile, e.len, (int32_t)tx << shift, (int32_t)ty << shift,
+                             0))
+      full++;
+    for (uint16_t i = 0; i < store.n_items; i++) items += store.items[i].used;
+    for (uint16_t i = 0; i < store.n_labels; i++) labels += store.labels[i].used;
+  }
+  map_pack_entry_t e;
+  if (map_pack_find(&p, 0xFFFF, 0xFFFF, &e, true) != MAP_PACK_NONE) bad++;
+  fclose(f);
+  printf("verificación: %zu tiles, %zu calles y %zu labels cargados, %zu no entran "
+         "enteros en el conjunto, %zu errores (%u páginas leídas)\n",
+         keys.size(), items, labels, full, bad, p.reads);
+  return bad == 0;
+}
+
+int main(int argc, char **argv) {
+  int zoom = 16;
+  const char *out_path = "maps.mpk";
+  std::vector<const char *> inputs;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-z") && i + 1 < argc) zoom = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-o") && i + 1 < argc) out_path = argv[++i];
+    else inputs.push_back(argv[i]);
+  }
+  if (inputs.empty() || zoom < MAP_PACK_ZOOM_MIN || zoom > MAP_PACK_ZOOM_MAX) {
+    fprintf(stderr, "uso: %s [-z %d..%d] [-o maps.mpk] extracto.json [...]\n", argv[0],
+            MAP_PACK_ZOOM_MIN, MAP_PACK_ZOOM_MAX);
+    return 1;
+  }
+
+  static overpass_t o;
+  for (const char *in : inputs)
+    if (!load_extract(in, &o)) return 1;
+
+  /* Ways → tiles */
+  const uint8_t shift = 28 - zoom;
+  std::map<uint32_t, tile_t> tiles;
+  int32_t min_x = INT32_MAX, min_y = INT32_MAX, max_x = INT32_MIN, max_y = INT32_MIN;
+  size_t n_ways = 0, no_geom = 0;
+  for (auto &kv : o.ways) {
+    way_t &w = kv.second;
+    if (w.geom.empty())
+      for (int64_t id : w.nodes) {
+        auto it = o.nodes.find(id);
+        if (it != o.nodes.end()) w.geom.push_back(it->second);
+      }
+    line_t raw;
+    for (auto &ll : w.geom) {
+      pt_t p = to_world(ll.first, ll.second);
+      if (raw.empty() || raw.back().x != p.x || raw.back().y != p.y) raw.push_back(p);
+    }
+    line_t line = simplify(raw, SIMPLIFY_EPS);
+    if (line.size() < 2) { no_geom++; continue; }
+    n_ways++;
+    int32_t bx1 = INT32_MAX, by1 = INT32_MAX, bx2 = INT32_MIN, by2 = INT32_MIN;
+    for (const pt_t &p : line) {
+      bx1 = std::min(bx1, p.x); by1 = std::min(by1, p.y);
+      bx2 = std::max(bx2, p.x); by2 = std::max(by2, p.y);
+    }
+    min_x = std::min(min_x, bx1); min_y = std::min(min_y, by1);
+    max_x = std::max(max_x, bx2); max_y = std::max(max_y, by2);
+    for (int32_t ty = by1 >> shift; ty <= by2 >> shift; ty++) {
+      for (int32_t tx = bx1 >> shift; tx <= bx2 >> shift; tx++) {
+        std::vector<line_t> parts = clip_to_tile(line, tx, ty, shift);
+        if (parts.empty()) continue;
+        tile_t &t = tiles[map_pack_key((uint16_t)tx, (uint16_t)ty)];
+        size_t best = 0;
+        for (size_t i = 0; i < parts.size(); i++) {
+          if (parts[i].size() > parts[best].size()) best = i;
+          t.pieces.push_back({parts[i], w.w});
+        }
+        if (w.name.empty()) continue;
+        const line_t &lp = parts[best];
+        label_t l = {w.name, lp[lp.size() / 2], w.w, lp.size()};
+        auto it = t.labels.find(w.name);
+        if (it == t.labels.end()) t.labels[w.name] = l;
+        else if (l.w > it->second.w || (l.w == it->second.w && l.n > it->second.n))
+          it->second = l;
+      }
+    }
+  }
+  if (tiles.empty()) {
+    fprintf(stderr, "sin calles en los extractos\n");
+    return 1;
+  }
+
+  /* Archivo: cabecera, tiles, directorio, índice de bloques */
+  FILE *f = fopen(out_path, "wb");
+  if (!f) { perror(out_path); return 1; }
+  writer_t dir, idx;
+  std::vector<uint32_t> keys;
+  uint32_t off = MAP_PACK_HDR_BYTES;
+  size_t dropped = 0, max_tile = 0;
+  fseek(f, off, SEEK_SET);
+  for (auto &kv : tiles) {
+    uint32_t key = kv.first;
+    pt_t origin = {(int32_t)((key & 0xFFFF) << shift), (int32_t)((key >> 16) << shift)};
+    size_t d = 0;
+    bytes b = encode_tile(kv.second, origin, &d);
+    dropped += d;
+    max_tile = std::max(max_tile, b.size());
+    if (keys.size() % MAP_PACK_DIR_BLOCK == 0) idx.u32(key);
+    dir.u32(key);
+    dir.u32(off);
+    dir.u32((uint32_t)b.size());
+    keys.push_back(key);
+    fwrite(b.data(), 1, b.size(), f);
+    off += (uint32_t)b.size();
+  }
+  uint32_t dir_off = off;
+  fwrite(dir.b.data(), 1, dir.b.size(), f);
+  uint32_t idx_off = dir_off + (uint32_t)dir.b.size();
+  fwrite(idx.b.data(), 1, idx.b.size(), f);
+  uint32_t file_len = idx_off + (uint32_t)idx.b.size();
+
+  writer_t h;
+  h.b.insert(h.b.end(), MAP_PACK_MAGIC, MAP_PACK_MAGIC + sizeof(MAP_PACK_MAGIC));
+  h.u8(MAP_PACK_VERSION);
+  h.u8((uint8_t)zoom);
+  h.u8(0);
+  h.u8(0);
+  h.u32((uint32_t)keys.size());
+  h.u32(dir_off);
+  h.u32(idx_off);
+  h.u32((uint32_t)min_x);
+  h.u32((uint32_t)min_y);
+  h.u32((uint32_t)max_x);
+  h.u32((uint32_t)max_y);
+  h.u32(file_len);
+  fseek(f, 0, SEEK_SET);
+  fwrite(h.b.data(), 1, h.b.size(), f);
+  fclose(f);
+
+  printf("%zu ways (%zu sin geometría), %zu tiles z%d, %u KB (tile más grande %zu B, "
+         "promedio %zu B)\n",
+         n_ways, no_geom, keys.size(), zoom, file_len / 1024, max_tile,
+         (size_t)(dir_off - MAP_PACK_HDR_BYTES) / keys.size());
+  if (dropped) printf("%zu tramos descartados por tamaño de tile\n", dropped);
+  return verify(out_path, keys) ? 0 : 1;
+}
@@ -0,0 +1,469 @@
+/*
+ * Reproducción en host de una sesión grabada del WebSocket del mapa
+ * (MAPS_REC=1, ver src/maps/map_rec.h): pasa cada fragmento por el mismo
+ * código que on_ws_event en el equipo (bin_rx, decoders del protocolo,
+ * map_json, vec_store, route_poly) y redibuja el mapa con map_raster en un
+ * buffer RGB565 del tamaño de la pantalla.
+ *
+ * LVGL no se compila en host: el dibujo es el de render_prims en
+ * screen_map.cpp sin labels ni marcador (calles, ruta del conjunto o del
+ * frame y ruta codificada, mismos grosores, colores y uniones), siempre
+ * completo (sin rectángulos sucios) y con el rumbo hacia arriba sin
+ * animación. Sirve para medir y comparar cambios del parser o del
+ * rasterizador sin el auto ni el teléfono; la medición final es en el equipo.
+ *
+ * Compilar desde la raíz del repo:
+ *
+ *   g++ -O2 -std=gnu++17 -Isrc -Iinclude \
+ *       tools/replay/map_replay.cpp src/maps/bin_rx.cpp src/maps/hs_decode.cpp \
+ *       src/maps/vec_proto.cpp src/maps/vec_frame.cpp src/maps/vec_store.cpp \
+ *       src/maps/vec_trig.cpp src/maps/json_sax.cpp src/maps/map_json.cpp \
+ *       src/maps/route_poly.cpp src/maps/map_raster.cpp -o map_replay
+ *
+ * Uso:
+ *   ./map_replay [-o dir] [-r dir] [-c chunk] [-q] sesion.mrs|sesion.bin
+ *
+ *   -o dir    escribe cada frame dibujado como dir/frame_NNNNN.ppm
+ *   -r dir    compara cada frame con el de igual nombre en dir (los de una
+ *             corrida anterior con -o) y cuenta los píxeles distintos; sale
+ *             con 1 si alguno difiere
+ *   -c chunk  para sesion.bin: tamaño de fragmento (default 1436)
+ *   -q        sin una línea por mensaje, solo el resumen
+ *
+ * sesion.bin es el formato de tools/bench/bench_hs.cpp (uint32 LE con el
+ * largo + los bytes de cada mensaje binario); se fragmenta con [chunk].
+ */
+#include "maps/bin_rx.h"
+#include "maps/map_json.h"
+#include "maps/map_raster.h"
+#include "maps/map_rec.h"
+#include "maps/route_poly.h"
+#include "maps/vec_frame.h"
+#include "maps/vec_proto.h"
+#include "maps/vec_store.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using clk = std::chrono::steady_clock;
+
+/* Mismos valores que maps_ws_server.cpp y screen_map.cpp */
+#define MAPS_BIN_MAX (64 * 1024)
+#define W MAPS_WS_MAP_W
+#define H MAPS_WS_MAP_H
+#define MAP_POS_X (W / 2)
+#define MAP_POS_Y (H * 3 / 4)
+#define MAP_ZOOM_MIN 10
+#define MAP_ROT_STEP 64
+#define ROUTE_WIDTH 5
+#define ROUTE_MAX_PTS 16384
+
+static uint16_t rgb565(uint32_t c) {
+  return (uint16_t)(((c >> 8) & 0xF800) | ((c >> 5) & 0x07E0) | ((c >> 3) & 0x001F));
+}
+static const uint16_t COLOR_BG = rgb565(0x1C1C2E);
+static const uint16_t COLOR_ROUTE = rgb565(0x4488FF);
+
+static int32_t road_width(uint8_t w) { return w == 3 ? 8 : w == 2 ? 5 : 3; }
+static uint16_t road_color(uint8_t w) {
+  return rgb565(w == 3 ? 0x7777AA : w == 2 ? 0x555580 : 0x3A3A5A);
+}
+
+/* ── Sesión ──────────────────────────────────────────────────────── */
+struct rec_t {
+  map_rec_hdr_t h;
+  std::vector<uint8_t> data;
+};
+
+static std::vector<rec_t> load_mrs(FILE *f) {
+  std::vector<rec_t> out;
+  rec_t r;
+  while (fread(&r.h, sizeof(r.h), 1, f) == 1) {
+    r.data.resize(r.h.len);
+    if (r.h.len && fread(r.data.data(), 1, r.h.len, f) != r.h.len) break;
+    out.push_back(r);
+  }
+  return out;
+}
+
+/* Formato de bench_hs: un mensaje binario completo por entrada */
+static std::vector<rec_t> load_bin(FILE *f, size_t chunk) {
+  std::vector<rec_t> out;
+  uint8_t l[4];
+  uint32_t ms = 0;
+  while (fread(l, 1, 4, f) == 4) {
+    uint32_t n = l[0] | (l[1] << 8) | (l[2] << 16) | ((uint32_t)l[3] << 24);
+    std::vector<uint8_t> m(n);
+    if (fread(m.data(), 1, n, f) != n) break;
+    for (size_t i = 0; i < n; i += chunk) {
+      rec_t r;
+      size_t len = std::min(chunk, (size_t)n - i);
+      r.h = {ms, (uint32_t)i, n, (uint16_t)len, 0, 0};
+      if (i + len == n) r.h.flags |= MAP_REC_FINAL;
+      r.data.assign(m.begin() + i, m.begin() + i + len);
+      out.push_back(std::move(r));
+    }
+    ms += 100;
+  }
+  return out;
+}
+
+static std::vector<rec_t> load_session(const char *path, size_t chunk) {
+  FILE *f = fopen(path, "rb");
+  if (!f) { perror(path); exit(1); }
+  char magic[MAP_REC_FILE_HDR];
+  std::vector<rec_t> out;
+  if (fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, MAP_REC_MAGIC, 4)) {
+    out = load_mrs(f);
+  } else {
+    rewind(f);
+    out = load_bin(f, chunk);
+  }
+  fclose(f);
+  return out;
+}
+
+/* ── Estado (lo que en el equipo vive en los buzones y en screen_map) ── */
+static uint8_t g_bin_buf[MAPS_BIN_MAX];
+static bin_rx_t g_rx;
+static map_json_t g_json;
+/* Como los slots de los buzones: el JSON se arma en su propio frame para
+ * que un "nav" o "gps" no pise el que se está mostrando */
+alignas(4) static uint8_t g_frame_mem[VEC_FRAME_BYTES];
+alignas(4) static uint8_t g_json_mem[VEC_FRAME_BYTES];
+static vec_frame_t g_frame, g_json_frame;
+static nav_step_t g_nav;
+static vec_store_t g_store;
+static const vec_frame_t *g_shown = nullptr; /* null: se dibuja el conjunto */
+
+/* Ruta codificada, como route_rx en screen_map.cpp (sin nav_route) */
+static vec_store_pt_t g_route[ROUTE_MAX_PTS];
+static uint32_t g_route_n = 0, g_route_id = 0, g_route_rx = 0, g_route_next = 0;
+
+static bool route_rx(const uint8_t *payload, size_t len) {
+  maps_bin_rd_t r = {payload, payload + len, true};
+  uint32_t id = maps_bin_rd_varint(r);
+  uint32_t total = maps_bin_rd_varint(r);
+  uint32_t first = maps_bin_rd_varint(r);
+  uint8_t precision = maps_bin_rd_u8(r);
+  if (!r.ok)
+    return false;
+  if (id == 0) {
+    g_route_id = g_route_rx = 0;
+    g_route_n = 0;
+    return true;
+  }
+  if (first == 0) {
+    g_route_n = 0;
+    g_route_id = 0;
+    g_route_rx = id;
+  } else if (id == g_route_id) {
+    return true;
+  } else if (id != g_route_rx || first != g_route_next) {
+    g_route_rx = 0;
+    g_route_n = 0;
+    return false;
+  }
+  int32_t n = route_poly_decode(r.p, r.end - r.p, precision, g_route + g_route_n,
+                                ROUTE_MAX_PTS - g_route_n);
+  if (n < 0) {
+    g_route_rx = 0;
+    g_route_n = 0;
+    return false;
+  }
+  g_route_n += (uint32_t)n;
+  g_route_next = first + (uint32_t)n;
+  if (g_route_next >= total || g_route_n >= ROUTE_MAX_PTS) {
+    g_route_id = g_route_rx;
+    g_route_rx = 0;
+  }
+  return true;
+}
+
+/* ── Dibujo ──────────────────────────────────────────────────────── */
+static uint16_t g_fb[W * H];
+static vec_point_t g_proj[ROUTE_MAX_PTS > VEC_STORE_ITEM_PTS ? ROUTE_MAX_PTS
+                                                            : VEC_STORE_ITEM_PTS];
+
+static void render_frame(const rast_surface_t &s, const vec_frame_t &f) {
+  for (uint16_t i = 0; i < f.n_roads; i++) {
+    const vec_poly_t &r = f.roads[i];
+    rast_polyline(&s, vec_frame_poly_pts(&f, r), r.n, road_width(r.w), road_color(r.w),
+                  RAST_JOIN_MITER);
+  }
+  for (uint16_t k = 0; k < f.n_routes; k++) {
+    const vec_poly_t &r = f.routes[k];
+    rast_polyline(&s, vec_frame_poly_pts(&f, r), r.n, ROUTE_WIDTH, COLOR_ROUTE,
+                  RAST_JOIN_ROUND);
+  }
+}
+
+static void render_store(const rast_surface_t &s, const vec_store_t &st) {
+  vec_view_t v;
+  vec_view_init(&v, &st, MAP_POS_X, MAP_POS_Y);
+  vec_view_zoom(&v, st.zoom < MAP_ZOOM_MIN ? MAP_ZOOM_MIN : st.zoom);
+  if (st.heading >= 0)
+    vec_view_rotate(&v, (uint16_t)((vec_angle_deg(st.heading) + MAP_ROT_STEP / 2) &
+                                   ~(MAP_ROT_STEP - 1)));
+  /* Calles y luego ruta, para que la ruta quede encima */
+  for (uint8_t kind : {MAPS_KIND_ROAD, MAPS_KIND_ROUTE}) {
+    for (uint16_t i = 0; i < st.n_items; i++) {
+      const vec_store_item_t &it = st.items[i];
+      if (!it.used || it.kind != kind || !vec_view_item_near(&v, &it, H))
+        continue;
+      uint8_t m = vec_view_project_item(&v, &it, g_proj);
+      if (kind == MAPS_KIND_ROAD)
+        rast_polyline(&s, g_proj, m, road_width(it.w), road_color(it.w), RAST_JOIN_MITER);
+      else
+        rast_polyline(&s, g_proj, m, ROUTE_WIDTH, COLOR_ROUTE, RAST_JOIN_ROUND);
+    }
+  }
+  if (g_route_id) {
+    for (uint32_t j = 0; j < g_route_n; j++)
+      g_proj[j] = vec_view_project(&v, g_route[j].x, g_route[j].y);
+    rast_polyline(&s, g_proj, (uint16_t)std::min<uint32_t>(g_route_n, 0xFFFF), ROUTE_WIDTH,
+                  COLOR_ROUTE, RAST_JOIN_ROUND);
+  }
+}
+
+static void render(void) {
+  for (int i = 0; i < W * H; i++) g_fb[i] = COLOR_BG;
+  rast_surface_t s = {g_fb, W, H, W, {0, 0, W - 1, H - 1}, true};
+  if (g_shown)
+    render_frame(s, *g_shown);
+  else
+    render_store(s, g_store);
+}
+
+static bool write_ppm(const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) return false;
+  fprintf(f, "P6\n%d %d\n255\n", W, H);
+  std::vector<uint8_t> row(W * 3);
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      uint16_t c = g_fb[y * W + x];
+      row[x * 3] = (uint8_t)(((c >> 11) & 0x1F) * 255 / 31);
+      row[x * 3 + 1] = (uint8_t)(((c >> 5) & 0x3F) * 255 / 63);
+      row[x * 3 + 2] = (uint8_t)((c & 0x1F) * 255 / 31);
+    }
+    fwrite(row.data(), 1, row.size(), f);
+  }
+  fclose(f);
+  return true;
+}
+
+/* Píxeles distintos contra la referencia; -1 si no se pudo leer */
+static long diff_ppm(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return -1;
+  int w = 0, h = 0, max = 0;
+  if (fscanf(f, "P6 %d %d %d", &w, &h, &max) != 3 || w != W || h != H || max != 255 ||
+      fgetc(f) == EOF) {
+    fclose(f);
+    return -1;
+  }
+  std::vector<uint8_t> ref((size_t)W * H * 3);
+  size_t got = fread(ref.data(), 1, ref.size(), f);
+  fclose(f);
+  if (got != ref.size()) return -1;
+  long n = 0;
+  for (int i = 0; i < W * H; i++) {
+    uint16_t c = g_fb[i];
+    const uint8_t *p = &ref[(size_t)i * 3];
+    if (p[0] != (uint8_t)(((c >> 11) & 0x1F) * 255 / 31) ||
+        p[1] != (uint8_t)(((c >> 5) & 0x3F) * 255 / 63) ||
+        p[2] != (uint8_t)((c & 0x1F) * 255 / 31))
+      n++;
+  }
+  return n;
+}
+
+/* ── Mensajes ────────────────────────────────────────────────────── */
+enum { K_VEC, K_DELTA, K_ROUTE, K_TILE, K_JSON, K_OTHER, K_N };
+static const char *k_names[K_N] = {"vec", "delta", "route", "tile", "json", "otro"};
+
+struct stat_t {
+  std::vector<double> parse, raster;
+  unsigned n = 0, bad = 0;
+  size_t bytes = 0;
+};
+
+static double pct(std::vector<double> v, double p) {
+  if (v.empty()) return 0;
+  std::sort(v.begin(), v.end());
+  return v[std::min(v.size() - 1, (size_t)(p * (v.size() - 1) + 0.5))];
+}
+
+/* Mensaje binario completo, como parse_bin_msg; true si cambió el mapa */
+static bool bin_msg(const uint8_t *data, size_t len, int *kind, bool *bad) {
+  maps_bin_hdr_t hdr;
+  *kind = K_OTHER;
+  if (!maps_bin_parse_hdr(data, len, &hdr)) {
+    *bad = true;
+    return false;
+  }
+  const uint8_t *payload = data + hdr.len;
+  size_t plen = len - hdr.len;
+  switch (hdr.type) {
+  case MAPS_BIN_VEC:
+    *kind = K_VEC;
+    if (!maps_bin_decode_vec(payload, plen, &g_frame)) {
+      *bad = true;
+      return false;
+    }
+    g_shown = &g_frame;
+    return true;
+  case MAPS_BIN_DELTA:
+    *kind = K_DELTA;
+    *bad = !vec_store_apply(&g_store, payload, plen);
+    g_shown = nullptr;
+    return true;
+  case MAPS_BIN_ROUTE:
+    *kind = K_ROUTE;
+    *bad = !route_rx(payload, plen);
+    g_shown = nullptr;
+    return true;
+  default:
+    return false;
+  }
+}
+
+int main(int argc, char **argv) {
+  const char *out_dir = nullptr, *ref_dir = nullptr, *path = nullptr;
+  size_t chunk = 1436;
+  bool quiet = false;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-o") && i + 1 < argc) out_dir = argv[++i];
+    else if (!strcmp(argv[i], "-r") && i + 1 < argc) ref_dir = argv[++i];
+    else if (!strcmp(argv[i], "-c") && i + 1 < argc) chunk = (size_t)atoi(argv[++i]);
+    else if (!strcmp(argv[i], "-q")) quiet = true;
+    else path = argv[i];
+  }
+  if (!path || chunk == 0) {
+    fprintf(stderr, "uso: %s [-o dir] [-r dir] [-c chunk] [-q] sesion.mrs|sesion.bin\n",
+            argv[0]);
+    return 2;
+  }
+  std::vector<rec_t> recs = load_session(path, chunk);
+  if (recs.empty()) { fprintf(stderr, "sin mensajes\n"); return 1; }
+
+  bin_rx_init(&g_rx, g_bin_buf, sizeof(g_bin_buf));
+  vec_frame_init(&g_frame, g_frame_mem, sizeof(g_frame_mem));
+  vec_frame_init(&g_json_frame, g_json_mem, sizeof(g_json_mem));
+  vec_store_clear(&g_store);
+
+  stat_t st[K_N];
+  unsigned frames = 0, gaps = 0, diff_frames = 0, missing_ref = 0;
+  long diff_max = 0;
+  double msg_us = 0;   /* parseo acumulado del mensaje en curso */
+  bool text_start = true;
+  char name[512];
+
+  for (const rec_t &r : recs) {
+    const map_rec_hdr_t &h = r.h;
+    bool final = h.flags & MAP_REC_FINAL;
+    if (h.flags & MAP_REC_GAP) gaps++;
+    int kind = -1;
+    bool bad = false, changed = false;
+
+    auto t0 = clk::now();
+    if (h.flags & MAP_REC_TEXT) {
+      /* Como MAPS_JSON_STREAM: el parser escribe en el frame y el paso */
+      if (text_start) {
+        map_json_begin(&g_json, &g_json_frame, &g_nav);
+        msg_us = 0;
+      }
+      map_json_feed(&g_json, (const char *)r.data.data(), r.data.size());
+      text_start = h.index + h.len >= h.total && final;
+      if (text_start) {
+        kind = K_JSON;
+        map_json_type_t t = map_json_end(&g_json);
+        if (t == MAP_JSON_VEC) {
+          std::swap(g_frame, g_json_frame);
+          g_shown = &g_frame;
+          changed = true;
+        } else if (t != MAP_JSON_NAV && t != MAP_JSON_GPS) {
+          bad = true;
+        }
+      }
+    } else {
+      bin_rx_out_t out;
+      switch (bin_rx_feed(&g_rx, h.index, h.total, final, r.data.data(), r.data.size(),
+                          &out)) {
+      case BIN_RX_MSG:
+        changed = bin_msg(out.data, out.len, &kind, &bad);
+        break;
+      case BIN_RX_JPEG:
+        /* Los JPEG no se decodifican (tjpgd va con el equipo): solo se cuentan */
+        if (out.index + out.len >= out.total)
+          kind = out.tag ? K_TILE : K_OTHER;
+        break;
+      case BIN_RX_MORE:
+        break;
+      default:
+        kind = K_OTHER;
+        bad = true;
+        break;
+      }
+    }
+    msg_us += std::chrono::duration<double, std::micro>(clk::now() - t0).count();
+    if (kind < 0)
+      continue;
+
+    stat_t &s = st[kind];
+    s.n++;
+    s.bad += bad;
+    s.bytes += h.total;
+    s.parse.push_back(msg_us);
+    double rast_us = 0;
+    if (changed) {
+      auto t1 = clk::now();
+      render();
+      rast_us = std::chrono::duration<double, std::micro>(clk::now() - t1).count();
+      s.raster.push_back(rast_us);
+      if (out_dir) {
+        snprintf(name, sizeof(name), "%s/frame_%05u.ppm", out_dir, frames);
+        if (!write_ppm(name)) { perror(name); return 1; }
+      }
+      if (ref_dir) {
+        snprintf(name, sizeof(name), "%s/frame_%05u.ppm", ref_dir, frames);
+        long d = diff_ppm(name);
+        if (d < 0) missing_ref++;
+        else if (d > 0) {
+          diff_frames++;
+          diff_max = std::max(diff_max, d);
+          if (!quiet) printf("  frame %05u: %ld píxeles distintos\n", frames, d);
+        }
+      }
+      frames++;
+    }
+    if (!quiet)
+      printf("%8.3f s  %-5s %6u B  parseo %7.1f us  raster %7.1f us%s\n", h.ms / 1000.0,
+             k_names[kind], h.total, msg_us, rast_us, bad ? "  (inválido)" : "");
+    msg_us = 0;
+  }
+
+  printf("\n%u fragmentos, %u frames dibujados%s\n", (unsigned)recs.size(), frames,
+         gaps ? " (la grabación perdió fragmentos)" : "");
+  printf("%-6s %6s %6s %9s  %21s  %21s\n", "tipo", "msgs", "inval", "KB",
+         "parseo p50/p95/max us", "raster p50/p95/max us");
+  for (int k = 0; k < K_N; k++) {
+    const stat_t &s = st[k];
+    if (!s.n) continue;
+    printf("%-6s %6u %6u %9.1f  %6.1f %6.1f %7.1f  %6.1f %6.1f %7.1f\n", k_names[k], s.n,
+           s.bad, s.bytes / 1024.0, pct(s.parse, 0.5), pct(s.parse, 0.95),
+           pct(s.parse, 1.0), pct(s.raster, 0.5), pct(s.raster, 0.95), pct(s.raster, 1.0));
+  }
+  if (ref_dir) {
+    printf("referencia: %u frames distintos (máx %ld píxeles)", diff_frames, diff_max);
+    if (missing_ref) printf(", %u sin referencia", missing_ref);
+    printf("\n");
+  }
+  return diff_frames ? 1 : 0;
+}